@@ -70,7 +70,7 @@ class SelectByAttributeSum(GeoAlgorithm):
         geom = QgsGeometry(ft.geometry())
         attrSum = ft[fieldName]
 
-        idx = QgsSpatialIndex(layer.getFeatures())
+        idx = QgsSpatialIndex.layerIndex(layer)
         req = QgsFeatureRequest()
         completed = False
         while not completed:
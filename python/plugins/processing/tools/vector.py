@@ -217,7 +217,7 @@ def spatialindex(layer):
             and layer.selectedFeatureCount() > 0:
         idx = QgsSpatialIndex(layer.selectedFeaturesIterator(request))
     else:
-        idx = QgsSpatialIndex(layer.getFeatures(request))
+        idx = QgsSpatialIndex.layerIndex(layer)
     return idx
 
 
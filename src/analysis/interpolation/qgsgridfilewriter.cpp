@@ -21,6 +21,46 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QProgressDialog>
+#include <QtConcurrentMap>
+
+///@cond PRIVATE
+//! Interpolates the rows of a block of the grid
+class QgsGridRowTask
+{
+  public:
+    QgsGridRowTask( QgsInterpolator* interpolator, const QVector<double>& xValues, const QVector<double>& yValues, int firstRow, double* values, char* valid )
+        : mInterpolator( interpolator )
+        , mXValues( xValues )
+        , mYValues( yValues )
+        , mFirstRow( firstRow )
+        , mValues( values )
+        , mValid( valid )
+    {}
+
+    void operator()( int row ) const
+    {
+      int nColumns = mXValues.size();
+      double y = mYValues.at( row );
+      double* values = mValues + static_cast< qint64 >( row - mFirstRow ) * nColumns;
+      char* valid = mValid + static_cast< qint64 >( row - mFirstRow ) * nColumns;
+      for ( int j = 0; j < nColumns; ++j )
+      {
+        valid[j] = mInterpolator->interpolatePoint( mXValues.at( j ), y, values[j] ) == 0;
+      }
+    }
+
+  private:
+    QgsInterpolator* mInterpolator;
+    const QVector<double>& mXValues;
+    const QVector<double>& mYValues;
+    int mFirstRow;
+    double* mValues;
+    char* mValid;
+};
+///@endcond
+
+//! Number of rows which are interpolated before they are written
+static const int ROW_BLOCK_SIZE = 64;
 
 QgsGridFileWriter::QgsGridFileWriter( QgsInterpolator* i, const QString& outputPath, const QgsRectangle& extent, int nCols, int nRows, double cellSizeX, double cellSizeY )
     : mInterpolator( i )
@@ -63,9 +103,21 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
   outStream.setRealNumberPrecision( 8 );
   writeHeader( outStream );
 
+  //cell centers, accumulated the same way as the values were always calculated
+  QVector<double> xValues( mNumColumns );
+  double currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
+  for ( int j = 0; j < mNumColumns; ++j )
+  {
+    xValues[j] = currentXValue;
+    currentXValue += mCellSizeX;
+  }
+  QVector<double> yValues( mNumRows );
   double currentYValue = mInterpolationExtent.yMaximum() - mCellSizeY / 2.0; //calculate value in the center of the cell
-  double currentXValue;
-  double interpolatedValue;
+  for ( int i = 0; i < mNumRows; ++i )
+  {
+    yValues[i] = currentYValue;
+    currentYValue -= mCellSizeY;
+  }
 
   QProgressDialog* progressDialog = nullptr;
   if ( showProgressDialog )
@@ -74,23 +126,54 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
     progressDialog->setWindowModality( Qt::WindowModal );
   }
 
-  for ( int i = 0; i < mNumRows; ++i )
+  bool parallel = mInterpolator->supportsParallelInterpolation();
+  if ( parallel && mNumRows > 0 && mNumColumns > 0 )
   {
-    currentXValue = mInterpolationExtent.xMinimum() + mCellSizeX / 2.0; //calculate value in the center of the cell
-    for ( int j = 0; j < mNumColumns; ++j )
+    //let the interpolator cache its base data before the rows are calculated by several threads
+    double interpolatedValue;
+    mInterpolator->interpolatePoint( xValues.at( 0 ), yValues.at( 0 ), interpolatedValue );
+  }
+
+  QVector<double> values( ROW_BLOCK_SIZE * mNumColumns );
+  QVector<char> valid( ROW_BLOCK_SIZE * mNumColumns );
+  for ( int firstRow = 0; firstRow < mNumRows; firstRow += ROW_BLOCK_SIZE )
+  {
+    int nBlockRows = qMin( ROW_BLOCK_SIZE, mNumRows - firstRow );
+    QgsGridRowTask task( mInterpolator, xValues, yValues, firstRow, values.data(), valid.data() );
+    if ( parallel )
     {
-      if ( mInterpolator->interpolatePoint( currentXValue, currentYValue, interpolatedValue ) == 0 )
+      QVector<int> rows( nBlockRows );
+      for ( int i = 0; i < nBlockRows; ++i )
       {
-        outStream << interpolatedValue << ' ';
+        rows[i] = firstRow + i;
       }
-      else
+      QtConcurrent::blockingMap( rows, task );
+    }
+    else
+    {
+      for ( int i = firstRow; i < firstRow + nBlockRows; ++i )
       {
-        outStream << "-9999 ";
+        task( i );
       }
-      currentXValue += mCellSizeX;
     }
-    outStream << endl;
-    currentYValue -= mCellSizeY;
+
+    for ( int i = 0; i < nBlockRows; ++i )
+    {
+      const double* rowValues = values.constData() + i * mNumColumns;
+      const char* rowValid = valid.constData() + i * mNumColumns;
+      for ( int j = 0; j < mNumColumns; ++j )
+      {
+        if ( rowValid[j] )
+        {
+          outStream << rowValues[j] << ' ';
+        }
+        else
+        {
+          outStream << "-9999 ";
+        }
+      }
+      outStream << endl;
+    }
 
     if ( showProgressDialog )
     {
@@ -99,7 +182,7 @@ int QgsGridFileWriter::writeFile( bool showProgressDialog )
         outputFile.remove();
         return 3;
       }
-      progressDialog->setValue( i );
+      progressDialog->setValue( firstRow + nBlockRows - 1 );
     }
   }
 
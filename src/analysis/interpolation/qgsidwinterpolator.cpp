@@ -18,13 +18,30 @@
 #include "qgsidwinterpolator.h"
 #include <cmath>
 #include <limits>
+#include <queue>
 
 QgsIDWInterpolator::QgsIDWInterpolator( const QList<LayerData>& layerData ): QgsInterpolator( layerData ), mDistanceCoefficient( 2.0 )
+    , mNeighbourCount( 0 )
+    , mSearchRadius( 0.0 )
+    , mIndexBuilt( false )
+    , mIndexColumns( 0 )
+    , mIndexRows( 0 )
+    , mIndexXMin( 0.0 )
+    , mIndexYMin( 0.0 )
+    , mIndexCellSize( 0.0 )
 {
 
 }
 
 QgsIDWInterpolator::QgsIDWInterpolator(): QgsInterpolator( QList<LayerData>() ), mDistanceCoefficient( 2.0 )
+    , mNeighbourCount( 0 )
+    , mSearchRadius( 0.0 )
+    , mIndexBuilt( false )
+    , mIndexColumns( 0 )
+    , mIndexRows( 0 )
+    , mIndexXMin( 0.0 )
+    , mIndexYMin( 0.0 )
+    , mIndexCellSize( 0.0 )
 {
 
 }
@@ -41,6 +58,15 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
     cacheBaseData();
   }
 
+  if ( mNeighbourCount > 0 || mSearchRadius > 0 )
+  {
+    if ( !mIndexBuilt )
+    {
+      buildIndex();
+    }
+    return interpolateFromIndex( x, y, result );
+  }
+
   double currentWeight;
   double distance;
 
@@ -68,3 +94,174 @@ int QgsIDWInterpolator::interpolatePoint( double x, double y, double& result )
   result = sumCounter / sumDenominator;
   return 0;
 }
+
+///@cond PRIVATE
+//! A vertex found by the nearest neighbour search, ordered by squared distance
+struct QgsIDWNeighbour
+{
+  QgsIDWNeighbour( double squaredDistance, const vertexData* vertex )
+      : squaredDistance( squaredDistance )
+      , vertex( vertex )
+  {}
+
+  bool operator<( const QgsIDWNeighbour& other ) const { return squaredDistance < other.squaredDistance; }
+
+  double squaredDistance;
+  const vertexData* vertex;
+};
+///@endcond
+
+int QgsIDWInterpolator::interpolateFromIndex( double x, double y, double& result ) const
+{
+  if ( mIndexedData.isEmpty() )
+  {
+    return 1;
+  }
+
+  const double maxSquaredDistance = mSearchRadius > 0 ? mSearchRadius * mSearchRadius : std::numeric_limits<double>::max();
+  const int centerColumn = indexColumn( x );
+  const int centerRow = indexRow( y );
+  const vertexData* vertices = mIndexedData.constData();
+
+  //max heap of the nearest vertices found so far, or all vertices within the radius if no count is set
+  std::priority_queue<QgsIDWNeighbour> neighbours;
+
+  //visit the cells in rings of growing size around the cell of the point
+  int maxRing = qMax( qMax( centerColumn, mIndexColumns - 1 - centerColumn ), qMax( centerRow, mIndexRows - 1 - centerRow ) );
+  if ( mSearchRadius > 0 )
+  {
+    maxRing = qMin( maxRing, static_cast< int >( std::ceil( mSearchRadius / mIndexCellSize ) ) + 1 );
+  }
+
+  for ( int ring = 0; ring <= maxRing; ++ring )
+  {
+    //points in cells of this ring are at least (ring - 1) cells away from the point
+    if ( ring > 1 )
+    {
+      const double reach = ( ring - 1 ) * mIndexCellSize;
+      if ( reach * reach > maxSquaredDistance )
+        break;
+      if ( mNeighbourCount > 0 && static_cast< int >( neighbours.size() ) >= mNeighbourCount && reach * reach >= neighbours.top().squaredDistance )
+        break;
+    }
+
+    for ( int row = centerRow - ring; row <= centerRow + ring; ++row )
+    {
+      if ( row < 0 || row >= mIndexRows )
+        continue;
+
+      //only the first and last row of a ring are complete, other rows just have two cells
+      const bool edgeRow = ( row == centerRow - ring || row == centerRow + ring );
+      const int columnStep = edgeRow ? 1 : 2 * ring;
+      for ( int column = centerColumn - ring; column <= centerColumn + ring; column += columnStep )
+      {
+        if ( column < 0 || column >= mIndexColumns )
+          continue;
+
+        const int cell = row * mIndexColumns + column;
+        for ( int i = mCellStart.at( cell ); i < mCellStart.at( cell + 1 ); ++i )
+        {
+          const vertexData* vertex = vertices + i;
+          const double squaredDistance = ( vertex->x - x ) * ( vertex->x - x ) + ( vertex->y - y ) * ( vertex->y - y );
+          if ( squaredDistance > maxSquaredDistance )
+            continue;
+
+          if ( mNeighbourCount <= 0 || static_cast< int >( neighbours.size() ) < mNeighbourCount )
+          {
+            neighbours.push( QgsIDWNeighbour( squaredDistance, vertex ) );
+          }
+          else if ( squaredDistance < neighbours.top().squaredDistance )
+          {
+            neighbours.pop();
+            neighbours.push( QgsIDWNeighbour( squaredDistance, vertex ) );
+          }
+        }
+      }
+    }
+  }
+
+  double sumCounter = 0;
+  double sumDenominator = 0;
+  for ( ; !neighbours.empty(); neighbours.pop() )
+  {
+    const vertexData* vertex = neighbours.top().vertex;
+    double distance = sqrt( neighbours.top().squaredDistance );
+    if (( distance - 0 ) < std::numeric_limits<double>::min() )
+    {
+      result = vertex->z;
+      return 0;
+    }
+    double currentWeight = 1 / ( pow( distance, mDistanceCoefficient ) );
+    sumCounter += ( currentWeight * vertex->z );
+    sumDenominator += currentWeight;
+  }
+
+  if ( sumDenominator == 0.0 )
+  {
+    return 1;
+  }
+
+  result = sumCounter / sumDenominator;
+  return 0;
+}
+
+void QgsIDWInterpolator::buildIndex()
+{
+  mIndexBuilt = true;
+  mIndexedData.clear();
+  mCellStart.clear();
+
+  int nVertices = mCachedBaseData.size();
+  if ( nVertices == 0 )
+  {
+    return;
+  }
+
+  double xMin = std::numeric_limits<double>::max();
+  double xMax = -std::numeric_limits<double>::max();
+  double yMin = std::numeric_limits<double>::max();
+  double yMax = -std::numeric_limits<double>::max();
+  Q_FOREACH ( const vertexData& vertex, mCachedBaseData )
+  {
+    xMin = qMin( xMin, vertex.x );
+    xMax = qMax( xMax, vertex.x );
+    yMin = qMin( yMin, vertex.y );
+    yMax = qMax( yMax, vertex.y );
+  }
+
+  //square cells holding about two vertices each. Flat extents are widened a little, so that
+  //vertices on a line do not end up in a single row of huge cells
+  double width = xMax - xMin;
+  double height = yMax - yMin;
+  double extent = qMax( width, height ) > 0 ? qMax( width, height ) : 1.0;
+  double minSize = extent / 4096.0;
+  double cellSize = qMax( sqrt( qMax( width, minSize ) * qMax( height, minSize ) * 2.0 / nVertices ), minSize );
+
+  mIndexXMin = xMin;
+  mIndexYMin = yMin;
+  mIndexCellSize = cellSize;
+  mIndexColumns = qMax( 1, static_cast< int >( width / cellSize ) + 1 );
+  mIndexRows = qMax( 1, static_cast< int >( height / cellSize ) + 1 );
+
+  //counting sort of the vertices by cell
+  QVector<int> cellOfVertex( nVertices );
+  mCellStart.fill( 0, mIndexColumns * mIndexRows + 1 );
+  for ( int i = 0; i < nVertices; ++i )
+  {
+    const vertexData& vertex = mCachedBaseData.at( i );
+    int cell = indexRow( vertex.y ) * mIndexColumns + indexColumn( vertex.x );
+    cellOfVertex[i] = cell;
+    ++mCellStart[cell + 1];
+  }
+  for ( int cell = 0; cell < mIndexColumns * mIndexRows; ++cell )
+  {
+    mCellStart[cell + 1] += mCellStart.at( cell );
+  }
+
+  QVector<int> insertPosition = mCellStart;
+  mIndexedData.resize( nVertices );
+  for ( int i = 0; i < nVertices; ++i )
+  {
+    mIndexedData[insertPosition[cellOfVertex.at( i )]++] = mCachedBaseData.at( i );
+  }
+}
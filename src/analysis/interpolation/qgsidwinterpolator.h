@@ -38,6 +38,38 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
 
     void setDistanceCoefficient( double p ) {mDistanceCoefficient = p;}
 
+    /** Sets the number of nearest points used to interpolate a value. With the default of 0
+     * all points are used, which gives the exact global inverse distance weighting. Nearest
+     * points are found with a grid index built when the base data is cached.
+     * @see neighbourCount()
+     * @see setSearchRadius()
+     * @note added in QGIS 2.18
+     */
+    void setNeighbourCount( int count ) { mNeighbourCount = count; }
+
+    /** Returns the number of nearest points used to interpolate a value, or 0 if all points are used.
+     * @see setNeighbourCount()
+     * @note added in QGIS 2.18
+     */
+    int neighbourCount() const { return mNeighbourCount; }
+
+    /** Sets the distance within which points are used to interpolate a value. If a neighbour count
+     * is set as well, the nearest points within the radius are used. Cells without any point within
+     * the radius are not interpolated. The default of 0 does not limit the distance.
+     * @see searchRadius()
+     * @see setNeighbourCount()
+     * @note added in QGIS 2.18
+     */
+    void setSearchRadius( double radius ) { mSearchRadius = radius; }
+
+    /** Returns the distance within which points are used to interpolate a value, or 0 if the distance is not limited.
+     * @see setSearchRadius()
+     * @note added in QGIS 2.18
+     */
+    double searchRadius() const { return mSearchRadius; }
+
+    bool supportsParallelInterpolation() const override { return true; }
+
   private:
 
     QgsIDWInterpolator(); //forbidden
@@ -46,6 +78,29 @@ class ANALYSIS_EXPORT QgsIDWInterpolator: public QgsInterpolator
        Smaller values mean sharper peaks at the data points. The default is a
        value of 2*/
     double mDistanceCoefficient;
+
+    int mNeighbourCount;
+    double mSearchRadius;
+
+    /** Calculates the value from the nearest points or the points within the search radius*/
+    int interpolateFromIndex( double x, double y, double& result ) const;
+
+    /** Sorts the cached vertices into a grid with about two vertices per cell*/
+    void buildIndex();
+
+    inline int indexColumn( double x ) const { return static_cast< int >( qBound( 0.0, ( x - mIndexXMin ) / mIndexCellSize, mIndexColumns - 1.0 ) ); }
+    inline int indexRow( double y ) const { return static_cast< int >( qBound( 0.0, ( y - mIndexYMin ) / mIndexCellSize, mIndexRows - 1.0 ) ); }
+
+    bool mIndexBuilt;
+    /** Cached vertices ordered by grid cell*/
+    QVector<vertexData> mIndexedData;
+    /** Position of the first vertex of each cell in mIndexedData, row by row, with an additional end position*/
+    QVector<int> mCellStart;
+    int mIndexColumns;
+    int mIndexRows;
+    double mIndexXMin;
+    double mIndexYMin;
+    double mIndexCellSize;
 };
 
 #endif
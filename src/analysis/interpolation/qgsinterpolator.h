@@ -65,6 +65,13 @@ class ANALYSIS_EXPORT QgsInterpolator
        @return 0 in case of success*/
     virtual int interpolatePoint( double x, double y, double& result ) = 0;
 
+    /** Returns true if interpolatePoint() may be called by several threads at a time once the
+     * base data is cached. QgsGridFileWriter then calculates the rows of the grid in parallel.
+     * The default implementation returns false.
+     * @note added in QGIS 2.18
+     */
+    virtual bool supportsParallelInterpolation() const { return false; }
+
     //! @note not available in Python bindings
     const QList<LayerData>& layerData() const { return mLayerData; }
 
@@ -48,3 +48,7 @@ float QgsAspectFilter::processNineCellWindow(
   }
 }
 
+void QgsAspectFilter::processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  processRow( this, scanLine1, scanLine2, scanLine3, resultLine, xSize );
+}
@@ -34,6 +34,10 @@ class ANALYSIS_EXPORT QgsAspectFilter: public QgsDerivativeFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
 
+    void processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize ) override;
+
+  protected:
+    bool canProcessRowsConcurrently() const override { return isExactType( this ); }
 };
 
 #endif // QGSASPECTFILTER_H
@@ -55,3 +55,8 @@ float QgsHillshadeFilter::processNineCellWindow( float* x11, float* x21, float*
   }
   return qMax( 0.0, 255.0 * (( cos( zenith_rad ) * cos( slope_rad ) ) + ( sin( zenith_rad ) * sin( slope_rad ) * cos( azimuth_rad - aspect_rad ) ) ) );
 }
+
+void QgsHillshadeFilter::processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  processRow( this, scanLine1, scanLine2, scanLine3, resultLine, xSize );
+}
@@ -36,11 +36,16 @@ class ANALYSIS_EXPORT QgsHillshadeFilter: public QgsDerivativeFilter
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
 
+    void processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize ) override;
+
     float lightAzimuth() const { return mLightAzimuth; }
     void setLightAzimuth( float azimuth ) { mLightAzimuth = azimuth; }
     float lightAngle() const { return mLightAngle; }
     void setLightAngle( float angle ) { mLightAngle = angle; }
 
+  protected:
+    bool canProcessRowsConcurrently() const override { return isExactType( this ); }
+
   private:
     float mLightAzimuth;
     float mLightAngle;
@@ -20,6 +20,10 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -27,6 +31,48 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! approximate number of cells in a block of rows
+static const int BLOCK_CELLS = 1 << 20;
+
+///@cond PRIVATE
+
+//! Calculates one output row of a block
+class QgsNineCellRowTask
+{
+  public:
+    QgsNineCellRowTask( QgsNineCellFilter* filter, float* inputBlock, float* resultBlock, int xSize )
+        : mFilter( filter )
+        , mInputBlock( inputBlock )
+        , mResultBlock( resultBlock )
+        , mXSize( xSize )
+    {}
+
+    void operator()( int row ) const
+    {
+      const int stride = mXSize + 2;
+      float* scanLine1 = mInputBlock + row * stride;
+      mFilter->processNineCellRow( scanLine1, scanLine1 + stride, scanLine1 + 2 * stride, mResultBlock + row * mXSize, mXSize );
+    }
+
+  private:
+    QgsNineCellFilter* mFilter;
+    float* mInputBlock;
+    float* mResultBlock;
+    int mXSize;
+};
+
+static bool writeRows( GDALRasterBandH band, int firstRow, int nRows, int xSize, float* data )
+{
+  if ( GDALRasterIO( band, GF_Write, 0, firstRow, xSize, nRows, data, xSize, nRows, GDT_Float32, 0, 0 ) != CE_None )
+  {
+    QgsDebugMsg( "Raster IO Error" );
+    return false;
+  }
+  return true;
+}
+
+///@endcond
+
 QgsNineCellFilter::QgsNineCellFilter( const QString& inputFile, const QString& outputFile, const QString& outputFormat )
     : mInputFile( inputFile )
     , mOutputFile( outputFile )
@@ -107,24 +153,27 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
     return 6;
   }
 
-  //keep only three scanlines in memory at a time
-  float* scanLine1 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine2 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-  float* scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
-
-  float* resultLine = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+  //rows are processed in blocks. The input rows of a block are read together with the row above and below
+  //and padded with a nodata cell on both sides, so values outside the layer extent (if the 3x3 window is on
+  //the border) are sent to the processing method as (input) nodata values. The output rows of a block are
+  //calculated by several threads and written while the next block is read and calculated.
+  const int blockRows = qMin( ySize, qMax( QThread::idealThreadCount() * 4, BLOCK_CELLS / xSize ) );
+  const int stride = xSize + 2;
+  float* inputBlock = ( float * ) CPLMalloc( sizeof( float ) * stride * ( blockRows + 2 ) );
+  float* resultBlock = ( float * ) CPLMalloc( sizeof( float ) * xSize * blockRows );
+  float* writeBlock = ( float * ) CPLMalloc( sizeof( float ) * xSize * blockRows );
+  QFuture<bool> writeFuture;
 
   if ( p )
   {
     p->setMaximum( ySize );
   }
 
-  //values outside the layer extent (if the 3x3 window is on the border) are sent to the processing method as (input) nodata values
-  for ( int i = 0; i < ySize; ++i )
+  for ( int blockStart = 0; blockStart < ySize; blockStart += blockRows )
   {
     if ( p )
     {
-      p->setValue( i );
+      p->setValue( blockStart );
     }
 
     if ( p && p->wasCanceled() )
@@ -132,76 +181,55 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
       break;
     }
 
-    if ( i == 0 )
+    int nRows = qMin( blockRows, ySize - blockStart );
+    int firstRow = qMax( blockStart - 1, 0 );
+    int lastRow = qMin( blockStart + nRows, ySize - 1 );
+
+    for ( int a = 0; a < stride * ( nRows + 2 ); ++a )
     {
-      //fill scanline 1 with (input) nodata for the values above the first row and feed scanline2 with the first row
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine1[a] = mInputNodataValue;
-      }
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, 0, xSize, 1, scanLine2, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
+      inputBlock[a] = mInputNodataValue;
     }
-    else
+    float* firstLine = inputBlock + ( firstRow - blockStart + 1 ) * stride + 1;
+    if ( GDALRasterIO( rasterBand, GF_Read, 0, firstRow, xSize, lastRow - firstRow + 1, firstLine, xSize, lastRow - firstRow + 1,
+                       GDT_Float32, 0, sizeof( float ) * stride ) != CE_None )
     {
-      //normally fetch only scanLine3 and release scanline 1 if we move forward one row
-      CPLFree( scanLine1 );
-      scanLine1 = scanLine2;
-      scanLine2 = scanLine3;
-      scanLine3 = ( float * ) CPLMalloc( sizeof( float ) * xSize );
+      QgsDebugMsg( "Raster IO Error" );
     }
 
-    if ( i == ySize - 1 ) //fill the row below the bottom with nodata values
+    QVector<int> rows( nRows );
+    for ( int i = 0; i < nRows; ++i )
     {
-      for ( int a = 0; a < xSize; ++a )
-      {
-        scanLine3[a] = mInputNodataValue;
-      }
+      rows[i] = i;
     }
-    else
+    QgsNineCellRowTask rowTask( this, inputBlock, resultBlock, xSize );
+    if ( canProcessRowsConcurrently() )
     {
-      if ( GDALRasterIO( rasterBand, GF_Read, 0, i + 1, xSize, 1, scanLine3, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "Raster IO Error" );
-      }
+      QtConcurrent::blockingMap( rows, rowTask );
     }
-
-    for ( int j = 0; j < xSize; ++j )
+    else
     {
-      if ( j == 0 )
-      {
-        resultLine[j] = processNineCellWindow( &mInputNodataValue, &scanLine1[j], &scanLine1[j+1], &mInputNodataValue, &scanLine2[j],
-                                               &scanLine2[j+1], &mInputNodataValue, &scanLine3[j], &scanLine3[j+1] );
-      }
-      else if ( j == xSize - 1 )
-      {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &mInputNodataValue, &scanLine2[j-1], &scanLine2[j],
-                                               &mInputNodataValue, &scanLine3[j-1], &scanLine3[j], &mInputNodataValue );
-      }
-      else
+      //subclasses (e.g. from Python) may not be thread safe
+      for ( int i = 0; i < nRows; ++i )
       {
-        resultLine[j] = processNineCellWindow( &scanLine1[j-1], &scanLine1[j], &scanLine1[j+1], &scanLine2[j-1], &scanLine2[j],
-                                               &scanLine2[j+1], &scanLine3[j-1], &scanLine3[j], &scanLine3[j+1] );
+        rowTask( rows[i] );
       }
     }
 
-    if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, xSize, 1, resultLine, xSize, 1, GDT_Float32, 0, 0 ) != CE_None )
-    {
-      QgsDebugMsg( "Raster IO Error" );
-    }
+    writeFuture.waitForFinished();
+    qSwap( resultBlock, writeBlock );
+    writeFuture = QtConcurrent::run( writeRows, outputRasterBand, blockStart, nRows, xSize, writeBlock );
   }
 
+  writeFuture.waitForFinished();
+
   if ( p )
   {
     p->setValue( ySize );
   }
 
-  CPLFree( resultLine );
-  CPLFree( scanLine1 );
-  CPLFree( scanLine2 );
-  CPLFree( scanLine3 );
+  CPLFree( inputBlock );
+  CPLFree( resultBlock );
+  CPLFree( writeBlock );
 
   GDALClose( inputDataset );
 
@@ -216,6 +244,15 @@ int QgsNineCellFilter::processRaster( QProgressDialog* p )
   return 0;
 }
 
+void QgsNineCellFilter::processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  for ( int j = 0; j < xSize; ++j )
+  {
+    resultLine[j] = processNineCellWindow( &scanLine1[j], &scanLine1[j+1], &scanLine1[j+2], &scanLine2[j], &scanLine2[j+1],
+                                           &scanLine2[j+2], &scanLine3[j], &scanLine3[j+1], &scanLine3[j+2] );
+  }
+}
+
 GDALDatasetH QgsNineCellFilter::openInputFile( int& nCellsX, int& nCellsY )
 {
   GDALDatasetH inputDataset = GDALOpen( TO8F( mInputFile ), GA_ReadOnly );
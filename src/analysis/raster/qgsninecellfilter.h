@@ -19,6 +19,7 @@
 #define QGSNINECELLFILTER_H
 
 #include <QString>
+#include <typeinfo>
 #include "gdal.h"
 
 class QProgressDialog;
@@ -58,6 +59,59 @@ class ANALYSIS_EXPORT QgsNineCellFilter
                                          float* x12, float* x22, float* x32,
                                          float* x13, float* x23, float* x33 ) = 0;
 
+    /** Calculates a row of output values. The three input rows are padded with one nodata cell on each side,
+      so the output cell j is calculated from the cells j, j + 1 and j + 2 of the input rows. The default
+      implementation calls processNineCellWindow() for every cell, subclasses override it with a loop over
+      their own window function (see processRow()) to avoid a virtual call per cell. Rows are calculated by
+      several threads at a time if canProcessRowsConcurrently() returns true, one after the other otherwise.
+      @param scanLine1 row above, xSize + 2 cells
+      @param scanLine2 current row, xSize + 2 cells
+      @param scanLine3 row below, xSize + 2 cells
+      @param resultLine output row, xSize cells
+      @param xSize number of cells in the output row
+      @note added in QGIS 2.18
+      @note not available in Python bindings*/
+    virtual void processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize );
+
+  protected:
+
+    /** Returns true if the rows may be calculated by several threads at a time. This is only safe for the
+      built-in filters, whose window functions do not touch shared state. The default implementation returns false.
+      @note added in QGIS 2.18*/
+    virtual bool canProcessRowsConcurrently() const { return false; }
+
+    /** Returns true if the dynamic type of filter is exactly T, i.e. filter is not an instance of a subclass of T
+      (which might override the window function of T).
+      @note added in QGIS 2.18*/
+    template <class T> static bool isExactType( const T* filter )
+    {
+      return typeid( *filter ) == typeid( T );
+    }
+
+    /** Calls the window function of the filter class T for every cell of a row. If the dynamic type of filter
+      is exactly T, this is done without virtual calls, otherwise processNineCellWindow() is called virtually
+      so that overrides in subclasses of T are respected.
+      Used by the processNineCellRow() implementations of subclasses.
+      @note added in QGIS 2.18*/
+    template <class T> static void processRow( T* filter, float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+    {
+      if ( !isExactType( filter ) )
+      {
+        for ( int j = 0; j < xSize; ++j )
+        {
+          resultLine[j] = filter->processNineCellWindow( &scanLine1[j], &scanLine1[j+1], &scanLine1[j+2], &scanLine2[j], &scanLine2[j+1],
+                          &scanLine2[j+2], &scanLine3[j], &scanLine3[j+1], &scanLine3[j+2] );
+        }
+        return;
+      }
+
+      for ( int j = 0; j < xSize; ++j )
+      {
+        resultLine[j] = filter->T::processNineCellWindow( &scanLine1[j], &scanLine1[j+1], &scanLine1[j+2], &scanLine2[j], &scanLine2[j+1],
+                        &scanLine2[j+2], &scanLine3[j], &scanLine3[j+1], &scanLine3[j+2] );
+      }
+    }
+
   private:
     //default constructor forbidden. We need input file, output file and format obligatory
     QgsNineCellFilter();
@@ -0,0 +1,286 @@
+/***************************************************************************
+  qgsrastercalcprogram.cpp - QgsRasterCalcProgram
+  -----------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgsrastercalcprogram.h"
+#include "qgsrasterblock.h"
+
+#include <qmath.h>
+
+///@cond PRIVATE
+
+QgsRasterCalcProgram::QgsRasterCalcProgram()
+    : mRegisterCount( 0 )
+    , mResultRegister( -1 )
+{
+}
+
+QgsRasterCalcProgram* QgsRasterCalcProgram::compile( const QgsRasterCalcNode* node, const QStringList& rasterRefs )
+{
+  if ( !node )
+    return nullptr;
+
+  QgsRasterCalcProgram* program = new QgsRasterCalcProgram();
+  program->mResultRegister = program->compileNode( node, rasterRefs );
+  if ( program->mResultRegister < 0 )
+  {
+    delete program;
+    return nullptr;
+  }
+  return program;
+}
+
+int QgsRasterCalcProgram::compileNode( const QgsRasterCalcNode* node, const QStringList& rasterRefs )
+{
+  Instruction instruction;
+
+  switch ( node->mType )
+  {
+    case QgsRasterCalcNode::tNumber:
+      instruction.op = opLoadNumber;
+      instruction.number = node->mNumber;
+      break;
+
+    case QgsRasterCalcNode::tRasterRef:
+      instruction.op = opLoadRaster;
+      instruction.b = rasterRefs.indexOf( node->mRasterName );
+      if ( instruction.b < 0 )
+        return -1;
+      break;
+
+    case QgsRasterCalcNode::tOperator:
+    {
+      if ( !node->mLeft )
+        return -1;
+
+      switch ( node->mOperator )
+      {
+        case QgsRasterCalcNode::opPLUS:
+        case QgsRasterCalcNode::opMINUS:
+        case QgsRasterCalcNode::opMUL:
+        case QgsRasterCalcNode::opDIV:
+        case QgsRasterCalcNode::opPOW:
+        case QgsRasterCalcNode::opEQ:
+        case QgsRasterCalcNode::opNE:
+        case QgsRasterCalcNode::opGT:
+        case QgsRasterCalcNode::opLT:
+        case QgsRasterCalcNode::opGE:
+        case QgsRasterCalcNode::opLE:
+        case QgsRasterCalcNode::opAND:
+        case QgsRasterCalcNode::opOR:
+          if ( !node->mRight )
+            return -1;
+          instruction.op = opBinary;
+          break;
+
+        case QgsRasterCalcNode::opSQRT:
+        case QgsRasterCalcNode::opSIN:
+        case QgsRasterCalcNode::opCOS:
+        case QgsRasterCalcNode::opTAN:
+        case QgsRasterCalcNode::opASIN:
+        case QgsRasterCalcNode::opACOS:
+        case QgsRasterCalcNode::opATAN:
+        case QgsRasterCalcNode::opSIGN:
+        case QgsRasterCalcNode::opLOG:
+        case QgsRasterCalcNode::opLOG10:
+          instruction.op = opUnary;
+          break;
+
+        case QgsRasterCalcNode::opNONE:
+          return -1;
+      }
+
+      instruction.oper = node->mOperator;
+      instruction.a = compileNode( node->mLeft, rasterRefs );
+      if ( instruction.a < 0 )
+        return -1;
+      if ( instruction.op == opBinary )
+      {
+        instruction.b = compileNode( node->mRight, rasterRefs );
+        if ( instruction.b < 0 )
+          return -1;
+      }
+      break;
+    }
+
+    case QgsRasterCalcNode::tMatrix:
+      // constant matrices do not have the size of a row
+      return -1;
+  }
+
+  instruction.dst = mRegisterCount++;
+  mCode << instruction;
+  return instruction.dst;
+}
+
+void QgsRasterCalcProgram::calculateRow( const QVector<QgsRasterBlock*>& inputs, int row, int nColumns, double nodataValue, double* result ) const
+{
+  QVector<double> registers( mRegisterCount * CHUNK_SIZE );
+  double* regs = registers.data();
+
+  for ( int column = 0; column < nColumns; column += CHUNK_SIZE )
+  {
+    const int count = qMin( CHUNK_SIZE, nColumns - column );
+
+    Q_FOREACH ( const Instruction& instruction, mCode )
+    {
+      double* dst = regs + instruction.dst * CHUNK_SIZE;
+      switch ( instruction.op )
+      {
+        case opLoadRaster:
+        {
+          //convert input raster values to double, also convert input no data to result no data
+          QgsRasterBlock* block = inputs.at( instruction.b );
+          for ( int i = 0; i < count; ++i )
+          {
+            dst[i] = block->isNoData( row, column + i ) ? nodataValue : block->value( row, column + i );
+          }
+          break;
+        }
+
+        case opLoadNumber:
+          for ( int i = 0; i < count; ++i )
+          {
+            dst[i] = instruction.number;
+          }
+          break;
+
+        case opBinary:
+          binary( instruction.oper, regs + instruction.a * CHUNK_SIZE, regs + instruction.b * CHUNK_SIZE, dst, count, nodataValue );
+          break;
+
+        case opUnary:
+          unary( instruction.oper, regs + instruction.a * CHUNK_SIZE, dst, count, nodataValue );
+          break;
+      }
+    }
+
+    const double* values = regs + mResultRegister * CHUNK_SIZE;
+    for ( int i = 0; i < count; ++i )
+    {
+      result[column + i] = values[i];
+    }
+  }
+}
+
+//operations with nodata values always generate nodata
+#define BINARY_LOOP( expression ) \
+  for ( int i = 0; i < count; ++i ) \
+  { \
+    const double x = a[i]; \
+    const double y = b[i]; \
+    dst[i] = ( x == nodataValue || y == nodataValue ) ? nodataValue : ( expression ); \
+  }
+
+void QgsRasterCalcProgram::binary( QgsRasterCalcNode::Operator op, const double* a, const double* b, double* dst, int count, double nodataValue )
+{
+  switch ( op )
+  {
+    case QgsRasterCalcNode::opPLUS:
+      BINARY_LOOP( x + y );
+      break;
+    case QgsRasterCalcNode::opMINUS:
+      BINARY_LOOP( x - y );
+      break;
+    case QgsRasterCalcNode::opMUL:
+      BINARY_LOOP( x * y );
+      break;
+    case QgsRasterCalcNode::opDIV:
+      BINARY_LOOP( y == 0 ? nodataValue : x / y );
+      break;
+    case QgsRasterCalcNode::opPOW:
+      //same validity test as QgsRasterMatrix::testPowerValidity()
+      BINARY_LOOP((( x == 0 && y < 0 ) || ( x < 0 && ( y - floor( y ) ) > 0 ) ) ? nodataValue : qPow( x, y ) );
+      break;
+    case QgsRasterCalcNode::opEQ:
+      BINARY_LOOP( x == y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opNE:
+      BINARY_LOOP( x == y ? 0.0 : 1.0 );
+      break;
+    case QgsRasterCalcNode::opGT:
+      BINARY_LOOP( x > y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opLT:
+      BINARY_LOOP( x < y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opGE:
+      BINARY_LOOP( x >= y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opLE:
+      BINARY_LOOP( x <= y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opAND:
+      BINARY_LOOP( x && y ? 1.0 : 0.0 );
+      break;
+    case QgsRasterCalcNode::opOR:
+      BINARY_LOOP( x || y ? 1.0 : 0.0 );
+      break;
+    default:
+      break;
+  }
+}
+
+#undef BINARY_LOOP
+
+#define UNARY_LOOP( expression ) \
+  for ( int i = 0; i < count; ++i ) \
+  { \
+    const double x = a[i]; \
+    dst[i] = x == nodataValue ? nodataValue : ( expression ); \
+  }
+
+void QgsRasterCalcProgram::unary( QgsRasterCalcNode::Operator op, const double* a, double* dst, int count, double nodataValue )
+{
+  switch ( op )
+  {
+    case QgsRasterCalcNode::opSQRT:
+      UNARY_LOOP( x < 0 ? nodataValue : sqrt( x ) ); //no complex numbers
+      break;
+    case QgsRasterCalcNode::opSIN:
+      UNARY_LOOP( sin( x ) );
+      break;
+    case QgsRasterCalcNode::opCOS:
+      UNARY_LOOP( cos( x ) );
+      break;
+    case QgsRasterCalcNode::opTAN:
+      UNARY_LOOP( tan( x ) );
+      break;
+    case QgsRasterCalcNode::opASIN:
+      UNARY_LOOP( asin( x ) );
+      break;
+    case QgsRasterCalcNode::opACOS:
+      UNARY_LOOP( acos( x ) );
+      break;
+    case QgsRasterCalcNode::opATAN:
+      UNARY_LOOP( atan( x ) );
+      break;
+    case QgsRasterCalcNode::opSIGN:
+      UNARY_LOOP( -x );
+      break;
+    case QgsRasterCalcNode::opLOG:
+      UNARY_LOOP( x <= 0 ? nodataValue : ::log( x ) );
+      break;
+    case QgsRasterCalcNode::opLOG10:
+      UNARY_LOOP( x <= 0 ? nodataValue : ::log10( x ) );
+      break;
+    default:
+      break;
+  }
+}
+
+#undef UNARY_LOOP
+
+///@endcond
@@ -0,0 +1,112 @@
+/***************************************************************************
+  qgsrastercalcprogram.h - QgsRasterCalcProgram
+  ---------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSRASTERCALCPROGRAM_H
+#define QGSRASTERCALCPROGRAM_H
+
+#include <QStringList>
+#include <QVector>
+
+#include "qgsrastercalcnode.h"
+
+class QgsRasterBlock;
+
+///@cond PRIVATE
+
+/**
+ * A raster calculator formula lowered to a flat list of element-wise operations.
+ *
+ * Rows are calculated in chunks of CHUNK_SIZE cells. Every operation runs as
+ * one tight loop over the chunk, so the operands of all operations stay in the
+ * cache and no matrix sized temporaries are allocated for the nodes of the tree.
+ * Nodata handling and the results are the same as the QgsRasterMatrix operations
+ * used by QgsRasterCalcNode::calculate().
+ *
+ * A compiled program is immutable, rows may be calculated by several threads
+ * at a time.
+ *
+ * This class is an implementation detail of QgsRasterCalculator and is not
+ * part of the public API.
+ */
+class QgsRasterCalcProgram
+{
+  public:
+
+    //! Number of cells of a row which are calculated at once
+    static const int CHUNK_SIZE = 512;
+
+    /**
+     * Compiles a calculation tree.
+     * @param node root of the tree
+     * @param rasterRefs names of the input rasters, in the order of the blocks passed to calculateRow()
+     * @returns compiled program, or nullptr if the tree contains constant matrices or
+     * references a raster which is not in rasterRefs
+     */
+    static QgsRasterCalcProgram* compile( const QgsRasterCalcNode* node, const QStringList& rasterRefs );
+
+    /**
+     * Calculates a row of the result.
+     * @param inputs input blocks, in the order of the raster references passed to compile()
+     * @param row row of the input blocks
+     * @param nColumns number of columns of the input blocks and the result
+     * @param nodataValue value used for nodata cells of the inputs and the result
+     * @param result receives nColumns values
+     */
+    void calculateRow( const QVector<QgsRasterBlock*>& inputs, int row, int nColumns, double nodataValue, double* result ) const;
+
+  private:
+
+    enum OpCode
+    {
+      opLoadRaster,
+      opLoadNumber,
+      opBinary,
+      opUnary
+    };
+
+    struct Instruction
+    {
+      Instruction()
+          : op( opLoadNumber )
+          , oper( QgsRasterCalcNode::opNONE )
+          , dst( -1 )
+          , a( -1 )
+          , b( -1 )
+          , number( 0 )
+      {}
+
+      OpCode op;
+      QgsRasterCalcNode::Operator oper;
+      int dst;
+      int a;
+      int b; //!< right operand register, or input block index for opLoadRaster
+      double number;
+    };
+
+    QgsRasterCalcProgram();
+
+    int compileNode( const QgsRasterCalcNode* node, const QStringList& rasterRefs );
+
+    static void binary( QgsRasterCalcNode::Operator op, const double* a, const double* b, double* dst, int count, double nodataValue );
+    static void unary( QgsRasterCalcNode::Operator op, const double* a, double* dst, int count, double nodataValue );
+
+    QVector<Instruction> mCode;
+    int mRegisterCount;
+    int mResultRegister;
+};
+
+///@endcond
+
+#endif // QGSRASTERCALCPROGRAM_H
@@ -17,11 +17,19 @@
 
 #include "qgsrastercalculator.h"
 #include "qgsrastercalcnode.h"
+#include "qgsrastercalcprogram.h"
 #include "qgsrasterlayer.h"
 #include "qgsrastermatrix.h"
 
 #include <QProgressDialog>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include <cmath>
+#include <limits>
+#include <new>
 
 #include <cpl_string.h>
 #include <gdalwarper.h>
@@ -34,6 +42,89 @@
 #define TO8F(x)  QFile::encodeName( x ).constData()
 #endif
 
+//! approximate number of cells in a band of output rows
+static const int BAND_CELLS = 1 << 22;
+
+///@cond PRIVATE
+
+//! Calculates one output row of a band
+class QgsRasterCalcRowTask
+{
+  public:
+    QgsRasterCalcRowTask( const QgsRasterCalcProgram* program, const QVector<QgsRasterBlock*>& inputs, int nColumns, double nodataValue, double* result )
+        : mProgram( program )
+        , mInputs( inputs )
+        , mColumns( nColumns )
+        , mNodataValue( nodataValue )
+        , mResult( result )
+    {}
+
+    void operator()( int row ) const
+    {
+      mProgram->calculateRow( mInputs, row, mColumns, mNodataValue, mResult + static_cast< qgssize >( row ) * mColumns );
+    }
+
+  private:
+    const QgsRasterCalcProgram* mProgram;
+    QVector<QgsRasterBlock*> mInputs;
+    int mColumns;
+    double mNodataValue;
+    double* mResult;
+};
+
+static GDALDataType gdalDataType( QGis::DataType type )
+{
+  switch ( type )
+  {
+    case QGis::Byte:
+      return GDT_Byte;
+    case QGis::UInt16:
+      return GDT_UInt16;
+    case QGis::Int16:
+      return GDT_Int16;
+    case QGis::UInt32:
+      return GDT_UInt32;
+    case QGis::Int32:
+      return GDT_Int32;
+    case QGis::Float64:
+      return GDT_Float64;
+    default:
+      return GDT_Float32;
+  }
+}
+
+//! Sets minimum and maximum to the range of an integer GDAL data type, returns false for other types
+static bool integerDataRange( GDALDataType type, double& minimum, double& maximum )
+{
+  switch ( type )
+  {
+    case GDT_Byte:
+      minimum = std::numeric_limits<unsigned char>::min();
+      maximum = std::numeric_limits<unsigned char>::max();
+      return true;
+    case GDT_UInt16:
+      minimum = std::numeric_limits<unsigned short>::min();
+      maximum = std::numeric_limits<unsigned short>::max();
+      return true;
+    case GDT_Int16:
+      minimum = std::numeric_limits<short>::min();
+      maximum = std::numeric_limits<short>::max();
+      return true;
+    case GDT_UInt32:
+      minimum = std::numeric_limits<unsigned int>::min();
+      maximum = std::numeric_limits<unsigned int>::max();
+      return true;
+    case GDT_Int32:
+      minimum = std::numeric_limits<int>::min();
+      maximum = std::numeric_limits<int>::max();
+      return true;
+    default:
+      return false;
+  }
+}
+
+///@endcond
+
 QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QString& outputFile, const QString& outputFormat,
     const QgsRectangle& outputExtent, int nOutputColumns, int nOutputRows, const QVector<QgsRasterCalculatorEntry>& rasterEntries )
     : mFormulaString( formulaString )
@@ -43,6 +134,7 @@ QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QS
     , mNumOutputColumns( nOutputColumns )
     , mNumOutputRows( nOutputRows )
     , mRasterEntries( rasterEntries )
+    , mOutputDataType( QGis::Float32 )
 {
   //default to first layer's crs
   mOutputCrs = mRasterEntries.at( 0 ).raster->crs();
@@ -58,6 +150,7 @@ QgsRasterCalculator::QgsRasterCalculator( const QString& formulaString, const QS
     , mNumOutputColumns( nOutputColumns )
     , mNumOutputRows( nOutputRows )
     , mRasterEntries( rasterEntries )
+    , mOutputDataType( QGis::Float32 )
 {
 }
 
@@ -72,40 +165,50 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     return static_cast<int>( ParserError );
   }
 
-  QMap< QString, QgsRasterBlock* > inputBlocks;
-  QVector<QgsRasterCalculatorEntry>::const_iterator it = mRasterEntries.constBegin();
-  for ( ; it != mRasterEntries.constEnd(); ++it )
+  //the last entry of a reference is used
+  QStringList rasterRefs;
+  QVector<int> entries;
+  for ( int i = 0; i < mRasterEntries.size(); ++i )
   {
-    if ( !it->raster ) // no raster layer in entry
+    if ( !mRasterEntries.at( i ).raster ) // no raster layer in entry
     {
       delete calcNode;
-      qDeleteAll( inputBlocks );
       return static_cast< int >( InputLayerError );
     }
 
-    QgsRasterBlock* block = nullptr;
-    // if crs transform needed
-    if ( it->raster->crs() != mOutputCrs )
+    int index = rasterRefs.indexOf( mRasterEntries.at( i ).ref );
+    if ( index < 0 )
     {
-      QgsRasterProjector proj;
-      proj.setCRS( it->raster->crs(), mOutputCrs );
-      proj.setInput( it->raster->dataProvider() );
-      proj.setPrecision( QgsRasterProjector::Exact );
-
-      block = proj.block( it->bandNumber, mOutputRectangle, mNumOutputColumns, mNumOutputRows );
+      rasterRefs << mRasterEntries.at( i ).ref;
+      entries << i;
     }
     else
     {
-      block = it->raster->dataProvider()->block( it->bandNumber, mOutputRectangle, mNumOutputColumns, mNumOutputRows );
+      entries[index] = i;
     }
-    if ( block->isEmpty() )
+  }
+
+  QgsRasterCalcProgram* program = QgsRasterCalcProgram::compile( calcNode, rasterRefs );
+  if ( program )
+  {
+    delete calcNode;
+    int result = processBlocks( program, rasterRefs, entries, p );
+    delete program;
+    return result;
+  }
+
+  //formulas with constant matrices are calculated on whole input rasters
+  QMap< QString, QgsRasterBlock* > inputBlocks;
+  Q_FOREACH ( int entry, entries )
+  {
+    QgsRasterBlock* block = readRows( mRasterEntries.at( entry ), 0, mNumOutputRows );
+    if ( !block )
     {
-      delete block;
       delete calcNode;
       qDeleteAll( inputBlocks );
       return static_cast<int>( MemoryError );
     }
-    inputBlocks.insert( it->ref, block );
+    inputBlocks.insert( mRasterEntries.at( entry ).ref, block );
   }
 
   //open output dataset for writing
@@ -119,8 +222,10 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   GDALSetProjection( outputDataset, mOutputCrs.toWkt().toLocal8Bit().data() );
   GDALRasterBandH outputRasterBand = GDALGetRasterBand( outputDataset, 1 );
 
-  float outputNodataValue = -FLT_MAX;
-  GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue );
+  GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue() );
+
+  //nodata value used while calculating
+  float calcNodataValue = -FLT_MAX;
 
   if ( p )
   {
@@ -128,7 +233,7 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   }
 
   QgsRasterMatrix resultMatrix;
-  resultMatrix.setNodataValue( outputNodataValue );
+  resultMatrix.setNodataValue( calcNodataValue );
 
   //read / write line by line
   for ( int i = 0; i < mNumOutputRows; ++i )
@@ -146,18 +251,15 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
     if ( calcNode->calculate( inputBlocks, resultMatrix, i ) )
     {
       bool resultIsNumber = resultMatrix.isNumber();
-      float* calcData = new float[mNumOutputColumns];
+      double* calcData = new double[mNumOutputColumns];
 
       for ( int j = 0; j < mNumOutputColumns; ++j )
       {
-        calcData[j] = ( float )( resultIsNumber ? resultMatrix.number() : resultMatrix.data()[j] );
+        calcData[j] = resultIsNumber ? resultMatrix.number() : resultMatrix.data()[j];
       }
 
       //write scanline to the dataset
-      if ( GDALRasterIO( outputRasterBand, GF_Write, 0, i, mNumOutputColumns, 1, calcData, mNumOutputColumns, 1, GDT_Float32, 0, 0 ) != CE_None )
-      {
-        QgsDebugMsg( "RasterIO error!" );
-      }
+      writeRows( outputRasterBand, i, 1, calcData );
 
       delete[] calcData;
     }
@@ -185,9 +287,214 @@ int QgsRasterCalculator::processCalculation( QProgressDialog* p )
   return static_cast< int >( Success );
 }
 
+int QgsRasterCalculator::processBlocks( const QgsRasterCalcProgram* program, const QStringList& rasterRefs, const QVector<int>& entries, QProgressDialog* p )
+{
+  //open output dataset for writing
+  GDALDriverH outputDriver = openOutputDriver();
+  if ( !outputDriver )
+  {
+    return static_cast< int >( CreateOutputError );
+  }
+
+  GDALDatasetH outputDataset = openOutputFile( outputDriver );
+  if ( !outputDataset )
+  {
+    return static_cast< int >( CreateOutputError );
+  }
+  GDALSetProjection( outputDataset, mOutputCrs.toWkt().toLocal8Bit().data() );
+  GDALRasterBandH outputRasterBand = GDALGetRasterBand( outputDataset, 1 );
+  GDALSetRasterNoDataValue( outputRasterBand, outputNodataValue() );
+
+  //nodata value used while calculating
+  const double calcNodataValue = -FLT_MAX;
+
+  //a band holds enough rows to keep all threads busy
+  const int bandRows = qMin( mNumOutputRows, qMax( QThread::idealThreadCount() * 4, BAND_CELLS / mNumOutputColumns ) );
+  const qgssize bandCells = static_cast< qgssize >( bandRows ) * mNumOutputColumns;
+  double* resultBand = new( std::nothrow ) double[bandCells];
+  double* writeBand = new( std::nothrow ) double[bandCells];
+  if ( !resultBand || !writeBand )
+  {
+    delete[] resultBand;
+    delete[] writeBand;
+    GDALClose( outputDataset );
+    return static_cast< int >( MemoryError );
+  }
+
+  if ( p )
+  {
+    p->setMaximum( mNumOutputRows );
+  }
+
+  Result result = Success;
+  QFuture<bool> writeFuture;
+  for ( int firstRow = 0; firstRow < mNumOutputRows; firstRow += bandRows )
+  {
+    if ( p )
+    {
+      p->setValue( firstRow );
+    }
+
+    if ( p && p->wasCanceled() )
+    {
+      result = Cancelled;
+      break;
+    }
+
+    int nRows = qMin( bandRows, mNumOutputRows - firstRow );
+
+    QVector<QgsRasterBlock*> inputs;
+    for ( int i = 0; i < rasterRefs.size(); ++i )
+    {
+      QgsRasterBlock* block = readRows( mRasterEntries.at( entries.at( i ) ), firstRow, nRows );
+      if ( !block )
+      {
+        result = MemoryError;
+        break;
+      }
+      inputs << block;
+    }
+    if ( result != Success )
+    {
+      qDeleteAll( inputs );
+      break;
+    }
+
+    QVector<int> rows( nRows );
+    for ( int i = 0; i < nRows; ++i )
+    {
+      rows[i] = i;
+    }
+    QtConcurrent::blockingMap( rows, QgsRasterCalcRowTask( program, inputs, mNumOutputColumns, calcNodataValue, resultBand ) );
+    qDeleteAll( inputs );
+
+    writeFuture.waitForFinished();
+    qSwap( resultBand, writeBand );
+    writeFuture = QtConcurrent::run( this, &QgsRasterCalculator::writeRows, outputRasterBand, firstRow, nRows, writeBand );
+  }
+
+  writeFuture.waitForFinished();
+
+  if ( p )
+  {
+    p->setValue( mNumOutputRows );
+  }
+
+  delete[] resultBand;
+  delete[] writeBand;
+
+  if ( result != Success )
+  {
+    //delete the dataset without closing (because it is faster)
+    GDALDeleteDataset( outputDriver, TO8F( mOutputFile ) );
+    return static_cast< int >( result );
+  }
+  GDALClose( outputDataset );
+
+  return static_cast< int >( Success );
+}
+
+QgsRasterBlock* QgsRasterCalculator::readRows( const QgsRasterCalculatorEntry& entry, int firstRow, int nRows ) const
+{
+  double rowHeight = mOutputRectangle.height() / mNumOutputRows;
+  QgsRectangle extent( mOutputRectangle.xMinimum(), mOutputRectangle.yMaximum() - ( firstRow + nRows ) * rowHeight,
+                       mOutputRectangle.xMaximum(), mOutputRectangle.yMaximum() - firstRow * rowHeight );
+  if ( firstRow == 0 && nRows == mNumOutputRows )
+    extent = mOutputRectangle;
+
+  QgsRasterBlock* block = nullptr;
+  // if crs transform needed
+  if ( entry.raster->crs() != mOutputCrs )
+  {
+    QgsRasterProjector proj;
+    proj.setCRS( entry.raster->crs(), mOutputCrs );
+    proj.setInput( entry.raster->dataProvider() );
+    proj.setPrecision( QgsRasterProjector::Exact );
+
+    block = proj.block( entry.bandNumber, extent, mNumOutputColumns, nRows );
+  }
+  else
+  {
+    block = entry.raster->dataProvider()->block( entry.bandNumber, extent, mNumOutputColumns, nRows );
+  }
+  if ( block->isEmpty() )
+  {
+    delete block;
+    return nullptr;
+  }
+  return block;
+}
+
+bool QgsRasterCalculator::writeRows( GDALRasterBandH band, int firstRow, int nRows, double* data ) const
+{
+  const qgssize nCells = static_cast< qgssize >( nRows ) * mNumOutputColumns;
+  CPLErr err;
+  if ( gdalDataType( mOutputDataType ) == GDT_Float32 )
+  {
+    //the calculation nodata value is the Float32 nodata value
+    float* calcData = new float[nCells];
+    for ( qgssize i = 0; i < nCells; ++i )
+    {
+      calcData[i] = ( float )data[i];
+    }
+    err = GDALRasterIO( band, GF_Write, 0, firstRow, mNumOutputColumns, nRows, calcData, mNumOutputColumns, nRows, GDT_Float32, 0, 0 );
+    delete[] calcData;
+  }
+  else
+  {
+    const double nodataValue = outputNodataValue();
+    double minimum, maximum;
+    const bool isInteger = integerDataRange( gdalDataType( mOutputDataType ), minimum, maximum );
+    if ( isInteger )
+    {
+      //the nodata value is at one end of the integer range. Valid results are rounded and clamped
+      //to the rest of the range here, so that they can not be written as nodata by GDAL
+      if ( nodataValue == maximum )
+        maximum -= 1;
+      else
+        minimum += 1;
+    }
+    for ( qgssize i = 0; i < nCells; ++i )
+    {
+      if ( data[i] == -FLT_MAX || ( isInteger && qIsNaN( data[i] ) ) )
+        data[i] = nodataValue;
+      else if ( isInteger )
+        data[i] = qBound( minimum, std::floor( data[i] + 0.5 ), maximum );
+    }
+    err = GDALRasterIO( band, GF_Write, 0, firstRow, mNumOutputColumns, nRows, data, mNumOutputColumns, nRows, GDT_Float64, 0, 0 );
+  }
+
+  if ( err != CE_None )
+  {
+    QgsDebugMsg( "RasterIO error!" );
+    return false;
+  }
+  return true;
+}
+
+double QgsRasterCalculator::outputNodataValue() const
+{
+  switch ( gdalDataType( mOutputDataType ) )
+  {
+    case GDT_Byte:
+      return std::numeric_limits<unsigned char>::max();
+    case GDT_UInt16:
+      return std::numeric_limits<unsigned short>::max();
+    case GDT_Int16:
+      return std::numeric_limits<short>::min();
+    case GDT_UInt32:
+      return std::numeric_limits<unsigned int>::max();
+    case GDT_Int32:
+      return std::numeric_limits<int>::min();
+    default:
+      return -FLT_MAX;
+  }
+}
+
 QgsRasterCalculator::QgsRasterCalculator()
     : mNumOutputColumns( 0 )
     , mNumOutputRows( 0 )
+    , mOutputDataType( QGis::Float32 )
 {
 }
 
@@ -216,7 +523,7 @@ GDALDatasetH QgsRasterCalculator::openOutputFile( GDALDriverH outputDriver )
 {
   //open output file
   char **papszOptions = nullptr;
-  GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( mOutputFile ), mNumOutputColumns, mNumOutputRows, 1, GDT_Float32, papszOptions );
+  GDALDatasetH outputDataset = GDALCreate( outputDriver, TO8F( mOutputFile ), mNumOutputColumns, mNumOutputRows, 1, gdalDataType( mOutputDataType ), papszOptions );
   if ( !outputDataset )
   {
     return outputDataset;
@@ -18,6 +18,7 @@
 #ifndef QGSRASTERCALCULATOR_H
 #define QGSRASTERCALCULATOR_H
 
+#include "qgis.h"
 #include "qgsfield.h"
 #include "qgsrectangle.h"
 #include "qgscoordinatereferencesystem.h"
@@ -25,6 +26,8 @@
 #include <QVector>
 #include "gdal.h"
 
+class QgsRasterBlock;
+class QgsRasterCalcProgram;
 class QgsRasterLayer;
 class QProgressDialog;
 
@@ -85,6 +88,21 @@ class ANALYSIS_EXPORT QgsRasterCalculator
     //TODO QGIS 3.0 - return QgsRasterCalculator::Result
     int processCalculation( QProgressDialog* p = nullptr );
 
+    /** Sets the data type of the output raster. Supported types are Byte, UInt16, Int16, UInt32, Int32,
+     * Float32 (the default) and Float64. Results are rounded and clamped to the range of integer types.
+     * Nodata is written as the largest value of unsigned types, the smallest value of signed integer
+     * types and -FLT_MAX for floating point types.
+     * @see outputDataType()
+     * @note added in QGIS 2.18
+     */
+    void setOutputDataType( QGis::DataType type ) { mOutputDataType = type; }
+
+    /** Returns the data type of the output raster.
+     * @see setOutputDataType()
+     * @note added in QGIS 2.18
+     */
+    QGis::DataType outputDataType() const { return mOutputDataType; }
+
   private:
     //default constructor forbidden. We need formula, output file, output format and output raster resolution obligatory
     QgsRasterCalculator();
@@ -101,6 +119,22 @@ class ANALYSIS_EXPORT QgsRasterCalculator
       @param transform double[6] array that receives the GDAL parameters*/
     void outputGeoTransform( double* transform ) const;
 
+    /** Calculates the output in bands of rows. The rows of a band are calculated in parallel
+      and written while the next band is read and calculated
+      @return QgsRasterCalculator::Result*/
+    int processBlocks( const QgsRasterCalcProgram* program, const QStringList& rasterRefs, const QVector<int>& entries, QProgressDialog* p );
+
+    /** Converts calculated values to the output data type and writes them
+      @param data values of nRows rows, calculation nodata values are replaced by the output nodata value*/
+    bool writeRows( GDALRasterBandH band, int firstRow, int nRows, double* data ) const;
+
+    /** Reads the rows of an input raster needed for a band of output rows
+      @return the block or nullptr if it could not be allocated*/
+    QgsRasterBlock* readRows( const QgsRasterCalculatorEntry& entry, int firstRow, int nRows ) const;
+
+    /** Returns the nodata value written for the output data type*/
+    double outputNodataValue() const;
+
     QString mFormulaString;
     QString mOutputFile;
     QString mOutputFormat;
@@ -116,6 +150,8 @@ class ANALYSIS_EXPORT QgsRasterCalculator
 
     /***/
     QVector<QgsRasterCalculatorEntry> mRasterEntries;
+
+    QGis::DataType mOutputDataType;
 };
 
 #endif // QGSRASTERCALCULATOR_H
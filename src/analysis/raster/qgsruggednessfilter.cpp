@@ -92,3 +92,7 @@ float QgsRuggednessFilter::processNineCellWindow( float* x11, float* x21, float*
   return sqrt( sum );
 }
 
+void QgsRuggednessFilter::processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  processRow( this, scanLine1, scanLine2, scanLine3, resultLine, xSize );
+}
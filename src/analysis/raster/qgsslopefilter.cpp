@@ -42,3 +42,7 @@ float QgsSlopeFilter::processNineCellWindow( float* x11, float* x21, float* x31,
   return atan( sqrt( derX * derX + derY * derY ) ) * 180.0 / M_PI;
 }
 
+void QgsSlopeFilter::processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize )
+{
+  processRow( this, scanLine1, scanLine2, scanLine3, resultLine, xSize );
+}
@@ -33,6 +33,11 @@ class ANALYSIS_EXPORT QgsSlopeFilter: public QgsDerivativeFilter
     float processNineCellWindow( float* x11, float* x21, float* x31,
                                  float* x12, float* x22, float* x32,
                                  float* x13, float* x23, float* x33 ) override;
+
+    void processNineCellRow( float* scanLine1, float* scanLine2, float* scanLine3, float* resultLine, int xSize ) override;
+
+  protected:
+    bool canProcessRowsConcurrently() const override { return isExactType( this ); }
 };
 
 #endif // QGSSLOPEFILTER_H
@@ -24,6 +24,9 @@
 #include "cpl_string.h"
 #include <QProgressDialog>
 #include <QFile>
+#include <QtConcurrentMap>
+#include <cmath>
+#include <limits>
 
 #if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 1800
 #define TO8F(x) (x).toUtf8().constData()
@@ -31,6 +34,256 @@
 #define TO8F(x) QFile::encodeName( x ).constData()
 #endif
 
+//! Maximum number of features whose statistics are calculated at once
+static const int MAX_BATCH_FEATURES = 256;
+//! Maximum number of raster cells read for a batch of features. Larger windows are read in blocks of rows
+static const qint64 MAX_BATCH_CELLS = 1 << 24;
+
+///@cond PRIVATE
+
+/** Rasterizes the rings of a polygon over the raster window of a feature. Coordinates are
+ * converted to cell units with the origin at the top left corner of the window and rows
+ * growing downwards, so that the cell ( row, column ) covers [column, column + 1] x [row, row + 1].
+ * Each row only visits the edges crossing it.
+ */
+class QgsZonalStatistics::Rasterizer
+{
+  public:
+    Rasterizer()
+        : mColumns( 0 )
+        , mRows( 0 )
+    {}
+
+    Rasterizer( const QgsGeometry* geometry, double originX, double originY, double cellSizeX, double cellSizeY, int nColumns, int nRows )
+        : mColumns( nColumns )
+        , mRows( nRows )
+    {
+      QgsMultiPolygon polygons = geometry->isMultipart() ? geometry->asMultiPolygon() : QgsMultiPolygon() << geometry->asPolygon();
+
+      QVector< QVector<int> > rowEdges( mRows );
+      Q_FOREACH ( const QgsPolygon& polygon, polygons )
+      {
+        for ( int ring = 0; ring < polygon.size(); ++ring )
+        {
+          addRing( polygon.at( ring ), ring == 0, originX, originY, cellSizeX, cellSizeY, rowEdges );
+        }
+      }
+
+      mRowStart.resize( mRows + 1 );
+      mRowStart[0] = 0;
+      for ( int row = 0; row < mRows; ++row )
+      {
+        mRowEdges << rowEdges.at( row );
+        mRowStart[row + 1] = mRowEdges.size();
+      }
+    }
+
+    int columnCount() const { return mColumns; }
+
+    /** Appends the ranges [begin, end) of the columns of a row whose centers are inside the polygon*/
+    void centerSpans( int row, QVector<int>& spans ) const
+    {
+      double v = row + 0.5;
+      QVector<double> crossings;
+      for ( int i = mRowStart.at( row ); i < mRowStart.at( row + 1 ); ++i )
+      {
+        const Edge& edge = mEdges.at( mRowEdges.at( i ) );
+        if (( edge.v1 <= v ) != ( edge.v2 <= v ) )
+        {
+          crossings << edge.u1 + ( v - edge.v1 ) * ( edge.u2 - edge.u1 ) / ( edge.v2 - edge.v1 );
+        }
+      }
+      qSort( crossings );
+
+      //even-odd rule, a cell is inside if its center is strictly between two crossings
+      for ( int i = 0; i + 1 < crossings.size(); i += 2 )
+      {
+        int begin = static_cast< int >( qBound( 0.0, std::floor( crossings.at( i ) - 0.5 ) + 1, static_cast< double >( mColumns ) ) );
+        int end = static_cast< int >( qBound( 0.0, std::ceil( crossings.at( i + 1 ) - 0.5 ), static_cast< double >( mColumns ) ) );
+        if ( begin < end )
+        {
+          spans << begin << end;
+        }
+      }
+    }
+
+    /** Calculates the fraction of each cell of a row which is covered by the polygon.
+     * The covered area of a cell [c, c + 1] x [r, r + 1] is the contour integral of
+     * ( clamp( u, c, c + 1 ) - c ) dv along the rings clipped to the row, which has a
+     * closed form for straight edges. Cells left of an edge get the full integral.
+     */
+    void coverage( int row, double* fractions ) const
+    {
+      QVector<double> full( mColumns + 1, 0.0 );
+      for ( int column = 0; column < mColumns; ++column )
+      {
+        fractions[column] = 0.0;
+      }
+
+      double top = row;
+      double bottom = row + 1;
+      for ( int i = mRowStart.at( row ); i < mRowStart.at( row + 1 ); ++i )
+      {
+        const Edge& edge = mEdges.at( mRowEdges.at( i ) );
+        double va = qBound( top, edge.v1, bottom );
+        double vb = qBound( top, edge.v2, bottom );
+        if ( va == vb )
+          continue;
+
+        double slope = ( edge.u2 - edge.u1 ) / ( edge.v2 - edge.v1 );
+        double ua = edge.u1 + ( va - edge.v1 ) * slope;
+        double ub = edge.u1 + ( vb - edge.v1 ) * slope;
+        double dv = ( vb - va ) * edge.sign;
+
+        double lo = qMin( ua, ub );
+        double hi = qMax( ua, ub );
+        int fullEnd = static_cast< int >( qBound( 0.0, std::floor( lo ), static_cast< double >( mColumns ) ) );
+        full[0] += dv;
+        full[fullEnd] -= dv;
+
+        int last = static_cast< int >( qBound( -1.0, std::floor( hi ), mColumns - 1.0 ) );
+        for ( int column = fullEnd; column <= last; ++column )
+        {
+          fractions[column] += dv * averageCover( ua, ub, column );
+        }
+      }
+
+      double running = 0.0;
+      for ( int column = 0; column < mColumns; ++column )
+      {
+        running += full.at( column );
+        fractions[column] = qBound( 0.0, fractions[column] + running, 1.0 );
+      }
+    }
+
+  private:
+
+    struct Edge
+    {
+      double u1;
+      double v1;
+      double u2;
+      double v2;
+      //! 1 or -1, so that exterior rings add to the covered area and holes subtract from it
+      double sign;
+    };
+
+    void addRing( const QgsPolyline& ring, bool exterior, double originX, double originY, double cellSizeX, double cellSizeY, QVector< QVector<int> >& rowEdges )
+    {
+      int nPoints = ring.size();
+      if ( nPoints < 3 )
+        return;
+
+      QVector<double> u( nPoints );
+      QVector<double> v( nPoints );
+      double area = 0;
+      for ( int i = 0; i < nPoints; ++i )
+      {
+        u[i] = ( ring.at( i ).x() - originX ) / cellSizeX;
+        v[i] = ( originY - ring.at( i ).y() ) / cellSizeY;
+      }
+      for ( int i = 0; i < nPoints; ++i )
+      {
+        int next = ( i + 1 ) % nPoints;
+        area += u.at( i ) * v.at( next ) - u.at( next ) * v.at( i );
+      }
+      if ( area == 0 )
+        return;
+
+      double sign = ( area > 0 ) == exterior ? 1.0 : -1.0;
+      for ( int i = 0; i < nPoints; ++i )
+      {
+        //rings are closed, but close them anyway if the last point differs
+        int next = ( i + 1 ) % nPoints;
+        if ( v.at( i ) == v.at( next ) )
+          continue;
+
+        double vMin = qMin( v.at( i ), v.at( next ) );
+        double vMax = qMax( v.at( i ), v.at( next ) );
+        if ( vMax <= 0 || vMin >= mRows )
+          continue;
+
+        Edge edge;
+        edge.u1 = u.at( i );
+        edge.v1 = v.at( i );
+        edge.u2 = u.at( next );
+        edge.v2 = v.at( next );
+        edge.sign = sign;
+        int index = mEdges.size();
+        mEdges << edge;
+
+        int firstRow = static_cast< int >( qMax( 0.0, std::floor( vMin ) ) );
+        int lastRow = static_cast< int >( qMin( mRows - 1.0, std::ceil( vMax ) - 1 ) );
+        for ( int row = firstRow; row <= lastRow; ++row )
+        {
+          rowEdges[row] << index;
+        }
+      }
+    }
+
+    //! Average of clamp( u, column, column + 1 ) - column while u runs linearly from ua to ub
+    static double averageCover( double ua, double ub, int column )
+    {
+      if ( qAbs( ub - ua ) < 1E-12 )
+      {
+        return qBound( 0.0, ( ua + ub ) / 2.0 - column, 1.0 );
+      }
+      return ( coverIntegral( ub - column ) - coverIntegral( ua - column ) ) / ( ub - ua );
+    }
+
+    //! Antiderivative of clamp( t, 0, 1 )
+    static double coverIntegral( double t )
+    {
+      if ( t <= 0 )
+        return 0;
+      if ( t <= 1 )
+        return t * t / 2.0;
+      return t - 0.5;
+    }
+
+    int mColumns;
+    int mRows;
+    QVector<Edge> mEdges;
+    //! Edges crossing each row, the edges of row r are mRowEdges[mRowStart[r]] to mRowEdges[mRowStart[r + 1] - 1]
+    QVector<int> mRowEdges;
+    QVector<int> mRowStart;
+};
+
+//! A feature whose statistics are calculated together with other features of a batch
+class QgsZonalStatistics::FeatureJob
+{
+  public:
+    FeatureJob()
+        : zonalStatistics( nullptr )
+        , offsetX( 0 )
+        , offsetY( 0 )
+        , nCellsX( 0 )
+        , nCellsY( 0 )
+        , calculated( false )
+    {}
+
+    //! Calculates the statistics, used by QtConcurrent
+    void calculate()
+    {
+      if ( !calculated )
+        zonalStatistics->calculateFeatureStatistics( *this );
+    }
+
+    const QgsZonalStatistics* zonalStatistics;
+    QgsFeatureId id;
+    Rasterizer rasterizer;
+    int offsetX;
+    int offsetY;
+    int nCellsX;
+    int nCellsY;
+    //! Cells of the raster window, row by row
+    QVector<float> cells;
+    FeatureStats stats;
+    bool calculated;
+};
+
+///@endcond
+
 QgsZonalStatistics::QgsZonalStatistics( QgsVectorLayer* polygonLayer, const QString& rasterFile, const QString& attributePrefix, int rasterBand, const Statistics& stats )
     : mRasterFilePath( rasterFile )
     , mRasterBand( rasterBand )
@@ -238,128 +491,163 @@ int QgsZonalStatistics::calculateStatistics( QProgressDialog* p )
   bool statsStoreValueCount = ( mStatistics & QgsZonalStatistics::Minority ) ||
                               ( mStatistics & QgsZonalStatistics::Majority );
 
-  FeatureStats featureStats( statsStoreValues, statsStoreValueCount );
   int featureCounter = 0;
 
   QgsChangedAttributesMap changeMap;
-  while ( fi.nextFeature( f ) )
+  QList<FeatureJob> jobs;
+  qint64 batchCells = 0;
+  bool finished = false;
+  while ( !finished )
   {
-    if ( p )
+    finished = !fi.nextFeature( f );
+    if ( !finished )
     {
-      p->setValue( featureCounter );
-    }
+      if ( p )
+      {
+        p->setValue( featureCounter );
+      }
 
-    if ( p && p->wasCanceled() )
-    {
-      break;
-    }
+      if ( p && p->wasCanceled() )
+      {
+        break;
+      }
 
-    if ( !f.constGeometry() )
-    {
       ++featureCounter;
-      continue;
-    }
-    const QgsGeometry* featureGeometry = f.constGeometry();
+      if ( !f.constGeometry() )
+      {
+        continue;
+      }
+      const QgsGeometry* featureGeometry = f.constGeometry();
 
-    QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
-    if ( featureRect.isEmpty() )
-    {
-      ++featureCounter;
-      continue;
-    }
+      QgsRectangle featureRect = featureGeometry->boundingBox().intersect( &rasterBBox );
+      if ( featureRect.isEmpty() )
+      {
+        continue;
+      }
 
-    int offsetX, offsetY, nCellsX, nCellsY;
-    if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
-    {
-      ++featureCounter;
-      continue;
-    }
+      int offsetX, offsetY, nCellsX, nCellsY;
+      if ( cellInfoForBBox( rasterBBox, featureRect, cellsizeX, cellsizeY, offsetX, offsetY, nCellsX, nCellsY ) != 0 )
+      {
+        continue;
+      }
 
-    //avoid access to cells outside of the raster (may occur because of rounding)
-    if (( offsetX + nCellsX ) > nCellsXGDAL )
-    {
-      nCellsX = nCellsXGDAL - offsetX;
-    }
-    if (( offsetY + nCellsY ) > nCellsYGDAL )
-    {
-      nCellsY = nCellsYGDAL - offsetY;
-    }
+      //avoid access to cells outside of the raster (may occur because of rounding)
+      if (( offsetX + nCellsX ) > nCellsXGDAL )
+      {
+        nCellsX = nCellsXGDAL - offsetX;
+      }
+      if (( offsetY + nCellsY ) > nCellsYGDAL )
+      {
+        nCellsY = nCellsYGDAL - offsetY;
+      }
+      if ( nCellsX <= 0 || nCellsY <= 0 )
+      {
+        continue;
+      }
 
-    statisticsFromMiddlePointTest( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                   rasterBBox, featureStats );
+      FeatureJob job;
+      job.zonalStatistics = this;
+      job.id = f.id();
+      job.offsetX = offsetX;
+      job.offsetY = offsetY;
+      job.nCellsX = nCellsX;
+      job.nCellsY = nCellsY;
+      job.rasterizer = Rasterizer( featureGeometry, rasterBBox.xMinimum() + offsetX * cellsizeX, rasterBBox.yMaximum() - offsetY * cellsizeY,
+                                   cellsizeX, cellsizeY, nCellsX, nCellsY );
+      job.stats = FeatureStats( statsStoreValues, statsStoreValueCount );
+
+      qint64 cells = static_cast< qint64 >( nCellsX ) * nCellsY;
+      if ( cells > MAX_BATCH_CELLS )
+      {
+        calculateLargeFeatureStatistics( rasterBand, job );
+      }
+      else
+      {
+        //read the whole window of the feature at once, the statistics are calculated in parallel
+        job.cells.resize( static_cast< int >( cells ) );
+        readCells( rasterBand, job, 0, nCellsY, job.cells.data() );
+        batchCells += cells;
+      }
+      jobs << job;
 
-    if ( featureStats.count <= 1 )
-    {
-      //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
-      statisticsFromPreciseIntersection( rasterBand, featureGeometry, offsetX, offsetY, nCellsX, nCellsY, cellsizeX, cellsizeY,
-                                         rasterBBox, featureStats );
+      if ( jobs.size() < MAX_BATCH_FEATURES && batchCells < MAX_BATCH_CELLS )
+      {
+        continue;
+      }
     }
 
-    //write the statistics value to the vector data provider
-    QgsAttributeMap changeAttributeMap;
-    if ( mStatistics & QgsZonalStatistics::Count )
-      changeAttributeMap.insert( countIndex, QVariant( featureStats.count ) );
-    if ( mStatistics & QgsZonalStatistics::Sum )
-      changeAttributeMap.insert( sumIndex, QVariant( featureStats.sum ) );
-    if ( featureStats.count > 0 )
+    QtConcurrent::blockingMap( jobs, &FeatureJob::calculate );
+
+    for ( int jobIndex = 0; jobIndex < jobs.size(); ++jobIndex )
     {
-      double mean = featureStats.sum / featureStats.count;
-      if ( mStatistics & QgsZonalStatistics::Mean )
-        changeAttributeMap.insert( meanIndex, QVariant( mean ) );
-      if ( mStatistics & QgsZonalStatistics::Median )
-      {
-        qSort( featureStats.values.begin(), featureStats.values.end() );
-        int size =  featureStats.values.count();
-        bool even = ( size % 2 ) < 1;
-        double medianValue;
-        if ( even )
-        {
-          medianValue = ( featureStats.values.at( size / 2 - 1 ) + featureStats.values.at( size / 2 ) ) / 2;
-        }
-        else //odd
-        {
-          medianValue = featureStats.values.at(( size + 1 ) / 2 - 1 );
-        }
-        changeAttributeMap.insert( medianIndex, QVariant( medianValue ) );
-      }
-      if ( mStatistics & QgsZonalStatistics::StDev )
+      FeatureJob& job = jobs[jobIndex];
+
+      //write the statistics value to the vector data provider
+      QgsAttributeMap changeAttributeMap;
+      if ( mStatistics & QgsZonalStatistics::Count )
+        changeAttributeMap.insert( countIndex, QVariant( job.stats.count ) );
+      if ( mStatistics & QgsZonalStatistics::Sum )
+        changeAttributeMap.insert( sumIndex, QVariant( job.stats.sum ) );
+      if ( job.stats.count > 0 )
       {
-        double sumSquared = 0;
-        for ( int i = 0; i < featureStats.values.count(); ++i )
+        double mean = job.stats.sum / job.stats.count;
+        if ( mStatistics & QgsZonalStatistics::Mean )
+          changeAttributeMap.insert( meanIndex, QVariant( mean ) );
+        if ( mStatistics & QgsZonalStatistics::Median )
         {
-          double diff = featureStats.values.at( i ) - mean;
-          sumSquared += diff * diff;
+          qSort( job.stats.values.begin(), job.stats.values.end() );
+          int size =  job.stats.values.count();
+          bool even = ( size % 2 ) < 1;
+          double medianValue;
+          if ( even )
+          {
+            medianValue = ( job.stats.values.at( size / 2 - 1 ) + job.stats.values.at( size / 2 ) ) / 2;
+          }
+          else //odd
+          {
+            medianValue = job.stats.values.at(( size + 1 ) / 2 - 1 );
+          }
+          changeAttributeMap.insert( medianIndex, QVariant( medianValue ) );
         }
-        double stdev = qPow( sumSquared / featureStats.values.count(), 0.5 );
-        changeAttributeMap.insert( stdevIndex, QVariant( stdev ) );
-      }
-      if ( mStatistics & QgsZonalStatistics::Min )
-        changeAttributeMap.insert( minIndex, QVariant( featureStats.min ) );
-      if ( mStatistics & QgsZonalStatistics::Max )
-        changeAttributeMap.insert( maxIndex, QVariant( featureStats.max ) );
-      if ( mStatistics & QgsZonalStatistics::Range )
-        changeAttributeMap.insert( rangeIndex, QVariant( featureStats.max - featureStats.min ) );
-      if ( mStatistics & QgsZonalStatistics::Minority || mStatistics & QgsZonalStatistics::Majority )
-      {
-        QList<int> vals = featureStats.valueCount.values();
-        qSort( vals.begin(), vals.end() );
-        if ( mStatistics & QgsZonalStatistics::Minority )
+        if ( mStatistics & QgsZonalStatistics::StDev )
         {
-          float minorityKey = featureStats.valueCount.key( vals.first() );
-          changeAttributeMap.insert( minorityIndex, QVariant( minorityKey ) );
+          double sumSquared = 0;
+          for ( int i = 0; i < job.stats.values.count(); ++i )
+          {
+            double diff = job.stats.values.at( i ) - mean;
+            sumSquared += diff * diff;
+          }
+          double stdev = qPow( sumSquared / job.stats.values.count(), 0.5 );
+          changeAttributeMap.insert( stdevIndex, QVariant( stdev ) );
         }
-        if ( mStatistics & QgsZonalStatistics::Majority )
+        if ( mStatistics & QgsZonalStatistics::Min )
+          changeAttributeMap.insert( minIndex, QVariant( job.stats.min ) );
+        if ( mStatistics & QgsZonalStatistics::Max )
+          changeAttributeMap.insert( maxIndex, QVariant( job.stats.max ) );
+        if ( mStatistics & QgsZonalStatistics::Range )
+          changeAttributeMap.insert( rangeIndex, QVariant( job.stats.max - job.stats.min ) );
+        if ( mStatistics & QgsZonalStatistics::Minority || mStatistics & QgsZonalStatistics::Majority )
         {
-          float majKey = featureStats.valueCount.key( vals.last() );
-          changeAttributeMap.insert( majorityIndex, QVariant( majKey ) );
+          QList<int> vals = job.stats.valueCount.values();
+          qSort( vals.begin(), vals.end() );
+          if ( mStatistics & QgsZonalStatistics::Minority )
+          {
+            float minorityKey = job.stats.valueCount.key( vals.first() );
+            changeAttributeMap.insert( minorityIndex, QVariant( minorityKey ) );
+          }
+          if ( mStatistics & QgsZonalStatistics::Majority )
+          {
+            float majKey = job.stats.valueCount.key( vals.last() );
+            changeAttributeMap.insert( majorityIndex, QVariant( majKey ) );
+          }
         }
+        if ( mStatistics & QgsZonalStatistics::Variety )
+          changeAttributeMap.insert( varietyIndex, QVariant( job.stats.valueCount.count() ) );
       }
-      if ( mStatistics & QgsZonalStatistics::Variety )
-        changeAttributeMap.insert( varietyIndex, QVariant( featureStats.valueCount.count() ) );
+      changeMap.insert( job.id, changeAttributeMap );
     }
-
-    changeMap.insert( f.id(), changeAttributeMap );
-    ++featureCounter;
+    jobs.clear();
+    batchCells = 0;
   }
 
   vectorProvider->changeAttributeValues( changeMap );
@@ -407,112 +695,93 @@ int QgsZonalStatistics::cellInfoForBBox( const QgsRectangle& rasterBBox, const Q
   return 0;
 }
 
-void QgsZonalStatistics::statisticsFromMiddlePointTest( void* band, const QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats )
+void QgsZonalStatistics::readCells( void* band, const FeatureJob& job, int firstRow, int nRows, float* cells ) const
 {
-  double cellCenterX, cellCenterY;
-
-  float* scanLine = ( float * ) CPLMalloc( sizeof( float ) * nCellsX );
-  cellCenterY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  stats.reset();
-
-  const GEOSGeometry* polyGeos = poly->asGeos();
-  if ( !polyGeos )
+  if ( GDALRasterIO( band, GF_Read, job.offsetX, job.offsetY + firstRow, job.nCellsX, nRows, cells, job.nCellsX, nRows, GDT_Float32, 0, 0 )
+       != CE_None )
   {
-    return;
+    QgsDebugMsg( "Raster IO Error" );
+    qFill( cells, cells + static_cast< qint64 >( job.nCellsX ) * nRows, std::numeric_limits<float>::quiet_NaN() );
   }
+}
+
+void QgsZonalStatistics::calculateFeatureStatistics( FeatureJob& job ) const
+{
+  job.stats.reset();
+  addCells( job.rasterizer, job.cells.constData(), 0, job.nCellsY, false, job.stats );
 
-  GEOSContextHandle_t geosctxt = QgsGeometry::getGEOSHandler();
-  const GEOSPreparedGeometry* polyGeosPrepared = GEOSPrepare_r( geosctxt, poly->asGeos() );
-  if ( !polyGeosPrepared )
+  if ( job.stats.count <= 1 )
   {
-    return;
+    //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+    job.stats.reset();
+    addCells( job.rasterizer, job.cells.constData(), 0, job.nCellsY, true, job.stats );
   }
 
-  GEOSCoordSequence* cellCenterCoords = nullptr;
-  GEOSGeometry* currentCellCenter = nullptr;
+  job.cells.clear();
+  job.calculated = true;
+}
 
-  for ( int i = 0; i < nCellsY; ++i )
+void QgsZonalStatistics::calculateLargeFeatureStatistics( void* band, FeatureJob& job ) const
+{
+  int blockRows = qMax( 1, static_cast< int >( MAX_BATCH_CELLS / job.nCellsX ) );
+  QVector<float> cells( blockRows * job.nCellsX );
+
+  job.stats.reset();
+  for ( int pass = 0; pass < 2; ++pass )
   {
-    if ( GDALRasterIO( band, GF_Read, pixelOffsetX, pixelOffsetY + i, nCellsX, 1, scanLine, nCellsX, 1, GDT_Float32, 0, 0 )
-         != CPLE_None )
-    {
-      continue;
-    }
-    cellCenterX = rasterBBox.xMinimum() + pixelOffsetX * cellSizeX + cellSizeX / 2;
-    for ( int j = 0; j < nCellsX; ++j )
+    bool precise = pass == 1;
+    for ( int firstRow = 0; firstRow < job.nCellsY; firstRow += blockRows )
     {
-      if ( validPixel( scanLine[j] ) )
-      {
-        GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-        cellCenterCoords = GEOSCoordSeq_create_r( geosctxt, 1, 2 );
-        GEOSCoordSeq_setX_r( geosctxt, cellCenterCoords, 0, cellCenterX );
-        GEOSCoordSeq_setY_r( geosctxt, cellCenterCoords, 0, cellCenterY );
-        currentCellCenter = GEOSGeom_createPoint_r( geosctxt, cellCenterCoords );
-        if ( GEOSPreparedContains_r( geosctxt, polyGeosPrepared, currentCellCenter ) )
-        {
-          stats.addValue( scanLine[j] );
-        }
-      }
-      cellCenterX += cellSizeX;
+      int nRows = qMin( blockRows, job.nCellsY - firstRow );
+      readCells( band, job, firstRow, nRows, cells.data() );
+      addCells( job.rasterizer, cells.constData(), firstRow, nRows, precise, job.stats );
     }
-    cellCenterY -= cellSizeY;
+
+    if ( job.stats.count > 1 )
+      break;
+
+    //the cell resolution is probably larger than the polygon area. We switch to precise pixel - polygon intersection in this case
+    job.stats.reset();
   }
-  GEOSGeom_destroy_r( geosctxt, currentCellCenter );
-  CPLFree( scanLine );
-  GEOSPreparedGeom_destroy_r( geosctxt, polyGeosPrepared );
+  job.calculated = true;
 }
 
-void QgsZonalStatistics::statisticsFromPreciseIntersection( void* band, const QgsGeometry* poly, int pixelOffsetX,
-    int pixelOffsetY, int nCellsX, int nCellsY, double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats &stats )
+void QgsZonalStatistics::addCells( const Rasterizer& rasterizer, const float* cells, int firstRow, int nRows, bool precise, FeatureStats& stats ) const
 {
-  stats.reset();
+  int nColumns = rasterizer.columnCount();
+  QVector<int> spans;
+  QVector<double> fractions( precise ? nColumns : 0 );
 
-  double currentY = rasterBBox.yMaximum() - pixelOffsetY * cellSizeY - cellSizeY / 2;
-  float* pixelData = ( float * ) CPLMalloc( sizeof( float ) );
-  QgsGeometry* pixelRectGeometry = nullptr;
-
-  double hCellSizeX = cellSizeX / 2.0;
-  double hCellSizeY = cellSizeY / 2.0;
-  double pixelArea = cellSizeX * cellSizeY;
-  double weight = 0;
-
-  for ( int row = 0; row < nCellsY; ++row )
+  for ( int i = 0; i < nRows; ++i )
   {
-    double currentX = rasterBBox.xMinimum() + cellSizeX / 2.0 + pixelOffsetX * cellSizeX;
-    for ( int col = 0; col < nCellsX; ++col )
+    const float* scanLine = cells + static_cast< qint64 >( i ) * nColumns;
+    if ( precise )
     {
-      if ( GDALRasterIO( band, GF_Read, pixelOffsetX + col, pixelOffsetY + row, nCellsX, 1, pixelData, 1, 1, GDT_Float32, 0, 0 ) != CE_None )
+      rasterizer.coverage( firstRow + i, fractions.data() );
+      for ( int j = 0; j < nColumns; ++j )
       {
-        QgsDebugMsg( "Raster IO Error" );
+        if ( fractions.at( j ) > 0 && validPixel( scanLine[j] ) )
+        {
+          stats.addValue( scanLine[j], fractions.at( j ) );
+        }
       }
-
-      if ( !validPixel( *pixelData ) )
-        continue;
-
-      pixelRectGeometry = QgsGeometry::fromRect( QgsRectangle( currentX - hCellSizeX, currentY - hCellSizeY, currentX + hCellSizeX, currentY + hCellSizeY ) );
-      if ( pixelRectGeometry )
+    }
+    else
+    {
+      spans.clear();
+      rasterizer.centerSpans( firstRow + i, spans );
+      for ( int k = 0; k + 1 < spans.size(); k += 2 )
       {
-        //intersection
-        QgsGeometry *intersectGeometry = pixelRectGeometry->intersection( poly );
-        if ( intersectGeometry )
+        for ( int j = spans.at( k ); j < spans.at( k + 1 ); ++j )
         {
-          double intersectionArea = intersectGeometry->area();
-          if ( intersectionArea >= 0.0 )
+          if ( validPixel( scanLine[j] ) )
           {
-            weight = intersectionArea / pixelArea;
-            stats.addValue( *pixelData, weight );
+            stats.addValue( scanLine[j] );
           }
-          delete intersectGeometry;
         }
-        delete pixelRectGeometry;
-        pixelRectGeometry = nullptr;
       }
-      currentX += cellSizeX;
     }
-    currentY -= cellSizeY;
   }
-  CPLFree( pixelData );
 }
 
 bool QgsZonalStatistics::validPixel( float value ) const
@@ -105,13 +105,21 @@ class ANALYSIS_EXPORT QgsZonalStatistics
     int cellInfoForBBox( const QgsRectangle& rasterBBox, const QgsRectangle& featureBBox, double cellSizeX, double cellSizeY,
                          int& offsetX, int& offsetY, int& nCellsX, int& nCellsY ) const;
 
-    /** Returns statistics by considering the pixels where the center point is within the polygon (fast)*/
-    void statisticsFromMiddlePointTest( void* band, const QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                        double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats );
+    class Rasterizer;
+    class FeatureJob;
 
-    /** Returns statistics with precise pixel - polygon intersection test (slow) */
-    void statisticsFromPreciseIntersection( void* band, const QgsGeometry* poly, int pixelOffsetX, int pixelOffsetY, int nCellsX, int nCellsY,
-                                            double cellSizeX, double cellSizeY, const QgsRectangle& rasterBBox, FeatureStats& stats );
+    /** Reads a block of rows of the raster window of a feature. Cells of rows which cannot be read are set to NaN*/
+    void readCells( void* band, const FeatureJob& job, int firstRow, int nRows, float* cells ) const;
+
+    /** Calculates the statistics of a feature whose raster window has been read into the job*/
+    void calculateFeatureStatistics( FeatureJob& job ) const;
+
+    /** Calculates the statistics of a feature with a large raster window, reading it in blocks of rows*/
+    void calculateLargeFeatureStatistics( void* band, FeatureJob& job ) const;
+
+    /** Adds the cells of a block of rows to the statistics.
+      @param precise weight the cells with the fraction covered by the polygon instead of testing the cell centers*/
+    void addCells( const Rasterizer& rasterizer, const float* cells, int firstRow, int nRows, bool precise, FeatureStats& stats ) const;
 
     /** Tests whether a pixel's value should be included in the result*/
     bool validPixel( float value ) const;
@@ -93,7 +93,7 @@ void CostCalculator::addObstacleCostPenalty( LabelPosition* lp, FeaturePart* obs
   lp->setCost( lp->cost() + obstacleCost );
 }
 
-void CostCalculator::setPolygonCandidatesCost( int nblp, QList< LabelPosition* >& lPos, RTree<FeaturePart*, double, 2, double> *obstacles, double bbx[4], double bby[4] )
+void CostCalculator::setPolygonCandidatesCost( int nblp, QList< LabelPosition* >& lPos, PackedRTree<FeaturePart*> *obstacles, double bbx[4], double bby[4] )
 {
   double normalizer;
   // compute raw cost
@@ -146,7 +146,7 @@ void CostCalculator::setPolygonCandidatesCost( int nblp, QList< LabelPosition* >
   }
 }
 
-void CostCalculator::setCandidateCostFromPolygon( LabelPosition* lp, RTree <FeaturePart*, double, 2, double> *obstacles, double bbx[4], double bby[4] )
+void CostCalculator::setCandidateCostFromPolygon( LabelPosition* lp, PackedRTree<FeaturePart*> *obstacles, double bbx[4], double bby[4] )
 {
   double amin[2];
   double amax[2];
@@ -173,7 +173,7 @@ void CostCalculator::setCandidateCostFromPolygon( LabelPosition* lp, RTree <Feat
   delete pCost;
 }
 
-int CostCalculator::finalizeCandidatesCosts( Feats* feat, int max_p, RTree <FeaturePart*, double, 2, double> *obstacles, double bbx[4], double bby[4] )
+int CostCalculator::finalizeCandidatesCosts( Feats* feat, int max_p, PackedRTree<FeaturePart*> *obstacles, double bbx[4], double bby[4] )
 {
   // If candidates list is smaller than expected
   if ( max_p > feat->lPos.count() )
@@ -17,6 +17,7 @@
 
 #include <QList>
 #include "rtree.hpp"
+#include "packedrtree.h"
 
 /**
  * \class pal::CostCalculator
@@ -35,13 +36,13 @@ namespace pal
       /** Increase candidate's cost according to its collision with passed feature */
       static void addObstacleCostPenalty( LabelPosition* lp, pal::FeaturePart *obstacle );
 
-      static void setPolygonCandidatesCost( int nblp, QList< LabelPosition* >& lPos, RTree<pal::FeaturePart*, double, 2, double> *obstacles, double bbx[4], double bby[4] );
+      static void setPolygonCandidatesCost( int nblp, QList< LabelPosition* >& lPos, PackedRTree<pal::FeaturePart*> *obstacles, double bbx[4], double bby[4] );
 
       /** Set cost to the smallest distance between lPos's centroid and a polygon stored in geoetry field */
-      static void setCandidateCostFromPolygon( LabelPosition* lp, RTree<pal::FeaturePart *, double, 2, double> *obstacles, double bbx[4], double bby[4] );
+      static void setCandidateCostFromPolygon( LabelPosition* lp, PackedRTree<pal::FeaturePart*> *obstacles, double bbx[4], double bby[4] );
 
       /** Sort candidates by costs, skip the worse ones, evaluate polygon candidates */
-      static int finalizeCandidatesCosts( Feats* feat, int max_p, RTree<pal::FeaturePart *, double, 2, double> *obstacles, double bbx[4], double bby[4] );
+      static int finalizeCandidatesCosts( Feats* feat, int max_p, PackedRTree<pal::FeaturePart*> *obstacles, double bbx[4], double bby[4] );
 
       /** Sorts label candidates in ascending order of cost
        */
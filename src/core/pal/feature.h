@@ -122,7 +122,7 @@ namespace pal
        * \param bboxMin min values of the map extent
        * \param bboxMax max values of the map extent
        * \param mapShape generate candidates for this spatial entity
-       * \param candidates index for candidates
+       * \param candidates index for candidates, may be nullptr if the candidates are indexed by the caller
        * \return the number of candidates generated in lPos
        */
       int createCandidates( QList<LabelPosition *> &lPos, double bboxMin[2], double bboxMax[2], PointSet *mapShape, RTree<LabelPosition*, double, 2, double>* candidates );
@@ -34,6 +34,7 @@
 #include "feature.h"
 #include "geomfunction.h"
 #include "util.h"
+#include "packedrtree.h"
 #include "qgslabelingenginev2.h"
 
 #include <cmath>
@@ -56,8 +57,8 @@ Layer::Layer( QgsAbstractLabelProvider* provider, const QString& name, QgsPalLay
     , mMergeLines( false )
     , mUpsidedownLabels( Upright )
 {
-  mFeatureIndex = new RTree<FeaturePart*, double, 2, double>();
-  mObstacleIndex = new RTree<FeaturePart*, double, 2, double>();
+  mFeatureIndex = new PackedRTree<FeaturePart*>();
+  mObstacleIndex = new PackedRTree<FeaturePart*>();
 
   if ( defaultPriority < 0.0001 )
     mDefaultPriority = 0.0001;
@@ -289,16 +290,9 @@ bool Layer::registerFeature( QgsLabelFeature* lf )
 
 void Layer::addFeaturePart( FeaturePart* fpart, const QString& labelText )
 {
-  double bmin[2];
-  double bmax[2];
-  fpart->getBoundingBox( bmin, bmax );
-
-  // add to list of layer's feature parts
+  // add to list of layer's feature parts, the r-tree is built from the list by buildIndexes()
   mFeatureParts << fpart;
 
-  // add to r-tree for fast spatial access
-  mFeatureIndex->Insert( bmin, bmax, fpart );
-
   // add to hashtable with equally named feature parts
   if ( mMergeLines && !labelText.isEmpty() )
   {
@@ -319,16 +313,31 @@ void Layer::addFeaturePart( FeaturePart* fpart, const QString& labelText )
 }
 
 void Layer::addObstaclePart( FeaturePart* fpart )
+{
+  // add to list of layer's obstacle parts, the r-tree is built from the list by buildIndexes()
+  mObstacleParts.append( fpart );
+}
+
+void Layer::buildIndexes()
 {
   double bmin[2];
   double bmax[2];
-  fpart->getBoundingBox( bmin, bmax );
 
-  // add to list of layer's feature parts
-  mObstacleParts.append( fpart );
+  mFeatureIndex->RemoveAll();
+  Q_FOREACH ( FeaturePart* fpart, mFeatureParts )
+  {
+    fpart->getBoundingBox( bmin, bmax );
+    mFeatureIndex->Insert( bmin, bmax, fpart );
+  }
+  mFeatureIndex->build();
 
-  // add to obstacle r-tree
-  mObstacleIndex->Insert( bmin, bmax, fpart );
+  mObstacleIndex->RemoveAll();
+  Q_FOREACH ( FeaturePart* fpart, mObstacleParts )
+  {
+    fpart->getBoundingBox( bmin, bmax );
+    mObstacleIndex->Insert( bmin, bmax, fpart );
+  }
+  mObstacleIndex->build();
 }
 
 static FeaturePart* _findConnectedPart( FeaturePart* partCheck, QLinkedList<FeaturePart*>* otherParts )
@@ -370,24 +379,9 @@ void Layer::joinConnectedFeatures()
       FeaturePart* otherPart = _findConnectedPart( partCheck, parts );
       if ( otherPart )
       {
-        // remove partCheck from r-tree
-        double checkpartBMin[2], checkpartBMax[2];
-        partCheck->getBoundingBox( checkpartBMin, checkpartBMax );
-
-        double otherPartBMin[2], otherPartBMax[2];
-        otherPart->getBoundingBox( otherPartBMin, otherPartBMax );
-
         // merge points from partCheck to p->item
         if ( otherPart->mergeWithFeaturePart( partCheck ) )
         {
-          // remove the parts we are joining from the index
-          mFeatureIndex->Remove( checkpartBMin, checkpartBMax, partCheck );
-          mFeatureIndex->Remove( otherPartBMin, otherPartBMax, otherPart );
-
-          // reinsert merged line to r-tree (probably not needed)
-          otherPart->getBoundingBox( otherPartBMin, otherPartBMax );
-          mFeatureIndex->Insert( otherPartBMin, otherPartBMax, otherPart );
-
           mConnectedFeaturesIds.insert( partCheck->featureId(), connectedFeaturesId );
           mConnectedFeaturesIds.insert( otherPart->featureId(), connectedFeaturesId );
 
@@ -429,10 +423,6 @@ void Layer::chopFeaturesAtRepeatDistance()
     {
       chopInterval *= ceil( fpart->getLabelWidth() / fpart->repeatDistance() );
 
-      double bmin[2], bmax[2];
-      fpart->getBoundingBox( bmin, bmax );
-      mFeatureIndex->Remove( bmin, bmax, fpart );
-
       const GEOSCoordSequence *cs = GEOSGeom_getCoordSeq_r( geosctxt, geom );
 
       // get number of points
@@ -486,8 +476,6 @@ void Layer::chopFeaturesAtRepeatDistance()
         GEOSGeometry* newgeom = GEOSGeom_createLineString_r( geosctxt, cooSeq );
         FeaturePart* newfpart = new FeaturePart( fpart->feature(), newgeom );
         newFeatureParts.append( newfpart );
-        newfpart->getBoundingBox( bmin, bmax );
-        mFeatureIndex->Insert( bmin, bmax, newfpart );
         part.clear();
         part.push_back( p );
       }
@@ -503,8 +491,6 @@ void Layer::chopFeaturesAtRepeatDistance()
       GEOSGeometry* newgeom = GEOSGeom_createLineString_r( geosctxt, cooSeq );
       FeaturePart* newfpart = new FeaturePart( fpart->feature(), newgeom );
       newFeatureParts.append( newfpart );
-      newfpart->getBoundingBox( bmin, bmax );
-      mFeatureIndex->Insert( bmin, bmax, newfpart );
       delete fpart;
     }
     else
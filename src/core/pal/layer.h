@@ -42,7 +42,7 @@ namespace pal
 {
 
   /// @cond PRIVATE
-  template<class DATATYPE, class ELEMTYPE, int NUMDIMS, class ELEMTYPEREAL, int TMAXNODES, int TMINNODES> class RTree;
+  template<class DATATYPE> class PackedRTree;
   /// @endcond
 
   class FeaturePart;
@@ -239,6 +239,11 @@ namespace pal
       /** Chop layer features at the repeat distance **/
       void chopFeaturesAtRepeatDistance();
 
+      /** Packs the spatial indexes of the feature and obstacle parts. Must be called after
+       * the parts have been joined and chopped, and before the indexes are searched.
+       */
+      void buildIndexes();
+
     protected:
       QgsAbstractLabelProvider* mProvider; // not owned
       QString mName;
@@ -268,12 +273,12 @@ namespace pal
       UpsideDownLabels mUpsidedownLabels;
 
       // indexes (spatial and id)
-      RTree<FeaturePart*, double, 2, double, 8, 4> *mFeatureIndex;
+      PackedRTree<FeaturePart*> *mFeatureIndex;
       //! Lookup table of label features (owned by the label feature provider that created them)
       QHash< QgsFeatureId, QgsLabelFeature*> mHashtable;
 
       //obstacle r-tree
-      RTree<FeaturePart*, double, 2, double, 8, 4> *mObstacleIndex;
+      PackedRTree<FeaturePart*> *mObstacleIndex;
 
       QHash< QString, QLinkedList<FeaturePart*>* > mConnectedHashtable;
       QStringList mConnectedTexts;
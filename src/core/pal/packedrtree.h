@@ -0,0 +1,309 @@
+/***************************************************************************
+  packedrtree.h - PackedRTree
+  ---------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef PAL_PACKEDRTREE_H
+#define PAL_PACKEDRTREE_H
+
+#include <QVector>
+#include <QVarLengthArray>
+#include <QtAlgorithms>
+#include <cfloat>
+#include <cmath>
+
+/// @cond PRIVATE
+
+namespace pal
+{
+
+  /** \ingroup core
+   * \brief Static R-tree which is bulk loaded once all items have been inserted.
+   *
+   * The items are sorted along a Hilbert curve through the centers of their bounding
+   * boxes and packed into full nodes, level by level. The bounding boxes of all nodes
+   * are kept in one array per coordinate, so testing the children of a node reads a
+   * few contiguous cache lines and no node is allocated on its own.
+   *
+   * Searching uses the same callback interface as RTree. Unlike RTree, items can not be
+   * removed and build() must be called before the tree is searched. Once built, the tree
+   * may be searched by several threads at a time.
+   *
+   * \note not available in Python bindings
+   * \note added in QGIS 2.18
+   */
+  template<class DATATYPE>
+  class PackedRTree
+  {
+    public:
+
+      //! Maximum number of children of a node
+      static const int NODE_SIZE = 16;
+
+      PackedRTree()
+          : mItemCount( 0 )
+          , mBuilt( false )
+      {}
+
+      /** Adds an item to the tree. Items can only be added before build() is called.
+       * @param a_min min coordinates of the bounding box of the item
+       * @param a_max max coordinates of the bounding box of the item
+       * @param a_dataId item
+       */
+      void Insert( const double a_min[2], const double a_max[2], const DATATYPE& a_dataId )
+      {
+        Q_ASSERT( !mBuilt );
+        mMinX << a_min[0];
+        mMinY << a_min[1];
+        mMaxX << a_max[0];
+        mMaxY << a_max[1];
+        mData << a_dataId;
+        ++mItemCount;
+      }
+
+      //! Packs the inserted items into the tree
+      void build();
+
+      /** Calls a_resultCallback for every item whose bounding box intersects the given rectangle,
+       * until the callback returns false.
+       * @returns number of items found
+       */
+      int Search( const double a_min[2], const double a_max[2], bool a_resultCallback( DATATYPE a_data, void* a_context ), void* a_context ) const;
+
+      //! Removes all items
+      void RemoveAll()
+      {
+        mMinX.clear();
+        mMinY.clear();
+        mMaxX.clear();
+        mMaxY.clear();
+        mData.clear();
+        mChild.clear();
+        mLevelBounds.clear();
+        mItemCount = 0;
+        mBuilt = false;
+      }
+
+      //! Returns the number of items
+      int Count() const { return mItemCount; }
+
+    private:
+
+      //! Orders items by their position on the Hilbert curve, ties by insertion order
+      class HilbertLessThan
+      {
+        public:
+          explicit HilbertLessThan( const QVector<quint32>& values )
+              : mValues( values )
+          {}
+
+          bool operator()( int a, int b ) const
+          {
+            return mValues.at( a ) < mValues.at( b ) || ( mValues.at( a ) == mValues.at( b ) && a < b );
+          }
+
+        private:
+          const QVector<quint32>& mValues;
+      };
+
+      //! Returns the distance along a Hilbert curve of order 16 of a grid cell
+      static quint32 hilbertIndex( quint32 x, quint32 y )
+      {
+        const quint32 n = 1 << 16;
+        quint32 d = 0;
+        for ( quint32 s = n / 2; s > 0; s /= 2 )
+        {
+          quint32 rx = ( x & s ) > 0;
+          quint32 ry = ( y & s ) > 0;
+          d += s * s * (( 3 * rx ) ^ ry );
+
+          // rotate the quadrant
+          if ( ry == 0 )
+          {
+            if ( rx == 1 )
+            {
+              x = n - 1 - x;
+              y = n - 1 - y;
+            }
+            qSwap( x, y );
+          }
+        }
+        return d;
+      }
+
+      template<class T> static void reorder( QVector<T>& values, const QVector<int>& order )
+      {
+        QVector<T> sorted( order.count() );
+        for ( int i = 0; i < order.count(); ++i )
+          sorted[i] = values.at( order.at( i ) );
+        values = sorted;
+      }
+
+      int mItemCount;
+      bool mBuilt;
+      //! bounding boxes of the items followed by the nodes of every level, the root is the last one
+      QVector<double> mMinX;
+      QVector<double> mMinY;
+      QVector<double> mMaxX;
+      QVector<double> mMaxY;
+      //! items, in the order of the leaf level
+      QVector<DATATYPE> mData;
+      //! index of the first child of every node, unused for items
+      QVector<int> mChild;
+      //! index past the last node of every level, starting with the items
+      QVector<int> mLevelBounds;
+  };
+
+  template<class DATATYPE>
+  void PackedRTree<DATATYPE>::build()
+  {
+    mBuilt = true;
+    mChild.clear();
+    mLevelBounds.clear();
+    if ( mItemCount == 0 )
+      return;
+
+    // extent of the item centers
+    double minX = DBL_MAX, minY = DBL_MAX, maxX = -DBL_MAX, maxY = -DBL_MAX;
+    for ( int i = 0; i < mItemCount; ++i )
+    {
+      double cx = 0.5 * ( mMinX.at( i ) + mMaxX.at( i ) );
+      double cy = 0.5 * ( mMinY.at( i ) + mMaxY.at( i ) );
+      minX = qMin( minX, cx );
+      minY = qMin( minY, cy );
+      maxX = qMax( maxX, cx );
+      maxY = qMax( maxY, cy );
+    }
+
+    const double hilbertMax = ( 1 << 16 ) - 1;
+    double scaleX = maxX > minX ? hilbertMax / ( maxX - minX ) : 0;
+    double scaleY = maxY > minY ? hilbertMax / ( maxY - minY ) : 0;
+
+    QVector<quint32> hilbertValues( mItemCount );
+    QVector<int> order( mItemCount );
+    for ( int i = 0; i < mItemCount; ++i )
+    {
+      double cx = 0.5 * ( mMinX.at( i ) + mMaxX.at( i ) );
+      double cy = 0.5 * ( mMinY.at( i ) + mMaxY.at( i ) );
+      quint32 x = static_cast< quint32 >( qBound( 0.0, std::floor(( cx - minX ) * scaleX ), hilbertMax ) );
+      quint32 y = static_cast< quint32 >( qBound( 0.0, std::floor(( cy - minY ) * scaleY ), hilbertMax ) );
+      hilbertValues[i] = hilbertIndex( x, y );
+      order[i] = i;
+    }
+    qSort( order.begin(), order.end(), HilbertLessThan( hilbertValues ) );
+
+    reorder( mMinX, order );
+    reorder( mMinY, order );
+    reorder( mMaxX, order );
+    reorder( mMaxY, order );
+    reorder( mData, order );
+
+    // number of nodes of every level
+    int nodeCount = mItemCount;
+    int levelCount = mItemCount;
+    mLevelBounds << nodeCount;
+    do
+    {
+      levelCount = ( levelCount + NODE_SIZE - 1 ) / NODE_SIZE;
+      nodeCount += levelCount;
+      mLevelBounds << nodeCount;
+    }
+    while ( levelCount > 1 );
+
+    mMinX.resize( nodeCount );
+    mMinY.resize( nodeCount );
+    mMaxX.resize( nodeCount );
+    mMaxY.resize( nodeCount );
+    mChild.fill( -1, nodeCount );
+
+    // every node covers NODE_SIZE consecutive entries of the level below
+    int start = 0;
+    for ( int level = 0; level < mLevelBounds.count() - 1; ++level )
+    {
+      int end = mLevelBounds.at( level );
+      int node = end;
+      for ( int i = start; i < end; i += NODE_SIZE, ++node )
+      {
+        int last = qMin( i + NODE_SIZE, end );
+        double nodeMinX = mMinX.at( i ), nodeMinY = mMinY.at( i ), nodeMaxX = mMaxX.at( i ), nodeMaxY = mMaxY.at( i );
+        for ( int j = i + 1; j < last; ++j )
+        {
+          nodeMinX = qMin( nodeMinX, mMinX.at( j ) );
+          nodeMinY = qMin( nodeMinY, mMinY.at( j ) );
+          nodeMaxX = qMax( nodeMaxX, mMaxX.at( j ) );
+          nodeMaxY = qMax( nodeMaxY, mMaxY.at( j ) );
+        }
+        mMinX[node] = nodeMinX;
+        mMinY[node] = nodeMinY;
+        mMaxX[node] = nodeMaxX;
+        mMaxY[node] = nodeMaxY;
+        mChild[node] = i;
+      }
+      start = end;
+    }
+  }
+
+  template<class DATATYPE>
+  int PackedRTree<DATATYPE>::Search( const double a_min[2], const double a_max[2], bool a_resultCallback( DATATYPE a_data, void* a_context ), void* a_context ) const
+  {
+    Q_ASSERT( mBuilt );
+    if ( !mBuilt || mItemCount == 0 )
+      return 0;
+
+    const double* minX = mMinX.constData();
+    const double* minY = mMinY.constData();
+    const double* maxX = mMaxX.constData();
+    const double* maxY = mMaxY.constData();
+
+    int found = 0;
+    int level = mLevelBounds.count() - 1;
+    int nodeIndex = mLevelBounds.at( level ) - 1;
+    QVarLengthArray<int, 128> stack;
+
+    Q_FOREVER
+    {
+      int end = qMin( nodeIndex + NODE_SIZE, mLevelBounds.at( level ) );
+      for ( int pos = nodeIndex; pos < end; ++pos )
+      {
+        if ( a_min[0] > maxX[pos] || a_max[0] < minX[pos] || a_min[1] > maxY[pos] || a_max[1] < minY[pos] )
+          continue;
+
+        if ( level == 0 )
+        {
+          ++found;
+          if ( a_resultCallback && !a_resultCallback( mData.at( pos ), a_context ) )
+            return found;
+        }
+        else
+        {
+          stack.append( mChild.at( pos ) );
+          stack.append( level - 1 );
+        }
+      }
+
+      if ( stack.isEmpty() )
+        break;
+
+      level = stack[stack.count() - 1];
+      nodeIndex = stack[stack.count() - 2];
+      stack.resize( stack.count() - 2 );
+    }
+
+    return found;
+  }
+
+} // namespace pal
+
+///@endcond
+
+#endif // PAL_PACKEDRTREE_H
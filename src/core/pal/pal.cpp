@@ -33,6 +33,7 @@
 #include "palexception.h"
 #include "palstat.h"
 #include "rtree.hpp"
+#include "packedrtree.h"
 #include "costcalculator.h"
 #include "feature.h"
 #include "geomfunction.h"
@@ -41,13 +42,68 @@
 #include "pointset.h"
 #include "internalexception.h"
 #include "util.h"
+#include "qgsgeos.h"
+#include "qgslogger.h"
 #include <cfloat>
+#include <cstdarg>
+#include <cstdio>
+#include <QThreadStorage>
+#include <QTime>
+#include <QtConcurrentMap>
 
 using namespace pal;
 
+/// @cond PRIVATE
+
+static void throwPalGEOSException( const char *fmt, ... )
+{
+  va_list ap;
+  char buffer[1024];
+
+  va_start( ap, fmt );
+  vsnprintf( buffer, sizeof buffer, fmt, ap );
+  va_end( ap );
+
+  throw GEOSException( QString::fromUtf8( buffer ) );
+}
+
+static void ignorePalGEOSNotice( const char *fmt, ... )
+{
+  Q_UNUSED( fmt );
+}
+
+class PalGEOSContext
+{
+  public:
+    GEOSContextHandle_t ctxt;
+
+    PalGEOSContext()
+    {
+      ctxt = initGEOS_r( ignorePalGEOSNotice, throwPalGEOSException );
+    }
+
+    ~PalGEOSContext()
+    {
+      finishGEOS_r( ctxt );
+    }
+
+  private:
+
+    PalGEOSContext( const PalGEOSContext& rh );
+    PalGEOSContext& operator=( const PalGEOSContext& rh );
+};
+
+static QThreadStorage<PalGEOSContext*> sGeosContexts;
+
+///@endcond
+
 GEOSContextHandle_t pal::geosContext()
 {
-  return QgsGeometry::getGEOSHandler();
+  // candidates are generated and problems are solved by several threads at a time,
+  // so every thread gets its own context. Geometries may be shared between contexts.
+  if ( !sGeosContexts.hasLocalData() )
+    sGeosContexts.setLocalData( new PalGEOSContext() );
+  return sGeosContexts.localData()->ctxt;
 }
 
 Pal::Pal()
@@ -118,14 +174,62 @@ Layer* Pal::addLayer( QgsAbstractLabelProvider* provider, const QString& layerNa
   return layer;
 }
 
+/// @cond PRIVATE
+
+/*
+ * Generates the candidates of a single feature part. Candidates of
+ * different parts are generated concurrently, the results are collected
+ * in the order of the parts so that the problem does not depend on the
+ * scheduling of the threads.
+ */
+class FeatureCandidates
+{
+  public:
+    FeatureCandidates( FeaturePart* part, int layerIndex, const double bboxMin[2], const double bboxMax[2], Pal* pal )
+        : part( part )
+        , layerIndex( layerIndex )
+        , priority( 0.0 )
+        , pal( pal )
+    {
+      this->bboxMin[0] = bboxMin[0];
+      this->bboxMin[1] = bboxMin[1];
+      this->bboxMax[0] = bboxMax[0];
+      this->bboxMax[1] = bboxMax[1];
+    }
+
+    void create()
+    {
+      if ( pal->isCancelled() )
+        return;
+
+      if ( part->createCandidates( lPos, bboxMin, bboxMax, part, nullptr ) )
+        priority = part->calculatePriority();
+      else
+      {
+        qDeleteAll( lPos );
+        lPos.clear();
+      }
+    }
+
+    FeaturePart* part;
+    int layerIndex;
+    double bboxMin[2];
+    double bboxMax[2];
+    QList< LabelPosition* > lPos;
+    double priority;
+    Pal* pal;
+};
+
+///@endcond
+
 typedef struct _featCbackCtx
 {
-  Layer *layer;
-  QLinkedList<Feats*>* fFeats;
-  RTree<FeaturePart*, double, 2, double> *obstacles;
-  RTree<LabelPosition*, double, 2, double> *candidates;
+  int layerIndex;
+  QList<FeatureCandidates>* parts;
+  PackedRTree<FeaturePart*> *obstacles;
   double bbox_min[2];
   double bbox_max[2];
+  Pal* pal;
 } FeatCallBackCtx;
 
 
@@ -152,30 +256,15 @@ bool extractFeatCallback( FeaturePart *ft_ptr, void *ctx )
     }
   }
 
-  // generate candidates for the feature part
-  QList< LabelPosition* > lPos;
-  if ( ft_ptr->createCandidates( lPos, context->bbox_min, context->bbox_max, ft_ptr, context->candidates ) )
-  {
-    // valid features are added to fFeats
-    Feats *ft = new Feats();
-    ft->feature = ft_ptr;
-    ft->shape = nullptr;
-    ft->lPos = lPos;
-    ft->priority = ft_ptr->calculatePriority();
-    context->fFeats->append( ft );
-  }
-  else
-  {
-    // Others are deleted
-    qDeleteAll( lPos );
-  }
+  // candidates for the feature part are generated later
+  context->parts->append( FeatureCandidates( ft_ptr, context->layerIndex, context->bbox_min, context->bbox_max, context->pal ) );
 
   return true;
 }
 
 typedef struct _obstaclebackCtx
 {
-  RTree<FeaturePart*, double, 2, double> *obstacles;
+  PackedRTree<FeaturePart*> *obstacles;
   int obstacleCount;
 } ObstacleCallBackCtx;
 
@@ -198,14 +287,14 @@ bool extractObstaclesCallback( FeaturePart *ft_ptr, void *ctx )
 
 typedef struct _filterContext
 {
-  RTree<LabelPosition*, double, 2, double> *cdtsIndex;
+  PackedRTree<LabelPosition*> *cdtsIndex;
   Pal* pal;
 } FilterContext;
 
 bool filteringCallback( FeaturePart *featurePart, void *ctx )
 {
 
-  RTree<LabelPosition*, double, 2, double> *cdtsIndex = ( reinterpret_cast< FilterContext* >( ctx ) )->cdtsIndex;
+  PackedRTree<LabelPosition*> *cdtsIndex = ( reinterpret_cast< FilterContext* >( ctx ) )->cdtsIndex;
   Pal* pal = ( reinterpret_cast< FilterContext* >( ctx ) )->pal;
 
   if ( pal->isCancelled() )
@@ -224,8 +313,8 @@ bool filteringCallback( FeaturePart *featurePart, void *ctx )
 
 Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, double phi_max )
 {
-  // to store obstacles
-  RTree<FeaturePart*, double, 2, double> *obstacles = new RTree<FeaturePart*, double, 2, double>();
+  // to store obstacles, packed once all layers have been extracted
+  PackedRTree<FeaturePart*> *obstacles = new PackedRTree<FeaturePart*>();
 
   Problem *prob = new Problem();
 
@@ -249,11 +338,13 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
   prob->pal = this;
 
   QLinkedList<Feats*> *fFeats = new QLinkedList<Feats*>;
+  QList<FeatureCandidates> parts;
 
   FeatCallBackCtx context;
-  context.fFeats = fFeats;
+  context.layerIndex = 0;
+  context.parts = &parts;
   context.obstacles = obstacles;
-  context.candidates = prob->candidates;
+  context.pal = this;
   context.bbox_min[0] = amin[0];
   context.bbox_min[1] = amin[1];
   context.bbox_max[0] = amax[0];
@@ -265,10 +356,17 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
 
   // first step : extract features from layers
 
-  int previousFeatureCount = 0;
   int previousObstacleCount = 0;
 
-  QStringList layersWithFeaturesInBBox;
+  QList<Layer*> extractedLayers;
+  QList<bool> layerHasObstacles;
+
+  // time spent building the packed indexes, extracting the features and obstacles from them
+  // and filtering the candidates against the obstacles (including the callbacks), reported in the debug log
+  QTime indexTime;
+  int indexBuildTime = 0;
+  int extractTime = 0;
+  int filterTime = 0;
 
   mMutex.lock();
   Q_FOREACH ( Layer* layer, mLayers )
@@ -291,23 +389,73 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
 
     layer->mMutex.lock();
 
-    // find features within bounding box and generate candidates list
-    context.layer = layer;
+    indexTime.start();
+    layer->buildIndexes();
+    indexBuildTime += indexTime.restart();
+
+    // find features within bounding box
+    context.layerIndex = extractedLayers.count();
     layer->mFeatureIndex->Search( amin, amax, extractFeatCallback, static_cast< void* >( &context ) );
     // find obstacles within bounding box
     layer->mObstacleIndex->Search( amin, amax, extractObstaclesCallback, static_cast< void* >( &obstacleContext ) );
+    extractTime += indexTime.elapsed();
 
     layer->mMutex.unlock();
 
-    if ( context.fFeats->size() - previousFeatureCount > 0 || obstacleContext.obstacleCount > previousObstacleCount )
-    {
-      layersWithFeaturesInBBox << layer->name();
-    }
-    previousFeatureCount = context.fFeats->size();
+    extractedLayers << layer;
+    layerHasObstacles << ( obstacleContext.obstacleCount > previousObstacleCount );
     previousObstacleCount = obstacleContext.obstacleCount;
   }
   mMutex.unlock();
 
+  indexTime.start();
+  obstacles->build();
+  indexBuildTime += indexTime.elapsed();
+
+  // generate candidates for all feature parts, candidate generation only reads the
+  // layers and the part itself
+  QtConcurrent::blockingMap( parts, &FeatureCandidates::create );
+
+  QList<bool> layerHasFeatures;
+  for ( i = 0; i < extractedLayers.count(); ++i )
+    layerHasFeatures << false;
+
+  // all candidates, only used for filtering them against the obstacles
+  PackedRTree<LabelPosition*> allCandidates;
+
+  for ( i = 0; i < parts.count(); ++i )
+  {
+    FeatureCandidates& part = parts[i];
+    if ( part.lPos.isEmpty() )
+      continue;
+
+    // valid features are added to fFeats
+    Q_FOREACH ( LabelPosition* pos, part.lPos )
+    {
+      double bmin[2], bmax[2];
+      pos->getBoundingBox( bmin, bmax );
+      allCandidates.Insert( bmin, bmax, pos );
+    }
+
+    Feats *ft = new Feats();
+    ft->feature = part.part;
+    ft->shape = nullptr;
+    ft->lPos = part.lPos;
+    ft->priority = part.priority;
+    fFeats->append( ft );
+    layerHasFeatures[part.layerIndex] = true;
+  }
+  parts.clear();
+
+  QStringList layersWithFeaturesInBBox;
+  for ( i = 0; i < extractedLayers.count(); ++i )
+  {
+    if ( layerHasFeatures.at( i ) || layerHasObstacles.at( i ) )
+    {
+      layersWithFeaturesInBBox << extractedLayers.at( i )->name();
+    }
+  }
+
   prob->nbLabelledLayers = layersWithFeaturesInBBox.size();
   prob->labelledLayersName = layersWithFeaturesInBBox;
 
@@ -330,10 +478,17 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
   // Filtering label positions against obstacles
   amin[0] = amin[1] = -DBL_MAX;
   amax[0] = amax[1] = DBL_MAX;
+  indexTime.start();
+  allCandidates.build();
+  indexBuildTime += indexTime.restart();
   FilterContext filterCtx;
-  filterCtx.cdtsIndex = prob->candidates;
+  filterCtx.cdtsIndex = &allCandidates;
   filterCtx.pal = this;
   obstacles->Search( amin, amax, filteringCallback, static_cast< void* >( &filterCtx ) );
+  filterTime += indexTime.elapsed();
+
+  QgsDebugMsgLevel( QString( "PAL indexes: build %1 ms, extract %2 ms, filter %3 ms ... features# %4 obstacles# %5 candidates# %6" )
+                    .arg( indexBuildTime ).arg( extractTime ).arg( filterTime ).arg( prob->nbft ).arg( obstacles->Count() ).arg( allCandidates.Count() ), 4 );
 
   if ( isCancelled() )
   {
@@ -377,8 +532,6 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
     // only keep the 'max_p' best candidates
     while ( feat->lPos.count() > max_p )
     {
-      // TODO remove from index
-      feat->lPos.last()->removeFromIndex( prob->candidates );
       delete feat->lPos.takeLast();
     }
 
@@ -390,7 +543,7 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
     for ( j = 0; j < feat->lPos.count(); j++, idlp++ )
     {
       lp = feat->lPos.at( j );
-      //lp->insertIntoIndex(prob->candidates);
+      lp->insertIntoIndex( prob->candidates );
       lp->setProblemIds( i, idlp ); // bugfix #1 (maxence 10/23/2008)
     }
     fFeats->append( feat );
@@ -448,6 +601,61 @@ Problem* Pal::extract( double lambda_min, double phi_min, double lambda_max, dou
   return prob;
 }
 
+/// @cond PRIVATE
+
+static void searchSolution( Problem* prob, SearchMethod method )
+{
+  if ( method == FALP )
+    prob->init_sol_falp();
+  else if ( method == CHAIN )
+    prob->chain_search();
+  else
+    prob->popmusic();
+}
+
+/*
+ * Solves an independent part of a problem, see Problem::splitComponents()
+ */
+class ComponentSolver
+{
+  public:
+    explicit ComponentSolver( SearchMethod method )
+        : method( method )
+    {}
+
+    void operator()( Problem*& component ) const
+    {
+      try
+      {
+        searchSolution( component, method );
+      }
+      catch ( InternalException::Empty )
+      {
+        // features of the component remain unlabeled
+      }
+    }
+
+    SearchMethod method;
+};
+
+///@endcond
+
+void Pal::solve( Problem* prob )
+{
+  // candidates of different components never overlap, so their solutions do not depend
+  // on each other. The components do not depend on the number of threads, which keeps
+  // the result deterministic.
+  QList<Problem*> components = prob->splitComponents();
+  if ( components.isEmpty() )
+  {
+    searchSolution( prob, searchMethod );
+    return;
+  }
+
+  QtConcurrent::blockingMap( components, ComponentSolver( searchMethod ) );
+  prob->mergeComponents( components );
+}
+
 /*
  * BIG MACHINE
  */
@@ -477,12 +685,7 @@ QList<LabelPosition*>* Pal::labeller( double bbox[4], PalStat **stats, bool disp
   prob->displayAll = displayAll;
 
   // search a solution
-  if ( searchMethod == FALP )
-    prob->init_sol_falp();
-  else if ( searchMethod == CHAIN )
-    prob->chain_search();
-  else
-    prob->popmusic();
+  solve( prob );
 
   // Post-Optimization
   //prob->post_optimization();
@@ -523,12 +726,7 @@ QList<LabelPosition*>* Pal::solveProblem( Problem* prob, bool displayAll )
 
   try
   {
-    if ( searchMethod == FALP )
-      prob->init_sol_falp();
-    else if ( searchMethod == CHAIN )
-      prob->chain_search();
-    else
-      prob->popmusic();
+    solve( prob );
   }
   catch ( InternalException::Empty )
   {
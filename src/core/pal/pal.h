@@ -274,6 +274,13 @@ namespace pal
       Problem* extract( double lambda_min, double phi_min,
                         double lambda_max, double phi_max );
 
+      /**
+       * \brief Searches a solution for a reduced problem using the current search method.
+       * Independent parts of the problem are solved concurrently.
+       * @param prob problem to solve
+       */
+      void solve( Problem* prob );
+
 
       /**
        * \brief Choose the size of popmusic subpart's
@@ -2244,6 +2244,174 @@ void Problem::chain_search()
   return;
 }
 
+//! Split problems are filled with components until they have at least this number of features
+#define MIN_COMPONENT_FEATURES 256
+
+typedef struct
+{
+  LabelPosition *lp;
+  int *parent;
+} ComponentContext;
+
+static int findComponent( int *parent, int feat )
+{
+  while ( parent[feat] != feat )
+  {
+    parent[feat] = parent[parent[feat]];
+    feat = parent[feat];
+  }
+  return feat;
+}
+
+bool componentCallback( LabelPosition *lp, void *ctx )
+{
+  ComponentContext *context = reinterpret_cast< ComponentContext* >( ctx );
+
+  int a = findComponent( context->parent, lp->getProblemFeatureId() );
+  int b = findComponent( context->parent, context->lp->getProblemFeatureId() );
+
+  if ( a != b && lp->isInConflict( context->lp ) )
+  {
+    // the smallest feature id is the root, so the components do not depend on the search order
+    if ( a < b )
+      context->parent[b] = a;
+    else
+      context->parent[a] = b;
+  }
+  return true;
+}
+
+QList<Problem*> Problem::splitComponents()
+{
+  QList<Problem*> components;
+
+  if ( nbft < 2 * MIN_COMPONENT_FEATURES )
+    return components;
+
+  int i, j;
+  double amin[2];
+  double amax[2];
+
+  // join features with conflicting candidates
+  QVector<int> parent( nbft );
+  for ( i = 0; i < nbft; i++ )
+    parent[i] = i;
+
+  ComponentContext context;
+  context.parent = parent.data();
+
+  for ( i = 0; i < nbft; i++ )
+  {
+    for ( j = 0; j < featNbLp[i]; j++ )
+    {
+      LabelPosition *lp = mLabelPositions.at( featStartId[i] + j );
+      lp->getBoundingBox( amin, amax );
+      context.lp = lp;
+      candidates->Search( amin, amax, componentCallback, &context );
+    }
+  }
+
+  // group the components in the order of their first feature
+  QVector<int> componentIndex( nbft, -1 );
+  QList< QVector<int> > groups;
+  for ( i = 0; i < nbft; i++ )
+  {
+    int root = findComponent( parent.data(), i );
+    if ( componentIndex[root] < 0 )
+    {
+      componentIndex[root] = groups.count();
+      groups << QVector<int>();
+    }
+    groups[componentIndex[root]] << i;
+  }
+
+  QList< QVector<int> > problemFeatures;
+  Q_FOREACH ( const QVector<int>& group, groups )
+  {
+    if ( problemFeatures.isEmpty() || problemFeatures.last().count() >= MIN_COMPONENT_FEATURES )
+      problemFeatures << QVector<int>();
+    problemFeatures.last() << group;
+  }
+
+  if ( problemFeatures.count() < 2 )
+    return components;
+
+  Q_FOREACH ( QVector<int> features, problemFeatures )
+  {
+    // features of a split problem are in increasing order of their id
+    qSort( features );
+
+    Problem *component = new Problem();
+    component->pal = pal;
+    component->displayAll = displayAll;
+    component->bbox[0] = bbox[0];
+    component->bbox[1] = bbox[1];
+    component->bbox[2] = bbox[2];
+    component->bbox[3] = bbox[3];
+    component->nbft = features.count();
+    component->featStartId = new int[component->nbft];
+    component->featNbLp = new int[component->nbft];
+    component->inactiveCost = new double[component->nbft];
+    component->mComponentFeatures = features;
+
+    int overlaps = 0;
+    for ( i = 0; i < component->nbft; i++ )
+    {
+      int feat = features.at( i );
+      component->featStartId[i] = component->nblp;
+      component->featNbLp[i] = featNbLp[feat];
+      component->inactiveCost[i] = inactiveCost[feat];
+
+      for ( j = 0; j < featNbLp[feat]; j++ )
+      {
+        LabelPosition *lp = mLabelPositions.at( featStartId[feat] + j );
+        lp->setProblemIds( i, component->nblp++ );
+        lp->insertIntoIndex( component->candidates );
+        component->addCandidatePosition( lp );
+        overlaps += lp->getNumOverlaps();
+      }
+    }
+    component->all_nblp = component->nblp;
+    component->nbOverlap = overlaps / 2;
+
+    components << component;
+  }
+
+  return components;
+}
+
+void Problem::mergeComponents( QList<Problem*>& components )
+{
+  init_sol_empty();
+
+  Q_FOREACH ( Problem* component, components )
+  {
+    for ( int i = 0; i < component->nbft; i++ )
+    {
+      int feat = component->mComponentFeatures.at( i );
+
+      // restore the ids of the candidates in this problem
+      for ( int j = 0; j < component->featNbLp[i]; j++ )
+      {
+        component->mLabelPositions.at( component->featStartId[i] + j )->setProblemIds( feat, featStartId[feat] + j );
+      }
+
+      if ( component->sol && component->sol->s[i] >= 0 )
+      {
+        sol->s[feat] = featStartId[feat] + component->sol->s[i] - component->featStartId[i];
+        mLabelPositions.at( sol->s[feat] )->insertIntoIndex( candidates_sol );
+      }
+    }
+
+    // the candidates are owned by this problem
+    component->mLabelPositions.clear();
+    delete component;
+  }
+  components.clear();
+
+  solution_cost();
+}
+
 bool Problem::compareLabelArea( pal::LabelPosition* l1, pal::LabelPosition* l2 )
 {
   return l1->getWidth() * l1->getHeight() > l2->getWidth() * l2->getHeight();
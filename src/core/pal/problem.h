@@ -34,6 +34,7 @@
 #include "rtree.hpp"
 #include <list>
 #include <QList>
+#include <QVector>
 
 namespace pal
 {
@@ -174,6 +175,25 @@ namespace pal
 
       static bool compareLabelArea( pal::LabelPosition* l1, pal::LabelPosition* l2 );
 
+      /**
+       * Splits a reduced problem into independent problems. Features whose candidates
+       * conflict with each other always end up in the same problem, so the problems can be
+       * solved concurrently. Small groups of features are combined into a single problem.
+       * The split only depends on the problem, not on the number of threads.
+       * @returns independent problems, or an empty list if the problem cannot be split.
+       * The returned problems borrow the candidates of this problem and must be passed to
+       * mergeComponents() once they are solved.
+       * @note added in QGIS 2.18
+       */
+      QList<Problem*> splitComponents();
+
+      /**
+       * Builds the solution of the problem from the solutions of the problems returned by
+       * splitComponents() and deletes them.
+       * @note added in QGIS 2.18
+       */
+      void mergeComponents( QList<Problem*>& components );
+
     private:
 
       /**
@@ -232,6 +252,11 @@ namespace pal
 
       int *featWrap;
 
+      /**
+       * For problems created by splitComponents(), the ids of the features in the split problem
+       */
+      QVector<int> mComponentFeatures;
+
       Chain *chain( SubPart *part, int seed );
 
       Chain *chain( int seed );
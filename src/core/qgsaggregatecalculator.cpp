@@ -21,7 +21,73 @@
 #include "qgsfeatureiterator.h"
 #include "qgsvectorlayer.h"
 
+///@cond PRIVATE
 
+/** Reads the values to aggregate from a feature iterator, either directly from an
+ * attribute or by evaluating an expression. Expressions are evaluated over blocks
+ * of features at once using QgsExpression::evaluateBatch().
+ */
+class QgsAggregateValueReader
+{
+  public:
+
+    QgsAggregateValueReader( QgsFeatureIterator& fit, int attr, QgsExpression* expression, QgsExpressionContext* context )
+        : mFit( fit )
+        , mAttr( attr )
+        , mExpression( expression )
+        , mContext( context )
+        , mPos( 0 )
+    {}
+
+    //! Fetches the next value, returns false once the iterator is exhausted
+    bool nextValue( QVariant& value )
+    {
+      if ( !mExpression )
+      {
+        if ( !mFit.nextFeature( mFeature ) )
+          return false;
+
+        value = mFeature.attribute( mAttr );
+        return true;
+      }
+
+      if ( mPos >= mValues.count() && !fetchBlock() )
+        return false;
+
+      value = mValues.at( mPos++ );
+      return true;
+    }
+
+  private:
+
+    static const int BLOCK_SIZE = 1024;
+
+    bool fetchBlock()
+    {
+      mFeatures.clear();
+      while ( mFeatures.count() < BLOCK_SIZE && mFit.nextFeature( mFeature ) )
+        mFeatures << mFeature;
+
+      if ( mFeatures.isEmpty() )
+        return false;
+
+      Q_ASSERT( mContext );
+      mValues = mExpression->evaluateBatch( mFeatures, mContext );
+      mPos = 0;
+      return true;
+    }
+
+    QgsFeatureIterator& mFit;
+    int mAttr;
+    QgsExpression* mExpression;
+    QgsExpressionContext* mContext;
+    QgsFeature mFeature;
+    QgsFeatureList mFeatures;
+    QVariantList mValues;
+    int mPos;
+};
+
+///@endcond
 
 QgsAggregateCalculator::QgsAggregateCalculator( QgsVectorLayer* layer )
     : mLayer( layer )
@@ -385,21 +451,12 @@ QVariant QgsAggregateCalculator::calculateNumericAggregate( QgsFeatureIterator&
   Q_ASSERT( expression || attr >= 0 );
 
   QgsStatisticalSummary s( stat );
-  QgsFeature f;
+  QgsAggregateValueReader reader( fit, attr, expression, context );
+  QVariant v;
 
-  while ( fit.nextFeature( f ) )
+  while ( reader.nextValue( v ) )
   {
-    if ( expression )
-    {
-      Q_ASSERT( context );
-      context->setFeature( f );
-      QVariant v = expression->evaluate( context );
-      s.addVariant( v );
-    }
-    else
-    {
-      s.addVariant( f.attribute( attr ) );
-    }
+    s.addVariant( v );
   }
   s.finalize();
   double val = s.statistic( stat );
@@ -412,21 +469,12 @@ QVariant QgsAggregateCalculator::calculateStringAggregate( QgsFeatureIterator& f
   Q_ASSERT( expression || attr >= 0 );
 
   QgsStringStatisticalSummary s( stat );
-  QgsFeature f;
+  QgsAggregateValueReader reader( fit, attr, expression, context );
+  QVariant v;
 
-  while ( fit.nextFeature( f ) )
+  while ( reader.nextValue( v ) )
   {
-    if ( expression )
-    {
-      Q_ASSERT( context );
-      context->setFeature( f );
-      QVariant v = expression->evaluate( context );
-      s.addValue( v );
-    }
-    else
-    {
-      s.addValue( f.attribute( attr ) );
-    }
+    s.addValue( v );
   }
   s.finalize();
   return s.statistic( stat );
@@ -437,24 +485,15 @@ QVariant QgsAggregateCalculator::concatenateStrings( QgsFeatureIterator& fit, in
 {
   Q_ASSERT( expression || attr >= 0 );
 
-  QgsFeature f;
+  QgsAggregateValueReader reader( fit, attr, expression, context );
+  QVariant v;
   QString result;
-  while ( fit.nextFeature( f ) )
+  while ( reader.nextValue( v ) )
   {
     if ( !result.isEmpty() )
       result += delimiter;
 
-    if ( expression )
-    {
-      Q_ASSERT( context );
-      context->setFeature( f );
-      QVariant v = expression->evaluate( context );
-      result += v.toString();
-    }
-    else
-    {
-      result += f.attribute( attr ).toString();
-    }
+    result += v.toString();
   }
   return result;
 }
@@ -500,21 +539,12 @@ QVariant QgsAggregateCalculator::calculateDateTimeAggregate( QgsFeatureIterator&
   Q_ASSERT( expression || attr >= 0 );
 
   QgsDateTimeStatisticalSummary s( stat );
-  QgsFeature f;
+  QgsAggregateValueReader reader( fit, attr, expression, context );
+  QVariant v;
 
-  while ( fit.nextFeature( f ) )
+  while ( reader.nextValue( v ) )
   {
-    if ( expression )
-    {
-      Q_ASSERT( context );
-      context->setFeature( f );
-      QVariant v = expression->evaluate( context );
-      s.addValue( v );
-    }
-    else
-    {
-      s.addValue( f.attribute( attr ) );
-    }
+    s.addValue( v );
   }
   s.finalize();
   return s.statistic( stat );
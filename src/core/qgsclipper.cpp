@@ -53,26 +53,34 @@ QgsConstWkbPtr QgsClipper::clippedLineWKB( QgsConstWkbPtr& wkbPtr, const QgsRect
     return QgsConstWkbPtr( nullptr, 0 );
   }
 
+  QPolygonF pts;
+  wkbPtr -= sizeof( unsigned int );
+  wkbPtr >> pts;
+
+  clippedLine( pts, clipExtent, line );
+  return wkbPtr;
+}
+
+void QgsClipper::clippedLine( const QPolygonF& pts, const QgsRectangle& clipExtent, QPolygonF& line )
+{
   double p0x, p0y, p1x = 0.0, p1y = 0.0; //original coordinates
   double p1x_c, p1y_c; //clipped end coordinates
   double lastClipX = 0.0, lastClipY = 0.0; //last successfully clipped coords
 
-  QPolygonF pts;
-  wkbPtr -= sizeof( unsigned int );
-  wkbPtr >> pts;
-  nPoints = pts.size();
+  int nPoints = pts.size();
 
-  line.clear();
+  // keep the allocated capacity of the output line, it may be reused for many lines
+  line.resize( 0 );
   line.reserve( nPoints + 1 );
 
-  QPointF *ptr = pts.data();
+  const QPointF *ptr = pts.constData();
 
   for ( int i = 0; i < nPoints; ++i, ++ptr )
   {
     if ( i == 0 )
     {
-      p1x = ptr->rx();
-      p1y = ptr->ry();
+      p1x = ptr->x();
+      p1y = ptr->y();
       continue;
     }
     else
@@ -80,8 +88,8 @@ QgsConstWkbPtr QgsClipper::clippedLineWKB( QgsConstWkbPtr& wkbPtr, const QgsRect
       p0x = p1x;
       p0y = p1y;
 
-      p1x = ptr->rx();
-      p1y = ptr->ry();
+      p1x = ptr->x();
+      p1y = ptr->y();
 
       p1x_c = p1x;
       p1y_c = p1y;
@@ -107,7 +115,6 @@ QgsConstWkbPtr QgsClipper::clippedLineWKB( QgsConstWkbPtr& wkbPtr, const QgsRect
       }
     }
   }
-  return wkbPtr;
 }
 
 void QgsClipper::connectSeparatedLines( double x0, double y0, double x1, double y1,
@@ -89,6 +89,15 @@ class CORE_EXPORT QgsClipper
       @param line out: clipped line coordinates*/
     static QgsConstWkbPtr clippedLineWKB( QgsConstWkbPtr& wkb, const QgsRectangle& clipExtent, QPolygonF& line );
 
+    /** Clips a polyline to clipExtent
+      @param pts line coordinates
+      @param clipExtent clipping bounds
+      @param line out: clipped line coordinates, the capacity of the polygon is kept
+      @note added in QGIS 2.18
+      @note not available in Python bindings
+    */
+    static void clippedLine( const QPolygonF& pts, const QgsRectangle& clipExtent, QPolygonF& line );
+
   private:
 
     // Used when testing for equivalance to 0.0
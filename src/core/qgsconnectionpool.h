@@ -83,46 +83,18 @@ class QgsConnectionPoolGroup
     {
       // we are going to acquire a resource - if no resource is available, we will block here
       sem.acquire();
+      return takeConnection();
+    }
 
-      // quick (preferred) way - use cached connection
-      {
-        QMutexLocker locker( &connMutex );
-
-        if ( !conns.isEmpty() )
-        {
-          Item i = conns.pop();
-          if ( !qgsConnectionPool_ConnectionIsValid( i.c ) )
-          {
-            qgsConnectionPool_ConnectionDestroy( i.c );
-            qgsConnectionPool_ConnectionCreate( connInfo, i.c );
-          }
-
-          // no need to run if nothing can expire
-          if ( conns.isEmpty() )
-          {
-            // will call the slot directly or queue the call (if the object lives in a different thread)
-            QMetaObject::invokeMethod( expirationTimer->parent(), "stopExpirationTimer" );
-          }
-
-          acquiredConns.append( i.c );
-
-          return i.c;
-        }
-      }
-
-      T c;
-      qgsConnectionPool_ConnectionCreate( connInfo, c );
-      if ( !c )
-      {
-        // we didn't get connection for some reason, so release the lock
-        sem.release();
+    //! Returns a connection if one can be acquired without blocking, while leaving
+    //! at least reserve connections available to other callers, or null otherwise
+    //! @note added in QGIS 2.18
+    T tryAcquire( int reserve = 0 )
+    {
+      if ( !sem.tryAcquire( 1 + reserve ) )
         return nullptr;
-      }
-
-      connMutex.lock();
-      acquiredConns.append( c );
-      connMutex.unlock();
-      return c;
+      sem.release( reserve );
+      return takeConnection();
     }
 
     void release( T conn )
@@ -167,6 +139,50 @@ class QgsConnectionPoolGroup
 
   protected:
 
+    //! Returns a cached or a new connection, once the semaphore has been acquired
+    T takeConnection()
+    {
+      // quick (preferred) way - use cached connection
+      {
+        QMutexLocker locker( &connMutex );
+
+        if ( !conns.isEmpty() )
+        {
+          Item i = conns.pop();
+          if ( !qgsConnectionPool_ConnectionIsValid( i.c ) )
+          {
+            qgsConnectionPool_ConnectionDestroy( i.c );
+            qgsConnectionPool_ConnectionCreate( connInfo, i.c );
+          }
+
+          // no need to run if nothing can expire
+          if ( conns.isEmpty() )
+          {
+            // will call the slot directly or queue the call (if the object lives in a different thread)
+            QMetaObject::invokeMethod( expirationTimer->parent(), "stopExpirationTimer" );
+          }
+
+          acquiredConns.append( i.c );
+
+          return i.c;
+        }
+      }
+
+      T c;
+      qgsConnectionPool_ConnectionCreate( connInfo, c );
+      if ( !c )
+      {
+        // we didn't get connection for some reason, so release the lock
+        sem.release();
+        return nullptr;
+      }
+
+      connMutex.lock();
+      acquiredConns.append( c );
+      connMutex.unlock();
+      return c;
+    }
+
     void initTimer( QObject* parent )
     {
       expirationTimer = new QTimer( parent );
@@ -266,6 +282,25 @@ class QgsConnectionPool
       return group->acquire();
     }
 
+    //! Try to acquire a connection without blocking: if no connections are available, null is returned.
+    //! @param connInfo connection string
+    //! @param reserve number of connections which must stay available once the connection is acquired
+    //! @return initialized connection or null if none is available or on error
+    //! @note added in QGIS 2.18
+    T tryAcquireConnection( const QString& connInfo, int reserve = 0 )
+    {
+      mMutex.lock();
+      typename T_Groups::iterator it = mGroups.find( connInfo );
+      if ( it == mGroups.end() )
+      {
+        it = mGroups.insert( connInfo, new T_Group( connInfo ) );
+      }
+      T_Group* group = *it;
+      mMutex.unlock();
+
+      return group->tryAcquire( reserve );
+    }
+
     //! Release an existing connection so it will get back into the pool and can be reused
     void releaseConnection( T conn )
     {
@@ -394,9 +394,28 @@ void QgsCoordinateTransform::transformPolygon( QPolygonF& poly, TransformDirecti
     return;
   }
 
-  //create x, y arrays
   int nVertices = poly.size();
+  if ( nVertices == 0 )
+    return;
+
+  if ( sizeof( qreal ) == sizeof( double ) )
+  {
+    // the points of the polygon are x, y pairs of doubles which proj can transform where they are
+    double* xy = reinterpret_cast<double*>( poly.data() );
+    try
+    {
+      transformCoords( nVertices, 2, xy, xy + 1, nullptr, direction );
+    }
+    catch ( const QgsCsException & )
+    {
+      // rethrow the exception
+      QgsDebugMsg( "rethrowing exception" );
+      throw;
+    }
+    return;
+  }
 
+  //create x, y arrays
   QVector<double> x( nVertices );
   QVector<double> y( nVertices );
   QVector<double> z( nVertices );
@@ -615,6 +634,11 @@ QgsRectangle QgsCoordinateTransform::transformBoundingBox( const QgsRectangle &r
 }
 
 void QgsCoordinateTransform::transformCoords( int numPoints, double *x, double *y, double *z, TransformDirection direction ) const
+{
+  transformCoords( numPoints, 1, x, y, z, direction );
+}
+
+void QgsCoordinateTransform::transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const
 {
   if ( mShortCircuit || !mInitialisedFlag )
     return;
@@ -650,7 +674,7 @@ void QgsCoordinateTransform::transformCoords( int numPoints, double *x, double *
   if (( pj_is_latlong( destProj ) && ( direction == ReverseTransform ) )
       || ( pj_is_latlong( sourceProj ) && ( direction == ForwardTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= DEG_TO_RAD;
       y[i] *= DEG_TO_RAD;
@@ -660,13 +684,13 @@ void QgsCoordinateTransform::transformCoords( int numPoints, double *x, double *
   int projResult;
   if ( direction == ReverseTransform )
   {
-    projResult = pj_transform( destProj, sourceProj, numPoints, 0, x, y, z );
+    projResult = pj_transform( destProj, sourceProj, numPoints, pointOffset, x, y, z );
   }
   else
   {
     Q_ASSERT( sourceProj );
     Q_ASSERT( destProj );
-    projResult = pj_transform( sourceProj, destProj, numPoints, 0, x, y, z );
+    projResult = pj_transform( sourceProj, destProj, numPoints, pointOffset, x, y, z );
   }
 
   if ( projResult != 0 )
@@ -674,7 +698,7 @@ void QgsCoordinateTransform::transformCoords( int numPoints, double *x, double *
     //something bad happened....
     QString points;
 
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       if ( direction == ForwardTransform )
       {
@@ -717,7 +741,7 @@ void QgsCoordinateTransform::transformCoords( int numPoints, double *x, double *
   if (( pj_is_latlong( destProj ) && ( direction == ForwardTransform ) )
       || ( pj_is_latlong( sourceProj ) && ( direction == ReverseTransform ) ) )
   {
-    for ( int i = 0; i < numPoints; ++i )
+    for ( int i = 0; i < numPoints * pointOffset; i += pointOffset )
     {
       x[i] *= RAD_TO_DEG;
       y[i] *= RAD_TO_DEG;
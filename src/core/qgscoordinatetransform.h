@@ -314,6 +314,11 @@ class CORE_EXPORT QgsCoordinateTransform : public QObject
 
     QPair< projPJ, projPJ > threadLocalProjData() const;
     void freeProj();
+
+    /** Transforms coordinates stored pointOffset doubles apart, e.g. 2 for the interleaved
+     * coordinates of a QPolygonF. z may be null.
+     */
+    void transformCoords( int numPoints, int pointOffset, double *x, double *y, double *z, TransformDirection direction ) const;
 };
 
 //! Output stream operator
@@ -60,6 +60,9 @@
 // from parser
 extern QgsExpression::Node* parseExpression( const QString& str, QString& parserErrorMsg );
 
+// whether prepare() lowers expressions to a QgsExpressionProgram
+static bool gCompilationEnabled = true;
+
 ///////////////////////////////////////////////
 // three-value logic
 
@@ -3584,6 +3587,10 @@ bool QgsExpression::isValid( const QString &text, const QgsExpressionContext *co
 void QgsExpression::setExpression( const QString& expression )
 {
   detach();
+  delete d->mProgram;
+  d->mProgram = nullptr;
+  delete d->mOptimizedNode;
+  d->mOptimizedNode = nullptr;
   d->mRootNode = ::parseExpression( expression, d->mParserErrorString );
   d->mEvalErrorString = QString();
   d->mExp = expression;
@@ -3818,7 +3825,31 @@ bool QgsExpression::prepare( const QgsExpressionContext *context )
     return false;
   }
 
-  return d->mRootNode->prepare( this, context );
+  bool res = d->mRootNode->prepare( this, context );
+
+  delete d->mProgram;
+  d->mProgram = nullptr;
+  delete d->mOptimizedNode;
+  d->mOptimizedNode = nullptr;
+
+  if ( gCompilationEnabled )
+  {
+    // fold what does not depend on the feature, then lower the prepared tree,
+    // column indexes are only known from here on
+    if ( res )
+    {
+      d->mOptimizedNode = QgsExpressionProgram::fold( this, d->mRootNode, context );
+      if ( d->mOptimizedNode && !d->mOptimizedNode->prepare( this, context ) )
+      {
+        delete d->mOptimizedNode;
+        d->mOptimizedNode = nullptr;
+        d->mEvalErrorString = QString();
+      }
+    }
+    d->mProgram = QgsExpressionProgram::compile( this, d->evaluationRoot(), context );
+  }
+
+  return res;
 }
 
 QVariant QgsExpression::evaluate( const QgsFeature* f )
@@ -3881,7 +3912,65 @@ QVariant QgsExpression::evaluate( const QgsExpressionContext *context )
     return QVariant();
   }
 
-  return d->mRootNode->eval( this, context );
+  if ( d->mProgram )
+    return d->mProgram->evaluate( this, context );
+
+  return d->evaluationRoot()->eval( this, context );
+}
+
+QVariantList QgsExpression::evaluateBatch( const QList<QgsFeature>& features, QgsExpressionContext* context )
+{
+  d->mEvalErrorString = QString();
+  if ( !d->mRootNode )
+  {
+    d->mEvalErrorString = tr( "No root node! Parsing failed?" );
+    QVariantList results;
+    for ( int i = 0; i < features.count(); ++i )
+      results << QVariant();
+    return results;
+  }
+
+  QgsExpressionContext localContext;
+  if ( !context )
+    context = &localContext;
+
+  if ( d->mProgram )
+    return d->mProgram->evaluateBatch( this, features, context );
+
+  QVariantList results;
+  results.reserve( features.count() );
+  QString firstError;
+  Q_FOREACH ( const QgsFeature& feature, features )
+  {
+    context->setFeature( feature );
+    QVariant result = d->evaluationRoot()->eval( this, context );
+    if ( hasEvalError() )
+    {
+      if ( firstError.isNull() )
+        firstError = d->mEvalErrorString;
+      d->mEvalErrorString = QString();
+      result = QVariant();
+    }
+    results << result;
+  }
+
+  d->mEvalErrorString = firstError;
+  return results;
+}
+
+bool QgsExpression::isCompiled() const
+{
+  return d->mProgram;
+}
+
+void QgsExpression::setCompilationEnabled( bool enabled )
+{
+  gCompilationEnabled = enabled;
+}
+
+bool QgsExpression::compilationEnabled()
+{
+  return gCompilationEnabled;
 }
 
 bool QgsExpression::hasEvalError() const
@@ -3914,6 +4003,14 @@ QString QgsExpression::dump() const
   return d->mRootNode->dump();
 }
 
+QString QgsExpression::dumpOptimized() const
+{
+  if ( !d->mRootNode )
+    return QString();
+
+  return d->evaluationRoot()->dump();
+}
+
 QgsDistanceArea* QgsExpression::geomCalculator()
 {
   return d->mCalc.data();
@@ -4091,6 +4188,11 @@ QVariant QgsExpression::NodeUnaryOperator::eval( QgsExpression *parent, const Qg
   QVariant val = mOperand->eval( parent, context );
   ENSURE_NO_EVAL_ERROR;
 
+  return evalOperation( parent, val );
+}
+
+QVariant QgsExpression::NodeUnaryOperator::evalOperation( QgsExpression *parent, const QVariant &val )
+{
   switch ( mOp )
   {
     case uoNot:
@@ -4137,6 +4239,11 @@ QVariant QgsExpression::NodeBinaryOperator::eval( QgsExpression *parent, const Q
   QVariant vR = mOpRight->eval( parent, context );
   ENSURE_NO_EVAL_ERROR;
 
+  return evalOperation( parent, vL, vR );
+}
+
+QVariant QgsExpression::NodeBinaryOperator::evalOperation( QgsExpression *parent, const QVariant &vL, const QVariant &vR )
+{
   switch ( mOp )
   {
     case boPlus:
@@ -4618,6 +4725,14 @@ QVariant QgsExpression::NodeInOperator::eval( QgsExpression *parent, const QgsEx
     return mNotIn ? TVL_True : TVL_False;
   QVariant v1 = mNode->eval( parent, context );
   ENSURE_NO_EVAL_ERROR;
+
+  return evalOperation( parent, context, v1 );
+}
+
+QVariant QgsExpression::NodeInOperator::evalOperation( QgsExpression *parent, const QgsExpressionContext *context, const QVariant &v1 )
+{
+  if ( mList->count() == 0 )
+    return mNotIn ? TVL_True : TVL_False;
   if ( isNull( v1 ) )
     return TVL_Unknown;
 
@@ -4876,9 +4991,9 @@ QVariant QgsExpression::NodeCondition::eval( QgsExpression *parent, const QgsExp
   Q_FOREACH ( WhenThen* cond, mConditions )
   {
     QVariant vWhen = cond->mWhenExp->eval( parent, context );
-    TVL tvl = getTVLValue( vWhen, parent );
+    bool matches = whenMatches( parent, vWhen );
     ENSURE_NO_EVAL_ERROR;
-    if ( tvl == True )
+    if ( matches )
     {
       QVariant vRes = cond->mThenExp->eval( parent, context );
       ENSURE_NO_EVAL_ERROR;
@@ -4897,6 +5012,11 @@ QVariant QgsExpression::NodeCondition::eval( QgsExpression *parent, const QgsExp
   return QVariant();
 }
 
+bool QgsExpression::NodeCondition::whenMatches( QgsExpression *parent, const QVariant &value )
+{
+  return getTVLValue( value, parent ) == True;
+}
+
 bool QgsExpression::NodeCondition::prepare( QgsExpression *parent, const QgsExpressionContext *context )
 {
   bool res;
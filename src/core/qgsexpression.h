@@ -228,6 +228,39 @@ class CORE_EXPORT QgsExpression
      */
     QVariant evaluate( const QgsExpressionContext* context );
 
+    /** Evaluates the expression against a block of features and returns one result per
+     * feature, in the same order. Compiled expressions are evaluated column-wise over the
+     * whole block, which is considerably faster than calling evaluate() for each feature.
+     * Features which fail to evaluate return an invalid QVariant and the first error is
+     * reported by evalErrorString().
+     * @param features features to evaluate
+     * @param context context for evaluating expression. Its feature is replaced by the
+     * evaluated features.
+     * @note prepare() should be called before calling this method.
+     * @note added in QGIS 2.18
+     */
+    QVariantList evaluateBatch( const QList<QgsFeature>& features, QgsExpressionContext* context );
+
+    /** Returns true if prepare() lowered this expression to a compiled instruction
+     * stream, which evaluate() then uses instead of walking the expression tree.
+     * @see setCompilationEnabled()
+     */
+    bool isCompiled() const;
+
+    /** Sets whether prepare() compiles expressions for faster repeated evaluation.
+     * Compilation folds the parts of the expression which do not depend on the feature
+     * and evaluates identical subexpressions only once. It is enabled by default.
+     * Disabling it forces evaluation through the expression tree, which is mainly
+     * useful to compare both evaluation paths.
+     * @see compilationEnabled()
+     */
+    static void setCompilationEnabled( bool enabled );
+
+    /** Returns whether prepare() compiles expressions for faster repeated evaluation.
+     * @see setCompilationEnabled()
+     */
+    static bool compilationEnabled();
+
     //! Returns true if an error occurred when evaluating last input
     bool hasEvalError() const;
     //! Returns evaluation error
@@ -299,6 +332,15 @@ class CORE_EXPORT QgsExpression
     //! expression() instead.
     QString dump() const;
 
+    /** Returns the expression as it is evaluated after prepare(), for debugging purposes.
+     * Subexpressions which do not depend on the feature are replaced by their value and
+     * CASE branches which can never be taken are removed. This is the same as dump()
+     * if nothing could be folded or compilation is disabled.
+     * @see setCompilationEnabled()
+     * @note added in QGIS 2.18
+     */
+    QString dumpOptimized() const;
+
     /** Return calculator used for distance and area calculations
      * (used by $length, $area and $perimeter functions only)
      * @see setGeomCalculator()
@@ -1111,6 +1153,12 @@ class CORE_EXPORT QgsExpression
         virtual void accept( Visitor& v ) const override { v.visit( *this ); }
         virtual Node* clone() const override;
 
+        /** Applies the operator to an already evaluated operand value.
+         * Errors are reported to the parent.
+         * @note not available in Python bindings
+         */
+        QVariant evalOperation( QgsExpression* parent, const QVariant& value );
+
       protected:
         UnaryOperator mOp;
         Node* mOperand;
@@ -1145,6 +1193,12 @@ class CORE_EXPORT QgsExpression
         int precedence() const;
         bool leftAssociative() const;
 
+        /** Applies the operator to already evaluated operand values.
+         * Errors are reported to the parent.
+         * @note not available in Python bindings
+         */
+        QVariant evalOperation( QgsExpression* parent, const QVariant& vL, const QVariant& vR );
+
       protected:
         bool compare( double diff );
         int computeInt( int x, int y );
@@ -1187,6 +1241,13 @@ class CORE_EXPORT QgsExpression
         virtual void accept( Visitor& v ) const override { v.visit( *this ); }
         virtual Node* clone() const override;
 
+        /** Tests an already evaluated value against the list. List items are
+         * evaluated against the context as required.
+         * Errors are reported to the parent.
+         * @note not available in Python bindings
+         */
+        QVariant evalOperation( QgsExpression* parent, const QgsExpressionContext* context, const QVariant& value );
+
       protected:
         Node* mNode;
         NodeList* mList;
@@ -1371,6 +1432,11 @@ class CORE_EXPORT QgsExpression
         /** The name of the column. */
         QString name() const { return mName; }
 
+        /** The index of the column, as resolved by prepare(), or -1 if the
+         * column has not been resolved yet.
+         */
+        int index() const { return mIndex; }
+
         virtual NodeType nodeType() const override { return ntColumnRef; }
         virtual bool prepare( QgsExpression* parent, const QgsExpressionContext* context ) override;
         virtual QVariant eval( QgsExpression* parent, const QgsExpressionContext* context ) override;
@@ -1423,6 +1489,20 @@ class CORE_EXPORT QgsExpression
         {}
         ~NodeCondition() { delete mElseExp; qDeleteAll( mConditions ); }
 
+        /** The list of WHEN ... THEN ... pairs, in evaluation order.
+         * @note not available in Python bindings
+         */
+        const WhenThenList& conditions() const { return mConditions; }
+
+        /** The ELSE expression, or nullptr if none is set. */
+        Node* elseExp() const { return mElseExp; }
+
+        /** Tests whether an already evaluated WHEN value selects its THEN branch.
+         * Errors are reported to the parent.
+         * @note not available in Python bindings
+         */
+        static bool whenMatches( QgsExpression* parent, const QVariant& value );
+
         virtual NodeType nodeType() const override { return ntCondition; }
         virtual QVariant eval( QgsExpression* parent, const QgsExpressionContext* context ) override;
         virtual bool prepare( QgsExpression* parent, const QgsExpressionContext* context ) override;
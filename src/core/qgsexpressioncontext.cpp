@@ -46,12 +46,14 @@ const QString QgsExpressionContext::EXPR_GEOMETRY_POINT_NUM( "geometry_point_num
 
 QgsExpressionContextScope::QgsExpressionContextScope( const QString& name )
     : mName( name )
+    , mStable( false )
 {
 
 }
 
 QgsExpressionContextScope::QgsExpressionContextScope( const QgsExpressionContextScope& other )
     : mName( other.mName )
+    , mStable( other.mStable )
     , mVariables( other.mVariables )
 {
   QHash<QString, QgsScopedExpressionFunction* >::const_iterator it = other.mFunctions.constBegin();
@@ -64,6 +66,7 @@ QgsExpressionContextScope::QgsExpressionContextScope( const QgsExpressionContext
 QgsExpressionContextScope& QgsExpressionContextScope::operator=( const QgsExpressionContextScope & other )
 {
   mName = other.mName;
+  mStable = other.mStable;
   mVariables = other.mVariables;
 
   qDeleteAll( mFunctions );
@@ -207,6 +210,7 @@ void QgsExpressionContextScope::setFields( const QgsFields &fields )
 //
 
 QgsExpressionContext::QgsExpressionContext( const QgsExpressionContext& other )
+    : mShareSubexpressions( other.mShareSubexpressions )
 {
   Q_FOREACH ( const QgsExpressionContextScope* scope, other.mStack )
   {
@@ -214,6 +218,7 @@ QgsExpressionContext::QgsExpressionContext( const QgsExpressionContext& other )
   }
   mHighlightedVariables = other.mHighlightedVariables;
   mCachedValues = other.mCachedValues;
+  mSharedValues = other.mSharedValues;
 }
 
 QgsExpressionContext& QgsExpressionContext::operator=( const QgsExpressionContext & other )
@@ -226,6 +231,8 @@ QgsExpressionContext& QgsExpressionContext::operator=( const QgsExpressionContex
   }
   mHighlightedVariables = other.mHighlightedVariables;
   mCachedValues = other.mCachedValues;
+  mShareSubexpressions = other.mShareSubexpressions;
+  mSharedValues = other.mSharedValues;
   return *this;
 }
 
@@ -474,6 +481,36 @@ void QgsExpressionContext::clearCachedValues() const
   mCachedValues.clear();
 }
 
+void QgsExpressionContext::setSubexpressionSharingEnabled( bool enabled )
+{
+  mShareSubexpressions = enabled;
+}
+
+bool QgsExpressionContext::subexpressionSharingEnabled() const
+{
+  return mShareSubexpressions;
+}
+
+void QgsExpressionContext::setSharedValue( const QString& key, const QVariant& value ) const
+{
+  mSharedValues.insert( key, value );
+}
+
+bool QgsExpressionContext::hasSharedValue( const QString& key ) const
+{
+  return mSharedValues.contains( key );
+}
+
+QVariant QgsExpressionContext::sharedValue( const QString& key ) const
+{
+  return mSharedValues.value( key, QVariant() );
+}
+
+void QgsExpressionContext::clearSharedValues() const
+{
+  mSharedValues.clear();
+}
+
 
 //
 // QgsExpressionContextUtils
@@ -482,6 +519,7 @@ void QgsExpressionContext::clearCachedValues() const
 QgsExpressionContextScope* QgsExpressionContextUtils::globalScope()
 {
   QgsExpressionContextScope* scope = new QgsExpressionContextScope( QObject::tr( "Global" ) );
+  scope->setStable( true );
 
   //read values from QSettings
   QSettings settings;
@@ -612,6 +650,7 @@ QgsExpressionContextScope* QgsExpressionContextUtils::projectScope()
   QgsProject* project = QgsProject::instance();
 
   QgsExpressionContextScope* scope = new QgsExpressionContextScope( QObject::tr( "Project" ) );
+  scope->setStable( true );
 
   //add variables defined in project file
   QStringList variableNames = project->readListEntry( "Variables", "/variableNames" );
@@ -677,6 +716,7 @@ void QgsExpressionContextUtils::setProjectVariables( const QgsStringMap &variabl
 QgsExpressionContextScope* QgsExpressionContextUtils::layerScope( const QgsMapLayer* layer )
 {
   QgsExpressionContextScope* scope = new QgsExpressionContextScope( QObject::tr( "Layer" ) );
+  scope->setStable( true );
 
   if ( !layer )
     return scope;
@@ -755,6 +795,7 @@ QgsExpressionContextScope* QgsExpressionContextUtils::mapSettingsScope( const Qg
   // (rationale is described in QgsComposerMap::createExpressionContext() )
 
   QgsExpressionContextScope* scope = new QgsExpressionContextScope( QObject::tr( "Map Settings" ) );
+  scope->setStable( true );
 
   //add known map settings context variables
   scope->addVariable( QgsExpressionContextScope::StaticVariable( "map_id", "canvas", true ) );
@@ -122,6 +122,22 @@ class CORE_EXPORT QgsExpressionContextScope
      */
     QString name() const { return mName; }
 
+    /** Returns true if the variables of the scope do not change while a map or layer is rendered,
+     * as for the global, project, layer and map settings scopes. Expressions which only reference
+     * variables from stable scopes may be folded to constants when they are prepared.
+     * @see setStable()
+     * @note added in QGIS 2.18
+     */
+    bool isStable() const { return mStable; }
+
+    /** Sets whether the variables of the scope do not change while a map or layer is rendered.
+     * Scopes are not stable by default.
+     * @param stable true if the scope is stable
+     * @see isStable()
+     * @note added in QGIS 2.18
+     */
+    void setStable( bool stable ) { mStable = stable; }
+
     /** Convenience method for setting a variable in the context scope by name and value. If a variable
      * with the same name is already set then its value is overwritten, otherwise a new variable is added to the scope.
      * @param name variable name
@@ -229,6 +245,7 @@ class CORE_EXPORT QgsExpressionContextScope
 
   private:
     QString mName;
+    bool mStable;
     QHash<QString, StaticVariable> mVariables;
     QHash<QString, QgsScopedExpressionFunction* > mFunctions;
 
@@ -251,7 +268,9 @@ class CORE_EXPORT QgsExpressionContext
 {
   public:
 
-    QgsExpressionContext() {}
+    QgsExpressionContext()
+        : mShareSubexpressions( false )
+    {}
 
     /** Copy constructor
      */
@@ -481,6 +500,54 @@ class CORE_EXPORT QgsExpressionContext
      */
     void clearCachedValues() const;
 
+    /** Sets whether compiled expressions evaluated against this context share the results of
+     * identical feature dependent function calls, eg "$area". Shared results are only valid
+     * for a single feature, so clearSharedValues() must be called before evaluating the
+     * expressions for another feature. Sharing is disabled by default.
+     * @see subexpressionSharingEnabled()
+     * @see clearSharedValues()
+     * @note added in QGIS 2.18
+     */
+    void setSubexpressionSharingEnabled( bool enabled );
+
+    /** Returns true if compiled expressions evaluated against this context share the results of
+     * identical feature dependent function calls.
+     * @see setSubexpressionSharingEnabled()
+     * @note added in QGIS 2.18
+     */
+    bool subexpressionSharingEnabled() const;
+
+    /** Stores the result of a subexpression for the current feature.
+     * @param key unique key of the subexpression
+     * @param value subexpression result
+     * @see sharedValue()
+     * @see setSubexpressionSharingEnabled()
+     * @note added in QGIS 2.18
+     */
+    void setSharedValue( const QString& key, const QVariant& value ) const;
+
+    /** Returns true if a result was stored for the subexpression with a matching key.
+     * @param key unique key of the subexpression
+     * @see setSharedValue()
+     * @note added in QGIS 2.18
+     */
+    bool hasSharedValue( const QString& key ) const;
+
+    /** Returns the stored result of the subexpression with a matching key, or an invalid QVariant if not set.
+     * @param key unique key of the subexpression
+     * @see setSharedValue()
+     * @see hasSharedValue()
+     * @note added in QGIS 2.18
+     */
+    QVariant sharedValue( const QString& key ) const;
+
+    /** Clears all stored subexpression results, eg before evaluating expressions for another feature.
+     * @see setSharedValue()
+     * @see setSubexpressionSharingEnabled()
+     * @note added in QGIS 2.18
+     */
+    void clearSharedValues() const;
+
     //! Inbuilt variable name for fields storage
     static const QString EXPR_FIELDS;
     //! Inbuilt variable name for feature storage
@@ -508,6 +575,9 @@ class CORE_EXPORT QgsExpressionContext
     // Cache is mutable because we want to be able to add cached values to const contexts
     mutable QMap< QString, QVariant > mCachedValues;
 
+    bool mShareSubexpressions;
+    mutable QHash< QString, QVariant > mSharedValues;
+
 };
 
 /** \ingroup core
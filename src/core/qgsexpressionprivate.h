@@ -21,6 +21,7 @@
 #include <QSharedPointer>
 
 #include "qgsexpression.h"
+#include "qgsexpressionprogram.h"
 #include "qgsdistancearea.h"
 #include "qgsunittypes.h"
 
@@ -36,6 +37,8 @@ class QgsExpressionPrivate
     QgsExpressionPrivate()
         : ref( 1 )
         , mRootNode( nullptr )
+        , mOptimizedNode( nullptr )
+        , mProgram( nullptr )
         , mRowNumber( 0 )
         , mScale( 0 )
         , mCalc( nullptr )
@@ -46,6 +49,8 @@ class QgsExpressionPrivate
     QgsExpressionPrivate( const QgsExpressionPrivate& other )
         : ref( 1 )
         , mRootNode( other.mRootNode ? other.mRootNode->clone() : nullptr )
+        , mOptimizedNode( nullptr )
+        , mProgram( nullptr )
         , mParserErrorString( other.mParserErrorString )
         , mEvalErrorString( other.mEvalErrorString )
         , mRowNumber( 0 )
@@ -58,13 +63,27 @@ class QgsExpressionPrivate
 
     ~QgsExpressionPrivate()
     {
+      delete mProgram;
+      delete mOptimizedNode;
       delete mRootNode;
     }
 
+    //! Returns the tree which is evaluated, with the folding done by prepare() if any
+    QgsExpression::Node* evaluationRoot() const { return mOptimizedNode ? mOptimizedNode : mRootNode; }
+
     QAtomicInt ref;
 
     QgsExpression::Node* mRootNode;
 
+    //! Copy of mRootNode with feature independent subtrees folded by prepare(), or nullptr
+    //! if nothing could be folded. Shared by copies until one of them is prepared again,
+    //! copying the private data does not copy it.
+    QgsExpression::Node* mOptimizedNode;
+
+    //! Compiled form of the evaluated tree, created by prepare(). Shared by copies until one
+    //! of them is prepared again, it keeps no state while evaluating so copies may evaluate it concurrently.
+    QgsExpressionProgram* mProgram;
+
     QString mParserErrorString;
     QString mEvalErrorString;
 
@@ -0,0 +1,1734 @@
+/***************************************************************************
+  qgsexpressionprogram.cpp - QgsExpressionProgram
+  -----------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#include "qgsexpressionprogram.h"
+
+#include <QStringList>
+#include <qmath.h>
+
+#include <math.h>
+#include <limits>
+
+#include "qgsexpressioncontext.h"
+
+///@cond PRIVATE
+
+static const char* OpCodeText[] =
+{
+  // this must correspond (number and order of element) to the declaration of the enum OpCode
+  "LOADFIELD", "UNARY", "BINARY", "IN", "CALL", "EVALNODE", "MOVE", "SETNULL", "JUMP", "JUMPIFNULL", "JUMPIFNOTTRUE",
+  "LOADSHARED", "STORESHARED"
+};
+
+void QgsExpressionProgram::Value::setVariant( const QVariant& value )
+{
+  if ( !value.isValid() )
+  {
+    type = Null;
+    return;
+  }
+
+  if ( !value.isNull() )
+  {
+    switch ( value.type() )
+    {
+      case QVariant::Int:
+        setInt( value.toInt() );
+        return;
+      case QVariant::Double:
+        setDouble( value.toDouble() );
+        return;
+      case QVariant::String:
+        setString( value.toString() );
+        return;
+      default:
+        break;
+    }
+  }
+
+  // typed NULLs are kept boxed, so that their type survives the round trip
+  type = Variant;
+  v = value;
+}
+
+QVariant QgsExpressionProgram::Value::toVariant() const
+{
+  switch ( type )
+  {
+    case Int:
+      return QVariant( i );
+    case Double:
+      return QVariant( d );
+    case String:
+      return QVariant( s );
+    case Variant:
+      return v;
+    case Null:
+    default:
+      return QVariant();
+  }
+}
+
+QgsExpressionProgram::Value QgsExpressionProgram::Column::at( int row ) const
+{
+  Value value;
+  switch ( layout )
+  {
+    case Ints:
+      value.setInt( ints.at( row ) );
+      break;
+    case Doubles:
+      value.setDouble( doubles.at( row ) );
+      break;
+    case Values:
+      value = values.at( row );
+      break;
+  }
+  return value;
+}
+
+void QgsExpressionProgram::Column::set( int row, const Value& value )
+{
+  if ( layout == Ints )
+  {
+    values.resize( ints.count() );
+    for ( int i = 0; i < ints.count(); ++i )
+      values[i].setInt( ints.at( i ) );
+  }
+  else if ( layout == Doubles )
+  {
+    values.resize( doubles.count() );
+    for ( int i = 0; i < doubles.count(); ++i )
+      values[i].setDouble( doubles.at( i ) );
+  }
+  layout = Values;
+  values[row] = value;
+}
+
+void QgsExpressionProgram::Column::updateFinite()
+{
+  finite = true;
+  const double* x = doubles.constData();
+  for ( int i = 0; i < doubles.count(); ++i )
+  {
+    if ( !qIsFinite( x[i] ) || qIsNaN( x[i] ) )
+    {
+      finite = false;
+      break;
+    }
+  }
+}
+
+QgsExpressionProgram::QgsExpressionProgram()
+    : mConditionalDepth( 0 )
+    , mShareResults( true )
+    , mResultSlot( -1 )
+    , mFallbackCount( 0 )
+{
+}
+
+QgsExpressionProgram::Dependency QgsExpressionProgram::dependency( QgsExpression::Node* node, const QgsExpressionContext* context )
+{
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+      return Static;
+
+    case QgsExpression::ntColumnRef:
+      return FeatureDependent;
+
+    case QgsExpression::ntUnaryOperator:
+      return dependency( static_cast<QgsExpression::NodeUnaryOperator*>( node )->operand(), context );
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      QgsExpression::NodeBinaryOperator* binary = static_cast<QgsExpression::NodeBinaryOperator*>( node );
+      return qMax( dependency( binary->opLeft(), context ), dependency( binary->opRight(), context ) );
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      QgsExpression::NodeInOperator* in = static_cast<QgsExpression::NodeInOperator*>( node );
+      Dependency result = dependency( in->node(), context );
+      Q_FOREACH ( QgsExpression::Node* item, in->list()->list() )
+        result = qMax( result, dependency( item, context ) );
+      return result;
+    }
+
+    case QgsExpression::ntFunction:
+      return functionDependency( static_cast<QgsExpression::NodeFunction*>( node ), context );
+
+    case QgsExpression::ntCondition:
+    {
+      QgsExpression::NodeCondition* condition = static_cast<QgsExpression::NodeCondition*>( node );
+      Dependency result = condition->elseExp() ? dependency( condition->elseExp(), context ) : Static;
+      Q_FOREACH ( QgsExpression::WhenThen* cond, condition->conditions() )
+      {
+        result = qMax( result, dependency( cond->mWhenExp, context ) );
+        result = qMax( result, dependency( cond->mThenExp, context ) );
+      }
+      return result;
+    }
+  }
+
+  return Volatile;
+}
+
+QgsExpressionProgram::Dependency QgsExpressionProgram::functionDependency( QgsExpression::NodeFunction* node, const QgsExpressionContext* context )
+{
+  // built in functions which return a different value on every call, or read the
+  // evaluation context, the project or other layers
+  static QSet<QString> sVolatileFunctions = QSet<QString>()
+      << "rand" << "randf" << "now" << "uuid" << "eval" << "get_feature" << "layer_property"
+      << "_specialcol_" << "$rownum" << "$scale" << "$map" << "$numpages" << "$page" << "$feature"
+      << "$atlasfeatureid" << "$atlasfeature" << "$atlasgeometry" << "$numfeatures";
+  // built in functions which read the feature without referencing attributes
+  static QSet<QString> sFeatureFunctions = QSet<QString>() << "$id" << "$currentfeature";
+
+  QgsExpression::Function* fd = QgsExpression::Functions()[node->fnIndex()];
+
+  // functions registered by plugins may do anything
+  if ( !dynamic_cast<QgsExpression::StaticFunction*>( fd ) || fd->isContextual()
+       || ( context && context->hasFunction( fd->name() ) ) || sVolatileFunctions.contains( fd->name() ) )
+    return Volatile;
+
+  QList<QgsExpression::Node*> args = node->args() ? node->args()->list() : QList<QgsExpression::Node*>();
+
+  if ( fd->name() == "var" )
+  {
+    // variables set by the global, project, layer and map settings scopes do not change
+    // while rendering, unlike the symbol, geometry part or row number variables
+    QgsExpression::NodeLiteral* name = args.count() == 1 ? dynamic_cast<QgsExpression::NodeLiteral*>( args.at( 0 ) ) : nullptr;
+    if ( !name || !context )
+      return Volatile;
+
+    const QgsExpressionContextScope* scope = context->activeScopeForVariable( name->value().toString() );
+    if ( !scope )
+      return Volatile;
+
+    return scope->isStable() ? Static : Volatile;
+  }
+
+  // lazy functions evaluate their arguments themselves, aggregates even against other layers
+  if ( fd->lazyEval() && fd->name() != "if" )
+    return Volatile;
+
+  Dependency result = fd->usesgeometry() || !fd->referencedColumns().isEmpty() || sFeatureFunctions.contains( fd->name() )
+                      ? FeatureDependent : Static;
+  Q_FOREACH ( QgsExpression::Node* arg, args )
+    result = qMax( result, dependency( arg, context ) );
+  return result;
+}
+
+QgsExpression::Node* QgsExpressionProgram::fold( QgsExpression* parent, QgsExpression::Node* rootNode, const QgsExpressionContext* context )
+{
+  if ( !rootNode )
+    return nullptr;
+
+  int folded = 0;
+  QgsExpression::Node* result = foldNode( parent, rootNode, context, folded );
+  if ( folded == 0 )
+  {
+    delete result;
+    return nullptr;
+  }
+
+  return result;
+}
+
+QgsExpression::Node* QgsExpressionProgram::foldNode( QgsExpression* parent, QgsExpression::Node* node, const QgsExpressionContext* context, int& folded )
+{
+  if ( node->nodeType() != QgsExpression::ntLiteral && dependency( node, context ) == Static )
+  {
+    QVariant value = node->eval( parent, context );
+    if ( !parent->hasEvalError() )
+    {
+      folded++;
+      return new QgsExpression::NodeLiteral( value );
+    }
+
+    // keep the subtree, so that the error is reported when evaluating
+    parent->setEvalErrorString( QString() );
+    return node->clone();
+  }
+
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntUnaryOperator:
+    {
+      QgsExpression::NodeUnaryOperator* unary = static_cast<QgsExpression::NodeUnaryOperator*>( node );
+      return new QgsExpression::NodeUnaryOperator( unary->op(), foldNode( parent, unary->operand(), context, folded ) );
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      QgsExpression::NodeBinaryOperator* binary = static_cast<QgsExpression::NodeBinaryOperator*>( node );
+      QgsExpression::Node* left = foldNode( parent, binary->opLeft(), context, folded );
+      QgsExpression::Node* right = foldNode( parent, binary->opRight(), context, folded );
+      return new QgsExpression::NodeBinaryOperator( binary->op(), left, right );
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      QgsExpression::NodeInOperator* in = static_cast<QgsExpression::NodeInOperator*>( node );
+      QgsExpression::Node* value = foldNode( parent, in->node(), context, folded );
+      QgsExpression::NodeList* list = new QgsExpression::NodeList();
+      Q_FOREACH ( QgsExpression::Node* item, in->list()->list() )
+        list->append( foldNode( parent, item, context, folded ) );
+      return new QgsExpression::NodeInOperator( value, list, in->isNotIn() );
+    }
+
+    case QgsExpression::ntFunction:
+    {
+      QgsExpression::NodeFunction* function = static_cast<QgsExpression::NodeFunction*>( node );
+      QgsExpression::Function* fd = QgsExpression::Functions()[function->fnIndex()];
+      if ( !function->args() || ( fd->lazyEval() && fd->name() != "if" ) )
+        break;
+
+      QgsExpression::NodeList* args = new QgsExpression::NodeList();
+      Q_FOREACH ( QgsExpression::Node* arg, function->args()->list() )
+        args->append( foldNode( parent, arg, context, folded ) );
+      return new QgsExpression::NodeFunction( function->fnIndex(), args );
+    }
+
+    case QgsExpression::ntCondition:
+    {
+      QgsExpression::NodeCondition* condition = static_cast<QgsExpression::NodeCondition*>( node );
+      QgsExpression::WhenThenList conditions;
+      QgsExpression::Node* elseExp = nullptr;
+      bool resolved = false;
+      Q_FOREACH ( QgsExpression::WhenThen* cond, condition->conditions() )
+      {
+        QgsExpression::Node* when = foldNode( parent, cond->mWhenExp, context, folded );
+        QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( when );
+        if ( literal )
+        {
+          bool matches = QgsExpression::NodeCondition::whenMatches( parent, literal->value() );
+          if ( parent->hasEvalError() )
+          {
+            parent->setEvalErrorString( QString() );
+          }
+          else if ( !matches )
+          {
+            // this branch can never be taken
+            delete when;
+            folded++;
+            continue;
+          }
+          else
+          {
+            // this branch is always taken, the following ones never are
+            delete when;
+            elseExp = foldNode( parent, cond->mThenExp, context, folded );
+            resolved = true;
+            folded++;
+            break;
+          }
+        }
+        conditions.append( new QgsExpression::WhenThen( when, foldNode( parent, cond->mThenExp, context, folded ) ) );
+      }
+
+      if ( !resolved && condition->elseExp() )
+        elseExp = foldNode( parent, condition->elseExp(), context, folded );
+
+      if ( conditions.isEmpty() )
+        return elseExp ? elseExp : new QgsExpression::NodeLiteral( QVariant() );
+
+      return new QgsExpression::NodeCondition( conditions, elseExp );
+    }
+
+    case QgsExpression::ntLiteral:
+    case QgsExpression::ntColumnRef:
+      break;
+  }
+
+  return node->clone();
+}
+
+QString QgsExpressionProgram::nodeKey( QgsExpression::Node* node )
+{
+  // unlike dump(), the key keeps the full precision of literals. Literals of other
+  // types, like folded geometries or intervals, have no textual form which identifies
+  // them, so subexpressions containing one get no key
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+    {
+      QVariant value = static_cast<QgsExpression::NodeLiteral*>( node )->value();
+      if ( value.isNull() )
+        return "NULL";
+      switch ( value.type() )
+      {
+        case QVariant::Double:
+          return QString::number( value.toDouble(), 'g', 17 );
+        case QVariant::String:
+          return QgsExpression::quotedString( value.toString() );
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+          return QString( "%1:%2" ).arg( value.typeName(), value.toString() );
+        default:
+          return QString();
+      }
+    }
+
+    case QgsExpression::ntColumnRef:
+      return QgsExpression::quotedColumnRef( static_cast<QgsExpression::NodeColumnRef*>( node )->name() );
+
+    case QgsExpression::ntUnaryOperator:
+    {
+      QgsExpression::NodeUnaryOperator* unary = static_cast<QgsExpression::NodeUnaryOperator*>( node );
+      QString operand = nodeKey( unary->operand() );
+      if ( operand.isEmpty() )
+        return QString();
+      return QString( "(%1 %2)" ).arg( QgsExpression::UnaryOperatorText[unary->op()], operand );
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      QgsExpression::NodeBinaryOperator* binary = static_cast<QgsExpression::NodeBinaryOperator*>( node );
+      QString left = nodeKey( binary->opLeft() );
+      QString right = nodeKey( binary->opRight() );
+      if ( left.isEmpty() || right.isEmpty() )
+        return QString();
+      return QString( "(%1 %2 %3)" ).arg( left, QgsExpression::BinaryOperatorText[binary->op()], right );
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      QgsExpression::NodeInOperator* in = static_cast<QgsExpression::NodeInOperator*>( node );
+      QString operand = nodeKey( in->node() );
+      if ( operand.isEmpty() )
+        return QString();
+      QStringList items;
+      Q_FOREACH ( QgsExpression::Node* item, in->list()->list() )
+      {
+        QString itemKey = nodeKey( item );
+        if ( itemKey.isEmpty() )
+          return QString();
+        items << itemKey;
+      }
+      return QString( "(%1 %2 (%3))" ).arg( operand, in->isNotIn() ? "NOT IN" : "IN", items.join( "," ) );
+    }
+
+    case QgsExpression::ntFunction:
+    {
+      QgsExpression::NodeFunction* function = static_cast<QgsExpression::NodeFunction*>( node );
+      QStringList args;
+      if ( function->args() )
+      {
+        Q_FOREACH ( QgsExpression::Node* arg, function->args()->list() )
+        {
+          QString argKey = nodeKey( arg );
+          if ( argKey.isEmpty() )
+            return QString();
+          args << argKey;
+        }
+      }
+      return QString( "%1(%2)" ).arg( QgsExpression::Functions()[function->fnIndex()]->name(), args.join( "," ) );
+    }
+
+    case QgsExpression::ntCondition:
+    {
+      QgsExpression::NodeCondition* condition = static_cast<QgsExpression::NodeCondition*>( node );
+      QString key = "(CASE";
+      Q_FOREACH ( QgsExpression::WhenThen* cond, condition->conditions() )
+      {
+        QString whenKey = nodeKey( cond->mWhenExp );
+        QString thenKey = nodeKey( cond->mThenExp );
+        if ( whenKey.isEmpty() || thenKey.isEmpty() )
+          return QString();
+        key += QString( " WHEN %1 THEN %2" ).arg( whenKey, thenKey );
+      }
+      if ( condition->elseExp() )
+      {
+        QString elseKey = nodeKey( condition->elseExp() );
+        if ( elseKey.isEmpty() )
+          return QString();
+        key += " ELSE " + elseKey;
+      }
+      return key + " END)";
+    }
+  }
+
+  return node->dump();
+}
+
+QgsExpressionProgram* QgsExpressionProgram::compile( QgsExpression* parent, QgsExpression::Node* rootNode, const QgsExpressionContext* context )
+{
+  if ( !rootNode )
+    return nullptr;
+
+  QgsExpressionProgram* program = new QgsExpressionProgram();
+  // $area, $length and $perimeter depend on the calculator and units of the expression
+  program->mShareResults = !parent || !parent->geomCalculator();
+  program->mResultSlot = program->compileNode( rootNode, context );
+
+  if ( program->mFallbackCount > 0 && program->mFallbackCount == program->mCode.count() )
+  {
+    // nothing was lowered, the tree interpreter is at least as fast
+    delete program;
+    return nullptr;
+  }
+
+  return program;
+}
+
+int QgsExpressionProgram::addConstant( const QVariant& value )
+{
+  Value constant;
+  constant.setVariant( value );
+  mSlots.append( constant );
+  mConstantSlots.append( true );
+  return mSlots.count() - 1;
+}
+
+int QgsExpressionProgram::addRegister()
+{
+  mSlots.append( Value() );
+  mConstantSlots.append( false );
+  return mSlots.count() - 1;
+}
+
+int QgsExpressionProgram::addInstruction( const Instruction& instruction )
+{
+  mCode.append( instruction );
+  return mCode.count() - 1;
+}
+
+int QgsExpressionProgram::compileNode( QgsExpression::Node* node, const QgsExpressionContext* context )
+{
+  // identical subexpressions are only evaluated once, provided that their first
+  // occurrence is evaluated unconditionally
+  QString key;
+  if ( node->nodeType() != QgsExpression::ntLiteral && node->nodeType() != QgsExpression::ntColumnRef
+       && dependency( node, context ) != Volatile )
+  {
+    key = nodeKey( node );
+    QHash<QString, int>::const_iterator it = key.isEmpty() ? mCommonSlots.constEnd() : mCommonSlots.constFind( key );
+    if ( it != mCommonSlots.constEnd() )
+      return it.value();
+  }
+
+  int slot = compileOperation( node, context );
+  if ( !key.isEmpty() && mConditionalDepth == 0 )
+    mCommonSlots.insert( key, slot );
+  return slot;
+}
+
+int QgsExpressionProgram::compileOperation( QgsExpression::Node* node, const QgsExpressionContext* context )
+{
+  switch ( node->nodeType() )
+  {
+    case QgsExpression::ntLiteral:
+    {
+      QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( node );
+      if ( !literal )
+        break;
+
+      return addConstant( literal->value() );
+    }
+
+    case QgsExpression::ntColumnRef:
+    {
+      QgsExpression::NodeColumnRef* columnRef = dynamic_cast<QgsExpression::NodeColumnRef*>( node );
+      if ( !columnRef || columnRef->index() < 0 )
+        break;
+
+      Instruction ins( opLoadField, addRegister(), columnRef->index() );
+      ins.node = node;
+      addInstruction( ins );
+      return ins.dst;
+    }
+
+    case QgsExpression::ntUnaryOperator:
+    {
+      QgsExpression::NodeUnaryOperator* unary = dynamic_cast<QgsExpression::NodeUnaryOperator*>( node );
+      if ( !unary )
+        break;
+
+      int operand = compileNode( unary->operand(), context );
+      Instruction ins( opUnary, addRegister(), operand );
+      ins.node = node;
+      addInstruction( ins );
+      return ins.dst;
+    }
+
+    case QgsExpression::ntBinaryOperator:
+    {
+      QgsExpression::NodeBinaryOperator* binary = dynamic_cast<QgsExpression::NodeBinaryOperator*>( node );
+      if ( !binary )
+        break;
+
+      int left = compileNode( binary->opLeft(), context );
+      int right = compileNode( binary->opRight(), context );
+      Instruction ins( opBinary, addRegister(), left, right );
+      ins.node = node;
+      addInstruction( ins );
+      return ins.dst;
+    }
+
+    case QgsExpression::ntInOperator:
+    {
+      QgsExpression::NodeInOperator* in = dynamic_cast<QgsExpression::NodeInOperator*>( node );
+      if ( !in )
+        break;
+
+      return compileIn( in, context );
+    }
+
+    case QgsExpression::ntFunction:
+    {
+      QgsExpression::NodeFunction* function = dynamic_cast<QgsExpression::NodeFunction*>( node );
+      if ( !function )
+        break;
+
+      return compileFunction( function, context );
+    }
+
+    case QgsExpression::ntCondition:
+    {
+      QgsExpression::NodeCondition* condition = dynamic_cast<QgsExpression::NodeCondition*>( node );
+      if ( !condition )
+        break;
+
+      return compileCondition( condition, context );
+    }
+  }
+
+  return compileFallback( node );
+}
+
+int QgsExpressionProgram::compileFallback( QgsExpression::Node* node )
+{
+  Instruction ins( opEvalNode, addRegister() );
+  ins.node = node;
+  addInstruction( ins );
+  mFallbackCount++;
+  return ins.dst;
+}
+
+int QgsExpressionProgram::compileIn( QgsExpression::NodeInOperator* node, const QgsExpressionContext* context )
+{
+  QList<QgsExpression::Node*> items = node->list()->list();
+  if ( items.isEmpty() )
+  {
+    // the tested value is not even evaluated in this case
+    return addConstant( QVariant( node->isNotIn() ? 1 : 0 ) );
+  }
+
+  int value = compileNode( node->node(), context );
+  Instruction ins( opIn, addRegister(), value );
+  ins.node = node;
+
+  InList list;
+  bool allLiterals = true;
+  Q_FOREACH ( QgsExpression::Node* item, items )
+  {
+    QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( item );
+    if ( !literal )
+    {
+      allLiterals = false;
+      break;
+    }
+
+    QVariant itemValue = literal->value();
+    if ( itemValue.isNull() )
+    {
+      list.hasNull = true;
+    }
+    else if ( itemValue.type() == QVariant::Int )
+    {
+      list.ints.insert( itemValue.toInt() );
+      list.allString = false;
+    }
+    else if ( itemValue.type() == QVariant::String )
+    {
+      list.strings.insert( itemValue.toString() );
+      list.allInt = false;
+    }
+    else
+    {
+      list.allInt = false;
+      list.allString = false;
+    }
+  }
+
+  if ( allLiterals && ( list.allInt || list.allString ) )
+  {
+    ins.b = mInLists.count();
+    mInLists.append( list );
+  }
+
+  addInstruction( ins );
+  return ins.dst;
+}
+
+int QgsExpressionProgram::compileFunction( QgsExpression::NodeFunction* node, const QgsExpressionContext* context )
+{
+  QgsExpression::Function* fd = QgsExpression::Functions()[node->fnIndex()];
+
+  // lazy functions work on the nodes themselves and contextual functions are
+  // looked up in the evaluation context, so leave both to the tree
+  if ( fd->lazyEval() || fd->isContextual() || ( context && context->hasFunction( fd->name() ) ) )
+    return compileFallback( node );
+
+  int dst = addRegister();
+
+  // results of feature dependent calls may already have been computed by another
+  // expression evaluated for the same feature
+  int sharedKey = -1;
+  int loadShared = -1;
+  QString key = mShareResults && dependency( node, context ) == FeatureDependent ? nodeKey( node ) : QString();
+  if ( !key.isEmpty() )
+  {
+    sharedKey = mSharedKeys.count();
+    mSharedKeys << key;
+    loadShared = addInstruction( Instruction( opLoadShared, dst, sharedKey ) );
+    mConditionalDepth++;
+  }
+
+  QVector<int> argSlots;
+  QList<int> nullJumps;
+  if ( node->args() )
+  {
+    Q_FOREACH ( QgsExpression::Node* arg, node->args()->list() )
+    {
+      int slot = compileNode( arg, context );
+      argSlots.append( slot );
+
+      // "normal" functions return NULL as soon as any argument is NULL,
+      // without evaluating the remaining arguments
+      QgsExpression::NodeLiteral* literal = dynamic_cast<QgsExpression::NodeLiteral*>( arg );
+      if ( !fd->handlesNull() && !( literal && !literal->value().isNull() ) )
+      {
+        if ( nullJumps.isEmpty() )
+          mConditionalDepth++;
+        nullJumps.append( addInstruction( Instruction( opJumpIfNull, -1, slot ) ) );
+      }
+    }
+  }
+
+  Instruction call( opCall, dst, mArgSlots.count(), argSlots.count() );
+  call.node = node;
+  call.function = fd;
+  mArgSlots += argSlots;
+  addInstruction( call );
+
+  if ( !nullJumps.isEmpty() )
+  {
+    int jumpToEnd = addInstruction( Instruction( opJump ) );
+    Q_FOREACH ( int jump, nullJumps )
+      mCode[jump].b = mCode.count();
+    addInstruction( Instruction( opSetNull, dst ) );
+    mCode[jumpToEnd].b = mCode.count();
+    mConditionalDepth--;
+  }
+
+  if ( sharedKey >= 0 )
+  {
+    addInstruction( Instruction( opStoreShared, -1, dst, sharedKey ) );
+    mCode[loadShared].b = mCode.count();
+    mConditionalDepth--;
+  }
+
+  return dst;
+}
+
+int QgsExpressionProgram::compileCondition( QgsExpression::NodeCondition* node, const QgsExpressionContext* context )
+{
+  int dst = addRegister();
+
+  // only the first condition is evaluated unconditionally
+  const int depth = mConditionalDepth;
+
+  QList<int> jumpsToEnd;
+  Q_FOREACH ( QgsExpression::WhenThen* cond, node->conditions() )
+  {
+    int when = compileNode( cond->mWhenExp, context );
+    int jumpToNext = addInstruction( Instruction( opJumpIfNotTrue, -1, when ) );
+    mConditionalDepth = depth + 1;
+    int then = compileNode( cond->mThenExp, context );
+    addInstruction( Instruction( opMove, dst, then ) );
+    jumpsToEnd.append( addInstruction( Instruction( opJump ) ) );
+    mCode[jumpToNext].b = mCode.count();
+  }
+
+  if ( node->elseExp() )
+  {
+    int elseSlot = compileNode( node->elseExp(), context );
+    addInstruction( Instruction( opMove, dst, elseSlot ) );
+  }
+  else
+  {
+    addInstruction( Instruction( opSetNull, dst ) );
+  }
+
+  Q_FOREACH ( int jump, jumpsToEnd )
+    mCode[jump].b = mCode.count();
+
+  mConditionalDepth = depth;
+  return dst;
+}
+
+QVariant QgsExpressionProgram::evaluate( QgsExpression* parent, const QgsExpressionContext* context ) const
+{
+  const Instruction* code = mCode.constData();
+  const int* argSlots = mArgSlots.constData();
+  const int codeSize = mCode.count();
+
+  // the slots are local to the call, as copies of the expression share the program
+  QVector<Value> slotValues( mSlots );
+  Value* slots = slotValues.data();
+
+  // the feature is only fetched from the context once per evaluation
+  bool featureFetched = false;
+  bool hasFeature = false;
+  QgsFeature feature;
+
+  int pc = 0;
+  while ( pc < codeSize )
+  {
+    const Instruction& ins = code[pc++];
+    switch ( ins.op )
+    {
+      case opLoadField:
+      {
+        if ( !featureFetched )
+        {
+          hasFeature = context && context->hasVariable( QgsExpressionContext::EXPR_FEATURE );
+          if ( hasFeature )
+            feature = context->feature();
+          featureFetched = true;
+        }
+
+        if ( hasFeature )
+          slots[ins.dst].setVariant( feature.attribute( ins.a ) );
+        else
+          slots[ins.dst].setString( '[' + static_cast<QgsExpression::NodeColumnRef*>( ins.node )->name() + ']' );
+        break;
+      }
+
+      case opUnary:
+      {
+        QgsExpression::NodeUnaryOperator* node = static_cast<QgsExpression::NodeUnaryOperator*>( ins.node );
+        if ( !unaryFast( node->op(), slots[ins.a], slots[ins.dst] ) )
+        {
+          slots[ins.dst].setVariant( node->evalOperation( parent, slots[ins.a].toVariant() ) );
+          if ( parent->hasEvalError() )
+            return QVariant();
+        }
+        break;
+      }
+
+      case opBinary:
+      {
+        QgsExpression::NodeBinaryOperator* node = static_cast<QgsExpression::NodeBinaryOperator*>( ins.node );
+        if ( !binaryFast( node->op(), slots[ins.a], slots[ins.b], slots[ins.dst] ) )
+        {
+          slots[ins.dst].setVariant( node->evalOperation( parent, slots[ins.a].toVariant(), slots[ins.b].toVariant() ) );
+          if ( parent->hasEvalError() )
+            return QVariant();
+        }
+        break;
+      }
+
+      case opIn:
+      {
+        QgsExpression::NodeInOperator* node = static_cast<QgsExpression::NodeInOperator*>( ins.node );
+        if ( ins.b < 0 || !inFast( mInLists.at( ins.b ), node->isNotIn(), slots[ins.a], slots[ins.dst] ) )
+        {
+          slots[ins.dst].setVariant( node->evalOperation( parent, context, slots[ins.a].toVariant() ) );
+          if ( parent->hasEvalError() )
+            return QVariant();
+        }
+        break;
+      }
+
+      case opCall:
+      {
+        QVariantList values;
+        values.reserve( ins.b );
+        for ( int i = 0; i < ins.b; ++i )
+          values.append( slots[argSlots[ins.a + i]].toVariant() );
+
+        slots[ins.dst].setVariant( ins.function->func( values, context, parent ) );
+        if ( parent->hasEvalError() )
+          return QVariant();
+        break;
+      }
+
+      case opEvalNode:
+      {
+        slots[ins.dst].setVariant( ins.node->eval( parent, context ) );
+        if ( parent->hasEvalError() )
+          return QVariant();
+        break;
+      }
+
+      case opMove:
+        slots[ins.dst] = slots[ins.a];
+        break;
+
+      case opSetNull:
+        slots[ins.dst].setNull();
+        break;
+
+      case opJump:
+        pc = ins.b;
+        break;
+
+      case opJumpIfNull:
+        if ( slots[ins.a].isNull() )
+          pc = ins.b;
+        break;
+
+      case opLoadShared:
+        if ( context && context->subexpressionSharingEnabled() && context->hasSharedValue( mSharedKeys.at( ins.a ) ) )
+        {
+          slots[ins.dst].setVariant( context->sharedValue( mSharedKeys.at( ins.a ) ) );
+          pc = ins.b;
+        }
+        break;
+
+      case opStoreShared:
+        if ( context && context->subexpressionSharingEnabled() )
+          context->setSharedValue( mSharedKeys.at( ins.b ), slots[ins.a].toVariant() );
+        break;
+
+      case opJumpIfNotTrue:
+      {
+        TVL tvl;
+        bool matches;
+        if ( tvlFast( slots[ins.a], tvl ) )
+        {
+          matches = tvl == True;
+        }
+        else
+        {
+          matches = QgsExpression::NodeCondition::whenMatches( parent, slots[ins.a].toVariant() );
+          if ( parent->hasEvalError() )
+            return QVariant();
+        }
+
+        if ( !matches )
+          pc = ins.b;
+        break;
+      }
+    }
+  }
+
+  return slots[mResultSlot].toVariant();
+}
+
+QVariantList QgsExpressionProgram::evaluateBatch( QgsExpression* parent, const QgsFeatureList& features, QgsExpressionContext* context ) const
+{
+  const int rows = features.count();
+  QVariantList results;
+  if ( rows == 0 )
+    return results;
+
+  // the columns are local to the call, as copies of the expression share the program
+  Block block;
+  prepareColumns( block, rows );
+
+  const Instruction* code = mCode.constData();
+  const int* argSlots = mArgSlots.constData();
+  const int codeSize = mCode.count();
+  Column* columns = block.columns.data();
+
+  // all jumps go forward, so a row takes part in an instruction as long as
+  // it has not jumped past it
+  const int finished = std::numeric_limits<int>::max();
+  QVector<int> rowPc( rows, 0 );
+  QVector<int> active;
+  active.reserve( rows );
+
+  // the context only holds a feature for instructions which call back into
+  // functions or the tree
+  int contextRow = -1;
+  QString firstError;
+
+#define SET_CONTEXT_ROW( row ) \
+  if ( contextRow != row ) \
+  { \
+    context->setFeature( features.at( row ) ); \
+    contextRow = row; \
+  }
+
+#define CHECK_ROW_ERROR( row ) \
+  if ( parent->hasEvalError() ) \
+  { \
+    if ( firstError.isNull() ) \
+      firstError = parent->evalErrorString(); \
+    parent->setEvalErrorString( QString() ); \
+    rowPc[row] = finished; \
+    continue; \
+  }
+
+  for ( int pc = 0; pc < codeSize; ++pc )
+  {
+    active.resize( 0 );
+    for ( int row = 0; row < rows; ++row )
+    {
+      if ( rowPc[row] <= pc )
+        active.append( row );
+    }
+    if ( active.isEmpty() )
+      continue;
+
+    const bool allActive = active.count() == rows;
+    const Instruction& ins = code[pc];
+    switch ( ins.op )
+    {
+      case opLoadField:
+      {
+        if ( allActive )
+        {
+          loadColumn( columns[ins.dst], ins.a, features );
+        }
+        else
+        {
+          Value value;
+          Q_FOREACH ( int row, active )
+          {
+            value.setVariant( features.at( row ).attribute( ins.a ) );
+            columns[ins.dst].set( row, value );
+          }
+        }
+        break;
+      }
+
+      case opUnary:
+      {
+        QgsExpression::NodeUnaryOperator* node = static_cast<QgsExpression::NodeUnaryOperator*>( ins.node );
+        Value result;
+        Q_FOREACH ( int row, active )
+        {
+          const Value operand = columns[ins.a].at( row );
+          if ( !unaryFast( node->op(), operand, result ) )
+          {
+            result.setVariant( node->evalOperation( parent, operand.toVariant() ) );
+            CHECK_ROW_ERROR( row );
+          }
+          columns[ins.dst].set( row, result );
+        }
+        break;
+      }
+
+      case opBinary:
+      {
+        QgsExpression::NodeBinaryOperator* node = static_cast<QgsExpression::NodeBinaryOperator*>( ins.node );
+        if ( allActive && binaryColumns( block, node->op(), columns[ins.a], columns[ins.b], columns[ins.dst], rows ) )
+          break;
+
+        Value result;
+        Q_FOREACH ( int row, active )
+        {
+          const Value left = columns[ins.a].at( row );
+          const Value right = columns[ins.b].at( row );
+          if ( !binaryFast( node->op(), left, right, result ) )
+          {
+            result.setVariant( node->evalOperation( parent, left.toVariant(), right.toVariant() ) );
+            CHECK_ROW_ERROR( row );
+          }
+          columns[ins.dst].set( row, result );
+        }
+        break;
+      }
+
+      case opIn:
+      {
+        QgsExpression::NodeInOperator* node = static_cast<QgsExpression::NodeInOperator*>( ins.node );
+        Value result;
+        Q_FOREACH ( int row, active )
+        {
+          const Value value = columns[ins.a].at( row );
+          if ( ins.b < 0 || !inFast( mInLists.at( ins.b ), node->isNotIn(), value, result ) )
+          {
+            SET_CONTEXT_ROW( row );
+            result.setVariant( node->evalOperation( parent, context, value.toVariant() ) );
+            CHECK_ROW_ERROR( row );
+          }
+          columns[ins.dst].set( row, result );
+        }
+        break;
+      }
+
+      case opCall:
+      {
+        Value result;
+        QVariantList values;
+        values.reserve( ins.b );
+        Q_FOREACH ( int row, active )
+        {
+          values.clear();
+          for ( int i = 0; i < ins.b; ++i )
+            values.append( columns[argSlots[ins.a + i]].at( row ).toVariant() );
+
+          SET_CONTEXT_ROW( row );
+          result.setVariant( ins.function->func( values, context, parent ) );
+          CHECK_ROW_ERROR( row );
+          columns[ins.dst].set( row, result );
+        }
+        break;
+      }
+
+      case opEvalNode:
+      {
+        Value result;
+        Q_FOREACH ( int row, active )
+        {
+          SET_CONTEXT_ROW( row );
+          result.setVariant( ins.node->eval( parent, context ) );
+          CHECK_ROW_ERROR( row );
+          columns[ins.dst].set( row, result );
+        }
+        break;
+      }
+
+      case opMove:
+      {
+        if ( allActive )
+        {
+          // whole columns are implicitly shared, nothing is copied here
+          columns[ins.dst] = columns[ins.a];
+        }
+        else
+        {
+          Q_FOREACH ( int row, active )
+            columns[ins.dst].set( row, columns[ins.a].at( row ) );
+        }
+        break;
+      }
+
+      case opSetNull:
+      {
+        Value null;
+        Q_FOREACH ( int row, active )
+          columns[ins.dst].set( row, null );
+        break;
+      }
+
+      case opJump:
+        Q_FOREACH ( int row, active )
+          rowPc[row] = ins.b;
+        break;
+
+      case opJumpIfNull:
+        Q_FOREACH ( int row, active )
+        {
+          if ( columns[ins.a].at( row ).isNull() )
+            rowPc[row] = ins.b;
+        }
+        break;
+
+      case opLoadShared:
+      case opStoreShared:
+        // shared results only hold values for the feature set in the context
+        break;
+
+      case opJumpIfNotTrue:
+      {
+        Q_FOREACH ( int row, active )
+        {
+          const Value value = columns[ins.a].at( row );
+          TVL tvl;
+          bool matches;
+          if ( tvlFast( value, tvl ) )
+          {
+            matches = tvl == True;
+          }
+          else
+          {
+            matches = QgsExpression::NodeCondition::whenMatches( parent, value.toVariant() );
+            CHECK_ROW_ERROR( row );
+          }
+
+          if ( !matches )
+            rowPc[row] = ins.b;
+        }
+        break;
+      }
+    }
+  }
+
+#undef SET_CONTEXT_ROW
+#undef CHECK_ROW_ERROR
+
+  results.reserve( rows );
+  const Column& resultColumn = columns[mResultSlot];
+  for ( int row = 0; row < rows; ++row )
+  {
+    if ( rowPc[row] == finished )
+      results.append( QVariant() );
+    else
+      results.append( resultColumn.at( row ).toVariant() );
+  }
+
+  if ( !firstError.isNull() )
+    parent->setEvalErrorString( firstError );
+
+  return results;
+}
+
+void QgsExpressionProgram::prepareColumns( Block& block, int rows ) const
+{
+  block.columns.resize( mSlots.count() );
+
+  for ( int slot = 0; slot < mSlots.count(); ++slot )
+  {
+    Column& column = block.columns[slot];
+    if ( !mConstantSlots.at( slot ) )
+    {
+      column.layout = Column::Values;
+      column.values.fill( Value(), rows );
+      continue;
+    }
+
+    // constants are broadcast to the whole block
+    const Value& constant = mSlots.at( slot );
+    if ( constant.type == Value::Int )
+    {
+      column.layout = Column::Ints;
+      column.ints.fill( constant.i, rows );
+    }
+    else if ( constant.type == Value::Double )
+    {
+      column.layout = Column::Doubles;
+      column.doubles.fill( constant.d, rows );
+      column.updateFinite();
+    }
+    else
+    {
+      column.layout = Column::Values;
+      column.values.fill( constant, rows );
+    }
+  }
+}
+
+void QgsExpressionProgram::loadColumn( Column& column, int index, const QgsFeatureList& features )
+{
+  const int rows = features.count();
+
+  column.layout = Column::Values;
+  column.values.resize( rows );
+  Value* values = column.values.data();
+
+  bool allInt = true;
+  bool allDouble = true;
+  for ( int row = 0; row < rows; ++row )
+  {
+    values[row].setVariant( features.at( row ).attribute( index ) );
+    allInt = allInt && values[row].type == Value::Int;
+    allDouble = allDouble && values[row].type == Value::Double;
+  }
+
+  // uniformly typed attributes are unboxed, so that the arithmetic runs over plain arrays
+  if ( allInt )
+  {
+    column.ints.resize( rows );
+    for ( int row = 0; row < rows; ++row )
+      column.ints[row] = values[row].i;
+    column.layout = Column::Ints;
+  }
+  else if ( allDouble )
+  {
+    column.doubles.resize( rows );
+    for ( int row = 0; row < rows; ++row )
+      column.doubles[row] = values[row].d;
+    column.layout = Column::Doubles;
+    column.updateFinite();
+  }
+}
+
+const double* QgsExpressionProgram::columnDoubles( const Column& column, QVector<double>& scratch, int rows )
+{
+  if ( column.layout == Column::Doubles )
+    return column.doubles.constData();
+
+  scratch.resize( rows );
+  const int* ints = column.ints.constData();
+  double* x = scratch.data();
+  for ( int i = 0; i < rows; ++i )
+    x[i] = ints[i];
+  return x;
+}
+
+bool QgsExpressionProgram::binaryColumns( Block& block, QgsExpression::BinaryOperator op, const Column& left, const Column& right, Column& result, int rows )
+{
+  // only columns without NULLs and non finite values can skip the per value checks
+  if ( !left.isNumeric() || !right.isNumeric() )
+    return false;
+
+  if ( left.layout == Column::Ints && right.layout == Column::Ints
+       && ( op == QgsExpression::boPlus || op == QgsExpression::boMinus || op == QgsExpression::boMul ) )
+  {
+    result.layout = Column::Ints;
+    result.ints.resize( rows );
+    const int* x = left.ints.constData();
+    const int* y = right.ints.constData();
+    int* out = result.ints.data();
+    switch ( op )
+    {
+      case QgsExpression::boPlus:
+        for ( int i = 0; i < rows; ++i )
+          out[i] = x[i] + y[i];
+        break;
+      case QgsExpression::boMinus:
+        for ( int i = 0; i < rows; ++i )
+          out[i] = x[i] - y[i];
+        break;
+      default:
+        for ( int i = 0; i < rows; ++i )
+          out[i] = x[i] * y[i];
+        break;
+    }
+    return true;
+  }
+
+  switch ( op )
+  {
+    case QgsExpression::boPlus:
+    case QgsExpression::boMinus:
+    case QgsExpression::boMul:
+    case QgsExpression::boDiv:
+    case QgsExpression::boPow:
+    {
+      const double* x = columnDoubles( left, block.scratchLeft, rows );
+      const double* y = columnDoubles( right, block.scratchRight, rows );
+
+      if ( op == QgsExpression::boDiv )
+      {
+        // divisions by zero return NULL, leave them to the per value path
+        for ( int i = 0; i < rows; ++i )
+        {
+          if ( y[i] == 0. )
+            return false;
+        }
+      }
+
+      result.layout = Column::Doubles;
+      result.doubles.resize( rows );
+      double* out = result.doubles.data();
+      switch ( op )
+      {
+        case QgsExpression::boPlus:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] + y[i];
+          break;
+        case QgsExpression::boMinus:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] - y[i];
+          break;
+        case QgsExpression::boMul:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] * y[i];
+          break;
+        case QgsExpression::boDiv:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] / y[i];
+          break;
+        default:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = pow( x[i], y[i] );
+          break;
+      }
+      result.updateFinite();
+      return true;
+    }
+
+    case QgsExpression::boEQ:
+    case QgsExpression::boNE:
+    case QgsExpression::boLT:
+    case QgsExpression::boGT:
+    case QgsExpression::boLE:
+    case QgsExpression::boGE:
+    {
+      const double* x = columnDoubles( left, block.scratchLeft, rows );
+      const double* y = columnDoubles( right, block.scratchRight, rows );
+
+      result.layout = Column::Ints;
+      result.ints.resize( rows );
+      int* out = result.ints.data();
+      switch ( op )
+      {
+        case QgsExpression::boEQ:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = qgsDoubleNear( x[i] - y[i], 0.0 ) ? 1 : 0;
+          break;
+        case QgsExpression::boNE:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = qgsDoubleNear( x[i] - y[i], 0.0 ) ? 0 : 1;
+          break;
+        case QgsExpression::boLT:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] - y[i] < 0 ? 1 : 0;
+          break;
+        case QgsExpression::boGT:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] - y[i] > 0 ? 1 : 0;
+          break;
+        case QgsExpression::boLE:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] - y[i] <= 0 ? 1 : 0;
+          break;
+        default:
+          for ( int i = 0; i < rows; ++i )
+            out[i] = x[i] - y[i] >= 0 ? 1 : 0;
+          break;
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+bool QgsExpressionProgram::tvlFast( const Value& value, TVL& result )
+{
+  switch ( value.type )
+  {
+    case Value::Null:
+      result = Unknown;
+      return true;
+    case Value::Int:
+      result = value.i != 0 ? True : False;
+      return true;
+    case Value::Double:
+      result = !qgsDoubleNear( value.d, 0.0 ) ? True : False;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool QgsExpressionProgram::compare( QgsExpression::BinaryOperator op, double diff )
+{
+  switch ( op )
+  {
+    case QgsExpression::boEQ:
+      return qgsDoubleNear( diff, 0.0 );
+    case QgsExpression::boNE:
+      return !qgsDoubleNear( diff, 0.0 );
+    case QgsExpression::boLT:
+      return diff < 0;
+    case QgsExpression::boGT:
+      return diff > 0;
+    case QgsExpression::boLE:
+      return diff <= 0;
+    case QgsExpression::boGE:
+      return diff >= 0;
+    default:
+      Q_ASSERT( false );
+      return false;
+  }
+}
+
+bool QgsExpressionProgram::unaryFast( QgsExpression::UnaryOperator op, const Value& value, Value& result )
+{
+  switch ( op )
+  {
+    case QgsExpression::uoNot:
+    {
+      TVL tvl;
+      if ( !tvlFast( value, tvl ) )
+        return false;
+
+      if ( tvl == Unknown )
+        result.setNull();
+      else
+        result.setInt( tvl == True ? 0 : 1 );
+      return true;
+    }
+
+    case QgsExpression::uoMinus:
+      if ( value.type == Value::Int )
+        result.setInt( -value.i );
+      else if ( value.isNumber() )
+        result.setDouble( -value.d );
+      else
+        return false;
+      return true;
+  }
+
+  return false;
+}
+
+bool QgsExpressionProgram::binaryFast( QgsExpression::BinaryOperator op, const Value& left, const Value& right, Value& result )
+{
+  if ( left.type == Value::Variant || right.type == Value::Variant )
+    return false;
+
+  switch ( op )
+  {
+    case QgsExpression::boPlus:
+      if ( left.type == Value::String && right.type == Value::String )
+      {
+        result.setString( left.s + right.s );
+        return true;
+      }
+      //intentional fall-through
+      FALLTHROUGH;
+    case QgsExpression::boMinus:
+    case QgsExpression::boMul:
+    case QgsExpression::boDiv:
+    case QgsExpression::boMod:
+    {
+      if ( left.type == Value::Null || right.type == Value::Null )
+      {
+        result.setNull();
+        return true;
+      }
+
+      if ( op != QgsExpression::boDiv && left.type == Value::Int && right.type == Value::Int )
+      {
+        // both are integers - use integer arithmetics
+        const int x = left.i;
+        const int y = right.i;
+        switch ( op )
+        {
+          case QgsExpression::boPlus:
+            result.setInt( x + y );
+            break;
+          case QgsExpression::boMinus:
+            result.setInt( x - y );
+            break;
+          case QgsExpression::boMul:
+            result.setInt( x * y );
+            break;
+          default:
+            if ( y == 0 )
+              result.setNull();
+            else
+              result.setInt( x % y );
+            break;
+        }
+        return true;
+      }
+
+      if ( !left.isNumber() || !right.isNumber() )
+        return false;
+
+      const double x = left.toDouble();
+      const double y = right.toDouble();
+      switch ( op )
+      {
+        case QgsExpression::boPlus:
+          result.setDouble( x + y );
+          break;
+        case QgsExpression::boMinus:
+          result.setDouble( x - y );
+          break;
+        case QgsExpression::boMul:
+          result.setDouble( x * y );
+          break;
+        case QgsExpression::boDiv:
+          if ( y == 0. )
+            result.setNull(); // silently handle division by zero and return NULL
+          else
+            result.setDouble( x / y );
+          break;
+        default:
+          if ( y == 0. )
+            result.setNull();
+          else
+            result.setDouble( fmod( x, y ) );
+          break;
+      }
+      return true;
+    }
+
+    case QgsExpression::boIntDiv:
+      // NULL operands are reported as conversion errors by the tree
+      if ( !left.isNumber() || !right.isNumber() )
+        return false;
+
+      if ( right.toDouble() == 0. )
+        result.setNull();
+      else
+        result.setInt( qFloor( left.toDouble() / right.toDouble() ) );
+      return true;
+
+    case QgsExpression::boPow:
+      if ( left.type == Value::Null || right.type == Value::Null )
+        result.setNull();
+      else if ( left.isNumber() && right.isNumber() )
+        result.setDouble( pow( left.toDouble(), right.toDouble() ) );
+      else
+        return false;
+      return true;
+
+    case QgsExpression::boAnd:
+    case QgsExpression::boOr:
+    {
+      TVL tvlL, tvlR;
+      if ( !tvlFast( left, tvlL ) || !tvlFast( right, tvlR ) )
+        return false;
+
+      TVL tvl;
+      if ( op == QgsExpression::boAnd )
+        tvl = tvlL == False || tvlR == False ? False : ( tvlL == Unknown || tvlR == Unknown ? Unknown : True );
+      else
+        tvl = tvlL == True || tvlR == True ? True : ( tvlL == Unknown || tvlR == Unknown ? Unknown : False );
+
+      if ( tvl == Unknown )
+        result.setNull();
+      else
+        result.setInt( tvl == True ? 1 : 0 );
+      return true;
+    }
+
+    case QgsExpression::boEQ:
+    case QgsExpression::boNE:
+    case QgsExpression::boLT:
+    case QgsExpression::boGT:
+    case QgsExpression::boLE:
+    case QgsExpression::boGE:
+      if ( left.type == Value::Null || right.type == Value::Null )
+        result.setNull();
+      else if ( left.isNumber() && right.isNumber() )
+        result.setInt( compare( op, left.toDouble() - right.toDouble() ) ? 1 : 0 );
+      else if ( left.type == Value::String && right.type == Value::String )
+        result.setInt( compare( op, QString::compare( left.s, right.s ) ) ? 1 : 0 );
+      else
+        return false;
+      return true;
+
+    case QgsExpression::boIs:
+    case QgsExpression::boIsNot:
+    {
+      bool equal;
+      if ( left.type == Value::Null || right.type == Value::Null )
+        equal = left.type == right.type;
+      else if ( left.isNumber() && right.isNumber() )
+        equal = qgsDoubleNear( left.toDouble(), right.toDouble() );
+      else if ( left.type == Value::String && right.type == Value::String )
+        equal = QString::compare( left.s, right.s ) == 0;
+      else
+        return false;
+
+      result.setInt( equal == ( op == QgsExpression::boIs ) ? 1 : 0 );
+      return true;
+    }
+
+    case QgsExpression::boRegexp:
+    case QgsExpression::boLike:
+    case QgsExpression::boNotLike:
+    case QgsExpression::boILike:
+    case QgsExpression::boNotILike:
+      if ( left.type != Value::Null && right.type != Value::Null )
+        return false;
+
+      result.setNull();
+      return true;
+
+    case QgsExpression::boConcat:
+      if ( left.type == Value::Null || right.type == Value::Null )
+        result.setNull();
+      else if ( left.type == Value::String && right.type == Value::String )
+        result.setString( left.s + right.s );
+      else
+        return false;
+      return true;
+  }
+
+  return false;
+}
+
+bool QgsExpressionProgram::inFast( const InList& list, bool notIn, const Value& value, Value& result )
+{
+  bool found;
+  switch ( value.type )
+  {
+    case Value::Null:
+      result.setNull();
+      return true;
+
+    case Value::Int:
+      if ( !list.allInt )
+        return false;
+
+      found = list.ints.contains( value.i );
+      break;
+
+    case Value::Double:
+    {
+      if ( !list.allInt || !value.isNumber() )
+        return false;
+
+      // only the nearest integer can be within the tolerance used by qgsDoubleNear
+      found = false;
+      if ( value.d >= std::numeric_limits<int>::min() && value.d <= std::numeric_limits<int>::max() )
+      {
+        int nearest = static_cast< int >( floor( value.d + 0.5 ) );
+        found = qgsDoubleNear( value.d, nearest ) && list.ints.contains( nearest );
+      }
+      break;
+    }
+
+    case Value::String:
+    {
+      if ( !list.allString )
+        return false;
+
+      // numeric strings are compared as numbers against numeric list items
+      bool ok;
+      double x = value.s.toDouble( &ok );
+      if ( ok && qIsFinite( x ) && !qIsNaN( x ) )
+        return false;
+
+      found = list.strings.contains( value.s );
+      break;
+    }
+
+    default:
+      return false;
+  }
+
+  if ( found )
+    result.setInt( notIn ? 0 : 1 );
+  else if ( list.hasNull )
+    result.setNull();
+  else
+    result.setInt( notIn ? 1 : 0 );
+  return true;
+}
+
+QString QgsExpressionProgram::dump() const
+{
+  QStringList lines;
+  for ( int i = 0; i < mCode.count(); ++i )
+  {
+    const Instruction& ins = mCode.at( i );
+    QString line = QString( "%1: %2" ).arg( i, 3 ).arg( OpCodeText[ins.op] );
+    if ( ins.dst >= 0 )
+      line += QString( " $%1" ).arg( ins.dst );
+    if ( ins.a >= 0 )
+      line += QString( " %1" ).arg( ins.a );
+    if ( ins.b >= 0 )
+      line += QString( " %1" ).arg( ins.b );
+    if ( ins.node )
+      line += QString( "  ; %1" ).arg( ins.node->dump() );
+    lines << line;
+  }
+  lines << QString( "result $%1" ).arg( mResultSlot );
+  return lines.join( "\n" );
+}
+
+///@endcond
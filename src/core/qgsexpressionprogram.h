@@ -0,0 +1,301 @@
+/***************************************************************************
+  qgsexpressionprogram.h - QgsExpressionProgram
+  ---------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSEXPRESSIONPROGRAM_H
+#define QGSEXPRESSIONPROGRAM_H
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+#include "qgsexpression.h"
+#include "qgsfeature.h"
+
+///@cond PRIVATE
+
+/**
+ * A prepared QgsExpression lowered to a flat instruction stream.
+ *
+ * Every node of the expression tree writes its result to its own slot. Slots
+ * hold unboxed int, double and string values and only keep a QVariant for other
+ * types, so the common numeric and string operators run without boxing
+ * intermediate values. Literals are stored once in constant slots, field
+ * references are resolved to attribute indexes and non contextual functions
+ * are bound when compiling.
+ *
+ * Whenever an operand has a type the fast paths do not handle, the instruction
+ * hands the boxed values to the originating node, so results and error
+ * messages are identical to the tree interpreter. Nodes which cannot be
+ * lowered at all (lazy and contextual functions, unresolved columns) are
+ * evaluated through the tree.
+ *
+ * Before compiling, fold() replaces the subtrees which do not depend on the
+ * feature by their value. While compiling, identical subexpressions are
+ * assigned a single slot, so that they are only evaluated once.
+ *
+ * The program itself is not modified by evaluating it, the values of the slots
+ * are kept per call. Copies of a prepared QgsExpression share the program, so
+ * they may be evaluated concurrently.
+ *
+ * This class is an implementation detail of QgsExpression and is not
+ * part of the public API.
+ */
+class QgsExpressionProgram
+{
+  public:
+
+    /**
+     * Returns a copy of a prepared expression tree where every subtree which does not
+     * depend on the feature is replaced by its value, and CASE branches which can never
+     * be taken are removed. The copy needs to be prepared before it is evaluated.
+     * @param parent expression owning the tree
+     * @param rootNode root node of the prepared expression
+     * @param context context which was used to prepare the expression
+     * @returns folded tree, or nullptr if nothing could be folded
+     */
+    static QgsExpression::Node* fold( QgsExpression* parent, QgsExpression::Node* rootNode, const QgsExpressionContext* context );
+
+    /**
+     * Compiles a prepared expression tree. The tree must outlive the program.
+     * Identical subexpressions are evaluated once. Calls to feature dependent functions
+     * store their results in the context, so that other expressions evaluated for the same
+     * feature can reuse them when the context has subexpression sharing enabled.
+     * @param parent expression owning the tree
+     * @param rootNode root node of the prepared expression
+     * @param context context which was used to prepare the expression
+     * @returns compiled program, or nullptr if nothing could be lowered
+     * @see QgsExpressionContext::setSubexpressionSharingEnabled()
+     */
+    static QgsExpressionProgram* compile( QgsExpression* parent, QgsExpression::Node* rootNode, const QgsExpressionContext* context );
+
+    /**
+     * Evaluates the program against a context. Errors are reported to the parent.
+     */
+    QVariant evaluate( QgsExpression* parent, const QgsExpressionContext* context ) const;
+
+    /**
+     * Evaluates the program against a block of features, returning one value per feature.
+     * The instructions are executed column-wise over the whole block. Rows which fail to
+     * evaluate return NULL and the first error is reported to the parent.
+     * @param parent expression being evaluated
+     * @param features features to evaluate
+     * @param context context used by functions and tree fallbacks, its feature is replaced
+     * while evaluating
+     */
+    QVariantList evaluateBatch( QgsExpression* parent, const QgsFeatureList& features, QgsExpressionContext* context ) const;
+
+    //! Returns the number of instructions in the program
+    int instructionCount() const { return mCode.count(); }
+
+    //! Returns a human readable listing of the program, for debugging
+    QString dump() const;
+
+  private:
+
+    struct Value
+    {
+      enum Type
+      {
+        Null,
+        Int,
+        Double,
+        String,
+        Variant
+      };
+
+      Value()
+          : type( Null )
+          , i( 0 )
+          , d( 0.0 )
+      {}
+
+      inline void setNull() { type = Null; }
+      inline void setInt( int value ) { type = Int; i = value; }
+      inline void setDouble( double value ) { type = Double; d = value; }
+      inline void setString( const QString& value ) { type = String; s = value; }
+      void setVariant( const QVariant& value );
+      QVariant toVariant() const;
+
+      //! Returns true for any value the tree interpreter considers as NULL
+      inline bool isNull() const { return type == Null || ( type == Variant && v.isNull() ); }
+
+      //! Returns true if the value is an int or a finite double
+      inline bool isNumber() const { return type == Int || ( type == Double && qIsFinite( d ) && !qIsNaN( d ) ); }
+      inline double toDouble() const { return type == Int ? i : d; }
+
+      Type type;
+      int i;
+      double d;
+      QString s;
+      QVariant v;
+    };
+
+    //! The values of a slot for a whole block of features
+    struct Column
+    {
+      enum Layout
+      {
+        Values,
+        Ints,
+        Doubles
+      };
+
+      Column()
+          : layout( Values )
+          , finite( true )
+      {}
+
+      Value at( int row ) const;
+
+      //! Sets the value of a single row, converting the column to generic values if needed
+      void set( int row, const Value& value );
+
+      //! Returns true if all rows are ints or finite doubles
+      inline bool isNumeric() const { return layout == Ints || ( layout == Doubles && finite ); }
+
+      void updateFinite();
+
+      Layout layout;
+      //! True if all doubles are finite, only meaningful for the Doubles layout
+      bool finite;
+      QVector<Value> values;
+      QVector<int> ints;
+      QVector<double> doubles;
+    };
+
+    //! The columns of all slots while evaluating a block of features
+    struct Block
+    {
+      QVector<Column> columns;
+      QVector<double> scratchLeft;
+      QVector<double> scratchRight;
+    };
+
+    enum OpCode
+    {
+      opLoadField,
+      opUnary,
+      opBinary,
+      opIn,
+      opCall,
+      opEvalNode,
+      opMove,
+      opSetNull,
+      opJump,
+      opJumpIfNull,
+      opJumpIfNotTrue,
+      opLoadShared,
+      opStoreShared,
+    };
+
+    struct Instruction
+    {
+      Instruction( OpCode op = opJump, int dst = -1, int a = -1, int b = -1 )
+          : op( op )
+          , dst( dst )
+          , a( a )
+          , b( b )
+          , node( nullptr )
+          , function( nullptr )
+      {}
+
+      OpCode op;
+      int dst;
+      int a;
+      int b;
+      QgsExpression::Node* node;
+      QgsExpression::Function* function;
+    };
+
+    //! Literal IN lists which can be tested without evaluating their nodes
+    struct InList
+    {
+      InList()
+          : allInt( true )
+          , allString( true )
+          , hasNull( false )
+      {}
+
+      bool allInt;
+      bool allString;
+      bool hasNull;
+      QSet<int> ints;
+      QSet<QString> strings;
+    };
+
+    enum TVL
+    {
+      False,
+      True,
+      Unknown
+    };
+
+    //! How the value of a subtree may change between evaluations, in increasing order
+    enum Dependency
+    {
+      Static,            //!< same value for every feature
+      FeatureDependent,  //!< only depends on the feature
+      Volatile           //!< depends on the evaluation context or changes on every call
+    };
+
+    QgsExpressionProgram();
+
+    static Dependency dependency( QgsExpression::Node* node, const QgsExpressionContext* context );
+    static Dependency functionDependency( QgsExpression::NodeFunction* node, const QgsExpressionContext* context );
+    static QgsExpression::Node* foldNode( QgsExpression* parent, QgsExpression::Node* node, const QgsExpressionContext* context, int& folded );
+    static QString nodeKey( QgsExpression::Node* node );
+
+    int compileNode( QgsExpression::Node* node, const QgsExpressionContext* context );
+    int compileOperation( QgsExpression::Node* node, const QgsExpressionContext* context );
+    int compileFallback( QgsExpression::Node* node );
+    int compileIn( QgsExpression::NodeInOperator* node, const QgsExpressionContext* context );
+    int compileFunction( QgsExpression::NodeFunction* node, const QgsExpressionContext* context );
+    int compileCondition( QgsExpression::NodeCondition* node, const QgsExpressionContext* context );
+
+    void prepareColumns( Block& block, int rows ) const;
+    static void loadColumn( Column& column, int index, const QgsFeatureList& features );
+    static bool binaryColumns( Block& block, QgsExpression::BinaryOperator op, const Column& left, const Column& right, Column& result, int rows );
+    static const double* columnDoubles( const Column& column, QVector<double>& scratch, int rows );
+
+    int addConstant( const QVariant& value );
+    int addRegister();
+    int addInstruction( const Instruction& instruction );
+
+    static bool unaryFast( QgsExpression::UnaryOperator op, const Value& value, Value& result );
+    static bool binaryFast( QgsExpression::BinaryOperator op, const Value& left, const Value& right, Value& result );
+    static bool inFast( const InList& list, bool notIn, const Value& value, Value& result );
+    static bool tvlFast( const Value& value, TVL& result );
+    static bool compare( QgsExpression::BinaryOperator op, double diff );
+
+    QVector<Instruction> mCode;
+    //! values of the constant slots, the other slots are copied from here for every evaluation
+    QVector<Value> mSlots;
+    QVector<int> mArgSlots;
+    QVector<InList> mInLists;
+    QVector<bool> mConstantSlots;
+    QStringList mSharedKeys;
+    QHash<QString, int> mCommonSlots;
+    int mConditionalDepth;
+    bool mShareResults;
+    int mResultSlot;
+    int mFallbackCount;
+};
+
+///@endcond
+
+#endif // QGSEXPRESSIONPROGRAM_H
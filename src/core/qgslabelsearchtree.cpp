@@ -99,6 +99,25 @@ bool QgsLabelSearchTree::insertLabel( pal::LabelPosition* labelPos, int featureI
   return true;
 }
 
+QgsLabelSearchTree* QgsLabelSearchTree::clone() const
+{
+  QgsLabelSearchTree* tree = new QgsLabelSearchTree();
+
+  double c_min[2];
+  double c_max[2];
+  Q_FOREACH ( const QgsLabelPosition* position, mOwnedPositions )
+  {
+    QgsLabelPosition* newEntry = new QgsLabelPosition( *position );
+    c_min[0] = newEntry->labelRect.xMinimum();
+    c_min[1] = newEntry->labelRect.yMinimum();
+    c_max[0] = newEntry->labelRect.xMaximum();
+    c_max[1] = newEntry->labelRect.yMaximum();
+    tree->mSpatialIndex.Insert( c_min, c_max, newEntry );
+    tree->mOwnedPositions << newEntry;
+  }
+  return tree;
+}
+
 void QgsLabelSearchTree::clear()
 {
   mSpatialIndex.RemoveAll();
@@ -56,6 +56,12 @@ class CORE_EXPORT QgsLabelSearchTree
      */
     bool insertLabel( pal::LabelPosition* labelPos, int featureId, const QString& layerName, const QString& labeltext, const QFont& labelfont, bool diagram = false, bool pinned = false, const QString& providerId = QString() );
 
+    /** Returns a copy of the tree and all its label positions. Caller takes ownership.
+     * @note not available in python bindings
+     * @note added in QGIS 2.18
+     */
+    QgsLabelSearchTree* clone() const;
+
   private:
     // set as mutable because RTree template is not const-correct
     mutable pal::RTree<QgsLabelPosition*, double, 2, double> mSpatialIndex;
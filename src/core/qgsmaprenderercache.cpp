@@ -17,12 +17,23 @@
 
 #include "qgsmaplayerregistry.h"
 #include "qgsmaplayer.h"
+#include "qgsmapsettings.h"
+#include "qgspallabeling.h"
+#include "qgsvectorlayer.h"
 
 QgsMapRendererCache::QgsMapRendererCache()
+    : mIncrementalPan( false )
+    , mRotation( 0 )
+    , mLabelingResults( nullptr )
 {
   clear();
 }
 
+QgsMapRendererCache::~QgsMapRendererCache()
+{
+  delete mLabelingResults;
+}
+
 void QgsMapRendererCache::clear()
 {
   QMutexLocker lock( &mMutex );
@@ -33,6 +44,9 @@ void QgsMapRendererCache::clearInternal()
 {
   mExtent.setMinimal();
   mScale = 0;
+  mRotation = 0;
+  mSize = QSize();
+  mPanOffset = QPoint();
 
   // make sure we are disconnected from all layers
   QMap<QString, QImage>::const_iterator it = mCachedImages.constBegin();
@@ -45,6 +59,53 @@ void QgsMapRendererCache::clearInternal()
     }
   }
   mCachedImages.clear();
+
+  it = mShiftedImages.constBegin();
+  for ( ; it != mShiftedImages.constEnd(); ++it )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( it.key() );
+    if ( layer )
+    {
+      disconnect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ) );
+    }
+  }
+  mShiftedImages.clear();
+
+  clearLabelCacheInternal();
+}
+
+void QgsMapRendererCache::clearLabelCacheInternal()
+{
+  QStringList layerIds = mLabelLayers;
+
+  mLabelKey.clear();
+  mLabelImage = QImage();
+  delete mLabelingResults;
+  mLabelingResults = nullptr;
+  mLabelLayers.clear();
+
+  Q_FOREACH ( const QString& layerId, layerIds )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( layer )
+    {
+      disconnect( layer, SIGNAL( dataChanged() ), this, SLOT( labeledLayerChanged() ) );
+      if ( qobject_cast<QgsVectorLayer*>( layer ) )
+        disconnect( layer, SIGNAL( editingStopped() ), this, SLOT( labeledLayerChanged() ) );
+    }
+  }
+}
+
+void QgsMapRendererCache::disconnectLayer( const QString& layerId )
+{
+  if ( mCachedImages.contains( layerId ) || mShiftedImages.contains( layerId ) )
+    return;
+
+  QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+  if ( layer )
+  {
+    disconnect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ) );
+  }
 }
 
 bool QgsMapRendererCache::init( const QgsRectangle& extent, double scale )
@@ -65,16 +126,140 @@ bool QgsMapRendererCache::init( const QgsRectangle& extent, double scale )
   return false;
 }
 
+bool QgsMapRendererCache::init( const QgsMapSettings& settings )
+{
+  QMutexLocker lock( &mMutex );
+
+  QgsRectangle extent = settings.visibleExtent();
+  double scale = settings.scale();
+
+  // check whether the params are the same
+  if ( extent == mExtent &&
+       qgsDoubleNear( scale, mScale ) &&
+       qgsDoubleNear( settings.rotation(), mRotation ) &&
+       settings.outputSize() == mSize )
+    return true;
+
+  // images of the previous extent can be moved into place if the map has only been panned by whole pixels
+  bool panned = false;
+  QPoint offset;
+  if ( mIncrementalPan && !mCachedImages.isEmpty() && !mExtent.isEmpty() &&
+       qgsDoubleNear( scale, mScale ) && qgsDoubleNear( settings.rotation(), mRotation ) && settings.outputSize() == mSize )
+  {
+    QgsPoint center = settings.mapToPixel().transform( mExtent.center() );
+    double dx = center.x() - mSize.width() / 2.0;
+    double dy = center.y() - mSize.height() / 2.0;
+    offset = QPoint( qRound( dx ), qRound( dy ) );
+    panned = qAbs( dx - offset.x() ) < 0.05 && qAbs( dy - offset.y() ) < 0.05 &&
+             qAbs( offset.x() ) < mSize.width() && qAbs( offset.y() ) < mSize.height();
+  }
+
+  if ( panned )
+  {
+    // the images of the previous pan are replaced, unless they have not been rendered again
+    QMap<QString, QImage> shiftedImages = mCachedImages;
+    mCachedImages.clear();
+    QStringList staleLayers = mShiftedImages.keys();
+    mShiftedImages = shiftedImages;
+    Q_FOREACH ( const QString& layerId, staleLayers )
+      disconnectLayer( layerId );
+
+    // labels are placed again for the new extent
+    clearLabelCacheInternal();
+  }
+  else
+  {
+    clearInternal();
+  }
+
+  // set new params
+  mExtent = extent;
+  mScale = scale;
+  mRotation = settings.rotation();
+  mSize = settings.outputSize();
+  mPanOffset = panned ? offset : QPoint();
+
+  return false;
+}
+
+void QgsMapRendererCache::setIncrementalPanEnabled( bool enabled )
+{
+  QMutexLocker lock( &mMutex );
+  mIncrementalPan = enabled;
+}
+
+bool QgsMapRendererCache::isIncrementalPanEnabled() const
+{
+  return mIncrementalPan;
+}
+
+QImage QgsMapRendererCache::shiftedCacheImage( const QString& layerId )
+{
+  QMutexLocker lock( &mMutex );
+  return mShiftedImages.value( layerId );
+}
+
+QPoint QgsMapRendererCache::panOffset()
+{
+  QMutexLocker lock( &mMutex );
+  return mPanOffset;
+}
+
+void QgsMapRendererCache::setLabelCache( const QString& key, const QImage& image, QgsLabelingResults* results, const QStringList& layerIds )
+{
+  QMutexLocker lock( &mMutex );
+
+  clearLabelCacheInternal();
+
+  mLabelKey = key;
+  mLabelImage = image;
+  mLabelingResults = results;
+  mLabelLayers = layerIds;
+
+  // the labels are invalid as soon as the data of any of the labeled layers changes, changes of the
+  // labeling configuration are caught by the key. Edited layers are not cached, but their edits are
+  // only seen by the cache once editing stops.
+  Q_FOREACH ( const QString& layerId, layerIds )
+  {
+    QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
+    if ( layer )
+    {
+      connect( layer, SIGNAL( dataChanged() ), this, SLOT( labeledLayerChanged() ), Qt::UniqueConnection );
+      if ( qobject_cast<QgsVectorLayer*>( layer ) )
+        connect( layer, SIGNAL( editingStopped() ), this, SLOT( labeledLayerChanged() ), Qt::UniqueConnection );
+    }
+  }
+}
+
+QImage QgsMapRendererCache::labelCacheImage( const QString& key, QgsLabelingResults** results )
+{
+  QMutexLocker lock( &mMutex );
+
+  if ( mLabelImage.isNull() || key != mLabelKey )
+    return QImage();
+
+  if ( results )
+    *results = mLabelingResults ? mLabelingResults->clone() : nullptr;
+  return mLabelImage;
+}
+
+void QgsMapRendererCache::clearLabelCache()
+{
+  QMutexLocker lock( &mMutex );
+  clearLabelCacheInternal();
+}
+
 void QgsMapRendererCache::setCacheImage( const QString& layerId, const QImage& img )
 {
   QMutexLocker lock( &mMutex );
   mCachedImages[layerId] = img;
+  mShiftedImages.remove( layerId );
 
   // connect to the layer to listen to layer's repaintRequested() signals
   QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
   if ( layer )
   {
-    connect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ) );
+    connect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ), Qt::UniqueConnection );
   }
 }
 
@@ -87,8 +272,16 @@ QImage QgsMapRendererCache::cacheImage( const QString& layerId )
 void QgsMapRendererCache::layerRequestedRepaint()
 {
   QgsMapLayer* layer = qobject_cast<QgsMapLayer*>( sender() );
-  if ( layer )
-    clearCacheImage( layer->id() );
+  if ( !layer )
+    return;
+
+  clearCacheImage( layer->id() );
+}
+
+void QgsMapRendererCache::labeledLayerChanged()
+{
+  QMutexLocker lock( &mMutex );
+  clearLabelCacheInternal();
 }
 
 void QgsMapRendererCache::clearCacheImage( const QString& layerId )
@@ -96,10 +289,7 @@ void QgsMapRendererCache::clearCacheImage( const QString& layerId )
   QMutexLocker lock( &mMutex );
 
   mCachedImages.remove( layerId );
+  mShiftedImages.remove( layerId );
 
-  QgsMapLayer* layer = QgsMapLayerRegistry::instance()->mapLayer( layerId );
-  if ( layer )
-  {
-    disconnect( layer, SIGNAL( repaintRequested() ), this, SLOT( layerRequestedRepaint() ) );
-  }
+  disconnectLayer( layerId );
 }
@@ -22,6 +22,8 @@
 
 #include "qgsrectangle.h"
 
+class QgsMapSettings;
+class QgsLabelingResults;
 
 /** \ingroup core
  * This class is responsible for keeping cache of rendered images of individual layers.
@@ -30,6 +32,9 @@
  * the cache listens to repaintRequested() signals from layer. If triggered, the cache
  * removes the rendered image (and disconnects from the layer).
  *
+ * The cache also keeps the labels of the map, as long as the extent and the data of the
+ * labeled layers do not change. Changes of the labeling configuration give a different key.
+ *
  * The class is thread-safe (multiple classes can access the same instance safely).
  *
  * @note added in 2.4
@@ -40,6 +45,7 @@ class CORE_EXPORT QgsMapRendererCache : public QObject
   public:
 
     QgsMapRendererCache();
+    ~QgsMapRendererCache();
 
     //! invalidate the cache contents
     void clear();
@@ -57,19 +63,103 @@ class CORE_EXPORT QgsMapRendererCache : public QObject
     //! remove layer from the cache
     void clearCacheImage( const QString& layerId );
 
+    /** Initializes the cache for rendering a map with the given settings. Works like init(),
+     * but if incremental panning is enabled and the map has only been shifted by whole pixels,
+     * at the same scale, rotation and size, the cached images are kept as shifted images.
+     * Renderer jobs then only render the parts of these layers which have become visible.
+     * @return flag whether the parameters are the same as last time
+     * @see shiftedCacheImage()
+     * @note added in QGIS 2.18
+     */
+    bool init( const QgsMapSettings& settings );
+
+    /** Sets whether images of the previous extent are reused when the map is panned.
+     * @see init( const QgsMapSettings& )
+     * @note added in QGIS 2.18
+     */
+    void setIncrementalPanEnabled( bool enabled );
+
+    /** Returns whether images of the previous extent are reused when the map is panned.
+     * @note added in QGIS 2.18
+     */
+    bool isIncrementalPanEnabled() const;
+
+    /** Returns the image of a layer rendered for the previous extent, if the map has only been
+     * panned since. Returns null image if there is none.
+     * @see panOffset()
+     * @note added in QGIS 2.18
+     */
+    QImage shiftedCacheImage( const QString& layerId );
+
+    /** Returns the offset in pixels by which the shifted images need to be moved to match the current extent.
+     * @see shiftedCacheImage()
+     * @note added in QGIS 2.18
+     */
+    QPoint panOffset();
+
+    /** Stores the labels rendered for the current extent. The labels are removed when the cache
+     * is initialized for a different extent or the data of one of the labeled layers changes.
+     * Other repaints of the labeled layers keep the labels, so the key has to cover everything
+     * else the labels depend on.
+     * @param key identifies the labeling configuration the labels have been placed with
+     * @param image labels rendered on a transparent image of the size of the map
+     * @param results labeling results, ownership is transferred to the cache
+     * @param layerIds IDs of the labeled layers
+     * @see labelCacheImage()
+     * @note not available in Python bindings
+     * @note added in QGIS 2.18
+     */
+    void setLabelCache( const QString& key, const QImage& image, QgsLabelingResults* results, const QStringList& layerIds );
+
+    /** Returns the cached labels if they have been placed with the given key, or a null image otherwise.
+     * @param key identifies the labeling configuration
+     * @param results if not null and the labels are cached, receives a copy of the labeling results. Caller takes ownership.
+     * @see setLabelCache()
+     * @note not available in Python bindings
+     * @note added in QGIS 2.18
+     */
+    QImage labelCacheImage( const QString& key, QgsLabelingResults** results = nullptr );
+
+    /** Removes the cached labels.
+     * @note added in QGIS 2.18
+     */
+    void clearLabelCache();
+
   protected slots:
     //! remove layer (that emitted the signal) from the cache
     void layerRequestedRepaint();
 
+    /** Removes the cached labels when the data of a labeled layer has changed
+     * @note added in QGIS 2.18
+     */
+    void labeledLayerChanged();
+
   protected:
     //! invalidate cache contents (without locking)
     void clearInternal();
 
+    //! disconnects from the repaint requests of a layer unless it has a cached or shifted image (without locking)
+    void disconnectLayer( const QString& layerId );
+
+    //! removes the cached labels (without locking)
+    void clearLabelCacheInternal();
+
   protected:
     QMutex mMutex;
     QgsRectangle mExtent;
     double mScale;
     QMap<QString, QImage> mCachedImages;
+
+  private:
+    bool mIncrementalPan;
+    double mRotation;
+    QSize mSize;
+    QPoint mPanOffset;
+    QMap<QString, QImage> mShiftedImages;
+    QString mLabelKey;
+    QImage mLabelImage;
+    QgsLabelingResults* mLabelingResults;
+    QStringList mLabelLayers;
 };
 
 
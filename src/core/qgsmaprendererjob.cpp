@@ -20,8 +20,10 @@
 #include <QTimer>
 #include <QtConcurrentMap>
 #include <QSettings>
+#include <QDomDocument>
 
 #include "qgscrscache.h"
+#include "qgsdiagramrendererv2.h"
 #include "qgslogger.h"
 #include "qgsrendercontext.h"
 #include "qgsmaplayer.h"
@@ -31,6 +33,9 @@
 #include "qgsmaprenderercache.h"
 #include "qgsmessagelog.h"
 #include "qgspallabeling.h"
+#include "qgslabelingenginev2.h"
+#include "qgsrulebasedlabeling.h"
+#include "qgsvectorlayerlabeling.h"
 #include "qgsvectorlayerrenderer.h"
 #include "qgsvectorlayer.h"
 
@@ -178,13 +183,20 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
 
   if ( mCache )
   {
-    bool cacheValid = mCache->init( mSettings.visibleExtent(), mSettings.scale() );
+    bool cacheValid = mCache->init( mSettings );
     QgsDebugMsg( QString( "CACHE VALID: %1" ).arg( cacheValid ) );
     Q_UNUSED( cacheValid );
   }
 
   mGeometryCaches.clear();
 
+  // layer images are only shown while rendering if every layer is drawn to its own image
+  QSettings settings;
+  int previewTimeBudget = 0;
+  if ( !painter && mSettings.testFlag( QgsMapSettings::RenderPartialOutput ) && settings.value( "/qgis/progressive_rendering", true ).toBool() )
+    previewTimeBudget = settings.value( "/qgis/progressive_rendering_budget", 150 ).toInt();
+  long previewMinFeatures = settings.value( "/qgis/progressive_rendering_min_features", 100000 ).toInt();
+
   while ( li.hasPrevious() )
   {
     QString layerId = li.previous();
@@ -243,6 +255,7 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
     layerJobs.append( LayerRenderJob() );
     LayerRenderJob& job = layerJobs.last();
     job.cached = false;
+    job.incremental = false;
     job.img = nullptr;
     job.blendMode = ml->blendMode();
     job.opacity = 1.0;
@@ -293,6 +306,10 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
       QPainter* mypPainter = new QPainter( job.img );
       mypPainter->setRenderHint( QPainter::Antialiasing, mSettings.testFlag( QgsMapSettings::Antialiasing ) );
       job.context.setPainter( mypPainter );
+
+      // after a pan, only render the parts of the layer which have become visible
+      if ( mCache )
+        job.incremental = prepareIncrementalPan( job, ml, ct, mCache->shiftedCacheImage( ml->id() ), mCache->panOffset() );
     }
 
     bool hasStyleOverride = mSettings.layerStyleOverrides().contains( ml->id() );
@@ -312,12 +329,188 @@ LayerRenderJobs QgsMapRendererJob::prepareJobs( QPainter* painter, QgsPalLabelin
       }
     }
 
+    // large vector layers first draw a coarse preview
+    if ( previewTimeBudget > 0 && job.img && !job.incremental )
+    {
+      QgsVectorLayerRenderer* vlr = dynamic_cast<QgsVectorLayerRenderer*>( job.renderer );
+      QgsVectorLayer* vl = qobject_cast<QgsVectorLayer*>( ml );
+      if ( vlr && vl && vl->featureCount() >= previewMinFeatures )
+      {
+        vlr->setPreviewTimeBudget( previewTimeBudget );
+      }
+    }
+
   } // while (li.hasPrevious())
 
   return layerJobs;
 }
 
 
+bool QgsMapRendererJob::prepareIncrementalPan( LayerRenderJob& job, const QgsMapLayer* ml, const QgsCoordinateTransform* ct, const QImage& shiftedImage, QPoint offset ) const
+{
+  if ( shiftedImage.isNull() || !job.img || shiftedImage.size() != job.img->size() || shiftedImage.format() != job.img->format() )
+    return false;
+
+  // the geometry cache needs all features of the extent
+  if ( mRequestedGeomCacheForLayers.contains( ml->id() ) )
+    return false;
+
+  // renderers which draw the features together, like the heatmap renderer, need all features of the extent.
+  // Style overrides are only applied when the renderer is created, so their renderer is not known here.
+  if ( const QgsVectorLayer* vl = qobject_cast<const QgsVectorLayer*>( ml ) )
+  {
+    if ( mSettings.layerStyleOverrides().contains( ml->id() ) ||
+         !QgsVectorLayerRenderer::rendererDrawsImmediately( vl->rendererV2() ) )
+      return false;
+  }
+
+  const int width = job.img->width();
+  const int height = job.img->height();
+
+  // the part of the previous image close to the newly exposed area is rendered again, so that symbols
+  // crossing the border are drawn completely. Symbols are rarely larger than an inch.
+  const int margin = qRound( mSettings.outputDpi() );
+  QRect kept = QRect( 0, 0, width, height ).intersected( QRect( offset, job.img->size() ) );
+  if ( offset.x() > 0 )
+    kept.setLeft( kept.left() + margin );
+  else if ( offset.x() < 0 )
+    kept.setRight( kept.right() - margin );
+  if ( offset.y() > 0 )
+    kept.setTop( kept.top() + margin );
+  else if ( offset.y() < 0 )
+    kept.setBottom( kept.bottom() - margin );
+
+  // when most of the layer needs to be rendered anyway, render it completely
+  if ( kept.isEmpty() || static_cast< qint64 >( kept.width() ) * kept.height() < static_cast< qint64 >( width ) * height / 2 )
+    return false;
+
+  QRegion dirty = QRegion( 0, 0, width, height ).subtracted( QRegion( kept ) );
+  if ( dirty.isEmpty() )
+    return false;
+
+  // features drawn near the border of the exposed area are fetched as well
+  QRect fetchRect = dirty.boundingRect().adjusted( -margin, -margin, margin + 1, margin + 1 );
+  const QgsMapToPixel& mtp = mSettings.mapToPixel();
+  QgsRectangle extent( mtp.toMapCoordinatesF( fetchRect.left(), fetchRect.top() ), mtp.toMapCoordinatesF( fetchRect.right(), fetchRect.bottom() ) );
+  extent.combineExtentWith( mtp.toMapCoordinatesF( fetchRect.left(), fetchRect.bottom() ) );
+  extent.combineExtentWith( mtp.toMapCoordinatesF( fetchRect.right(), fetchRect.top() ) );
+  if ( ct )
+  {
+    QgsRectangle r2;
+    reprojectToLayerExtent( ml, ct, extent, r2 );
+    if ( !extent.isFinite() )
+      return false;
+  }
+
+  QPainter* painter = job.context.painter();
+  painter->setCompositionMode( QPainter::CompositionMode_Source );
+  painter->drawImage( kept.topLeft(), shiftedImage, kept.translated( -offset ) );
+  painter->setCompositionMode( QPainter::CompositionMode_SourceOver );
+  painter->setClipRegion( dirty );
+  job.context.setExtent( extent );
+  return true;
+}
+
+/// @cond PRIVATE
+
+//! Returns true if labels are drawn with a blend mode, which needs the map image below the labels
+static bool labelsUseBlending( const QgsPalLayerSettings* settings )
+{
+  if ( !settings )
+    return false;
+
+  return settings->blendMode != QPainter::CompositionMode_SourceOver
+         || ( settings->bufferDraw && settings->bufferBlendMode != QPainter::CompositionMode_SourceOver )
+         || ( settings->shapeDraw && settings->shapeBlendMode != QPainter::CompositionMode_SourceOver )
+         || ( settings->shadowDraw && settings->shadowBlendMode != QPainter::CompositionMode_SourceOver )
+         || settings->dataDefinedIsActive( QgsPalLayerSettings::FontBlendMode )
+         || settings->dataDefinedIsActive( QgsPalLayerSettings::BufferBlendMode )
+         || settings->dataDefinedIsActive( QgsPalLayerSettings::ShapeBlendMode )
+         || settings->dataDefinedIsActive( QgsPalLayerSettings::ShadowBlendMode );
+}
+
+///@endcond
+
+QString QgsMapRendererJob::labelCacheKey( const QgsLabelingEngineV2* labelingEngine2, QStringList& labeledLayers ) const
+{
+  labeledLayers.clear();
+  if ( !labelingEngine2 )
+    return QString();
+
+  QStringList key;
+  key << QString::number( mSettings.outputDpi(), 'g', 17 )
+  << mSettings.destinationCrs().toProj4()
+  << QString::number( mSettings.hasCrsTransformEnabled() )
+  << QString::number( static_cast< int >( mSettings.flags() ) )
+  << QString::number( static_cast< int >( labelingEngine2->flags() ) )
+  << QString::number( static_cast< int >( labelingEngine2->searchMethod() ) );
+
+  int candPoint, candLine, candPolygon;
+  const_cast< QgsLabelingEngineV2* >( labelingEngine2 )->numCandidatePositions( candPoint, candLine, candPolygon );
+  key << QString::number( candPoint ) << QString::number( candLine ) << QString::number( candPolygon );
+
+  Q_FOREACH ( const QString& layerId, mSettings.layers() )
+  {
+    QgsVectorLayer* vl = qobject_cast<QgsVectorLayer*>( QgsMapLayerRegistry::instance()->mapLayer( layerId ) );
+    if ( !vl || !vl->isInScaleRange( mSettings.scale() ) || !QgsPalLabeling::staticWillUseLayer( vl ) )
+      continue;
+
+    // features of edited layers change without notice
+    if ( vl->isEditable() || !vl->labeling() )
+      return QString();
+
+    // labeling configuration, labels drawn with blend modes need to be drawn onto the map
+    bool useAdvancedEffects = mSettings.testFlag( QgsMapSettings::UseAdvancedEffects );
+    QDomDocument doc;
+    if ( vl->labeling()->type() == "rule-based" )
+    {
+      const QgsRuleBasedLabeling* labeling = static_cast< const QgsRuleBasedLabeling* >( vl->labeling() );
+      Q_FOREACH ( const QgsRuleBasedLabeling::Rule* rule, labeling->rootRule()->descendants() )
+      {
+        if ( useAdvancedEffects && labelsUseBlending( rule->settings() ) )
+          return QString();
+      }
+      doc.appendChild( labeling->save( doc ) );
+    }
+    else if ( vl->labelsEnabled() )
+    {
+      QgsPalLayerSettings settings = QgsPalLayerSettings::fromLayer( vl );
+      if ( useAdvancedEffects && labelsUseBlending( &settings ) )
+        return QString();
+      doc.appendChild( settings.writeXml( doc ) );
+    }
+
+    // diagrams are placed by the same engine
+    QDomDocument diagramDoc;
+    if ( vl->diagramsEnabled() )
+    {
+      QDomElement diagramElem = diagramDoc.createElement( "diagrams" );
+      vl->diagramRenderer()->writeXML( diagramElem, diagramDoc, vl );
+      if ( vl->diagramLayerSettings() )
+        vl->diagramLayerSettings()->writeXML( diagramElem, diagramDoc, vl );
+      diagramDoc.appendChild( diagramElem );
+    }
+
+    key << vl->id() << doc.toString( -1 ) << diagramDoc.toString( -1 )
+    << mSettings.layerStyleOverrides().value( layerId );
+
+    // labels of points are placed around and avoid the symbols, so their symbols are part of the key
+    if ( vl->geometryType() == QGis::Point && vl->rendererV2() )
+    {
+      QDomDocument rendererDoc;
+      rendererDoc.appendChild( vl->rendererV2()->save( rendererDoc ) );
+      key << rendererDoc.toString( -1 );
+    }
+
+    // data
+    key << vl->source() << vl->subsetString();
+
+    labeledLayers << layerId;
+  }
+
+  return key.join( "\n" );
+}
+
 void QgsMapRendererJob::cleanupJobs( LayerRenderJobs& jobs )
 {
   for ( LayerRenderJobs::iterator it = jobs.begin(); it != jobs.end(); ++it )
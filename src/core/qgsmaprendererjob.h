@@ -48,6 +48,7 @@ struct LayerRenderJob
   QPainter::CompositionMode blendMode;
   double opacity;
   bool cached; // if true, img already contains cached image from previous rendering
+  bool incremental; //!< if true, img contains the cached image of the previous extent, only the newly exposed parts are rendered
   QString layerId;
   int renderingTime; //!< time it took to render the layer in ms (it is -1 if not rendered or still rendering)
 };
@@ -175,6 +176,25 @@ class CORE_EXPORT QgsMapRendererJob : public QObject
 
     bool needTemporaryImage( QgsMapLayer* ml );
 
+    /** Moves the image of a layer rendered for the previous extent into place after the map has been
+     * panned and restricts the job to the parts of the map which need to be rendered again.
+     * @returns false if the whole layer needs to be rendered
+     * @note not available in Python bindings
+     * @note added in QGIS 2.18
+     */
+    bool prepareIncrementalPan( LayerRenderJob& job, const QgsMapLayer* ml, const QgsCoordinateTransform* ct, const QImage& shiftedImage, QPoint offset ) const;
+
+    /** Returns the key identifying the labels of the map in the render cache. The key covers
+     * the labeling engine settings, the map settings and the labeling configuration and data
+     * source of every labeled layer.
+     * @param labelingEngine2 labeling engine with the settings of the project
+     * @param labeledLayers receives the IDs of the labeled layers
+     * @returns key, or an empty string if the labels can not be cached
+     * @note not available in Python bindings
+     * @note added in QGIS 2.18
+     */
+    QString labelCacheKey( const QgsLabelingEngineV2* labelingEngine2, QStringList& labeledLayers ) const;
+
     //! @note not available in Python bindings
     static void drawLabeling( const QgsMapSettings& settings, QgsRenderContext& renderContext, QgsPalLabeling* labelingEngine, QgsLabelingEngineV2* labelingEngine2, QPainter* painter );
     static void drawOldLabeling( const QgsMapSettings& settings, QgsRenderContext& renderContext );
@@ -19,9 +19,18 @@
 #include "qgslabelingenginev2.h"
 #include "qgslogger.h"
 #include "qgsmaplayerrenderer.h"
+#include "qgsmaplayerregistry.h"
+#include "qgsmaprenderercache.h"
+#include "qgsmaplayerstylemanager.h"
+#include "qgsmessagelog.h"
 #include "qgspallabeling.h"
+#include "qgsvectorlayer.h"
+#include "qgsvectorlayerrenderer.h"
 
 #include <QtConcurrentMap>
+#include <QSettings>
+
+#include <limits>
 
 #define LABELING_V2
 
@@ -30,6 +39,7 @@ QgsMapRendererParallelJob::QgsMapRendererParallelJob( const QgsMapSettings& sett
     , mStatus( Idle )
     , mLabelingEngine( nullptr )
     , mLabelingEngineV2( nullptr )
+    , mCachedLabelingResults( nullptr )
 {
 }
 
@@ -45,6 +55,9 @@ QgsMapRendererParallelJob::~QgsMapRendererParallelJob()
 
   delete mLabelingEngineV2;
   mLabelingEngineV2 = nullptr;
+
+  delete mCachedLabelingResults;
+  mCachedLabelingResults = nullptr;
 }
 
 void QgsMapRendererParallelJob::start()
@@ -62,12 +75,35 @@ void QgsMapRendererParallelJob::start()
   delete mLabelingEngineV2;
   mLabelingEngineV2 = nullptr;
 
+  mLabelCacheKey.clear();
+  mLabeledLayers.clear();
+  mLabelImage = QImage();
+  mCachedLabelImage = QImage();
+  delete mCachedLabelingResults;
+  mCachedLabelingResults = nullptr;
+
   if ( mSettings.testFlag( QgsMapSettings::DrawLabeling ) )
   {
 #ifdef LABELING_V2
     mLabelingEngineV2 = new QgsLabelingEngineV2();
     mLabelingEngineV2->readSettingsFromProject();
     mLabelingEngineV2->setMapSettings( mSettings );
+
+    if ( mCache )
+    {
+      // reuse the labels of the previous rendering if none of the labeled layers has changed
+      mCache->init( mSettings );
+      mLabelCacheKey = labelCacheKey( mLabelingEngineV2, mLabeledLayers );
+      if ( !mLabelCacheKey.isEmpty() )
+        mCachedLabelImage = mCache->labelCacheImage( mLabelCacheKey, &mCachedLabelingResults );
+
+      if ( !mCachedLabelImage.isNull() )
+      {
+        // no need to register features for labeling
+        delete mLabelingEngineV2;
+        mLabelingEngineV2 = nullptr;
+      }
+    }
 #else
     mLabelingEngine = new QgsPalLabeling;
     mLabelingEngine->loadEngineSettings();
@@ -77,13 +113,15 @@ void QgsMapRendererParallelJob::start()
 
   mLayerJobs = prepareJobs( nullptr, mLabelingEngine, mLabelingEngineV2 );
 
+  prepareTiles();
+
   QgsDebugMsg( QString( "QThreadPool max thread count is %1" ).arg( QThreadPool::globalInstance()->maxThreadCount() ) );
 
   // start async job
 
   connect( &mFutureWatcher, SIGNAL( finished() ), SLOT( renderLayersFinished() ) );
 
-  mFuture = QtConcurrent::map( mLayerJobs, renderLayerStatic );
+  mFuture = QtConcurrent::map( mRenderQueue, renderQueuedLayerStatic );
   mFutureWatcher.setFuture( mFuture );
 }
 
@@ -101,6 +139,12 @@ void QgsMapRendererParallelJob::cancel()
     if ( it->renderer && it->renderer->feedback() )
       it->renderer->feedback()->cancel();
   }
+  for ( QList<LayerTile>::iterator it = mLayerTiles.begin(); it != mLayerTiles.end(); ++it )
+  {
+    it->job.context.setRenderingStopped( true );
+    if ( it->job.renderer && it->job.renderer->feedback() )
+      it->job.renderer->feedback()->cancel();
+  }
 
   if ( mStatus == RenderingLayers )
   {
@@ -137,6 +181,12 @@ void QgsMapRendererParallelJob::cancelWithoutBlocking()
     if ( it->renderer && it->renderer->feedback() )
       it->renderer->feedback()->cancel();
   }
+  for ( QList<LayerTile>::iterator it = mLayerTiles.begin(); it != mLayerTiles.end(); ++it )
+  {
+    it->job.context.setRenderingStopped( true );
+    if ( it->job.renderer && it->job.renderer->feedback() )
+      it->job.renderer->feedback()->cancel();
+  }
 
   if ( mStatus == RenderingLayers )
   {
@@ -188,7 +238,13 @@ bool QgsMapRendererParallelJob::isActive() const
 
 QgsLabelingResults* QgsMapRendererParallelJob::takeLabelingResults()
 {
-  if ( mLabelingEngine )
+  if ( mCachedLabelingResults )
+  {
+    QgsLabelingResults* results = mCachedLabelingResults;
+    mCachedLabelingResults = nullptr;
+    return results;
+  }
+  else if ( mLabelingEngine )
     return mLabelingEngine->takeResults();
   else if ( mLabelingEngineV2 )
     return mLabelingEngineV2->takeResults();
@@ -196,10 +252,28 @@ QgsLabelingResults* QgsMapRendererParallelJob::takeLabelingResults()
     return nullptr;
 }
 
+void QgsMapRendererParallelJob::setLayerTileCount( const QString& layerId, int tiles )
+{
+  if ( tiles > 1 )
+    mLayerTileCounts.insert( layerId, tiles );
+  else
+    mLayerTileCounts.remove( layerId );
+}
+
+int QgsMapRendererParallelJob::layerTileCount( const QString& layerId ) const
+{
+  return mLayerTileCounts.value( layerId, 1 );
+}
+
+QList<int> QgsMapRendererParallelJob::tileRenderingTimes( const QString& layerId ) const
+{
+  return mTileRenderingTimes.value( layerId );
+}
+
 QImage QgsMapRendererParallelJob::renderedImage()
 {
   if ( mStatus == RenderingLayers )
-    return composeImage( mSettings, mLayerJobs );
+    return mLayerTiles.isEmpty() ? composeImage( mSettings, mLayerJobs ) : composeTiledImage();
   else
     return mFinalImage; // when rendering labels or idle
 }
@@ -208,16 +282,28 @@ void QgsMapRendererParallelJob::renderLayersFinished()
 {
   Q_ASSERT( mStatus == RenderingLayers );
 
+  mergeTiles();
+
   // compose final image
   mFinalImage = composeImage( mSettings, mLayerJobs );
 
+  logTileRenderingTime();
   logRenderingTime( mLayerJobs );
 
   cleanupJobs( mLayerJobs );
 
   QgsDebugMsg( "PARALLEL layers finished" );
 
-  if ( mSettings.testFlag( QgsMapSettings::DrawLabeling ) && !mLabelingRenderContext.renderingStopped() )
+  if ( mSettings.testFlag( QgsMapSettings::DrawLabeling ) && !mCachedLabelImage.isNull() )
+  {
+    // labels have not changed since the previous rendering
+    QPainter painter( &mFinalImage );
+    painter.drawImage( 0, 0, mCachedLabelImage );
+    painter.end();
+
+    renderingFinished();
+  }
+  else if ( mSettings.testFlag( QgsMapSettings::DrawLabeling ) && !mLabelingRenderContext.renderingStopped() )
   {
     mStatus = RenderingLabels;
 
@@ -239,6 +325,12 @@ void QgsMapRendererParallelJob::renderingFinished()
 
   mStatus = Idle;
 
+  if ( mCache && !mLabelImage.isNull() && mLabelingEngineV2 && mLabelingEngineV2->results() && !mLabelingRenderContext.renderingStopped() )
+  {
+    mCache->setLabelCache( mLabelCacheKey, mLabelImage, mLabelingEngineV2->results()->clone(), mLabeledLayers );
+  }
+  mLabelImage = QImage();
+
   mRenderingTime = mRenderingStart.elapsed();
 
   emit finished();
@@ -279,10 +371,21 @@ void QgsMapRendererParallelJob::renderLayerStatic( LayerRenderJob& job )
   QgsDebugMsg( QString( "job %1 end [%2 ms] (layer %3)" ).arg( reinterpret_cast< ulong >( &job ), 0, 16 ).arg( job.renderingTime ).arg( job.layerId ) );
 }
 
+void QgsMapRendererParallelJob::renderQueuedLayerStatic( LayerRenderJob* job )
+{
+  renderLayerStatic( *job );
+}
 
 void QgsMapRendererParallelJob::renderLabelsStatic( QgsMapRendererParallelJob* self )
 {
-  QPainter painter( &self->mFinalImage );
+  // labels which can be cached are drawn onto their own image first
+  if ( self->mCache && self->mLabelingEngineV2 && !self->mLabelCacheKey.isEmpty() )
+  {
+    self->mLabelImage = QImage( self->mSettings.outputSize(), self->mSettings.outputImageFormat() );
+    self->mLabelImage.fill( 0 );
+  }
+
+  QPainter painter( self->mLabelImage.isNull() ? &self->mFinalImage : &self->mLabelImage );
 
   try
   {
@@ -304,13 +407,223 @@ void QgsMapRendererParallelJob::renderLabelsStatic( QgsMapRendererParallelJob* s
   }
 
   painter.end();
+
+  if ( !self->mLabelImage.isNull() )
+  {
+    QPainter mapPainter( &self->mFinalImage );
+    mapPainter.drawImage( 0, 0, self->mLabelImage );
+    mapPainter.end();
+  }
 }
 
 void QgsMapRendererParallelJob::renderLayersFinishedWhenJobCanceled()
 {
+  mergeTiles();
+
+  logTileRenderingTime();
   logRenderingTime( mLayerJobs );
 
   cleanupJobs( mLayerJobs );
   renderingFinished();
 }
 
+
+void QgsMapRendererParallelJob::prepareTiles()
+{
+  mLayerTiles.clear();
+  mTileRenderingTimes.clear();
+
+  for ( int i = 0; i < mLayerJobs.count(); ++i )
+  {
+    const LayerRenderJob& job = mLayerJobs.at( i );
+    int tiles = qMin( mLayerTileCounts.value( job.layerId, 1 ), mSettings.outputSize().height() );
+    // the old labeling engine and the geometry cache expect a single renderer per layer
+    if ( tiles > 1 && !job.cached && !job.incremental && job.img && !mLabelingEngine && !mRequestedGeomCacheForLayers.contains( job.layerId ) )
+      prepareLayerTiles( i, tiles );
+  }
+
+  mRenderQueue.clear();
+  for ( LayerRenderJobs::iterator it = mLayerJobs.begin(); it != mLayerJobs.end(); ++it )
+    mRenderQueue << &*it;
+  for ( QList<LayerTile>::iterator it = mLayerTiles.begin(); it != mLayerTiles.end(); ++it )
+    mRenderQueue << &it->job;
+}
+
+void QgsMapRendererParallelJob::prepareLayerTiles( int layerJob, int tiles )
+{
+  LayerRenderJob& job = mLayerJobs[layerJob];
+  QgsVectorLayerRenderer* layerRenderer = dynamic_cast<QgsVectorLayerRenderer*>( job.renderer );
+  QgsVectorLayer* vl = qobject_cast<QgsVectorLayer*>( QgsMapLayerRegistry::instance()->mapLayer( job.layerId ) );
+  if ( !layerRenderer || !vl )
+    return;
+
+  const int width = mSettings.outputSize().width();
+  const int height = mSettings.outputSize().height();
+  // features drawn near the edge of a strip are also fetched by the neighbouring strips,
+  // so that symbols larger than their geometry are not cut. Symbols are rarely larger than an inch.
+  const double margin = mSettings.outputDpi();
+  const QgsMapToPixel& mtp = mSettings.mapToPixel();
+  const QgsCoordinateTransform* ct = job.context.coordinateTransform();
+
+  QList<LayerTile> layerTiles;
+  QList<QgsRectangle> extents;
+  for ( int t = 0; t < tiles; ++t )
+  {
+    int top = height * t / tiles;
+    int bottom = height * ( t + 1 ) / tiles;
+
+    QgsRectangle extent( mtp.toMapCoordinatesF( -margin, top - margin ), mtp.toMapCoordinatesF( width + margin, bottom + margin ) );
+    extent.combineExtentWith( mtp.toMapCoordinatesF( -margin, bottom + margin ) );
+    extent.combineExtentWith( mtp.toMapCoordinatesF( width + margin, top - margin ) );
+    if ( ct )
+    {
+      QgsRectangle r2;
+      reprojectToLayerExtent( vl, ct, extent, r2 );
+      if ( !extent.isFinite() )
+        return;
+    }
+    extents << extent;
+
+    // the first tile is drawn by the layer job itself
+    if ( t == 0 )
+      continue;
+
+    LayerTile tile;
+    tile.layerJob = layerJob;
+    tile.rect = QRect( 0, top, width, bottom - top );
+    tile.job.img = new QImage( tile.rect.size(), mSettings.outputImageFormat() );
+    if ( tile.job.img->isNull() )
+    {
+      // not enough memory for the strips, render the layer as a whole
+      delete tile.job.img;
+      Q_FOREACH ( const LayerTile& created, layerTiles )
+        delete created.job.img;
+      return;
+    }
+    tile.job.img->fill( 0 );
+    layerTiles << tile;
+  }
+
+  QPainter* layerPainter = job.context.painter();
+  layerPainter->setClipRect( QRect( 0, 0, width, height / tiles ) );
+  job.context.setExtent( extents.at( 0 ) );
+  layerRenderer->setLabelingRows( -std::numeric_limits<double>::max(), height / tiles );
+
+  bool hasStyleOverride = mSettings.layerStyleOverrides().contains( vl->id() );
+  if ( hasStyleOverride )
+    vl->styleManager()->setOverrideStyle( mSettings.layerStyleOverrides().value( vl->id() ) );
+
+  for ( int t = 1; t < tiles; ++t )
+  {
+    mLayerTiles << layerTiles.at( t - 1 );
+    LayerTile& tile = mLayerTiles.last();
+    LayerRenderJob& tileJob = tile.job;
+    tileJob.cached = false;
+    tileJob.incremental = false;
+    tileJob.blendMode = job.blendMode;
+    tileJob.opacity = job.opacity;
+    tileJob.layerId = job.layerId;
+    tileJob.renderingTime = -1;
+
+    // the labeling engine is set by shareLabeling(), the layer is registered with it once
+    tileJob.context = QgsRenderContext::fromMapSettings( mSettings );
+    tileJob.context.setCoordinateTransform( ct );
+    tileJob.context.setExtent( extents.at( t ) );
+
+    // the strip is drawn with the coordinates of the whole map image
+    QPainter* painter = new QPainter( tileJob.img );
+    painter->setRenderHint( QPainter::Antialiasing, mSettings.testFlag( QgsMapSettings::Antialiasing ) );
+    painter->translate( 0, -tile.rect.top() );
+    painter->setClipRect( tile.rect );
+    tileJob.context.setPainter( painter );
+
+    tileJob.renderer = vl->createMapRenderer( tileJob.context );
+    static_cast<QgsVectorLayerRenderer*>( tileJob.renderer )->shareLabeling( layerRenderer );
+    double bottom = t == tiles - 1 ? std::numeric_limits<double>::max() : tile.rect.bottom() + 1;
+    static_cast<QgsVectorLayerRenderer*>( tileJob.renderer )->setLabelingRows( tile.rect.top(), bottom );
+  }
+
+  if ( hasStyleOverride )
+    vl->styleManager()->restoreOverrideStyle();
+}
+
+void QgsMapRendererParallelJob::mergeTiles()
+{
+  for ( QList<LayerTile>::iterator it = mLayerTiles.begin(); it != mLayerTiles.end(); ++it )
+  {
+    LayerTile& tile = *it;
+    LayerRenderJob& layerJob = mLayerJobs[tile.layerJob];
+
+    QList<int>& times = mTileRenderingTimes[layerJob.layerId];
+    if ( times.isEmpty() )
+      times << layerJob.renderingTime;
+    times << tile.job.renderingTime;
+    layerJob.renderingTime = qMax( layerJob.renderingTime, tile.job.renderingTime );
+
+    QPainter* painter = layerJob.context.painter();
+    painter->setClipping( false );
+    painter->drawImage( tile.rect.topLeft(), *tile.job.img );
+
+    delete tile.job.context.painter();
+    tile.job.context.setPainter( nullptr );
+    delete tile.job.img;
+    tile.job.img = nullptr;
+
+    Q_FOREACH ( const QString& message, tile.job.renderer->errors() )
+      mErrors.append( Error( tile.job.renderer->layerID(), message ) );
+    delete tile.job.renderer;
+    tile.job.renderer = nullptr;
+
+    // a canceled tile leaves its part of the layer unfinished, the layer must not be cached
+    if ( tile.job.context.renderingStopped() )
+      layerJob.context.setRenderingStopped( true );
+  }
+
+  mLayerTiles.clear();
+  mRenderQueue.clear();
+}
+
+QImage QgsMapRendererParallelJob::composeTiledImage() const
+{
+  QImage image( mSettings.outputSize(), mSettings.outputImageFormat() );
+  image.fill( mSettings.backgroundColor().rgba() );
+
+  QPainter painter( &image );
+
+  for ( int i = 0; i < mLayerJobs.count(); ++i )
+  {
+    const LayerRenderJob& job = mLayerJobs.at( i );
+
+    painter.setCompositionMode( job.blendMode );
+    painter.setOpacity( job.opacity );
+
+    Q_ASSERT( job.img );
+
+    painter.drawImage( 0, 0, *job.img );
+
+    // tiles only cover the part of the map which is not drawn by the layer job
+    Q_FOREACH ( const LayerTile& tile, mLayerTiles )
+    {
+      if ( tile.layerJob == i )
+        painter.drawImage( tile.rect.topLeft(), *tile.job.img );
+    }
+  }
+
+  painter.end();
+  return image;
+}
+
+void QgsMapRendererParallelJob::logTileRenderingTime() const
+{
+  QSettings settings;
+  if ( !settings.value( "/Map/logCanvasRefreshEvent", false ).toBool() )
+    return;
+
+  for ( QMap<QString, QList<int> >::const_iterator it = mTileRenderingTimes.constBegin(); it != mTileRenderingTimes.constEnd(); ++it )
+  {
+    for ( int t = 0; t < it.value().count(); ++t )
+    {
+      QgsMessageLog::logMessage( tr( "%1 ms: %2 (tile %3/%4)" ).arg( it.value().at( t ) ).arg( it.key() ).arg( t + 1 ).arg( it.value().count() ), tr( "Rendering" ) );
+    }
+  }
+}
@@ -44,6 +44,35 @@ class CORE_EXPORT QgsMapRendererParallelJob : public QgsMapRendererQImageJob
     // from QgsMapRendererJobWithPreview
     virtual QImage renderedImage() override;
 
+    /**
+     * Sets the number of tiles a vector layer is split into while rendering. Every tile is a
+     * horizontal strip of the map image drawn by its own layer renderer, so that a single heavy
+     * layer is rendered by several threads. Tiles are clipped to their strip and composed in
+     * order, therefore symbol levels and blending give the same result as an undivided layer.
+     * Labels and diagrams of a feature are registered by the tile which draws the center of its
+     * bounding box. Layers for which a geometry cache is requested are never split.
+     * @param layerId ID of the vector layer
+     * @param tiles number of tiles, 1 renders the layer as a whole
+     * @see layerTileCount()
+     * @note added in QGIS 2.18
+     */
+    void setLayerTileCount( const QString& layerId, int tiles );
+
+    /**
+     * Returns the number of tiles a layer is split into while rendering.
+     * @see setLayerTileCount()
+     * @note added in QGIS 2.18
+     */
+    int layerTileCount( const QString& layerId ) const;
+
+    /**
+     * Returns the time in milliseconds it took to render each tile of a layer in the last
+     * rendering, or an empty list if the layer was not split.
+     * @see setLayerTileCount()
+     * @note added in QGIS 2.18
+     */
+    QList<int> tileRenderingTimes( const QString& layerId ) const;
+
   protected slots:
     //! layers are rendered, labeling is still pending
     void renderLayersFinished();
@@ -53,6 +82,8 @@ class CORE_EXPORT QgsMapRendererParallelJob : public QgsMapRendererQImageJob
   protected:
 
     static void renderLayerStatic( LayerRenderJob& job );
+    //! @note not available in Python bindings
+    static void renderQueuedLayerStatic( LayerRenderJob* job );
     static void renderLabelsStatic( QgsMapRendererParallelJob* self );
 
   protected:
@@ -78,6 +109,42 @@ class CORE_EXPORT QgsMapRendererParallelJob : public QgsMapRendererQImageJob
   private slots:
 
     void renderLayersFinishedWhenJobCanceled();
+
+  private:
+
+    //! A horizontal strip of a layer which is rendered by its own renderer
+    struct LayerTile
+    {
+      //! index of the layer job in mLayerJobs
+      int layerJob;
+      //! strip of the map image covered by the tile
+      QRect rect;
+      LayerRenderJob job;
+    };
+
+    //! Splits the layer jobs into tiles and fills the render queue
+    void prepareTiles();
+    void prepareLayerTiles( int layerJob, int tiles );
+    //! Draws the rendered tiles into the images of their layers and deletes the tiles
+    void mergeTiles();
+    //! Composes the preview image while some layers are still rendered in tiles
+    QImage composeTiledImage() const;
+    void logTileRenderingTime() const;
+
+    QMap<QString, int> mLayerTileCounts;
+    QList<LayerTile> mLayerTiles;
+    //! layer and tile jobs which need to be rendered
+    QList<LayerRenderJob*> mRenderQueue;
+    QMap<QString, QList<int> > mTileRenderingTimes;
+
+    //! key of the labels in the render cache, empty if the labels can not be cached
+    QString mLabelCacheKey;
+    QStringList mLabeledLayers;
+    //! labels drawn by this job, stored in the render cache when finished
+    QImage mLabelImage;
+    //! labels of a previous job which are reused
+    QImage mCachedLabelImage;
+    QgsLabelingResults* mCachedLabelingResults;
 };
 
 
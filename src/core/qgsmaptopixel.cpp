@@ -22,6 +22,11 @@
 #include <QTransform>
 
 #include "qgslogger.h"
+#include "qgscoordinatetransform.h"
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#endif
 
 QgsMapToPixel::QgsMapToPixel( double mapUnitsPerPixel,
                               double xc,
@@ -331,6 +336,73 @@ void QgsMapToPixel::transformInPlace( float& x, float& y ) const
   y = my;
 }
 
+void QgsMapToPixel::transformInPlace( double* x, double* y, int count ) const
+{
+  // the matrix is always affine, see transform()
+  const double m11 = mMatrix.m11(), m12 = mMatrix.m12(), dx = mMatrix.dx();
+  const double m21 = mMatrix.m21(), m22 = mMatrix.m22(), dy = mMatrix.dy();
+
+  int i = 0;
+#if defined( __SSE2__ )
+  const __m128d vm11 = _mm_set1_pd( m11 ), vm12 = _mm_set1_pd( m12 ), vdx = _mm_set1_pd( dx );
+  const __m128d vm21 = _mm_set1_pd( m21 ), vm22 = _mm_set1_pd( m22 ), vdy = _mm_set1_pd( dy );
+  for ( ; i + 1 < count; i += 2 )
+  {
+    __m128d vx = _mm_loadu_pd( x + i );
+    __m128d vy = _mm_loadu_pd( y + i );
+    _mm_storeu_pd( x + i, _mm_add_pd( _mm_add_pd( _mm_mul_pd( vm11, vx ), _mm_mul_pd( vm21, vy ) ), vdx ) );
+    _mm_storeu_pd( y + i, _mm_add_pd( _mm_add_pd( _mm_mul_pd( vm12, vx ), _mm_mul_pd( vm22, vy ) ), vdy ) );
+  }
+#endif
+  for ( ; i < count; ++i )
+  {
+    double px = x[i];
+    double py = y[i];
+    x[i] = m11 * px + m21 * py + dx;
+    y[i] = m12 * px + m22 * py + dy;
+  }
+}
+
+void QgsMapToPixel::transformPolygon( QPolygonF& points, const QgsCoordinateTransform* ct ) const
+{
+  if ( ct )
+  {
+    ct->transformPolygon( points );
+  }
+
+  const double m11 = mMatrix.m11(), m12 = mMatrix.m12(), dx = mMatrix.dx();
+  const double m21 = mMatrix.m21(), m22 = mMatrix.m22(), dy = mMatrix.dy();
+
+  int count = points.size();
+  QPointF* ptr = points.data();
+  int i = 0;
+#if defined( __SSE2__ )
+  if ( sizeof( qreal ) == sizeof( double ) )
+  {
+    // every point is an x, y pair of doubles: x' y' = x * (m11 m12) + y * (m21 m22) + (dx dy)
+    const __m128d mx = _mm_setr_pd( m11, m12 );
+    const __m128d my = _mm_setr_pd( m21, m22 );
+    const __m128d d = _mm_setr_pd( dx, dy );
+    double* xy = reinterpret_cast<double*>( ptr );
+    for ( ; i < count; ++i, xy += 2 )
+    {
+      __m128d p = _mm_loadu_pd( xy );
+      __m128d px = _mm_unpacklo_pd( p, p );
+      __m128d py = _mm_unpackhi_pd( p, p );
+      _mm_storeu_pd( xy, _mm_add_pd( _mm_add_pd( _mm_mul_pd( mx, px ), _mm_mul_pd( my, py ) ), d ) );
+    }
+  }
+#endif
+  for ( ; i < count; ++i )
+  {
+    QPointF& p = ptr[i];
+    double px = p.x();
+    double py = p.y();
+    p.rx() = m11 * px + m21 * py + dx;
+    p.ry() = m12 * px + m22 * py + dy;
+  }
+}
+
 QTransform QgsMapToPixel::transform() const
 {
   // NOTE: operations are done in the reverse order in which
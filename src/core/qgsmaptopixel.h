@@ -19,11 +19,13 @@
 
 #include "qgspoint.h"
 #include <QTransform>
+#include <QPolygonF>
 #include <vector>
 
 #include <cassert>
 
 class QgsPoint;
+class QgsCoordinateTransform;
 class QPoint;
 
 /** \ingroup core
@@ -111,6 +113,29 @@ class CORE_EXPORT QgsMapToPixel
         transformInPlace( x[i], y[i] );
     }
 
+    /**
+     * Transforms arrays of map (world) coordinates to device coordinates, in place.
+     * Several points are transformed at a time with SIMD instructions where available.
+     * @param x array of x coordinates
+     * @param y array of y coordinates
+     * @param count number of points
+     * @note added in QGIS 2.18
+     * @note not available in python bindings
+     */
+    void transformInPlace( double* x, double* y, int count ) const;
+
+    /**
+     * Transforms a polygon to device coordinates, in place. If a coordinate transform is
+     * given, the points are reprojected with it first, so layer coordinates are converted
+     * to device coordinates with a single call and without copying the polygon.
+     * @param points polygon in map coordinates, or in layer coordinates if ct is set
+     * @param ct optional transform from layer to map coordinates
+     * @throws QgsCsException if the points can not be reprojected
+     * @note added in QGIS 2.18
+     * @note not available in python bindings
+     */
+    void transformPolygon( QPolygonF& points, const QgsCoordinateTransform* ct = nullptr ) const;
+
     QgsPoint toMapCoordinates( int x, int y ) const;
 
     //! Transform device coordinates to map (world) coordinates
@@ -5291,6 +5291,17 @@ QgsLabelingResults::~QgsLabelingResults()
   mLabelSearchTree = nullptr;
 }
 
+QgsLabelingResults* QgsLabelingResults::clone() const
+{
+  QgsLabelingResults* results = new QgsLabelingResults();
+  if ( mLabelSearchTree )
+  {
+    delete results->mLabelSearchTree;
+    results->mLabelSearchTree = mLabelSearchTree->clone();
+  }
+  return results;
+}
+
 QList<QgsLabelPosition> QgsLabelingResults::labelsAtPosition( const QgsPoint& p ) const
 {
   QList<QgsLabelPosition> positions;
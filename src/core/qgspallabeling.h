@@ -859,6 +859,11 @@ class CORE_EXPORT QgsLabelingResults
     //! return infos about labels within a given (map) rectangle
     QList<QgsLabelPosition> labelsWithinRect( const QgsRectangle& r ) const;
 
+    /** Returns a copy of the results. Caller takes ownership.
+     * @note added in QGIS 2.18
+     */
+    QgsLabelingResults* clone() const;
+
   private:
     QgsLabelingResults( const QgsLabelingResults& ); // no copying allowed
     QgsLabelingResults& operator=( const QgsLabelingResults& rh );
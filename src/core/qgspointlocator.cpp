@@ -16,6 +16,7 @@
 #include "qgspointlocator.h"
 
 #include "qgsgeometry.h"
+#include "qgsspatialindex.h"
 #include "qgsvectorlayer.h"
 #include "qgswkbptr.h"
 #include "qgis.h"
@@ -698,7 +699,11 @@ bool QgsPointLocator::rebuildIndex( int maxFeaturesToIndex )
         QgsDebugMsg( QString( "could not transform bounding box to map, skipping the snap filter (%1)" ).arg( e.what() ) );
       }
     }
-    request.setFilterRect( rect );
+    // a stored index of the layer gives the features within the extent without scanning the whole file
+    if ( QgsSpatialIndex::canStoreLayerIndex( mLayer ) )
+      request.setFilterFids( QgsSpatialIndex::layerIndex( mLayer ).intersects( rect ).toSet() );
+    else
+      request.setFilterRect( rect );
   }
   QgsFeatureIterator fi = mLayer->getFeatures( request );
   int indexedCount = 0;
@@ -0,0 +1,287 @@
+/***************************************************************************
+  qgssimplificationpyramid.cpp - QgsSimplificationPyramid
+  -------------------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "qgssimplificationpyramid.h"
+#include "qgsgeometry.h"
+#include "qgslogger.h"
+#include "qgswkbptr.h"
+
+#include "simplify/effectivearea.h"
+
+#include <QByteArray>
+
+#include <cfloat>
+
+QgsSimplificationPyramid::QgsSimplificationPyramid( int maximumSize )
+    : mMaximumSize( maximumSize )
+    , mSize( 0 )
+{
+}
+
+QgsGeometry* QgsSimplificationPyramid::simplify( QgsFeatureId fid, const QgsGeometry& geometry, double tolerance )
+{
+  const unsigned char* wkb = geometry.asWkb();
+  int wkbSize = geometry.wkbSize();
+  if ( !wkb || wkbSize <= 0 )
+    return nullptr;
+
+  Rings rings;
+  try
+  {
+    if ( !readRings( wkb, wkbSize, rings ) )
+      return nullptr;
+  }
+  catch ( const QgsWkbException& e )
+  {
+    QgsDebugMsg( QString( "Could not read the geometry of feature %1: %2" ).arg( fid ).arg( e.what() ) );
+    return nullptr;
+  }
+
+  uint sum = checksum( wkb, wkbSize );
+  QVector<float> areas;
+  {
+    QReadLocker locker( &mLock );
+    QHash<QgsFeatureId, Entry>::const_iterator it = mEntries.constFind( fid );
+    if ( it != mEntries.constEnd() && it->wkbSize == wkbSize && it->checksum == sum )
+      areas = it->areas;
+  }
+
+  if ( areas.isEmpty() )
+  {
+    calculateAreas( rings, areas );
+
+    Entry entry;
+    entry.wkbSize = wkbSize;
+    entry.checksum = sum;
+    entry.areas = areas;
+
+    QWriteLocker locker( &mLock );
+    QHash<QgsFeatureId, Entry>::iterator it = mEntries.find( fid );
+    if ( it != mEntries.end() )
+    {
+      mSize -= entrySize( *it );
+      mEntries.erase( it );
+    }
+    if ( mSize + entrySize( entry ) <= mMaximumSize )
+    {
+      mEntries.insert( fid, entry );
+      mSize += entrySize( entry );
+    }
+  }
+
+  if ( areas.count() != rings.coords.count() / 2 )
+    return nullptr;
+
+  return filter( rings, areas, tolerance * tolerance );
+}
+
+void QgsSimplificationPyramid::remove( QgsFeatureId fid )
+{
+  QWriteLocker locker( &mLock );
+  QHash<QgsFeatureId, Entry>::iterator it = mEntries.find( fid );
+  if ( it != mEntries.end() )
+  {
+    mSize -= entrySize( *it );
+    mEntries.erase( it );
+  }
+}
+
+void QgsSimplificationPyramid::clear()
+{
+  QWriteLocker locker( &mLock );
+  mEntries.clear();
+  mSize = 0;
+}
+
+void QgsSimplificationPyramid::setMaximumSize( int bytes )
+{
+  QWriteLocker locker( &mLock );
+  mMaximumSize = bytes;
+}
+
+int QgsSimplificationPyramid::maximumSize() const
+{
+  QReadLocker locker( &mLock );
+  return mMaximumSize;
+}
+
+int QgsSimplificationPyramid::size() const
+{
+  QReadLocker locker( &mLock );
+  return mSize;
+}
+
+int QgsSimplificationPyramid::count() const
+{
+  QReadLocker locker( &mLock );
+  return mEntries.count();
+}
+
+bool QgsSimplificationPyramid::readRings( const unsigned char* wkb, int wkbSize, Rings& rings )
+{
+  QgsConstWkbPtr wkbPtr( wkb, wkbSize );
+  QgsWKBTypes::Type wkbType = wkbPtr.readHeader();
+  QgsWKBTypes::Type flatType = QgsWKBTypes::flatType( wkbType );
+  if ( flatType != QgsWKBTypes::LineString && flatType != QgsWKBTypes::MultiLineString &&
+       flatType != QgsWKBTypes::Polygon && flatType != QgsWKBTypes::MultiPolygon )
+    return false;
+
+  bool multi = flatType == QgsWKBTypes::MultiLineString || flatType == QgsWKBTypes::MultiPolygon;
+  bool polygon = flatType == QgsWKBTypes::Polygon || flatType == QgsWKBTypes::MultiPolygon;
+  rings.type = flatType;
+  rings.coords.reserve( wkbSize / sizeof( double ) );
+
+  unsigned int numParts = 1;
+  if ( multi )
+    wkbPtr >> numParts;
+
+  for ( unsigned int part = 0; part < numParts; ++part )
+  {
+    QgsWKBTypes::Type partType = multi ? wkbPtr.readHeader() : wkbType;
+    int skipZM = ( QgsWKBTypes::coordDimensions( partType ) - 2 ) * sizeof( double );
+
+    unsigned int numRings = 1;
+    if ( polygon )
+      wkbPtr >> numRings;
+
+    for ( unsigned int ring = 0; ring < numRings; ++ring )
+    {
+      unsigned int numPoints;
+      wkbPtr >> numPoints;
+      if ( numPoints > static_cast<unsigned int>( wkbPtr.remaining() / ( 2 * sizeof( double ) + skipZM ) ) )
+      {
+        QgsDebugMsg( QString( "%1 points exceed wkb length (%2)" ).arg( numPoints ).arg( wkbPtr.remaining() ) );
+        return false;
+      }
+
+      double x, y;
+      for ( unsigned int i = 0; i < numPoints; ++i )
+      {
+        wkbPtr >> x >> y;
+        wkbPtr += skipZM;
+        rings.coords << x << y;
+      }
+      rings.ringSizes << numPoints;
+    }
+    rings.partSizes << numRings;
+  }
+
+  return true;
+}
+
+void QgsSimplificationPyramid::calculateAreas( const Rings& rings, QVector<float>& areas )
+{
+  bool polygon = rings.type == QgsWKBTypes::Polygon || rings.type == QgsWKBTypes::MultiPolygon;
+  areas.resize( rings.coords.count() / 2 );
+
+  int offset = 0;
+  Q_FOREACH ( int numPoints, rings.ringSizes )
+  {
+    float* ringAreas = areas.data() + offset;
+    if ( numPoints < 3 )
+    {
+      for ( int i = 0; i < numPoints; ++i )
+        ringAreas[i] = FLT_MAX;
+    }
+    else
+    {
+      POINTARRAY inpts;
+      inpts.pointlist = const_cast<double*>( rings.coords.constData() ) + 2 * offset;
+      inpts.dimension = 2;
+      inpts.npoints = numPoints;
+      inpts.flags = 0;
+
+      // calculate the area of every vertex rather than stopping at a threshold, rings keep at least 4 vertices
+      EFFECTIVE_AREAS* ea = initiate_effectivearea( &inpts );
+      ptarray_calc_areas( ea, polygon ? 4 : 2, 1, 0 );
+      for ( int i = 0; i < numPoints; ++i )
+        ringAreas[i] = qMin( ea->res_arealist[i], static_cast<double>( FLT_MAX ) );
+      destroy_effectivearea( ea );
+    }
+    offset += numPoints;
+  }
+}
+
+QgsGeometry* QgsSimplificationPyramid::filter( const Rings& rings, const QVector<float>& areas, double minimumArea )
+{
+  int numKept = 0;
+  Q_FOREACH ( float area, areas )
+  {
+    if ( area > minimumArea )
+      ++numKept;
+  }
+  if ( numKept == areas.count() )
+    return nullptr;
+
+  bool multi = rings.type == QgsWKBTypes::MultiLineString || rings.type == QgsWKBTypes::MultiPolygon;
+  bool polygon = rings.type == QgsWKBTypes::Polygon || rings.type == QgsWKBTypes::MultiPolygon;
+  QgsWKBTypes::Type partType = polygon ? QgsWKBTypes::Polygon : QgsWKBTypes::LineString;
+
+  int partHeaderSize = 1 + sizeof( int ) + ( polygon ? sizeof( int ) : 0 );
+  int wkbSize = ( multi ? 1 + 2 * sizeof( int ) : 0 ) + rings.partSizes.count() * partHeaderSize +
+                rings.ringSizes.count() * sizeof( int ) + numKept * 2 * sizeof( double );
+  unsigned char* wkb = new unsigned char[wkbSize];
+  QgsWkbPtr wkbPtr( wkb, wkbSize );
+
+  if ( multi )
+    wkbPtr << ( char ) QgsApplication::endian() << rings.type << static_cast<unsigned int>( rings.partSizes.count() );
+
+  const double* coords = rings.coords.constData();
+  const float* vertexAreas = areas.constData();
+  int ring = 0;
+  Q_FOREACH ( int numRings, rings.partSizes )
+  {
+    wkbPtr << ( char ) QgsApplication::endian() << partType;
+    if ( polygon )
+      wkbPtr << static_cast<unsigned int>( numRings );
+
+    for ( int i = 0; i < numRings; ++i, ++ring )
+    {
+      int numPoints = rings.ringSizes.at( ring );
+      unsigned int numRingKept = 0;
+      for ( int j = 0; j < numPoints; ++j )
+      {
+        if ( vertexAreas[j] > minimumArea )
+          ++numRingKept;
+      }
+
+      wkbPtr << numRingKept;
+      for ( int j = 0; j < numPoints; ++j )
+      {
+        if ( vertexAreas[j] > minimumArea )
+          wkbPtr << coords[2 * j] << coords[2 * j + 1];
+      }
+
+      coords += 2 * numPoints;
+      vertexAreas += numPoints;
+    }
+  }
+
+  QgsGeometry* geometry = new QgsGeometry();
+  geometry->fromWkb( wkb, wkbSize );
+  return geometry;
+}
+
+uint QgsSimplificationPyramid::checksum( const unsigned char* wkb, int wkbSize )
+{
+  // the whole WKB is hashed, as the geometry has been read already this adds little to the cost of a lookup
+  return qHash( QByteArray::fromRawData( reinterpret_cast<const char*>( wkb ), wkbSize ) );
+}
+
+int QgsSimplificationPyramid::entrySize( const Entry& entry )
+{
+  return sizeof( QgsFeatureId ) + sizeof( Entry ) + entry.areas.count() * sizeof( float );
+}
@@ -0,0 +1,134 @@
+/***************************************************************************
+  qgssimplificationpyramid.h - QgsSimplificationPyramid
+  -----------------------------------------------------
+
+ begin                : October 2026
+ copyright            : (C) 2026 by NextGIS
+ email                : info at nextgis dot com
+ ***************************************************************************
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ ***************************************************************************/
+#ifndef QGSSIMPLIFICATIONPYRAMID_H
+#define QGSSIMPLIFICATIONPYRAMID_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+
+#include "qgsfeature.h"
+#include "qgswkbtypes.h"
+
+class QgsGeometry;
+
+/** \ingroup core
+ * \brief Stores the significance of the vertices of the features of a layer, so that
+ * their geometries can be simplified to any tolerance without running a simplification
+ * algorithm again.
+ *
+ * The significance of a vertex is its effective area, as calculated by the Visvalingam
+ * algorithm when all less significant vertices have been removed. It is calculated once
+ * per feature and kept in memory, keyed by the feature id. Simplifying a geometry to a
+ * tolerance then only keeps the vertices whose effective area is larger than the square
+ * of the tolerance, which gives the same result as QgsMapToPixelSimplifier::Visvalingam.
+ *
+ * The stored areas are checked against the size and a hash of the WKB of the geometry,
+ * so that changed geometries are calculated again. Line and polygon geometries are
+ * supported, the simplified geometries are 2D.
+ *
+ * The pyramid may be used by several threads at a time.
+ *
+ * \note added in QGIS 2.18
+ * \note not available in Python bindings
+ */
+class CORE_EXPORT QgsSimplificationPyramid
+{
+  public:
+
+    /** Constructor for QgsSimplificationPyramid.
+     * @param maximumSize maximum size of the stored areas, in bytes
+     */
+    explicit QgsSimplificationPyramid( int maximumSize = 64 * 1024 * 1024 );
+
+    /** Simplifies the geometry of a feature, calculating and storing the significance of its
+     * vertices if it is not known yet.
+     * @param fid id of the feature
+     * @param geometry geometry of the feature
+     * @param tolerance simplification tolerance, in layer units
+     * @returns simplified geometry, or nullptr if no vertex can be removed or the geometry
+     * type is not supported. Ownership is transferred to the caller.
+     */
+    QgsGeometry* simplify( QgsFeatureId fid, const QgsGeometry& geometry, double tolerance );
+
+    //! Removes the stored areas of a feature
+    void remove( QgsFeatureId fid );
+
+    //! Removes all stored areas
+    void clear();
+
+    /** Sets the maximum size of the stored areas, in bytes. Once the pyramid is full,
+     * the areas of further features are calculated whenever they are simplified.
+     * @see maximumSize()
+     */
+    void setMaximumSize( int bytes );
+
+    /** Returns the maximum size of the stored areas, in bytes.
+     * @see setMaximumSize()
+     */
+    int maximumSize() const;
+
+    //! Returns the size of the stored areas, in bytes
+    int size() const;
+
+    //! Returns the number of features with stored areas
+    int count() const;
+
+  private:
+
+    struct Entry
+    {
+      Entry()
+          : wkbSize( 0 )
+          , checksum( 0 )
+      {}
+
+      int wkbSize;
+      uint checksum;
+      //! effective area of every vertex, in the order of the WKB
+      QVector<float> areas;
+    };
+
+    //! The 2D vertices of a line or polygon geometry, ring by ring
+    struct Rings
+    {
+      Rings()
+          : type( QgsWKBTypes::Unknown )
+      {}
+
+      QgsWKBTypes::Type type;
+      QVector<double> coords;
+      QVector<int> ringSizes;
+      //! number of rings of every part
+      QVector<int> partSizes;
+    };
+
+    static bool readRings( const unsigned char* wkb, int wkbSize, Rings& rings );
+    static void calculateAreas( const Rings& rings, QVector<float>& areas );
+    static QgsGeometry* filter( const Rings& rings, const QVector<float>& areas, double minimumArea );
+    static uint checksum( const unsigned char* wkb, int wkbSize );
+
+    static int entrySize( const Entry& entry );
+
+    mutable QReadWriteLock mLock;
+    QHash<QgsFeatureId, Entry> mEntries;
+    int mMaximumSize;
+    int mSize;
+
+    Q_DISABLE_COPY( QgsSimplificationPyramid )
+};
+
+#endif // QGSSIMPLIFICATIONPYRAMID_H
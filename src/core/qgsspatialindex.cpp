@@ -20,9 +20,22 @@
 #include "qgsfeatureiterator.h"
 #include "qgsrectangle.h"
 #include "qgslogger.h"
+#include "qgsapplication.h"
+#include "qgsvectordataprovider.h"
+#include "qgsvectorlayer.h"
 
 #include "SpatialIndex.h"
 
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+
 using namespace SpatialIndex;
 
 
@@ -152,11 +165,17 @@ class QgsSpatialIndexData : public QSharedData
 {
   public:
     QgsSpatialIndexData()
+        : mStorage( nullptr )
+        , mRTree( nullptr )
+        , mFileBacked( false )
     {
       initTree();
     }
 
     explicit QgsSpatialIndexData( const QgsFeatureIterator& fi )
+        : mStorage( nullptr )
+        , mRTree( nullptr )
+        , mFileBacked( false )
     {
       QgsFeatureIteratorDataStream fids( fi );
       initTree( &fids );
@@ -164,11 +183,14 @@ class QgsSpatialIndexData : public QSharedData
 
     QgsSpatialIndexData( const QgsSpatialIndexData& other )
         : QSharedData( other )
+        , mStorage( nullptr )
+        , mRTree( nullptr )
+        , mFileBacked( false )
     {
       initTree();
 
       // copy R-tree data one by one (is there a faster way??)
-      double low[]  = { DBL_MIN, DBL_MIN };
+      double low[]  = { -DBL_MAX, -DBL_MAX };
       double high[] = { DBL_MAX, DBL_MAX };
       SpatialIndex::Region query( low, high, 2 );
       QgsSpatialIndexCopyVisitor visitor( mRTree );
@@ -204,6 +226,73 @@ class QgsSpatialIndexData : public QSharedData
                                         leafCapacity, dimension, variant, indexId );
     }
 
+    /** Creates an R-tree stored in the files baseName.idx and baseName.dat and bulk loads it
+     * with features from the iterator.
+     * @returns identifier of the R-tree within the files, or -1 if the files could not be written
+     */
+    static SpatialIndex::id_type createFiles( const QgsFeatureIterator& fi, const QString& baseName )
+    {
+      QgsFeatureIteratorDataStream fids( fi );
+      std::string name = QFile::encodeName( baseName ).constData();
+      IStorageManager* storage = nullptr;
+      ISpatialIndex* tree = nullptr;
+      SpatialIndex::id_type indexId = -1;
+      try
+      {
+        storage = StorageManager::createNewDiskStorageManager( name, 4096 );
+        // bulk loading refuses empty streams
+        if ( fids.hasNext() )
+          tree = RTree::createAndBulkLoadNewRTree( RTree::BLM_STR, fids, *storage, 0.7, 10, 10, 2, RTree::RV_RSTAR, indexId );
+        else
+          tree = RTree::createNewRTree( *storage, 0.7, 10, 10, 2, RTree::RV_RSTAR, indexId );
+      }
+      catch ( Tools::Exception &e )
+      {
+        Q_UNUSED( e );
+        QgsDebugMsg( QString( "Tools::Exception caught: %1" ).arg( e.what().c_str() ) );
+        indexId = -1;
+      }
+      catch ( ... )
+      {
+        QgsDebugMsg( "unknown spatial index exception caught" );
+        indexId = -1;
+      }
+
+      // the headers are written when the tree and the storage are destroyed
+      delete tree;
+      delete storage;
+      return indexId;
+    }
+
+    /** Opens an R-tree created by createFiles().
+     * @returns data of the index, or nullptr if the files could not be read
+     */
+    static QgsSpatialIndexData* openFiles( const QString& baseName, SpatialIndex::id_type indexId )
+    {
+      std::string name = QFile::encodeName( baseName ).constData();
+      IStorageManager* storage = nullptr;
+      try
+      {
+        storage = StorageManager::loadDiskStorageManager( name );
+        ISpatialIndex* tree = RTree::loadRTree( *storage, indexId );
+        return new QgsSpatialIndexData( storage, tree );
+      }
+      catch ( Tools::Exception &e )
+      {
+        Q_UNUSED( e );
+        QgsDebugMsg( QString( "Tools::Exception caught: %1" ).arg( e.what().c_str() ) );
+      }
+      catch ( ... )
+      {
+        QgsDebugMsg( "unknown spatial index exception caught" );
+      }
+      delete storage;
+      return nullptr;
+    }
+
+    /** Returns true if the R-tree is stored in files, which must not be modified*/
+    bool isFileBacked() const { return mFileBacked; }
+
     /** Storage manager */
     SpatialIndex::IStorageManager* mStorage;
 
@@ -212,6 +301,14 @@ class QgsSpatialIndexData : public QSharedData
 
   private:
 
+    QgsSpatialIndexData( SpatialIndex::IStorageManager* storage, SpatialIndex::ISpatialIndex* tree )
+        : mStorage( storage )
+        , mRTree( tree )
+        , mFileBacked( true )
+    {}
+
+    bool mFileBacked;
+
     QgsSpatialIndexData& operator=( const QgsSpatialIndexData& rh );
 };
 
@@ -233,6 +330,11 @@ QgsSpatialIndex::QgsSpatialIndex( const QgsSpatialIndex& other )
 {
 }
 
+QgsSpatialIndex::QgsSpatialIndex( QgsSpatialIndexData* data )
+    : d( data )
+{
+}
+
 QgsSpatialIndex:: ~QgsSpatialIndex()
 {
 }
@@ -244,6 +346,145 @@ QgsSpatialIndex& QgsSpatialIndex::operator=( const QgsSpatialIndex & other )
   return *this;
 }
 
+/** Serializes the creation and the opening of stored layer indexes*/
+static QMutex sLayerIndexMutex;
+
+/** Returns the base name of the files of the stored index of a layer, or an empty string if the
+ * layer cannot have a stored index. The key identifies the version of the data the index is built from.
+ * The name starts with a hash of the data source followed by a hash of the key, so that indexes of
+ * different versions of the data never share files.
+ */
+static QString layerIndexBaseName( QgsVectorLayer* layer, QString& key )
+{
+  if ( !layer || !layer->dataProvider() )
+    return QString();
+
+  QFileInfo fi( layer->source().section( '|', 0, 0 ) );
+  if ( !fi.isFile() )
+    return QString();
+
+  QString source = QString( "%1\n%2\n%3" ).arg( layer->providerType(), layer->source(), layer->dataProvider()->subsetString() );
+  key = QString( "%1\n%2 %3" ).arg( source ).arg( fi.lastModified().toMSecsSinceEpoch() ).arg( fi.size() );
+
+  // SQLite based files in WAL mode (eg. GeoPackage) write changes to the log until it is checkpointed,
+  // which leaves the database file untouched
+  QFileInfo wal( fi.filePath() + "-wal" );
+  if ( wal.isFile() )
+    key += QString( "\n%1 %2" ).arg( wal.lastModified().toMSecsSinceEpoch() ).arg( wal.size() );
+
+  return QString( "%1/%2-%3" ).arg( QgsSpatialIndex::cacheDirectory(),
+                                    QCryptographicHash::hash( source.toUtf8(), QCryptographicHash::Md5 ).toHex(),
+                                    QCryptographicHash::hash( key.toUtf8(), QCryptographicHash::Md5 ).toHex() );
+}
+
+/** Removes the files of stored indexes of the same data source as the given base name, except for
+ * the index of the base name itself unless all is true. Indexes which are still open keep their
+ * files where the system allows to remove open files, elsewhere they are removed later.
+ */
+static void removeLayerIndexFiles( const QString& baseName, bool all )
+{
+  QFileInfo fi( baseName );
+  QString prefix = fi.fileName().section( '-', 0, 0 );
+  QDir dir( fi.absolutePath() );
+  Q_FOREACH ( const QString& fileName, dir.entryList( QStringList() << prefix + "-*", QDir::Files ) )
+  {
+    if ( all || !fileName.startsWith( fi.fileName() + '.' ) )
+      dir.remove( fileName );
+  }
+}
+
+QgsSpatialIndex QgsSpatialIndex::layerIndex( QgsVectorLayer* layer )
+{
+  if ( !layer )
+    return QgsSpatialIndex();
+
+  QgsFeatureRequest request;
+  request.setSubsetOfAttributes( QgsAttributeList() );
+
+  QString key;
+  QString baseName = layerIndexBaseName( layer, key );
+  if ( baseName.isEmpty() || layer->isModified() )
+    return QgsSpatialIndex( layer->getFeatures( request ) );
+
+  QMutexLocker locker( &sLayerIndexMutex );
+
+  // the key file holds the identifier of the tree followed by the key
+  QFile keyFile( baseName + ".key" );
+  if ( keyFile.open( QIODevice::ReadOnly ) )
+  {
+    QTextStream in( &keyFile );
+    in.setCodec( "UTF-8" );
+    bool ok;
+    SpatialIndex::id_type indexId = in.readLine().toLongLong( &ok );
+    if ( ok && in.readAll() == key )
+    {
+      QgsSpatialIndexData* data = QgsSpatialIndexData::openFiles( baseName, indexId );
+      if ( data )
+        return QgsSpatialIndex( data );
+    }
+    keyFile.close();
+  }
+
+  // indexes of previous versions of the data are not used anymore
+  removeLayerIndexFiles( baseName, false );
+
+  // (re)create the stored index in files of its own, which are moved into place once they are
+  // complete. Indexes opened by other instances or processes are never written to. The key file
+  // is moved last, so that incomplete files are never used.
+  QDir().mkpath( cacheDirectory() );
+  QString tempName = QString( "%1.%2" ).arg( baseName ).arg( QCoreApplication::applicationPid() );
+  SpatialIndex::id_type indexId = QgsSpatialIndexData::createFiles( layer->getFeatures( request ), tempName );
+  QFile tempKeyFile( tempName + ".key" );
+  if ( indexId >= 0 && tempKeyFile.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+  {
+    QTextStream out( &tempKeyFile );
+    out.setCodec( "UTF-8" );
+    out << indexId << '\n' << key;
+    out.flush();
+    tempKeyFile.close();
+
+    keyFile.remove();
+    QFile::remove( baseName + ".idx" );
+    QFile::remove( baseName + ".dat" );
+    if ( QFile::rename( tempName + ".idx", baseName + ".idx" ) &&
+         QFile::rename( tempName + ".dat", baseName + ".dat" ) &&
+         QFile::rename( tempName + ".key", baseName + ".key" ) )
+    {
+      QgsSpatialIndexData* data = QgsSpatialIndexData::openFiles( baseName, indexId );
+      if ( data )
+        return QgsSpatialIndex( data );
+    }
+  }
+
+  QFile::remove( tempName + ".key" );
+  QFile::remove( tempName + ".idx" );
+  QFile::remove( tempName + ".dat" );
+  QgsDebugMsg( QString( "Could not store the spatial index of %1" ).arg( layer->source() ) );
+  return QgsSpatialIndex( layer->getFeatures( request ) );
+}
+
+bool QgsSpatialIndex::canStoreLayerIndex( QgsVectorLayer* layer )
+{
+  QString key;
+  return !layerIndexBaseName( layer, key ).isEmpty() && !layer->isModified();
+}
+
+void QgsSpatialIndex::invalidateLayerIndex( QgsVectorLayer* layer )
+{
+  QString key;
+  QString baseName = layerIndexBaseName( layer, key );
+  if ( baseName.isEmpty() )
+    return;
+
+  QMutexLocker locker( &sLayerIndexMutex );
+  removeLayerIndexFiles( baseName, true );
+}
+
+QString QgsSpatialIndex::cacheDirectory()
+{
+  return QgsApplication::qgisSettingsDirPath() + "spatialindex";
+}
+
 SpatialIndex::Region QgsSpatialIndex::rectToRegion( const QgsRectangle& rect )
 {
   double pt1[2] = { rect.xMinimum(), rect.yMinimum() },
@@ -271,6 +512,8 @@ bool QgsSpatialIndex::insertFeature( const QgsFeature& f )
   if ( !featureInfo( f, r, id ) )
     return false;
 
+  detachFromFiles();
+
   // TODO: handle possible exceptions correctly
   try
   {
@@ -302,10 +545,19 @@ bool QgsSpatialIndex::deleteFeature( const QgsFeature& f )
   if ( !featureInfo( f, r, id ) )
     return false;
 
+  detachFromFiles();
+
   // TODO: handle exceptions
   return d->mRTree->deleteData( r, FID_TO_NUMBER( id ) );
 }
 
+void QgsSpatialIndex::detachFromFiles()
+{
+  // stored indexes are shared with other sessions, modify a copy in memory instead
+  if ( d.constData()->isFileBacked() )
+    d = new QgsSpatialIndexData( *d.constData() );
+}
+
 QList<QgsFeatureId> QgsSpatialIndex::intersects( const QgsRectangle& rect ) const
 {
   QList<QgsFeatureId> list;
@@ -41,6 +41,7 @@ class QgsPoint;
 
 class QgsSpatialIndexData;
 class QgsFeatureIterator;
+class QgsVectorLayer;
 
 /** \ingroup core
  * \class QgsSpatialIndex
@@ -71,6 +72,36 @@ class CORE_EXPORT QgsSpatialIndex
     /** Implement assignment operator */
     QgsSpatialIndex& operator=( const QgsSpatialIndex& other );
 
+    /** Returns a spatial index of the features of a layer. Indexes of layers read from a file
+     * without unsaved edits are stored in cacheDirectory(), keyed by the data source, the subset
+     * string and the modification time and size of the file and of its write-ahead log (for GeoPackage
+     * and SpatiaLite files). Later calls, also in later sessions,
+     * open the stored index instead of reading the features again. Other layers are indexed in memory.
+     * Adding or deleting features of a stored index does not change the stored files.
+     * @see invalidateLayerIndex()
+     * @note added in QGIS 2.18
+     */
+    static QgsSpatialIndex layerIndex( QgsVectorLayer* layer );
+
+    /** Returns true if layerIndex() stores the index of a layer rather than reading all of its
+     * features into memory, ie. the layer is read from a file and has no unsaved edits.
+     * @see layerIndex()
+     * @note added in QGIS 2.18
+     */
+    static bool canStoreLayerIndex( QgsVectorLayer* layer );
+
+    /** Removes the stored index of a layer. Called when edits of the layer are committed.
+     * @see layerIndex()
+     * @note added in QGIS 2.18
+     */
+    static void invalidateLayerIndex( QgsVectorLayer* layer );
+
+    /** Returns the directory where the indexes of layers are stored.
+     * @see layerIndex()
+     * @note added in QGIS 2.18
+     */
+    static QString cacheDirectory();
+
     /* operations */
 
     /** Add feature to index */
@@ -103,6 +134,11 @@ class CORE_EXPORT QgsSpatialIndex
 
   private:
 
+    explicit QgsSpatialIndex( QgsSpatialIndexData* data );
+
+    //! Replaces an index stored in files by a copy in memory before it is modified
+    void detachFromFiles();
+
     QSharedDataPointer<QgsSpatialIndexData> d;
 
 };
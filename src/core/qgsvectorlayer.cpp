@@ -63,6 +63,7 @@
 #include "qgsrectangle.h"
 #include "qgsrelationmanager.h"
 #include "qgsrendercontext.h"
+#include "qgsspatialindex.h"
 #include "qgsvectordataprovider.h"
 #include "qgsvectorlayereditbuffer.h"
 #include "qgsvectorlayereditpassthrough.h"
@@ -81,6 +82,7 @@
 #include "qgsstylev2.h"
 #include "qgssymbologyv2conversion.h"
 #include "qgspallabeling.h"
+#include "qgssimplificationpyramid.h"
 #include "qgssimplifymethod.h"
 #include "qgsexpressioncontext.h"
 
@@ -139,6 +141,7 @@ QgsVectorLayer::QgsVectorLayer( const QString& vectorLayerPath,
     , mLayerTransparency( 0 )
     , mVertexMarkerOnlyForSelection( false )
     , mCache( new QgsGeometryCache() )
+    , mSimplificationPyramid( nullptr )
     , mEditBuffer( nullptr )
     , mJoinBuffer( nullptr )
     , mExpressionFieldBuffer( nullptr )
@@ -162,6 +165,10 @@ QgsVectorLayer::QgsVectorLayer( const QString& vectorLayerPath,
   connect( this, SIGNAL( selectionChanged( QgsFeatureIds, QgsFeatureIds, bool ) ), this, SIGNAL( selectionChanged() ) );
   connect( this, SIGNAL( selectionChanged( QgsFeatureIds, QgsFeatureIds, bool ) ), this, SIGNAL( repaintRequested() ) );
 
+  // edited geometries have to be simplified again
+  connect( this, SIGNAL( geometryChanged( QgsFeatureId, QgsGeometry& ) ), this, SLOT( removeFromSimplificationPyramid( QgsFeatureId ) ) );
+  connect( this, SIGNAL( featureDeleted( QgsFeatureId ) ), this, SLOT( removeFromSimplificationPyramid( QgsFeatureId ) ) );
+
   // Default simplify drawing settings
   QSettings settings;
   mSimplifyMethod.setSimplifyHints( static_cast< QgsVectorSimplifyMethod::SimplifyHints >( settings.value( "/qgis/simplifyDrawingHints", static_cast< int>( mSimplifyMethod.simplifyHints() ) ).toInt() ) );
@@ -169,6 +176,7 @@ QgsVectorLayer::QgsVectorLayer( const QString& vectorLayerPath,
   mSimplifyMethod.setThreshold( settings.value( "/qgis/simplifyDrawingTol", mSimplifyMethod.threshold() ).toFloat() );
   mSimplifyMethod.setForceLocalOptimization( settings.value( "/qgis/simplifyLocal", mSimplifyMethod.forceLocalOptimization() ).toBool() );
   mSimplifyMethod.setMaximumScale( settings.value( "/qgis/simplifyMaxScale", mSimplifyMethod.maximumScale() ).toFloat() );
+  mSimplifyMethod.setUseSimplificationPyramid( settings.value( "/qgis/simplifyPyramid", mSimplifyMethod.useSimplificationPyramid() ).toBool() );
 } // QgsVectorLayer ctor
 
 
@@ -185,6 +193,7 @@ QgsVectorLayer::~QgsVectorLayer()
   delete mJoinBuffer;
   delete mExpressionFieldBuffer;
   delete mCache;
+  delete mSimplificationPyramid;
   delete mLabel;  // old deprecated implementation
   delete mLabeling;
   delete mDiagramLayerSettings;
@@ -1096,6 +1105,13 @@ bool QgsVectorLayer::simplifyDrawingCanbeApplied( const QgsRenderContext& render
   return false;
 }
 
+QgsSimplificationPyramid* QgsVectorLayer::simplificationPyramid()
+{
+  if ( !mSimplificationPyramid )
+    mSimplificationPyramid = new QgsSimplificationPyramid();
+  return mSimplificationPyramid;
+}
+
 QgsConditionalLayerStyles* QgsVectorLayer::conditionalStyles() const
 {
   return mConditionalStyles;
@@ -1804,6 +1820,7 @@ bool QgsVectorLayer::setDataProvider( QString const & provider )
 
   connect( mDataProvider, SIGNAL( dataChanged() ), this, SIGNAL( dataChanged() ) );
   connect( mDataProvider, SIGNAL( dataChanged() ), this, SLOT( removeSelection() ) );
+  connect( mDataProvider, SIGNAL( dataChanged() ), this, SLOT( clearSimplificationPyramid() ) );
 
   return true;
 } // QgsVectorLayer:: setDataProvider
@@ -2059,6 +2076,7 @@ bool QgsVectorLayer::readStyle( const QDomNode &node, QString &errorMessage )
     mSimplifyMethod.setThreshold( e.attribute( "simplifyDrawingTol", "1" ).toFloat() );
     mSimplifyMethod.setForceLocalOptimization( e.attribute( "simplifyLocal", "1" ).toInt() );
     mSimplifyMethod.setMaximumScale( e.attribute( "simplifyMaxScale", "1" ).toFloat() );
+    mSimplifyMethod.setUseSimplificationPyramid( e.attribute( "simplifyPyramid", "0" ).toInt() );
 
     //also restore custom properties (for labeling-ng)
     readCustomProperties( node, "labeling" );
@@ -2230,6 +2248,7 @@ bool QgsVectorLayer::writeStyle( QDomNode &node, QDomDocument &doc, QString &err
     mapLayerNode.setAttribute( "simplifyDrawingTol", QString::number( mSimplifyMethod.threshold() ) );
     mapLayerNode.setAttribute( "simplifyLocal", mSimplifyMethod.forceLocalOptimization() ? 1 : 0 );
     mapLayerNode.setAttribute( "simplifyMaxScale", QString::number( mSimplifyMethod.maximumScale() ) );
+    mapLayerNode.setAttribute( "simplifyPyramid", mSimplifyMethod.useSimplificationPyramid() ? 1 : 0 );
 
     //save customproperties (for labeling ng)
     writeCustomProperties( node, doc );
@@ -2636,6 +2655,10 @@ bool QgsVectorLayer::commitChanges()
 
   bool success = mEditBuffer->commitChanges( mCommitErrors );
 
+  // even a failed commit may have changed some features
+  QgsSpatialIndex::invalidateLayerIndex( this );
+  clearSimplificationPyramid();
+
   if ( success )
   {
     delete mEditBuffer;
@@ -4307,6 +4330,18 @@ void QgsVectorLayer::onJoinedFieldsChanged()
   updateFields();
 }
 
+void QgsVectorLayer::clearSimplificationPyramid()
+{
+  if ( mSimplificationPyramid )
+    mSimplificationPyramid->clear();
+}
+
+void QgsVectorLayer::removeFromSimplificationPyramid( QgsFeatureId fid )
+{
+  if ( mSimplificationPyramid )
+    mSimplificationPyramid->remove( fid );
+}
+
 void QgsVectorLayer::onFeatureDeleted( QgsFeatureId fid )
 {
   if ( mEditCommandActive )
@@ -60,6 +60,7 @@ class QgsRectangle;
 class QgsRectangle;
 class QgsRelation;
 class QgsRelationManager;
+class QgsSimplificationPyramid;
 class QgsSingleSymbolRendererV2;
 class QgsSymbolV2;
 class QgsVectorDataProvider;
@@ -1906,6 +1907,15 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
      */
     bool simplifyDrawingCanbeApplied( const QgsRenderContext& renderContext, QgsVectorSimplifyMethod::SimplifyHint simplifyHint ) const;
 
+    /** Returns the simplification pyramid of the layer, which stores the significance of the vertices
+     * of the features once they have been rendered with QgsVectorSimplifyMethod::useSimplificationPyramid().
+     * The pyramid is created on first use and cleared when the data of the layer changes, the
+     * stored areas of a feature are removed when its geometry is edited or the feature is deleted.
+     * @note not available in python bindings
+     * @note added in QGIS 2.18
+     */
+    QgsSimplificationPyramid* simplificationPyramid();
+
     /**
      * @brief Return the conditional styles that are set for this layer. Style information is
      * used to render conditional formatting in the attribute table.
@@ -2196,6 +2206,8 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
   private slots:
     void onJoinedFieldsChanged();
     void onFeatureDeleted( QgsFeatureId fid );
+    void clearSimplificationPyramid();
+    void removeFromSimplificationPyramid( QgsFeatureId fid );
 
   protected:
     /** Set the extent */
@@ -2324,6 +2336,9 @@ class CORE_EXPORT QgsVectorLayer : public QgsMapLayer
     //! cache for some vector layer data - currently only geometries for faster editing
     QgsGeometryCache* mCache;
 
+    //! significance of the vertices of the features for simplified rendering, created on first use
+    QgsSimplificationPyramid* mSimplificationPyramid;
+
     //! stores information about uncommitted changes to layer
     QgsVectorLayerEditBuffer* mEditBuffer;
     friend class QgsVectorLayerEditBuffer;
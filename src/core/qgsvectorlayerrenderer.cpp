@@ -23,6 +23,7 @@
 #include "qgspallabeling.h"
 #include "qgsrendererv2.h"
 #include "qgsrendercontext.h"
+#include "qgssimplificationpyramid.h"
 #include "qgssinglesymbolrendererv2.h"
 #include "qgssymbollayerv2.h"
 #include "qgssymbolv2.h"
@@ -33,9 +34,13 @@
 #include "qgsvectorlayerlabelprovider.h"
 #include "qgspainteffect.h"
 #include "qgsfeaturefilterprovider.h"
+#include "qgsclipper.h"
+#include "qgswkbptr.h"
+#include "qgswkbsimplifierptr.h"
 
 #include <QSettings>
 #include <QPicture>
+#include <QTime>
 
 // TODO:
 // - passing of cache to QgsVectorLayer
@@ -53,6 +58,14 @@ QgsVectorLayerRenderer::QgsVectorLayerRenderer( QgsVectorLayer* layer, QgsRender
     , mDiagrams( false )
     , mLabelProvider( nullptr )
     , mDiagramProvider( nullptr )
+    , mSimplificationPyramid( nullptr )
+    , mPyramidTolerance( 0 )
+    , mRestrictLabelingRows( false )
+    , mLabelingTop( 0.0 )
+    , mLabelingBottom( 0.0 )
+    , mPreviewTimeBudget( 0 )
+    , mLevelStreamingEnabled( false )
+    , mFastPathEnabled( false )
 {
   mSource = new QgsVectorLayerFeatureSource( layer );
 
@@ -67,6 +80,8 @@ QgsVectorLayerRenderer::QgsVectorLayerRenderer( QgsVectorLayer* layer, QgsRender
 
   mSimplifyMethod = layer->simplifyMethod();
   mSimplifyGeometry = layer->simplifyDrawingCanbeApplied( mContext, QgsVectorSimplifyMethod::GeometrySimplification );
+  if ( mSimplifyGeometry && mSimplifyMethod.useSimplificationPyramid() )
+    mSimplificationPyramid = layer->simplificationPyramid();
 
   QSettings settings;
   mVertexMarkerOnlyForSelection = settings.value( "/qgis/digitizing/marker_only_for_selected", false ).toBool();
@@ -87,6 +102,9 @@ QgsVectorLayerRenderer::QgsVectorLayerRenderer( QgsVectorLayer* layer, QgsRender
 
   mVertexMarkerSize = settings.value( "/qgis/digitizing/marker_size", 3 ).toInt();
 
+  mLevelStreamingEnabled = settings.value( "/qgis/stream_symbol_levels", true ).toBool();
+  mFastPathEnabled = settings.value( "/qgis/enable_fast_render_path", true ).toBool();
+
   if ( !mRendererV2 )
     return;
 
@@ -216,7 +234,17 @@ bool QgsVectorLayerRenderer::render()
       }
     }
 
-    if ( validTransform )
+    if ( validTransform && mSimplificationPyramid )
+    {
+      // the geometries are simplified from the pyramid, neither by the provider nor by the symbols
+      mPyramidTolerance = map2pixelTol;
+
+      QgsVectorSimplifyMethod vectorMethod = mSimplifyMethod;
+      vectorMethod.setTolerance( map2pixelTol );
+      vectorMethod.setForceLocalOptimization( false );
+      mContext.setVectorSimplifyMethod( vectorMethod );
+    }
+    else if ( validTransform )
     {
       QgsSimplifyMethod simplifyMethod;
       simplifyMethod.setMethodType( QgsSimplifyMethod::OptimizeForRendering );
@@ -243,6 +271,29 @@ bool QgsVectorLayerRenderer::render()
     mContext.setVectorSimplifyMethod( vectorMethod );
   }
 
+  // with a preview, the layer image shows the preview until the exact result has been drawn aside
+  QPainter* layerPainter = mContext.painter();
+  QScopedPointer<QImage> exactImage;
+  QScopedPointer<QPainter> exactPainter;
+  if ( mPreviewTimeBudget > 0 && !usingEffect && layerPainter->device()->devType() == QInternal::Image && !layerPainter->hasClipping() &&
+       rendererDrawsImmediately( mRendererV2 ) )
+  {
+    drawPreview( featureRequest );
+
+    const QImage* layerImage = static_cast<QImage*>( layerPainter->device() );
+    exactImage.reset( new QImage( layerImage->size(), layerImage->format() ) );
+    if ( !exactImage->isNull() )
+    {
+      exactImage->setDotsPerMeterX( layerImage->dotsPerMeterX() );
+      exactImage->setDotsPerMeterY( layerImage->dotsPerMeterY() );
+      exactImage->fill( 0 );
+      exactPainter.reset( new QPainter( exactImage.data() ) );
+      exactPainter->setRenderHints( layerPainter->renderHints() );
+      exactPainter->setCompositionMode( layerPainter->compositionMode() );
+      mContext.setPainter( exactPainter.data() );
+    }
+  }
+
   QgsFeatureIterator fit = mSource->getFeatures( featureRequest );
   // Attach an interruption checker so that iterators that have potentially
   // slow fetchFeature() implementations, such as in the WFS provider, can
@@ -253,13 +304,31 @@ bool QgsVectorLayerRenderer::render()
   if (( mRendererV2->capabilities() & QgsFeatureRendererV2::SymbolLevels ) && mRendererV2->usingSymbolLevels() )
     drawRendererV2Levels( fit );
   else
+  {
+    prepareFastPath();
     drawRendererV2( fit );
+  }
 
   if ( usingEffect )
   {
     mRendererV2->paintEffect()->end( mContext );
   }
 
+  if ( exactPainter )
+  {
+    exactPainter->end();
+    mContext.setPainter( layerPainter );
+
+    // a cancelled job is not shown anymore, keep the preview
+    if ( !mContext.renderingStopped() )
+    {
+      layerPainter->save();
+      layerPainter->setCompositionMode( QPainter::CompositionMode_Source );
+      layerPainter->drawImage( 0, 0, *exactImage );
+      layerPainter->restore();
+    }
+  }
+
   return true;
 }
 
@@ -274,7 +343,317 @@ void QgsVectorLayerRenderer::setGeometryCachePointer( QgsGeometryCache* cache )
   }
 }
 
+void QgsVectorLayerRenderer::setLabelingRows( double top, double bottom )
+{
+  mRestrictLabelingRows = true;
+  mLabelingTop = top;
+  mLabelingBottom = bottom;
+}
+
+void QgsVectorLayerRenderer::shareLabeling( QgsVectorLayerRenderer* renderer )
+{
+  if ( !renderer->mLabelingMutex )
+    renderer->mLabelingMutex = QSharedPointer<QMutex>( new QMutex() );
+  mLabelingMutex = renderer->mLabelingMutex;
+
+  mLabeling = renderer->mLabeling;
+  mDiagrams = renderer->mDiagrams;
+  mLabelProvider = renderer->mLabelProvider;
+  mDiagramProvider = renderer->mDiagramProvider;
+  // the attributes of the labels and diagrams are added by their preparation
+  mAttrNames = renderer->mAttrNames;
+
+  mContext.setLabelingEngine( renderer->mContext.labelingEngine() );
+  mContext.setLabelingEngineV2( renderer->mContext.labelingEngineV2() );
+}
+
+bool QgsVectorLayerRenderer::isInLabelingRows( const QgsFeature& feature ) const
+{
+  if ( !mRestrictLabelingRows )
+    return true;
+
+  QgsPoint center = feature.constGeometry()->boundingBox().center();
+  try
+  {
+    if ( const QgsCoordinateTransform* ct = mContext.coordinateTransform() )
+      center = ct->transform( center );
+  }
+  catch ( const QgsCsException &cse )
+  {
+    Q_UNUSED( cse );
+    return false; // the feature could not be labeled anyway
+  }
+
+  double row = mContext.mapToPixel().transform( center ).y();
+  return row >= mLabelingTop && row < mLabelingBottom;
+}
+
+bool QgsVectorLayerRenderer::rendererDrawsImmediately( const QgsFeatureRendererV2* renderer )
+{
+  // renderers like the rule based, heatmap, point displacement or inverted polygon
+  // renderers collect the features and draw them in stopRender(), they depend on
+  // all the features which are rendered together
+  if ( !renderer )
+    return false;
+  QString type = renderer->type();
+  return type == "singleSymbol" || type == "categorizedSymbol" || type == "graduatedSymbol" ||
+         type == "25dRenderer" || type == "nullSymbol";
+}
+
+void QgsVectorLayerRenderer::drawPreview( const QgsFeatureRequest& request )
+{
+  QTime time;
+  time.start();
+
+  // geometries are simplified to a few pixels, by the provider if it can
+  const QImage* layerImage = static_cast<QImage*>( mContext.painter()->device() );
+  double tolerance = 4 * mContext.extent().width() / layerImage->width();
+
+  QgsFeatureRequest previewRequest( request );
+  QgsVectorSimplifyMethod vectorMethod = mContext.vectorSimplifyMethod();
+  if ( mGeometryType != QGis::Point )
+  {
+    QgsSimplifyMethod simplifyMethod;
+    simplifyMethod.setMethodType( QgsSimplifyMethod::OptimizeForRendering );
+    simplifyMethod.setTolerance( tolerance );
+    previewRequest.setSimplifyMethod( simplifyMethod );
+
+    QgsVectorSimplifyMethod previewMethod;
+    previewMethod.setSimplifyHints( QgsVectorSimplifyMethod::GeometrySimplification );
+    previewMethod.setTolerance( tolerance );
+    previewMethod.setForceLocalOptimization( true );
+    mContext.setVectorSimplifyMethod( previewMethod );
+  }
+
+  QgsExpressionContextScope* symbolScope = QgsExpressionContextUtils::updateSymbolScope( nullptr, new QgsExpressionContextScope() );
+  mContext.expressionContext().appendScope( symbolScope );
+
+  int count = 0;
+  QgsFeatureIterator fit = mSource->getFeatures( previewRequest );
+  fit.setInterruptionChecker( &mInterruptionChecker );
+  QgsFeature fet;
+  while ( time.elapsed() < mPreviewTimeBudget && !mContext.renderingStopped() && fit.nextFeature( fet ) )
+  {
+    if ( !fet.constGeometry() )
+      continue;
+
+    try
+    {
+      mContext.expressionContext().setFeature( fet );
+      mRendererV2->renderFeature( fet, mContext );
+      ++count;
+    }
+    catch ( const QgsCsException &cse )
+    {
+      Q_UNUSED( cse );
+    }
+  }
+  fit.close();
+
+  delete mContext.expressionContext().popScope();
+  mContext.setVectorSimplifyMethod( vectorMethod );
+
+  QgsDebugMsgLevel( QString( "preview of %1 features drawn in %2 ms" ).arg( count ).arg( time.elapsed() ), 2 );
+}
+
+void QgsVectorLayerRenderer::prepareFastPath()
+{
+  mFastSymbols.clear();
+  if ( !mFastPathEnabled )
+    return;
+
+  // these renderers draw every feature with the symbol returned by symbolForFeature()
+  QString rendererType = mRendererV2->type();
+  if ( rendererType != "singleSymbol" && rendererType != "categorizedSymbol" && rendererType != "graduatedSymbol" )
+    return;
+
+  Q_FOREACH ( QgsSymbolV2* symbol, mRendererV2->symbols( mContext ) )
+  {
+    if ( !symbol || symbol->symbolLayerCount() == 0 )
+      continue;
+    if ( symbol->type() != QgsSymbolV2::Line && symbol->type() != QgsSymbolV2::Fill )
+      continue;
+
+    bool simple = true;
+    for ( int i = 0; i < symbol->symbolLayerCount() && simple; ++i )
+    {
+      const QgsSymbolLayerV2* layer = symbol->symbolLayer( i );
+      simple = ( layer->layerType() == "SimpleLine" || layer->layerType() == "SimpleFill" ) && !layer->hasDataDefinedProperties();
+    }
+    if ( simple )
+      mFastSymbols.insert( symbol );
+  }
+
+  // same clipping rectangle as QgsSymbolV2::_getLineString()
+  const QgsRectangle& e = mContext.extent();
+  double cw = e.width() / 10;
+  double ch = e.height() / 10;
+  mFastClipRect = QgsRectangle( e.xMinimum() - cw, e.yMinimum() - ch, e.xMaximum() + cw, e.yMaximum() + ch );
+
+  // reserving marks the buffers as reused, so that they keep their memory when shrinking
+  mFastPoints.reserve( 1024 );
+  mFastLine.reserve( 1024 );
+}
+
+bool QgsVectorLayerRenderer::drawFeatureFast( const QgsFeature& feature, QgsSymbolV2* symbol )
+{
+  const QgsGeometry* geom = feature.constGeometry();
+  if ( !geom->geometry() )
+    return false;
+
+  QgsWKBTypes::Type flatType = QgsWKBTypes::flatType( geom->geometry()->wkbType() );
+  bool clip = !mContext.testFlag( QgsRenderContext::RenderMapTile ) && symbol->clipFeaturesToExtent();
+
+  if (( flatType == QgsWKBTypes::LineString || flatType == QgsWKBTypes::MultiLineString ) && symbol->type() == QgsSymbolV2::Line )
+  {
+    mContext.setGeometry( geom->geometry() );
+
+    QgsLineSymbolV2* lineSymbol = static_cast<QgsLineSymbolV2*>( symbol );
+    QgsConstWkbSimplifierPtr wkbPtr( geom->asWkb(), geom->wkbSize(), mContext.vectorSimplifyMethod() );
+
+    unsigned int numParts = 1;
+    if ( flatType == QgsWKBTypes::MultiLineString )
+    {
+      wkbPtr.readHeader();
+      wkbPtr >> numParts;
+    }
+
+    for ( unsigned int part = 0; part < numParts; ++part )
+    {
+      if ( !readFastLine( wkbPtr, clip ) )
+        break;
+      lineSymbol->renderPolyline( mFastLine, &feature, mContext );
+    }
+    return true;
+  }
+
+  if (( flatType == QgsWKBTypes::Polygon || flatType == QgsWKBTypes::MultiPolygon ) && symbol->type() == QgsSymbolV2::Fill )
+  {
+    mContext.setGeometry( geom->geometry() );
+
+    QgsFillSymbolV2* fillSymbol = static_cast<QgsFillSymbolV2*>( symbol );
+    QgsConstWkbSimplifierPtr wkbPtr( geom->asWkb(), geom->wkbSize(), mContext.vectorSimplifyMethod() );
+
+    unsigned int numParts = 1;
+    if ( flatType == QgsWKBTypes::MultiPolygon )
+    {
+      wkbPtr.readHeader();
+      wkbPtr >> numParts;
+    }
+
+    for ( unsigned int part = 0; part < numParts; ++part )
+    {
+      QgsWKBTypes::Type partType = wkbPtr.readHeader();
+      unsigned int numRings;
+      wkbPtr >> numRings;
+
+      bool valid = true;
+      int holeCount = 0;
+      mFastPoints.resize( 0 );
+      for ( unsigned int ring = 0; ring < numRings && valid; ++ring )
+      {
+        if ( ring == 0 )
+        {
+          valid = readFastRing( wkbPtr, partType, mFastPoints, clip );
+          continue;
+        }
+
+        // hole buffers are taken from the spare ones and given back once the polygon is drawn
+        if ( holeCount == mFastRings.count() )
+          mFastRings << ( mFastSpareRings.isEmpty() ? QPolygonF() : mFastSpareRings.takeLast() );
+
+        QPolygonF& hole = mFastRings[holeCount];
+        valid = readFastRing( wkbPtr, partType, hole, clip );
+        if ( !hole.isEmpty() )
+          ++holeCount;
+      }
+
+      while ( mFastRings.count() > holeCount )
+        mFastSpareRings << mFastRings.takeLast();
+
+      if ( !valid )
+        break;
+      if ( mFastPoints.isEmpty() )
+        continue;
+
+      fillSymbol->renderPolygon( mFastPoints, holeCount > 0 ? &mFastRings : nullptr, &feature, mContext );
+    }
+    return true;
+  }
+
+  return false;
+}
+
+bool QgsVectorLayerRenderer::readFastLine( QgsConstWkbPtr& wkbPtr, bool clip )
+{
+  QgsWKBTypes::Type wkbType = wkbPtr.readHeader();
+  unsigned int nPoints;
+  wkbPtr >> nPoints;
+
+  int skipZM = ( QgsWKBTypes::coordDimensions( wkbType ) - 2 ) * sizeof( double );
+  if ( static_cast<int>( nPoints * ( 2 * sizeof( double ) + skipZM ) ) > wkbPtr.remaining() )
+  {
+    QgsDebugMsg( QString( "%1 points exceed wkb length (%2>%3)" ).arg( nPoints ).arg( nPoints * ( 2 * sizeof( double ) + skipZM ) ).arg( wkbPtr.remaining() ) );
+    return false;
+  }
+
+  wkbPtr -= sizeof( unsigned int );
+  if ( clip && nPoints > 1 )
+  {
+    //apply clipping for large lines to achieve a better rendering performance
+    wkbPtr >> mFastPoints;
+    if ( mFastClipRect.contains( QgsRectangle( mFastPoints.boundingRect() ) ) )
+      mFastLine.swap( mFastPoints );
+    else
+      QgsClipper::clippedLine( mFastPoints, mFastClipRect, mFastLine );
+  }
+  else
+  {
+    wkbPtr >> mFastLine;
+  }
+
+  transformFastPoints( mFastLine );
+  return true;
+}
+
+bool QgsVectorLayerRenderer::readFastRing( QgsConstWkbPtr& wkbPtr, QgsWKBTypes::Type wkbType, QPolygonF& ring, bool clip )
+{
+  unsigned int nPoints;
+  wkbPtr >> nPoints;
+
+  int skipZM = ( QgsWKBTypes::coordDimensions( wkbType ) - 2 ) * sizeof( double );
+  if ( static_cast<int>( nPoints * ( 2 * sizeof( double ) + skipZM ) ) > wkbPtr.remaining() )
+  {
+    QgsDebugMsg( QString( "%1 points exceed wkb length (%2>%3)" ).arg( nPoints ).arg( nPoints * ( 2 * sizeof( double ) + skipZM ) ).arg( wkbPtr.remaining() ) );
+    return false;
+  }
+
+  wkbPtr -= sizeof( unsigned int );
+  wkbPtr >> ring;
+  if ( ring.isEmpty() )
+    return true;
+
+  //clip close to view extent, if needed
+  if ( clip && !mContext.extent().contains( QgsRectangle( ring.boundingRect() ) ) )
+  {
+    QgsClipper::trimPolygon( ring, mFastClipRect );
+  }
+
+  transformFastPoints( ring );
+  return true;
+}
+
+void QgsVectorLayerRenderer::transformFastPoints( QPolygonF& pts ) const
+{
+  mContext.mapToPixel().transformPolygon( pts, mContext.coordinateTransform() );
+}
 
+void QgsVectorLayerRenderer::simplifyFromPyramid( QgsFeature& feature )
+{
+  QgsGeometry* simplified = mSimplificationPyramid->simplify( feature.id(), *feature.constGeometry(), mPyramidTolerance );
+  if ( simplified )
+    feature.setGeometry( simplified );
+}
 
 void QgsVectorLayerRenderer::drawRendererV2( QgsFeatureIterator& fit )
 {
@@ -295,6 +674,9 @@ void QgsVectorLayerRenderer::drawRendererV2( QgsFeatureIterator& fit )
       if ( !fet.constGeometry() )
         continue; // skip features without geometry
 
+      if ( mPyramidTolerance > 0 )
+        simplifyFromPyramid( fet );
+
       mContext.expressionContext().setFeature( fet );
 
       bool sel = mContext.showSelection() && mSelectedFeatureIds.contains( fet.id() );
@@ -307,11 +689,17 @@ void QgsVectorLayerRenderer::drawRendererV2( QgsFeatureIterator& fit )
       }
 
       // render feature
-      bool rendered = mRendererV2->renderFeature( fet, mContext, -1, sel, drawMarker );
+      bool rendered;
+      QgsSymbolV2* fastSymbol = !mFastSymbols.isEmpty() && !sel && !drawMarker ? mRendererV2->symbolForFeature( fet, mContext ) : nullptr;
+      if ( fastSymbol && mFastSymbols.contains( fastSymbol ) && drawFeatureFast( fet, fastSymbol ) )
+        rendered = true;
+      else
+        rendered = mRendererV2->renderFeature( fet, mContext, -1, sel, drawMarker );
 
       // labeling - register feature
-      if ( rendered )
+      if ( rendered && isInLabelingRows( fet ) )
       {
+        QMutexLocker locker( mLabelingMutex.data() );
         if ( mContext.labelingEngine() )
         {
           if ( mLabeling )
@@ -363,6 +751,98 @@ void QgsVectorLayerRenderer::drawRendererV2( QgsFeatureIterator& fit )
   stopRendererV2( nullptr );
 }
 
+/// @cond PRIVATE
+
+/** Images the symbol level items are drawn into, so that the features do not need to be kept
+ * until all of them have been fetched. Every item of a level gets an image of its own, as all features
+ * of one item have to be drawn before the next item of the same level. Images are created for the items which are used.
+ */
+class QgsSymbolLevelImages
+{
+  public:
+    QgsSymbolLevelImages( QPainter* layerPainter, int itemCount )
+        : mLayerPainter( layerPainter )
+        , mImages( itemCount, nullptr )
+        , mPainters( itemCount, nullptr )
+    {}
+
+    ~QgsSymbolLevelImages()
+    {
+      qDeleteAll( mPainters );
+      qDeleteAll( mImages );
+    }
+
+    //! Returns the painter of a level item, with the same settings as the layer painter
+    QPainter* painter( int item )
+    {
+      if ( !mPainters.at( item ) )
+      {
+        const QImage* layerImage = static_cast<QImage*>( mLayerPainter->device() );
+        QImage* image = new QImage( layerImage->size(), QImage::Format_ARGB32_Premultiplied );
+        image->setDotsPerMeterX( layerImage->dotsPerMeterX() );
+        image->setDotsPerMeterY( layerImage->dotsPerMeterY() );
+        image->fill( 0 );
+        mImages[item] = image;
+
+        QPainter* painter = new QPainter( image );
+        painter->setRenderHints( mLayerPainter->renderHints() );
+        painter->setWorldTransform( mLayerPainter->worldTransform() );
+        painter->setPen( mLayerPainter->pen() );
+        painter->setBrush( mLayerPainter->brush() );
+        mPainters[item] = painter;
+      }
+      return mPainters.at( item );
+    }
+
+    //! Draws the item images on the layer painter, in the order of the levels and their items
+    void composite()
+    {
+      mLayerPainter->save();
+      mLayerPainter->resetTransform();
+      for ( int item = 0; item < mPainters.count(); ++item )
+      {
+        if ( !mPainters.at( item ) )
+          continue;
+
+        mPainters[item]->end();
+        mLayerPainter->drawImage( 0, 0, *mImages.at( item ) );
+      }
+      mLayerPainter->restore();
+    }
+
+  private:
+    QPainter* mLayerPainter;
+    QVector<QImage*> mImages;
+    QVector<QPainter*> mPainters;
+};
+
+//! Returns true if any symbol layer of the levels is drawn with a paint effect
+static bool levelsUsePaintEffects( const QgsSymbolV2LevelOrder& levels )
+{
+  Q_FOREACH ( const QgsSymbolV2Level& level, levels )
+  {
+    Q_FOREACH ( QgsSymbolV2LevelItem item, level )
+    {
+      QgsPaintEffect* effect = item.symbol()->symbolLayer( item.layer() )->paintEffect();
+      if ( effect && effect->enabled() )
+        return true;
+    }
+  }
+  return false;
+}
+
+/// @endcond
+
+bool QgsVectorLayerRenderer::canStreamLevels( int itemCount ) const
+{
+  // the images of the level items are composited with source over, so other feature blend modes need all items in one image
+  QPainter* painter = mContext.painter();
+  return mLevelStreamingEnabled && itemCount > 0 && itemCount <= MAX_STREAMED_LEVELS &&
+         painter->device()->devType() == QInternal::Image &&
+         painter->compositionMode() == QPainter::CompositionMode_SourceOver &&
+         !painter->hasClipping();
+}
+
 void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
 {
   QHash< QgsSymbolV2*, QList<QgsFeature> > features; // key = symbol, value = array of features
@@ -376,16 +856,58 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
     selRenderer->startRender( mContext, mFields );
   }
 
+  // find out the order
+  QgsSymbolV2LevelOrder levels;
+  QgsSymbolV2List symbols = mRendererV2->symbols( mContext );
+  for ( int i = 0; i < symbols.count(); i++ )
+  {
+    QgsSymbolV2* sym = symbols[i];
+    for ( int j = 0; j < sym->symbolLayerCount(); j++ )
+    {
+      int level = sym->symbolLayer( j )->renderingPass();
+      if ( level < 0 || level >= 1000 ) // ignore invalid levels
+        continue;
+      QgsSymbolV2LevelItem item( sym, j );
+      while ( level >= levels.count() ) // append new empty levels
+        levels.append( QgsSymbolV2Level() );
+      levels[level].append( item );
+    }
+  }
+
+  // level item images and symbol layers each symbol is drawn in, when streaming
+  QPainter* layerPainter = mContext.painter();
+  QScopedPointer<QgsSymbolLevelImages> levelImages;
+  QHash< QgsSymbolV2*, QList< QPair<int, int> > > symbolPasses;
+  int itemCount = 0;
+  for ( int l = 0; l < levels.count(); l++ )
+  {
+    itemCount += levels.at( l ).count();
+  }
+  // effects like shadows blend with the levels below, which are not part of the image of a level item
+  if ( canStreamLevels( itemCount ) && !levelsUsePaintEffects( levels ) )
+  {
+    levelImages.reset( new QgsSymbolLevelImages( layerPainter, itemCount ) );
+    int itemIndex = 0;
+    for ( int l = 0; l < levels.count(); l++ )
+    {
+      Q_FOREACH ( QgsSymbolV2LevelItem item, levels.at( l ) )
+      {
+        symbolPasses[item.symbol()] << qMakePair( itemIndex++, item.layer() );
+      }
+    }
+  }
+
   QgsExpressionContextScope* symbolScope = QgsExpressionContextUtils::updateSymbolScope( nullptr, new QgsExpressionContextScope() );
   mContext.expressionContext().appendScope( symbolScope );
 
-  // 1. fetch features
+  // 1. fetch features, drawing them right away when streaming
   QgsFeature fet;
   while ( fit.nextFeature( fet ) )
   {
     if ( mContext.renderingStopped() )
     {
       qDebug( "rendering stop!" );
+      mContext.setPainter( layerPainter );
       stopRendererV2( selRenderer );
       delete mContext.expressionContext().popScope();
       return;
@@ -394,6 +916,9 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
     if ( !fet.constGeometry() )
       continue; // skip features without geometry
 
+    if ( mPyramidTolerance > 0 )
+      simplifyFromPyramid( fet );
+
     mContext.expressionContext().setFeature( fet );
     QgsSymbolV2* sym = mRendererV2->symbolForFeature( fet, mContext );
     if ( !sym )
@@ -401,11 +926,37 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
       continue;
     }
 
-    if ( !features.contains( sym ) )
+    if ( levelImages )
+    {
+      bool sel = mContext.showSelection() && mSelectedFeatureIds.contains( fet.id() );
+      bool drawMarker = ( mDrawVertexMarkers && mContext.drawEditingInformation() && ( !mVertexMarkerOnlyForSelection || sel ) );
+
+      QList< QPair<int, int> > passes = symbolPasses.value( sym );
+      for ( int i = 0; i < passes.count(); ++i )
+      {
+        mContext.setPainter( levelImages->painter( passes.at( i ).first ) );
+        try
+        {
+          mRendererV2->renderFeature( fet, mContext, passes.at( i ).second, sel, drawMarker );
+        }
+        catch ( const QgsCsException &cse )
+        {
+          Q_UNUSED( cse );
+          QgsDebugMsg( QString( "Failed to transform a point while drawing a feature with ID '%1'. Ignoring this feature. %2" )
+                       .arg( fet.id() ).arg( cse.what() ) );
+          break;
+        }
+      }
+      mContext.setPainter( layerPainter );
+    }
+    else
     {
-      features.insert( sym, QList<QgsFeature>() );
+      if ( !features.contains( sym ) )
+      {
+        features.insert( sym, QList<QgsFeature>() );
+      }
+      features[sym].append( fet );
     }
-    features[sym].append( fet );
 
     if ( mCache )
     {
@@ -413,6 +964,11 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
       mCache->cacheGeometry( fet.id(), *fet.constGeometry() );
     }
 
+    if ( !isInLabelingRows( fet ) )
+      continue;
+
+    QMutexLocker locker( mLabelingMutex.data() );
+
     if ( mContext.labelingEngine() )
     {
       mContext.expressionContext().setFeature( fet );
@@ -454,22 +1010,11 @@ void QgsVectorLayerRenderer::drawRendererV2Levels( QgsFeatureIterator& fit )
 
   delete mContext.expressionContext().popScope();
 
-  // find out the order
-  QgsSymbolV2LevelOrder levels;
-  QgsSymbolV2List symbols = mRendererV2->symbols( mContext );
-  for ( int i = 0; i < symbols.count(); i++ )
+  if ( levelImages )
   {
-    QgsSymbolV2* sym = symbols[i];
-    for ( int j = 0; j < sym->symbolLayerCount(); j++ )
-    {
-      int level = sym->symbolLayer( j )->renderingPass();
-      if ( level < 0 || level >= 1000 ) // ignore invalid levels
-        continue;
-      QgsSymbolV2LevelItem item( sym, j );
-      while ( level >= levels.count() ) // append new empty levels
-        levels.append( QgsSymbolV2Level() );
-      levels[level].append( item );
-    }
+    levelImages->composite();
+    stopRendererV2( selRenderer );
+    return;
   }
 
   // 2. draw features in correct order
@@ -26,10 +26,17 @@ class QgsDiagramLayerSettings;
 
 class QgsGeometryCache;
 class QgsFeatureIterator;
+class QgsSimplificationPyramid;
 class QgsSingleSymbolRendererV2;
+class QgsSymbolV2;
+class QgsConstWkbPtr;
 
 #include <QList>
+#include <QMutex>
 #include <QPainter>
+#include <QPolygonF>
+#include <QSet>
+#include <QSharedPointer>
 
 typedef QList<int> QgsAttributeList;
 
@@ -37,7 +44,9 @@ typedef QList<int> QgsAttributeList;
 #include "qgsfield.h"  // QgsFields
 #include "qgsfeature.h"  // QgsFeatureIds
 #include "qgsfeatureiterator.h"
+#include "qgsrectangle.h"
 #include "qgsvectorsimplifymethod.h"
+#include "qgswkbtypes.h"
 
 #include "qgsmaplayerrenderer.h"
 
@@ -76,6 +85,45 @@ class QgsVectorLayerRenderer : public QgsMapLayerRenderer
     //! @note The way how geometries are cached is really suboptimal - this method may be removed in future releases
     void setGeometryCachePointer( QgsGeometryCache* cache );
 
+    /**
+     * Restricts labels and diagrams to the features whose bounding box center is drawn
+     * between the given rows of the map image, so that a layer rendered in several parts
+     * registers each feature once. The top row is included, the bottom row is not.
+     * @note added in QGIS 2.18
+     */
+    void setLabelingRows( double top, double bottom );
+
+    /**
+     * Registers labels and diagrams with the providers of another renderer of the same
+     * layer rather than with providers of its own, so that a layer rendered in several
+     * parts is a single layer for the labeling engine. The render context of this renderer
+     * gets the labeling engine of the other renderer, it must have none when this renderer
+     * is created. The providers are locked while features are registered, so that both
+     * renderers may run at the same time.
+     * @note added in QGIS 2.18
+     */
+    void shareLabeling( QgsVectorLayerRenderer* renderer );
+
+    /**
+     * Enables a coarse preview of the layer. The features are first drawn with strongly
+     * simplified geometries until the time budget is spent, then the exact result is rendered
+     * to a separate image which replaces the preview once the layer is complete. The painter
+     * of the render context must draw to an image used only by this layer. Renderers which
+     * draw the features once all of them have been collected, like the heatmap renderer,
+     * are not previewed.
+     * @param msecs time budget of the preview, 0 disables it
+     * @note added in QGIS 2.18
+     */
+    void setPreviewTimeBudget( int msecs ) { mPreviewTimeBudget = msecs; }
+
+    /**
+     * Returns true if a feature renderer draws every feature as it is rendered, rather than
+     * collecting the features and drawing them in stopRender(). Only such renderers draw
+     * the same result when the features are rendered in several parts.
+     * @note added in QGIS 2.18
+     */
+    static bool rendererDrawsImmediately( const QgsFeatureRendererV2* renderer );
+
   private:
 
     /** Registers label and diagram layer
@@ -89,13 +137,54 @@ class QgsVectorLayerRenderer : public QgsMapLayerRenderer
      */
     void drawRendererV2( QgsFeatureIterator& fit );
 
-    /** Draw layer with renderer V2 using symbol levels. QgsFeatureRenderer::startRender() needs to be called before using this method
+    /** Draw layer with renderer V2 using symbol levels. QgsFeatureRenderer::startRender() needs to be called before using this method.
+     * When drawing on an image, every level item (a symbol layer of a symbol) is drawn into an image of its own
+     * while the features are fetched and the item images are composited at the end in the order of the levels,
+     * otherwise the features are kept until all have been fetched.
      */
     void drawRendererV2Levels( QgsFeatureIterator& fit );
 
+    //! Maximum number of symbol level items which are drawn into images of their own
+    static const int MAX_STREAMED_LEVELS = 16;
+
+    //! Returns true if the level items can be drawn into images of their own rather than keeping the features
+    bool canStreamLevels( int itemCount ) const;
+
     /** Stop version 2 renderer and selected renderer (if required) */
     void stopRendererV2( QgsSingleSymbolRendererV2* selRenderer );
 
+    //! Returns true if labels and diagrams of the feature should be registered
+    bool isInLabelingRows( const QgsFeature& feature ) const;
+
+    /** Draws the features of the request with coarse geometries until the preview time budget
+     * is spent. Labels and diagrams are not registered.
+     */
+    void drawPreview( const QgsFeatureRequest& request );
+
+    /** Collects the symbols whose features can be drawn by drawFeatureFast(). This is the case
+     * for line and fill symbols made of simple layers without data defined properties, which
+     * neither need the feature nor its geometry object.
+     */
+    void prepareFastPath();
+
+    /** Draws a feature with a symbol accepted by prepareFastPath(), reading the coordinates straight from
+     * the WKB of the feature into buffers which are reused for all features.
+     * @returns false if the geometry type is not handled, the feature then needs to be drawn by the renderer
+     */
+    bool drawFeatureFast( const QgsFeature& feature, QgsSymbolV2* symbol );
+
+    //! Reads, clips and transforms a linestring of the WKB into mFastLine
+    bool readFastLine( QgsConstWkbPtr& wkbPtr, bool clip );
+
+    //! Reads, clips and transforms a polygon ring of the WKB
+    bool readFastRing( QgsConstWkbPtr& wkbPtr, QgsWKBTypes::Type wkbType, QPolygonF& ring, bool clip );
+
+    //! Transforms points of the fast path from layer to screen coordinates, in place
+    void transformFastPoints( QPolygonF& pts ) const;
+
+    //! Replaces the geometry of a feature by its simplification from the pyramid of the layer
+    void simplifyFromPyramid( QgsFeature& feature );
+
 
   protected:
 
@@ -135,11 +224,41 @@ class QgsVectorLayerRenderer : public QgsMapLayerRenderer
     //! used with new labeling engine (QgsLabelingEngineV2): provider for diagrams.
     //! may be null. no need to delete: if exists it is owned by labeling engine
     QgsVectorLayerDiagramProvider* mDiagramProvider;
+    //! lock of the label and diagram providers, if they are shared with other renderers
+    QSharedPointer<QMutex> mLabelingMutex;
 
     QPainter::CompositionMode mFeatureBlendMode;
 
     QgsVectorSimplifyMethod mSimplifyMethod;
     bool mSimplifyGeometry;
+
+    //! simplification pyramid of the layer, if geometries are simplified with it. Owned by the layer
+    QgsSimplificationPyramid* mSimplificationPyramid;
+    //! tolerance of the simplification with the pyramid in layer units, 0 if not simplifying
+    double mPyramidTolerance;
+
+    //! whether labeling is restricted to mLabelingTop and mLabelingBottom rows
+    bool mRestrictLabelingRows;
+    double mLabelingTop;
+    double mLabelingBottom;
+
+    //! time budget of the preview in ms, 0 if no preview is drawn
+    int mPreviewTimeBudget;
+
+    //! whether symbol levels may be drawn into images of their own
+    bool mLevelStreamingEnabled;
+
+    //! whether features may be drawn by drawFeatureFast()
+    bool mFastPathEnabled;
+    //! symbols whose features are drawn by drawFeatureFast()
+    QSet<QgsSymbolV2*> mFastSymbols;
+    //! clip rectangle of the fast path, in layer coordinates
+    QgsRectangle mFastClipRect;
+    //! buffers of the fast path, reused for all features
+    QPolygonF mFastPoints;
+    QPolygonF mFastLine;
+    QList<QPolygonF> mFastRings;
+    QList<QPolygonF> mFastSpareRings;
 };
 
 
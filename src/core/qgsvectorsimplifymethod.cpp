@@ -24,5 +24,6 @@ QgsVectorSimplifyMethod::QgsVectorSimplifyMethod()
     , mThreshold( QGis::DEFAULT_MAPTOPIXEL_THRESHOLD )
     , mLocalOptimization( true )
     , mMaximumScale( 1 )
+    , mUseSimplificationPyramid( false )
 {
 }
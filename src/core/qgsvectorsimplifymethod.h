@@ -76,6 +76,19 @@ class CORE_EXPORT QgsVectorSimplifyMethod
     /** Gets the maximum scale at which the layer should be simplified */
     inline float maximumScale() const { return mMaximumScale; }
 
+    /** Sets whether the geometries are simplified using the significance of their vertices stored
+     * in the simplification pyramid of the layer, rather than by the simplification algorithm.
+     * The stored significance is calculated once per feature using the Visvalingam algorithm.
+     * @see QgsVectorLayer::simplificationPyramid()
+     * @note added in QGIS 2.18
+     */
+    void setUseSimplificationPyramid( bool usePyramid ) { mUseSimplificationPyramid = usePyramid; }
+    /** Returns whether the geometries are simplified using the simplification pyramid of the layer.
+     * @see setUseSimplificationPyramid()
+     * @note added in QGIS 2.18
+     */
+    inline bool useSimplificationPyramid() const { return mUseSimplificationPyramid; }
+
   private:
     /** Simplification hints for fast rendering of features of the vector layer managed */
     SimplifyHints mSimplifyHints;
@@ -89,6 +102,8 @@ class CORE_EXPORT QgsVectorSimplifyMethod
     bool mLocalOptimization;
     /** Maximum scale at which the layer should be simplified (Maximum scale at which generalisation should be carried out) */
     float mMaximumScale;
+    /** Simplification uses the simplification pyramid of the layer */
+    bool mUseSimplificationPyramid;
 };
 
 Q_DECLARE_OPERATORS_FOR_FLAGS( QgsVectorSimplifyMethod::SimplifyHints )
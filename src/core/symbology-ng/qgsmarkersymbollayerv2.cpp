@@ -1762,6 +1762,7 @@ QgsSvgMarkerSymbolLayerV2::QgsSvgMarkerSymbolLayerV2( const QString& name, doubl
   mOutlineWidthUnit = QgsSymbolV2::MM;
   mColor = QColor( Qt::black );
   mOutlineColor = QColor( Qt::black );
+  mPrerender = false;
 }
 
 
@@ -1949,13 +1950,70 @@ QString QgsSvgMarkerSymbolLayerV2::layerType() const
 void QgsSvgMarkerSymbolLayerV2::startRender( QgsSymbolV2RenderContext& context )
 {
   QgsMarkerSymbolLayerV2::startRender( context ); // get anchor point expressions
-  Q_UNUSED( context );
   prepareExpressions( context );
+
+  mPrerenderedImages.clear();
+  mPrerender = QgsSvgCache::instance()->markerPrerenderingEnabled() && !context.renderContext().forceVectorOutput();
+
+  // rasterize the image right away if it is the same for all features
+  if ( mPrerender && !hasDataDefinedProperty( QgsSymbolLayerV2::EXPR_NAME ) && !hasDataDefinedProperty( QgsSymbolLayerV2::EXPR_SIZE )
+       && !hasDataDefinedProperty( QgsSymbolLayerV2::EXPR_OUTLINE_WIDTH ) && !hasDataDefinedProperty( QgsSymbolLayerV2::EXPR_FILL )
+       && !hasDataDefinedProperty( QgsSymbolLayerV2::EXPR_OUTLINE ) && context.renderContext().painter() )
+  {
+    bool hasDataDefinedSize = false;
+    double scaledSize = calculateSize( context, hasDataDefinedSize );
+    double size = QgsSymbolLayerV2Utils::convertToPainterUnits( context.renderContext(), scaledSize, mSizeUnit, mSizeMapUnitScale );
+    double outlineWidth = QgsSymbolLayerV2Utils::convertToPainterUnits( context.renderContext(), mOutlineWidth, mOutlineWidthUnit, mOutlineWidthMapUnitScale );
+    if ( static_cast< int >( size ) >= 1 && size <= 10000.0 )
+    {
+      prerenderedImage( mPath, size, mColor, mOutlineColor, outlineWidth, context );
+    }
+  }
 }
 
 void QgsSvgMarkerSymbolLayerV2::stopRender( QgsSymbolV2RenderContext& context )
 {
   Q_UNUSED( context );
+  mPrerender = false;
+  mPrerenderedImages.clear();
+}
+
+QImage QgsSvgMarkerSymbolLayerV2::prerenderedImage( const QString& path, double size, const QColor& fill, const QColor& outline, double outlineWidth, QgsSymbolV2RenderContext& context )
+{
+  double alpha = context.alpha();
+  Q_FOREACH ( const PrerenderedImage& prerendered, mPrerenderedImages )
+  {
+    if ( qgsDoubleNear( prerendered.size, size ) && qgsDoubleNear( prerendered.outlineWidth, outlineWidth ) && qgsDoubleNear( prerendered.alpha, alpha )
+         && prerendered.fill == fill && prerendered.outline == outline && prerendered.path == path )
+      return prerendered.image;
+  }
+
+  bool fitsInCache = true;
+  QImage img = QgsSvgCache::instance()->svgAsImage( path, size, fill, outline, outlineWidth,
+               context.renderContext().scaleFactor(), context.renderContext().rasterScaleFactor(), fitsInCache );
+  if ( !fitsInCache || img.width() <= 1 )
+    return QImage();
+
+  //consider transparency
+  if ( !qgsDoubleNear( alpha, 1.0 ) )
+  {
+    img = img.copy();
+    QgsSymbolLayerV2Utils::multiplyImageOpacity( &img, alpha );
+  }
+
+  if ( mPrerenderedImages.count() < MAX_PRERENDERED_IMAGES )
+  {
+    PrerenderedImage prerendered;
+    prerendered.path = path;
+    prerendered.size = size;
+    prerendered.fill = fill;
+    prerendered.outline = outline;
+    prerendered.outlineWidth = outlineWidth;
+    prerendered.alpha = alpha;
+    prerendered.image = img;
+    mPrerenderedImages << prerendered;
+  }
+  return img;
 }
 
 void QgsSvgMarkerSymbolLayerV2::renderPoint( QPointF point, QgsSymbolV2RenderContext& context )
@@ -2023,7 +2081,17 @@ void QgsSvgMarkerSymbolLayerV2::renderPoint( QPointF point, QgsSymbolV2RenderCon
   bool fitsInCache = true;
   bool usePict = true;
   double hwRatio = 1.0;
-  if ( !context.renderContext().forceVectorOutput() && !rotated )
+  if ( mPrerender && !rotated )
+  {
+    QImage img = prerenderedImage( path, size, fillColor, outlineColor, outlineWidth, context );
+    if ( !img.isNull() )
+    {
+      usePict = false;
+      p->drawImage( -img.width() / 2.0, -img.height() / 2.0, img );
+      hwRatio = static_cast< double >( img.height() ) / static_cast< double >( img.width() );
+    }
+  }
+  else if ( !context.renderContext().forceVectorOutput() && !rotated )
   {
     QImage img = QgsSvgCache::instance()->svgAsImage( path, size, fillColor, outlineColor, outlineWidth,
                  context.renderContext().scaleFactor(), context.renderContext().rasterScaleFactor(), fitsInCache );
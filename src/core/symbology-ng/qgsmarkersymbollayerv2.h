@@ -28,6 +28,7 @@
 
 #include <QPen>
 #include <QBrush>
+#include <QImage>
 #include <QPicture>
 #include <QPolygonF>
 #include <QFont>
@@ -551,6 +552,28 @@ class CORE_EXPORT QgsSvgMarkerSymbolLayerV2 : public QgsMarkerSymbolLayerV2
     double calculateSize( QgsSymbolV2RenderContext& context, bool& hasDataDefinedSize ) const;
     void calculateOffsetAndRotation( QgsSymbolV2RenderContext& context, double scaledSize, QPointF& offset, double& angle ) const;
 
+    //! Image rasterized while rendering, drawn without querying the svg cache again
+    struct PrerenderedImage
+    {
+      QString path;
+      double size;
+      QColor fill;
+      QColor outline;
+      double outlineWidth;
+      double alpha;
+      QImage image;
+    };
+
+    //! Maximum number of images kept for data defined parameters
+    static const int MAX_PRERENDERED_IMAGES = 32;
+
+    /** Returns the image for the given parameters, rasterizing it through the svg cache the first time
+     * it is used during the current rendering. Returns a null image if the svg does not fit in the cache.
+     */
+    QImage prerenderedImage( const QString& path, double size, const QColor& fill, const QColor& outline, double outlineWidth, QgsSymbolV2RenderContext& context );
+
+    bool mPrerender;
+    QList< PrerenderedImage > mPrerenderedImages;
 };
 
 
@@ -34,6 +34,32 @@
 #include <QDomElement>
 #include <QUuid>
 
+///@cond PRIVATE
+
+/** Lets the rule filters share the results of identical subexpressions, eg "$area",
+ * while testing a single feature against all rules.
+ */
+class QgsRuleFilterSharingScope
+{
+  public:
+    explicit QgsRuleFilterSharingScope( QgsRenderContext& context )
+        : mContext( context.expressionContext() )
+    {
+      mContext.clearSharedValues();
+      mContext.setSubexpressionSharingEnabled( true );
+    }
+
+    ~QgsRuleFilterSharingScope()
+    {
+      mContext.setSubexpressionSharingEnabled( false );
+      mContext.clearSharedValues();
+    }
+
+  private:
+    QgsExpressionContext& mContext;
+};
+
+///@endcond
 
 QgsRuleBasedRendererV2::Rule::Rule( QgsSymbolV2* symbol, int scaleMinDenom, int scaleMaxDenom, const QString& filterExp, const QString& label, const QString& description, bool elseRule )
     : mParent( nullptr )
@@ -843,6 +869,7 @@ bool QgsRuleBasedRendererV2::renderFeature( QgsFeature& feature,
   mCurrentFeatures.append( FeatureToRender( feature, flags ) );
 
   // check each active rule
+  QgsRuleFilterSharingScope sharing( context );
   return mRootRule->renderFeature( mCurrentFeatures.last(), context, mRenderQueue ) == Rule::Rendered;
 }
 
@@ -1191,21 +1218,25 @@ QString QgsRuleBasedRendererV2::dump() const
 
 bool QgsRuleBasedRendererV2::willRenderFeature( QgsFeature& feat, QgsRenderContext& context )
 {
+  QgsRuleFilterSharingScope sharing( context );
   return mRootRule->willRenderFeature( feat, &context );
 }
 
 QgsSymbolV2List QgsRuleBasedRendererV2::symbolsForFeature( QgsFeature& feat, QgsRenderContext& context )
 {
+  QgsRuleFilterSharingScope sharing( context );
   return mRootRule->symbolsForFeature( feat, &context );
 }
 
 QgsSymbolV2List QgsRuleBasedRendererV2::originalSymbolsForFeature( QgsFeature& feat, QgsRenderContext& context )
 {
+  QgsRuleFilterSharingScope sharing( context );
   return mRootRule->symbolsForFeature( feat, &context );
 }
 
 QSet< QString > QgsRuleBasedRendererV2::legendKeysForFeature( QgsFeature& feature, QgsRenderContext& context )
 {
+  QgsRuleFilterSharingScope sharing( context );
   return mRootRule->legendKeysForFeature( feature, &context );
 }
 
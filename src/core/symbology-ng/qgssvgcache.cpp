@@ -35,6 +35,9 @@
 #include <QFileInfo>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QSettings>
+
+#include <cstring>
 
 QgsSvgCacheEntry::QgsSvgCacheEntry()
     : file( QString() )
@@ -89,7 +92,7 @@ int QgsSvgCacheEntry::dataSize() const
   }
   if ( image )
   {
-    size += ( image->width() * image->height() * 32 );
+    size += image->byteCount();
   }
   return size;
 }
@@ -102,23 +105,145 @@ QgsSvgCache* QgsSvgCache::instance()
 
 QgsSvgCache::QgsSvgCache( QObject *parent )
     : QObject( parent )
-    , mTotalSize( 0 )
-    , mLeastRecentEntry( nullptr )
-    , mMostRecentEntry( nullptr )
+    , mMaximumSize( 0 )
+    , mMarkerPrerendering( true )
 {
   mMissingSvg = QString( "<svg width='10' height='10'><text x='5' y='10' font-size='10' text-anchor='middle'>?</text></svg>" ).toAscii();
+
+  QSettings settings;
+  setMaximumSize( settings.value( "/qgis/svgCacheSize", 20 ).toInt() * 1024L * 1024L );
+  mMarkerPrerendering = settings.value( "/qgis/svgMarkerPrerendering", true ).toBool();
 }
 
 QgsSvgCache::~QgsSvgCache()
 {
-  qDeleteAll( mEntryLookup );
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    qDeleteAll( mShards[i].entryLookup );
+  }
+}
+
+static uint hashDouble( double value )
+{
+  quint64 bits;
+  memcpy( &bits, &value, sizeof( bits ) );
+  return qHash( bits );
+}
+
+QgsSvgCache::Shard& QgsSvgCache::shard( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth )
+{
+  // different sizes and colors of the same file go to different shards, so that a
+  // single symbol used with many parameters does not crowd out a single shard
+  uint hash = qHash( file );
+  hash = hash * 31 + hashDouble( size );
+  hash = hash * 31 + fill.rgba();
+  hash = hash * 31 + outline.rgba();
+  hash = hash * 31 + hashDouble( outlineWidth );
+  return mShards[ hash % SHARD_COUNT ];
+}
+
+QgsSvgCache::Shard& QgsSvgCache::shard( const QgsSvgCacheEntry* entry )
+{
+  return shard( entry->lookupKey, entry->size, entry->fill, entry->outline, entry->outlineWidth );
+}
+
+void QgsSvgCache::setMaximumSize( long bytes )
+{
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    mShards[i].mutex.lock();
+  }
+
+  mMaximumSize = qMax( 0L, bytes );
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    mShards[i].maximumSize = mMaximumSize / SHARD_COUNT;
+    trimShard( mShards[i] );
+  }
+
+  for ( int i = SHARD_COUNT - 1; i >= 0; --i )
+  {
+    mShards[i].mutex.unlock();
+  }
+}
+
+long QgsSvgCache::maximumSize() const
+{
+  return mMaximumSize;
+}
+
+long QgsSvgCache::totalSize() const
+{
+  long size = 0;
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    size += mShards[i].totalSize;
+  }
+  return size;
+}
+
+int QgsSvgCache::entryCount() const
+{
+  int count = 0;
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    count += mShards[i].entryLookup.size();
+  }
+  return count;
+}
+
+long QgsSvgCache::hitCount() const
+{
+  long count = 0;
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    count += mShards[i].hits;
+  }
+  return count;
+}
+
+long QgsSvgCache::missCount() const
+{
+  long count = 0;
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    count += mShards[i].misses;
+  }
+  return count;
+}
+
+long QgsSvgCache::evictionCount() const
+{
+  long count = 0;
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    count += mShards[i].evictions;
+  }
+  return count;
+}
+
+void QgsSvgCache::resetStatistics()
+{
+  for ( int i = 0; i < SHARD_COUNT; ++i )
+  {
+    QMutexLocker locker( &mShards[i].mutex );
+    mShards[i].hits = 0;
+    mShards[i].misses = 0;
+    mShards[i].evictions = 0;
+  }
 }
 
 
 QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
                                        double widthScaleFactor, double rasterScaleFactor, bool& fitsInCache )
 {
-  QMutexLocker locker( &mMutex );
+  Shard& s = shard( file, size, fill, outline, outlineWidth );
+  QMutexLocker locker( &s.mutex );
 
   fitsInCache = true;
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
@@ -138,8 +263,9 @@ QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor&
     }
     long cachedDataSize = 0;
     cachedDataSize += currentEntry->svgContent.size();
-    cachedDataSize += static_cast< int >( currentEntry->size * currentEntry->size * hwRatio * 32 );
-    if ( cachedDataSize > mMaximumSize / 2 )
+    cachedDataSize += static_cast< long >( currentEntry->size * currentEntry->size * hwRatio * 4 );
+    // the image is kept by the shard, so it has to fit into the budget of the shard rather than of the cache
+    if ( cachedDataSize > s.maximumSize / 2 )
     {
       fitsInCache = false;
       delete currentEntry->image;
@@ -160,7 +286,7 @@ QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor&
       cacheImage( currentEntry );
       result = *(currentEntry->image);
     }
-    trimToMaximumSize();
+    trimShard( s );
   }
   else
   {
@@ -173,7 +299,8 @@ QImage QgsSvgCache::svgAsImage( const QString& file, double size, const QColor&
 QPicture QgsSvgCache::svgAsPicture( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
     double widthScaleFactor, double rasterScaleFactor, bool forceVectorOutput )
 {
-  QMutexLocker locker( &mMutex );
+  Shard& s = shard( file, size, fill, outline, outlineWidth );
+  QMutexLocker locker( &s.mutex );
 
   QgsSvgCacheEntry* currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
@@ -182,7 +309,7 @@ QPicture QgsSvgCache::svgAsPicture( const QString& file, double size, const QCol
   if ( !currentEntry->picture )
   {
     cachePicture( currentEntry, forceVectorOutput );
-    trimToMaximumSize();
+    trimShard( s );
   }
 
   QPicture p;
@@ -197,7 +324,8 @@ QPicture QgsSvgCache::svgAsPicture( const QString& file, double size, const QCol
 const QByteArray& QgsSvgCache::svgContent( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
     double widthScaleFactor, double rasterScaleFactor )
 {
-  QMutexLocker locker( &mMutex );
+  Shard& s = shard( file, size, fill, outline, outlineWidth );
+  QMutexLocker locker( &s.mutex );
 
   QgsSvgCacheEntry *currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
@@ -206,7 +334,8 @@ const QByteArray& QgsSvgCache::svgContent( const QString& file, double size, con
 
 QSizeF QgsSvgCache::svgViewboxSize( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth, double widthScaleFactor, double rasterScaleFactor )
 {
-  QMutexLocker locker( &mMutex );
+  Shard& s = shard( file, size, fill, outline, outlineWidth );
+  QMutexLocker locker( &s.mutex );
 
   QgsSvgCacheEntry *currentEntry = cacheEntry( file, size, fill, outline, outlineWidth, widthScaleFactor, rasterScaleFactor );
 
@@ -223,25 +352,27 @@ QgsSvgCacheEntry* QgsSvgCache::insertSVG( const QString& file, double size, cons
 
   replaceParamsAndCacheSvg( entry );
 
-  mEntryLookup.insert( file, entry );
+  Shard& s = shard( entry );
+  s.entryLookup.insert( file, entry );
+  s.misses++;
 
   //insert to most recent place in entry list
-  if ( !mMostRecentEntry ) //inserting first entry
+  if ( !s.mostRecentEntry ) //inserting first entry
   {
-    mLeastRecentEntry = entry;
-    mMostRecentEntry = entry;
+    s.leastRecentEntry = entry;
+    s.mostRecentEntry = entry;
     entry->previousEntry = nullptr;
     entry->nextEntry = nullptr;
   }
   else
   {
-    entry->previousEntry = mMostRecentEntry;
+    entry->previousEntry = s.mostRecentEntry;
     entry->nextEntry = nullptr;
-    mMostRecentEntry->nextEntry = entry;
-    mMostRecentEntry = entry;
+    s.mostRecentEntry->nextEntry = entry;
+    s.mostRecentEntry = entry;
   }
 
-  trimToMaximumSize();
+  trimShard( s );
   return entry;
 }
 
@@ -351,7 +482,7 @@ void QgsSvgCache::replaceParamsAndCacheSvg( QgsSvgCacheEntry* entry )
   entry->svgContent.replace( "\n<tspan", "<tspan" );
   entry->svgContent.replace( "</tspan>\n", "</tspan>" );
 
-  mTotalSize += entry->svgContent.size();
+  shard( entry ).totalSize += entry->svgContent.size();
 }
 
 double QgsSvgCache::calcSizeScaleFactor( QgsSvgCacheEntry* entry, const QDomElement& docElem, QSizeF& viewboxSize ) const
@@ -569,7 +700,7 @@ void QgsSvgCache::cacheImage( QgsSvgCacheEntry* entry )
   }
 
   entry->image = image;
-  mTotalSize += ( image->width() * image->height() * 32 );
+  shard( entry ).totalSize += image->byteCount();
 }
 
 void QgsSvgCache::cachePicture( QgsSvgCacheEntry *entry, bool forceVectorOutput )
@@ -602,15 +733,17 @@ void QgsSvgCache::cachePicture( QgsSvgCacheEntry *entry, bool forceVectorOutput
   QPainter p( picture );
   r.render( &p, rect );
   entry->picture = picture;
-  mTotalSize += entry->picture->size();
+  shard( entry ).totalSize += entry->picture->size();
 }
 
 QgsSvgCacheEntry* QgsSvgCache::cacheEntry( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
     double widthScaleFactor, double rasterScaleFactor )
 {
-  //search entries in mEntryLookup
+  Shard& s = shard( file, size, fill, outline, outlineWidth );
+
+  //search entries in the lookup table of the shard
   QgsSvgCacheEntry* currentEntry = nullptr;
-  QList<QgsSvgCacheEntry*> entries = mEntryLookup.values( file );
+  QList<QgsSvgCacheEntry*> entries = s.entryLookup.values( file );
 
   QList<QgsSvgCacheEntry*>::iterator entryIt = entries.begin();
   for ( ; entryIt != entries.end(); ++entryIt )
@@ -633,18 +766,21 @@ QgsSvgCacheEntry* QgsSvgCache::cacheEntry( const QString& file, double size, con
   }
   else
   {
+    s.hits++;
     takeEntryFromList( currentEntry );
-    if ( !mMostRecentEntry ) //list is empty
+    if ( !s.mostRecentEntry ) //list is empty
     {
-      mMostRecentEntry = currentEntry;
-      mLeastRecentEntry = currentEntry;
+      currentEntry->previousEntry = nullptr;
+      currentEntry->nextEntry = nullptr;
+      s.mostRecentEntry = currentEntry;
+      s.leastRecentEntry = currentEntry;
     }
     else
     {
-      mMostRecentEntry->nextEntry = currentEntry;
-      currentEntry->previousEntry = mMostRecentEntry;
+      s.mostRecentEntry->nextEntry = currentEntry;
+      currentEntry->previousEntry = s.mostRecentEntry;
       currentEntry->nextEntry = nullptr;
-      mMostRecentEntry = currentEntry;
+      s.mostRecentEntry = currentEntry;
     }
   }
 
@@ -922,23 +1058,26 @@ void QgsSvgCache::containsElemParams( const QDomElement& elem, bool& hasFillPara
 
 void QgsSvgCache::removeCacheEntry( const QString& s, QgsSvgCacheEntry* entry )
 {
+  shard( entry ).entryLookup.remove( s, entry );
   delete entry;
-  mEntryLookup.remove( s, entry );
 }
 
 void QgsSvgCache::printEntryList()
 {
   QgsDebugMsg( "****************svg cache entry list*************************" );
-  QgsDebugMsg( "Cache size: " + QString::number( mTotalSize ) );
-  QgsSvgCacheEntry* entry = mLeastRecentEntry;
-  while ( entry )
+  for ( int i = 0; i < SHARD_COUNT; ++i )
   {
-    QgsDebugMsg( "***Entry:" );
-    QgsDebugMsg( "File:" + entry->file );
-    QgsDebugMsg( "Size:" + QString::number( entry->size ) );
-    QgsDebugMsg( "Width scale factor" + QString::number( entry->widthScaleFactor ) );
-    QgsDebugMsg( "Raster scale factor" + QString::number( entry->rasterScaleFactor ) );
-    entry = entry->nextEntry;
+    QgsDebugMsg( QString( "Shard %1 size: %2" ).arg( i ).arg( mShards[i].totalSize ) );
+    QgsSvgCacheEntry* entry = mShards[i].leastRecentEntry;
+    while ( entry )
+    {
+      QgsDebugMsg( "***Entry:" );
+      QgsDebugMsg( "File:" + entry->file );
+      QgsDebugMsg( "Size:" + QString::number( entry->size ) );
+      QgsDebugMsg( "Width scale factor" + QString::number( entry->widthScaleFactor ) );
+      QgsDebugMsg( "Raster scale factor" + QString::number( entry->rasterScaleFactor ) );
+      entry = entry->nextEntry;
+    }
   }
 }
 
@@ -982,20 +1121,26 @@ QImage QgsSvgCache::imageFromCachedPicture(const QgsSvgCacheEntry &entry) const
 
 void QgsSvgCache::trimToMaximumSize()
 {
-  //only one entry in cache
-  if ( mLeastRecentEntry == mMostRecentEntry )
+  for ( int i = 0; i < SHARD_COUNT; ++i )
   {
-    return;
+    QMutexLocker locker( &mShards[i].mutex );
+    trimShard( mShards[i] );
   }
-  QgsSvgCacheEntry* entry = mLeastRecentEntry;
-  while ( entry && ( mTotalSize > mMaximumSize ) )
+}
+
+void QgsSvgCache::trimShard( Shard& shard )
+{
+  // always keep the most recent entry, it is the one which is being used
+  QgsSvgCacheEntry* entry = shard.leastRecentEntry;
+  while ( entry && entry != shard.mostRecentEntry && ( shard.totalSize > shard.maximumSize ) )
   {
     QgsSvgCacheEntry* bkEntry = entry;
     entry = entry->nextEntry;
 
     takeEntryFromList( bkEntry );
-    mEntryLookup.remove( bkEntry->lookupKey, bkEntry );
-    mTotalSize -= bkEntry->dataSize();
+    shard.entryLookup.remove( bkEntry->lookupKey, bkEntry );
+    shard.totalSize -= bkEntry->dataSize();
+    shard.evictions++;
     delete bkEntry;
   }
 }
@@ -1007,13 +1152,14 @@ void QgsSvgCache::takeEntryFromList( QgsSvgCacheEntry* entry )
     return;
   }
 
+  Shard& s = shard( entry );
   if ( entry->previousEntry )
   {
     entry->previousEntry->nextEntry = entry->nextEntry;
   }
   else
   {
-    mLeastRecentEntry = entry->nextEntry;
+    s.leastRecentEntry = entry->nextEntry;
   }
   if ( entry->nextEntry )
   {
@@ -1021,7 +1167,7 @@ void QgsSvgCache::takeEntryFromList( QgsSvgCacheEntry* entry )
   }
   else
   {
-    mMostRecentEntry = entry->previousEntry;
+    s.mostRecentEntry = entry->previousEntry;
   }
 }
 
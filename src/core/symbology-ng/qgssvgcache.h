@@ -91,6 +91,10 @@ class CORE_EXPORT QgsSvgCacheEntry
  * A cache for images / pictures derived from svg files. This class supports parameter replacement in svg files
 according to the svg params specification (http://www.w3.org/TR/2009/WD-SVGParamPrimer-20090616/). Supported are
 the parameters 'fill-color', 'pen-color', 'outline-width', 'stroke-width'. E.g. <circle fill="param(fill-color red)" stroke="param(pen-color black)" stroke-width="param(outline-width 1)"
+
+The entries are spread over several independently locked shards, so that threads rendering different
+symbols do not wait for each other. Each shard keeps its own least recently used list and an equal part
+of the memory budget, see setMaximumSize().
 */
 class CORE_EXPORT QgsSvgCache : public QObject
 {
@@ -199,6 +203,71 @@ class CORE_EXPORT QgsSvgCache : public QObject
     const QByteArray& svgContent( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth,
                                   double widthScaleFactor, double rasterScaleFactor );
 
+    /** Sets the memory budget of the cache. The least recently used entries are removed
+     * once the estimated size of the cached images, pictures and svg contents exceeds it.
+     * Images which would take more than half of the budget are not cached.
+     * The default budget is read from the "/qgis/svgCacheSize" setting, in megabytes.
+     * @param bytes maximum size in bytes
+     * @see maximumSize()
+     * @note added in QGIS 2.18
+     */
+    void setMaximumSize( long bytes );
+
+    /** Returns the memory budget of the cache in bytes.
+     * @see setMaximumSize()
+     * @note added in QGIS 2.18
+     */
+    long maximumSize() const;
+
+    /** Returns the estimated size of all cached images, pictures and svg contents in bytes.
+     * @note added in QGIS 2.18
+     */
+    long totalSize() const;
+
+    /** Returns the number of cached entries.
+     * @note added in QGIS 2.18
+     */
+    int entryCount() const;
+
+    /** Returns the number of requests which were served by an existing entry since the
+     * statistics were last reset.
+     * @see resetStatistics()
+     * @note added in QGIS 2.18
+     */
+    long hitCount() const;
+
+    /** Returns the number of requests which created a new entry since the statistics were last reset.
+     * @see resetStatistics()
+     * @note added in QGIS 2.18
+     */
+    long missCount() const;
+
+    /** Returns the number of entries which were removed to respect the memory budget since the
+     * statistics were last reset.
+     * @see resetStatistics()
+     * @note added in QGIS 2.18
+     */
+    long evictionCount() const;
+
+    /** Resets the hit, miss and eviction counters.
+     * @note added in QGIS 2.18
+     */
+    void resetStatistics();
+
+    /** Sets whether SVG marker symbol layers rasterize their images once when rendering starts
+     * and draw them without querying the cache for every point. The default value is read
+     * from the "/qgis/svgMarkerPrerendering" setting.
+     * @see markerPrerenderingEnabled()
+     * @note added in QGIS 2.18
+     */
+    void setMarkerPrerenderingEnabled( bool enabled ) { mMarkerPrerendering = enabled; }
+
+    /** Returns whether SVG marker symbol layers rasterize their images once when rendering starts.
+     * @see setMarkerPrerenderingEnabled()
+     * @note added in QGIS 2.18
+     */
+    bool markerPrerenderingEnabled() const { return mMarkerPrerendering; }
+
   signals:
     /** Emit a signal to be caught by qgisapp and display a msg on status bar */
     void statusChanged( const QString&  theStatusQString );
@@ -237,18 +306,54 @@ class CORE_EXPORT QgsSvgCache : public QObject
     void downloadProgress( qint64, qint64 );
 
   private:
-    /** Entry pointers accessible by file name*/
-    QMultiHash< QString, QgsSvgCacheEntry* > mEntryLookup;
-    /** Estimated total size of all images, pictures and svgContent*/
-    long mTotalSize;
 
-    //The svg cache keeps the entries on a double connected list, moving the current entry to the front.
-    //That way, removing entries for more space can start with the least used objects.
-    QgsSvgCacheEntry* mLeastRecentEntry;
-    QgsSvgCacheEntry* mMostRecentEntry;
+    //! Number of independently locked parts of the cache
+    static const int SHARD_COUNT = 16;
+
+    //! Part of the cache holding the entries whose parameters hash to the same value
+    struct Shard
+    {
+      Shard()
+          : totalSize( 0 )
+          , maximumSize( 0 )
+          , leastRecentEntry( nullptr )
+          , mostRecentEntry( nullptr )
+          , hits( 0 )
+          , misses( 0 )
+          , evictions( 0 )
+      {}
+
+      //! Mutex to prevent concurrent access to the shard from multiple threads at once (may corrupt the entries otherwise).
+      mutable QMutex mutex;
+      /** Entry pointers accessible by file name*/
+      QMultiHash< QString, QgsSvgCacheEntry* > entryLookup;
+      /** Estimated total size of all images, pictures and svgContent*/
+      long totalSize;
+      long maximumSize;
+
+      //The shard keeps the entries on a double connected list, moving the current entry to the front.
+      //That way, removing entries for more space can start with the least used objects.
+      QgsSvgCacheEntry* leastRecentEntry;
+      QgsSvgCacheEntry* mostRecentEntry;
+
+      long hits;
+      long misses;
+      long evictions;
+    };
+
+    Shard mShards[SHARD_COUNT];
 
     //Maximum cache size
-    static const long mMaximumSize = 20000000;
+    long mMaximumSize;
+
+    bool mMarkerPrerendering;
+
+    /** Returns the shard holding the entries with the given parameters*/
+    Shard& shard( const QString& file, double size, const QColor& fill, const QColor& outline, double outlineWidth );
+    Shard& shard( const QgsSvgCacheEntry* entry );
+
+    /** Removes the least used items of a shard until it is under its part of the budget*/
+    void trimShard( Shard& shard );
 
     /** Replaces parameters in elements of a dom node and calls method for all child nodes*/
     void replaceElemParams( QDomElement& elem, const QColor& fill, const QColor& outline, double outlineWidth );
@@ -283,9 +388,6 @@ class CORE_EXPORT QgsSvgCache : public QObject
     /** SVG content to be rendered if SVG file was not found. */
     QByteArray mMissingSvg;
 
-    //! Mutex to prevent concurrent access to the class from multiple threads at once (may corrupt the entries otherwise).
-    QMutex mMutex;
-
 };
 
 #endif // QGSSVGCACHE_H
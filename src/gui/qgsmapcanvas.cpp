@@ -613,6 +613,7 @@ void QgsMapCanvas::setCachingEnabled( bool enabled )
   if ( enabled )
   {
     mCache = new QgsMapRendererCache;
+    mCache->setIncrementalPanEnabled( QSettings().value( "/qgis/enable_incremental_pan", true ).toBool() );
   }
   else
   {
@@ -747,6 +748,16 @@ void QgsMapCanvas::refreshMap()
 
   mMapUpdateTimer.start();
 
+  // large layers draw a coarse preview first, show it as soon as it is done
+  if ( mUseParallelRendering )
+  {
+    QSettings settings;
+    int previewTimeBudget = settings.value( "/qgis/progressive_rendering_budget", 150 ).toInt();
+    int previewDelay = previewTimeBudget + 25; // the preview ends with the first feature past the budget
+    if ( settings.value( "/qgis/progressive_rendering", true ).toBool() && previewDelay < mMapUpdateTimer.interval() )
+      QTimer::singleShot( previewDelay, this, SLOT( mapUpdateTimeout() ) );
+  }
+
   emit renderStarting();
 }
 
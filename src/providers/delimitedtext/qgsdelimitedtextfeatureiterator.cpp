@@ -154,6 +154,23 @@ QgsDelimitedTextFeatureIterator::QgsDelimitedTextFeatureIterator( QgsDelimitedTe
     mRequest.setSubsetOfAttributes( attrs );
   }
 
+  // Only extract the values of the columns which are used from each record
+  int fieldLimit = 0;
+  if ( ! mTestSubset && ( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes ) )
+  {
+    fieldLimit = 1;
+    if ( mLoadGeometry )
+    {
+      fieldLimit = qMax( fieldLimit, qMax( mSource->mWktFieldIndex, qMax( mSource->mXFieldIndex, mSource->mYFieldIndex ) ) + 1 );
+    }
+    Q_FOREACH ( int fieldIdx, mRequest.subsetOfAttributes() )
+    {
+      if ( fieldIdx >= 0 && fieldIdx < mSource->attributeColumns.count() )
+        fieldLimit = qMax( fieldLimit, mSource->attributeColumns.at( fieldIdx ) + 1 );
+    }
+  }
+  mSource->mFile->setFieldLimit( fieldLimit );
+
   QgsDebugMsg( QString( "Iterator is scanning file: " ) + ( mMode == FileScan ? "Yes" : "No" ) );
   QgsDebugMsg( QString( "Iterator is loading geometries: " ) + ( mLoadGeometry ? "Yes" : "No" ) );
   QgsDebugMsg( QString( "Iterator is testing geometries: " ) + ( mTestGeometry ? "Yes" : "No" ) );
@@ -297,7 +314,7 @@ bool QgsDelimitedTextFeatureIterator::nextFeatureInternal( QgsFeature& feature )
 
     // We ignore empty records, such as added randomly by spreadsheets
 
-    if ( QgsDelimitedTextProvider::recordIsEmpty( tokens ) ) continue;
+    if ( QgsDelimitedTextProvider::recordIsEmpty( tokens ) && ! file->skippedValues() ) continue;
 
     QgsFeatureId fid = file->recordId();
 
@@ -512,6 +529,8 @@ QgsDelimitedTextFeatureSource::QgsDelimitedTextFeatureSource( const QgsDelimited
 
   mFile = new QgsDelimitedTextFile();
   mFile->setFromUrl( url );
+  // locate records directly from the lines read by the provider
+  mFile->copyLineOffsets( *p->mFile );
 
   mExpressionContext << QgsExpressionContextUtils::globalScope()
   << QgsExpressionContextUtils::projectScope();
@@ -29,12 +29,19 @@
 #include <QRegExp>
 #include <QUrl>
 
+#include <cstring>
+
 
 QgsDelimitedTextFile::QgsDelimitedTextFile( const QString& url )
     : mFileName( QString() )
     , mEncoding( "UTF-8" )
     , mFile( nullptr )
     , mStream( nullptr )
+    , mCodec( nullptr )
+    , mMappedData( nullptr )
+    , mMappedSize( 0 )
+    , mMappedStart( 0 )
+    , mMappedPos( 0 )
     , mUseWatcher( false )
     , mWatcher( nullptr )
     , mDefinitionValid( false )
@@ -43,6 +50,7 @@ QgsDelimitedTextFile::QgsDelimitedTextFile( const QString& url )
     , mTrimFields( false )
     , mSkipLines( 0 )
     , mMaxFields( 0 )
+    , mFieldLimit( 0 )
     , mMaxNameLength( 200 ) // Don't want field names to be too unweildy!
     , mAnchoredRegexp( false )
     , mLineNumber( -1 )
@@ -51,6 +59,8 @@ QgsDelimitedTextFile::QgsDelimitedTextFile( const QString& url )
     , mHoldCurrentRecord( false )
     , mMaxRecordNumber( -1 )
     , mMaxFieldCount( 0 )
+    , mSkippedValues( false )
+    , mLineOffsetsFileSize( -1 )
     , mDefaultFieldName( "field_%1" )
     // field_ is optional in following regexp to simplify QgsDelimitedTextFile::fieldNumber()
     , mDefaultFieldRegexp( "^(?:field_)?(\\d+)$", Qt::CaseInsensitive )
@@ -75,9 +85,15 @@ void QgsDelimitedTextFile::close()
   }
   if ( mFile )
   {
+    // Also unmaps the file
     delete mFile;
     mFile = nullptr;
   }
+  mMappedData = nullptr;
+  mMappedSize = 0;
+  mMappedStart = 0;
+  mMappedPos = 0;
+  mCodec = nullptr;
   if ( mWatcher )
   {
     delete mWatcher;
@@ -104,11 +120,15 @@ bool QgsDelimitedTextFile::open()
     }
     if ( mFile )
     {
-      mStream = new QTextStream( mFile );
-      if ( ! mEncoding.isEmpty() )
+      mCodec = mEncoding.isEmpty() ? QTextCodec::codecForLocale() : QTextCodec::codecForName( mEncoding.toAscii() );
+      if ( ! mapFile() )
       {
-        QTextCodec *codec =  QTextCodec::codecForName( mEncoding.toAscii() );
-        mStream->setCodec( codec );
+        mStream = new QTextStream( mFile );
+        if ( ! mEncoding.isEmpty() )
+        {
+          QTextCodec *codec =  QTextCodec::codecForName( mEncoding.toAscii() );
+          mStream->setCodec( codec );
+        }
       }
       if ( mUseWatcher )
       {
@@ -121,6 +141,67 @@ bool QgsDelimitedTextFile::open()
   return nullptr != mFile;
 }
 
+bool QgsDelimitedTextFile::mapFile()
+{
+  // A watched file is expected to be rewritten while it is open, which would truncate
+  // or change the mapped bytes under the reader, so it is read through a stream
+  if ( mUseWatcher ) return false;
+
+  // Lines are split on new line bytes, which cannot be done for UTF-16 or UTF-32
+  if ( ! mCodec ) return false;
+  QByteArray codecName = mCodec->name().toUpper();
+  if ( codecName.startsWith( "UTF-16" ) || codecName.startsWith( "UTF-32" ) || codecName.startsWith( "ISO-10646-UCS" ) ) return false;
+
+  qint64 size = mFile->size();
+  if ( size <= 0 ) return false;
+  uchar *data = mFile->map( 0, size );
+  if ( ! data ) return false;
+
+  // Handle byte order marks as QTextStream does
+  qint64 start = 0;
+  if ( size >= 2 && (( data[0] == 0xFF && data[1] == 0xFE ) || ( data[0] == 0xFE && data[1] == 0xFF ) ) )
+  {
+    mFile->unmap( data );
+    return false;
+  }
+  if ( size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF )
+  {
+    start = 3;
+    mCodec = QTextCodec::codecForName( "UTF-8" );
+  }
+
+  // Line offsets are only valid for the file they were read from
+  QDateTime modified = QFileInfo( mFileName ).lastModified();
+  if ( size != mLineOffsetsFileSize || modified != mLineOffsetsFileModified )
+  {
+    mLineOffsets.clear();
+    mLineOffsetsFileSize = size;
+    mLineOffsetsFileModified = modified;
+  }
+
+  mMappedData = data;
+  mMappedSize = size;
+  mMappedStart = start;
+  mMappedPos = start;
+  return true;
+}
+
+bool QgsDelimitedTextFile::mappedFileChanged() const
+{
+  if ( ! mMappedData ) return false;
+  QFileInfo fi( mFileName );
+  return fi.size() != mMappedSize || fi.lastModified() != mLineOffsetsFileModified;
+}
+
+void QgsDelimitedTextFile::copyLineOffsets( const QgsDelimitedTextFile &other )
+{
+  if ( other.mFileName != mFileName || other.mLineOffsets.size() <= mLineOffsets.size() ) return;
+  if ( mMappedData && ( other.mLineOffsetsFileSize != mLineOffsetsFileSize || other.mLineOffsetsFileModified != mLineOffsetsFileModified ) ) return;
+  mLineOffsets = other.mLineOffsets;
+  mLineOffsetsFileSize = other.mLineOffsetsFileSize;
+  mLineOffsetsFileModified = other.mLineOffsetsFileModified;
+}
+
 void QgsDelimitedTextFile::updateFile()
 {
   close();
@@ -411,6 +492,11 @@ void QgsDelimitedTextFile::setMaxFields( int maxFields )
   mMaxFields = maxFields;
 }
 
+void QgsDelimitedTextFile::setFieldLimit( int fieldLimit )
+{
+  mFieldLimit = fieldLimit;
+}
+
 void QgsDelimitedTextFile::setDiscardEmptyFields( bool discardEmptyFields )
 {
   resetDefinition();
@@ -533,6 +619,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextRecord( QStringList &reco
     if ( status != RecordOk ) return RecordEOF;
 
     mCurrentRecord.clear();
+    mSkippedValues = false;
     mRecordLineNumber = mLineNumber;
     if ( mRecordNumber >= 0 )
     {
@@ -551,20 +638,31 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextRecord( QStringList &reco
 
 QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
 {
+  // A file rewritten by another program since it was mapped is mapped again,
+  // reading beyond the new end of the file would crash
+  if ( mappedFileChanged() ) close();
+
   // Make sure the file is valid open
   if ( ! isValid() || ! open() ) return InvalidDefinition;
 
   // Reset the file pointer
-  mStream->seek( 0 );
+  if ( mMappedData )
+  {
+    mMappedPos = mMappedStart;
+  }
+  else
+  {
+    mStream->seek( 0 );
+  }
   mLineNumber = 0;
   mRecordNumber = -1;
   mRecordLineNumber = -1;
 
   // Skip header lines
+  QString buffer;
   for ( int i = mSkipLines; i-- > 0; )
   {
-    if ( mStream->readLine().isNull() ) return RecordEOF;
-    mLineNumber++;
+    if ( nextLine( buffer, false ) != RecordOk ) return RecordEOF;
   }
   // Read the column names
   Status result = RecordOk;
@@ -580,12 +678,32 @@ QgsDelimitedTextFile::Status  QgsDelimitedTextFile::reset()
 
 QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bool skipBlank )
 {
-  if ( ! mStream )
+  if ( ! mStream && ! mMappedData )
   {
     Status status = reset();
     if ( status != RecordOk ) return status;
   }
 
+  if ( mMappedData )
+  {
+    while ( mMappedPos < mMappedSize )
+    {
+      // Record where each line starts the first time it is read
+      if ( mLineOffsets.size() == mLineNumber ) mLineOffsets.append( mMappedPos );
+
+      const char *start = reinterpret_cast<const char *>( mMappedData ) + mMappedPos;
+      const char *end = static_cast<const char *>( memchr( start, '\n', mMappedSize - mMappedPos ) );
+      qint64 length = end ? end - start : mMappedSize - mMappedPos;
+      mMappedPos += end ? length + 1 : length;
+      if ( length > 0 && start[length - 1] == '\r' ) length--;
+      buffer = mCodec->toUnicode( start, length );
+      mLineNumber++;
+      if ( skipBlank && buffer.isEmpty() ) continue;
+      return RecordOk;
+    }
+    return RecordEOF;
+  }
+
   while ( ! mStream->atEnd() )
   {
     buffer = mStream->readLine();
@@ -601,11 +719,30 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::nextLine( QString &buffer, bo
 
 bool QgsDelimitedTextFile::setNextLineNumber( long nextLineNumber )
 {
-  if ( ! mStream ) return false;
+  if ( ! mStream && ! mMappedData ) return false;
+  if ( mappedFileChanged() && reset() != RecordOk ) return false;
+  if ( mMappedData )
+  {
+    // Jump to the nearest line located so far which is not after the requested line
+    long line = qMin( nextLineNumber - 1, static_cast<long>( mLineOffsets.size() ) - 1 );
+    if ( line >= 0 && ( line > mLineNumber || mLineNumber > nextLineNumber - 1 ) )
+    {
+      if ( line < mLineNumber ) mRecordNumber = -1;
+      mMappedPos = mLineOffsets.at( line );
+      mLineNumber = line;
+    }
+  }
   if ( mLineNumber > nextLineNumber - 1 )
   {
     mRecordNumber = -1;
-    mStream->seek( 0 );
+    if ( mMappedData )
+    {
+      mMappedPos = mMappedStart;
+    }
+    else
+    {
+      mStream->seek( 0 );
+    }
     mLineNumber = 0;
   }
   QString buffer;
@@ -620,6 +757,13 @@ bool QgsDelimitedTextFile::setNextLineNumber( long nextLineNumber )
 void QgsDelimitedTextFile::appendField( QStringList &record, QString field, bool quoted )
 {
   if ( mMaxFields > 0 && record.size() >= mMaxFields ) return;
+  if ( mFieldLimit > 0 && record.size() >= mFieldLimit )
+  {
+    // Only note whether the record has other values
+    if ( ! quoted && mTrimFields ) field = field.trimmed();
+    if ( ! field.isEmpty() ) mSkippedValues = true;
+    return;
+  }
   if ( quoted )
   {
     record.append( field );
@@ -701,6 +845,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
   QChar quoteChar = 0;  // Actual quote character used to open quotes
   bool started = false; // Non-blank chars in field or quotes started
   bool ended = false;   // Quoted field ended
+  bool skip = false;    // Field is beyond the field limit
   int cp = 0;          // Pointer to the next character in the buffer
   int cpmax = buffer.size(); // End of string
 
@@ -720,7 +865,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
           status = RecordInvalid;
           break;
         }
-        field.append( '\n' );
+        appendChar( field, '\n', skip, quoted );
         cp = 0;
         cpmax = buffer.size();
         escaped = false;
@@ -732,7 +877,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
     // If escaped, then just append the character
     if ( escaped )
     {
-      field.append( c );
+      appendChar( field, c, skip, quoted );
       escaped = false;
       continue;
     }
@@ -766,7 +911,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
         // escape the quote..
         if ( isEscape && buffer[cp] == quoteChar )
         {
-          field.append( quoteChar );
+          appendChar( field, quoteChar, skip, true );
           cp++;
         }
         // Otherwise end of quoted field
@@ -799,7 +944,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
     // If within quotes, then append to the string
     else if ( quoted )
     {
-      field.append( c );
+      appendChar( field, c, skip, true );
     }
     // If it is a delimiter, then end of field...
     else if ( isDelim )
@@ -810,12 +955,13 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
       field.clear();
       started = false;
       ended = false;
+      skip = mFieldLimit > 0 && fields.size() >= mFieldLimit;
     }
     // Whitespace is permitted before the start of a field, or
     // after the end..
     else if ( c.isSpace() )
     {
-      if ( ! ended ) field.append( c );
+      if ( ! ended ) appendChar( field, c, skip, false );
     }
     // Other chars permitted if not after quoted field
     else
@@ -825,7 +971,7 @@ QgsDelimitedTextFile::Status QgsDelimitedTextFile::parseQuoted( QString &buffer,
         fields.clear();
         return RecordInvalid;
       }
-      field.append( c );
+      appendChar( field, c, skip, false );
       started = true;
     }
   }
@@ -22,11 +22,14 @@
 #include <QRegExp>
 #include <QUrl>
 #include <QObject>
+#include <QDateTime>
+#include <QVector>
 
 class QgsFeature;
 class QgsField;
 class QFile;
 class QFileSystemWatcher;
+class QTextCodec;
 class QTextStream;
 
 
@@ -65,6 +68,10 @@ class QTextStream;
 *   The field is ignored for csv and whitespace
 * - quoteChar, optional, a single character used for quoting plain fields
 * - escapeChar, optional, a single characer used for escaping (may be the same as quoteChar)
+*
+* Files in encodings where a new line is a single byte are memory mapped rather than
+* read through a QTextStream.  The byte offset of each line is recorded as the file is
+* read, so that records already visited can be located directly by setNextRecordId().
 */
 
 // Note: this has been implemented as a single class rather than a set of classes based
@@ -207,6 +214,30 @@ class QgsDelimitedTextFile : public QObject
      */
     int maxFields() { return mMaxFields; }
 
+    /** Set the number of fields of each record which are returned by nextRecord().
+     *  Later fields are still parsed, but their values are not extracted, only
+     *  whether they are empty (see skippedValues()).  By default all fields are
+     *  returned (0).
+     *  @param fieldLimit  The number of fields returned
+     */
+    void setFieldLimit( int fieldLimit );
+    /** Return the number of fields of each record which are returned
+     *  @return fieldLimit  The number of fields returned, 0 if all
+     */
+    int fieldLimit() { return mFieldLimit; }
+    /** Return whether the last record read has non empty fields beyond the
+     *  field limit.
+     *  @return skipped  True if values were not returned
+     */
+    bool skippedValues() { return mSkippedValues; }
+
+    /** Copy the line offsets located by another parser reading the same file,
+     *  so that its records can be located without reading the file from the
+     *  start.  The offsets are discarded if the file has changed since.
+     *  @param other  A parser of the same file
+     */
+    void copyLineOffsets( const QgsDelimitedTextFile &other );
+
     /** Set the field names
      *  Field names are set from QStringList.  Names may be modified
      *  to ensure that they are unique, not empty, and do not conflict
@@ -318,6 +349,19 @@ class QgsDelimitedTextFile : public QObject
      */
     void close();
 
+    /** Memory map the opened file if its lines can be split on bytes and
+     * it is not watched for changes
+     *
+     * @return mapped  True if the file is memory mapped
+     */
+    bool mapFile();
+
+    /** Check whether the mapped file has been changed since it was mapped
+     *
+     * @return changed  True if the size or modification time of the file differ
+     */
+    bool mappedFileChanged() const;
+
     /** Reset the status if the definition is changing (eg clear
      *  existing field names, etc...
      */
@@ -343,6 +387,14 @@ class QgsDelimitedTextFile : public QObject
      */
     void appendField( QStringList &record, QString field, bool quoted = false );
 
+    /** Utility routine to add a character to a field.  Fields beyond the field
+     *  limit only keep their first character which is not trimmed.
+     */
+    void appendChar( QString &field, QChar c, bool skip, bool quoted ) const
+    {
+      if ( ! skip || ( field.isEmpty() && ( quoted || ! mTrimFields || ! c.isSpace() ) ) ) field.append( c );
+    }
+
     // Pointer to the currently selected parser
     Status( QgsDelimitedTextFile::*mParser )( QString &buffer, QStringList &fields );
 
@@ -350,6 +402,13 @@ class QgsDelimitedTextFile : public QObject
     QString mEncoding;
     QFile *mFile;
     QTextStream *mStream;
+    QTextCodec *mCodec;
+    // Memory mapped file, null if the file is read through mStream
+    const uchar *mMappedData;
+    qint64 mMappedSize;
+    // Position of the first line (after any byte order mark) and of the next line in the mapped file
+    qint64 mMappedStart;
+    qint64 mMappedPos;
     bool mUseWatcher;
     QFileSystemWatcher *mWatcher;
 
@@ -361,6 +420,7 @@ class QgsDelimitedTextFile : public QObject
     bool mTrimFields;
     int mSkipLines;
     int mMaxFields;
+    int mFieldLimit;
     int mMaxNameLength;
 
     // Parameters used by parsers
@@ -380,6 +440,13 @@ class QgsDelimitedTextFile : public QObject
     // Maximum number of record (ie maximum record number visited)
     long mMaxRecordNumber;
     int mMaxFieldCount;
+    bool mSkippedValues;
+
+    // Byte offsets in the mapped file of the start of each line read so far (line 1 first),
+    // and the size and modification time of the file they were read from
+    QVector<qint64> mLineOffsets;
+    qint64 mLineOffsetsFileSize;
+    QDateTime mLineOffsetsFileModified;
 
     QString mDefaultFieldName;
     QRegExp mDefaultFieldRegexp;
@@ -26,6 +26,7 @@
 #include <QSettings>
 #include <QRegExp>
 #include <QUrl>
+#include <QtConcurrentMap>
 #if QT_VERSION >= 0x050000
 #include <QUrlQuery>
 #endif
@@ -55,6 +56,11 @@ static const QString TEXT_PROVIDER_DESCRIPTION = "Delimited text data provider";
 
 static const int SUBSET_ID_THRESHOLD_FACTOR = 10;
 
+// Number of records read from the file before they are checked in parallel when
+// scanning the file.
+
+static const int SCAN_BATCH_SIZE = 10000;
+
 QRegExp QgsDelimitedTextProvider::WktPrefixRegexp( "^\\s*(?:\\d+\\s+|SRID\\=\\d+\\;)", Qt::CaseInsensitive );
 QRegExp QgsDelimitedTextProvider::CrdDmsRegexp( "^\\s*(?:([-+nsew])\\s*)?(\\d{1,3})(?:[^0-9.]+([0-5]?\\d))?[^0-9.]+([0-5]?\\d(?:\\.\\d+)?)[^0-9.]*([-+nsew])?\\s*$", Qt::CaseInsensitive );
 
@@ -328,6 +334,157 @@ bool QgsDelimitedTextProvider::createSpatialIndex()
 // immediately rescanning (when the file is loaded and then the subset expression is
 // set)
 
+/// @cond PRIVATE
+
+// A record read while scanning the file, with the result of checking its geometry
+// and the types its values could have.
+
+struct QgsDelimitedTextScanRecord
+{
+  enum GeometryStatus
+  {
+    GeometryEmpty,
+    GeometryValid,
+    GeometryInvalid
+  };
+
+  // Types a value could have, each one includes the following ones
+  enum ValueType
+  {
+    ValueEmpty = 0,
+    ValueText = 1,
+    ValueDouble = 2,
+    ValueLongLong = 4,
+    ValueInt = 8
+  };
+
+  QgsDelimitedTextScanRecord()
+      : status( QgsDelimitedTextFile::RecordOk )
+      , recordId( -1 )
+      , isEmpty( false )
+      , geometryStatus( GeometryEmpty )
+      , geometry( nullptr )
+      , wktHasPrefix( false )
+  {}
+
+  QgsDelimitedTextFile::Status status;
+  long recordId;
+  QStringList parts;
+  bool isEmpty;
+  GeometryStatus geometryStatus;
+  // Geometry read from WKT, owned by the record until it is used
+  QgsGeometry *geometry;
+  // Point read from X and Y fields
+  QgsPoint point;
+  bool wktHasPrefix;
+  // ValueType flags of each field
+  QVector<char> valueTypes;
+};
+
+// Checks records on QtConcurrent threads
+
+class QgsDelimitedTextRecordCheck
+{
+  public:
+    QgsDelimitedTextRecordCheck( const QgsDelimitedTextProvider *provider, bool wktHasPrefix )
+        : mProvider( provider )
+        , mWktHasPrefix( wktHasPrefix )
+    {}
+
+    void operator()( QgsDelimitedTextScanRecord &record ) const
+    {
+      mProvider->checkRecord( record, mWktHasPrefix );
+    }
+
+  private:
+    const QgsDelimitedTextProvider *mProvider;
+    bool mWktHasPrefix;
+};
+
+///@endcond
+
+// Checks the geometry of a record and the types its values could have.  This only depends
+// on the record, so that records can be checked in parallel.  Results which depend on the
+// previous records, such as the geometry type of the layer, are handled by scanFile().
+
+void QgsDelimitedTextProvider::checkRecord( QgsDelimitedTextScanRecord &record, bool wktHasPrefix ) const
+{
+  if ( record.status != QgsDelimitedTextFile::RecordOk ) return;
+  record.isEmpty = recordIsEmpty( record.parts );
+  if ( record.isEmpty ) return;
+
+  QStringList &parts = record.parts;
+
+  record.geometryStatus = QgsDelimitedTextScanRecord::GeometryValid;
+  record.wktHasPrefix = false;
+  if ( mGeomRep == GeomAsWkt )
+  {
+    if ( mWktFieldIndex >= parts.size() || parts[mWktFieldIndex].isEmpty() )
+    {
+      record.geometryStatus = QgsDelimitedTextScanRecord::GeometryEmpty;
+    }
+    else
+    {
+      QString sWkt = parts[mWktFieldIndex];
+      record.wktHasPrefix = !wktHasPrefix && sWkt.indexOf( WktPrefixRegexp ) >= 0;
+      record.geometry = geomFromWkt( sWkt, wktHasPrefix || record.wktHasPrefix );
+      if ( ! record.geometry ) record.geometryStatus = QgsDelimitedTextScanRecord::GeometryInvalid;
+    }
+  }
+  else if ( mGeomRep == GeomAsXy )
+  {
+    QString sX = mXFieldIndex < parts.size() ? parts[mXFieldIndex] : QString();
+    QString sY = mYFieldIndex < parts.size() ? parts[mYFieldIndex] : QString();
+    if ( sX.isEmpty() && sY.isEmpty() )
+    {
+      record.geometryStatus = QgsDelimitedTextScanRecord::GeometryEmpty;
+    }
+    else if ( ! pointFromXY( sX, sY, record.point, mDecimalPoint, mXyDms ) )
+    {
+      record.geometryStatus = QgsDelimitedTextScanRecord::GeometryInvalid;
+    }
+  }
+
+  // Types are tested from the most to the least restrictive, any value which
+  // can be an int can also be a long long or a double
+
+  record.valueTypes.fill( QgsDelimitedTextScanRecord::ValueEmpty, parts.size() );
+  for ( int i = 0; i < parts.size(); i++ )
+  {
+    QString &value = parts[i];
+    // Ignore empty fields - spreadsheet generated CSV files often
+    // have random empty fields at the end of a row
+    if ( value.isEmpty() )
+      continue;
+
+    bool ok = false;
+    char type = QgsDelimitedTextScanRecord::ValueText;
+    value.toInt( &ok );
+    if ( ok )
+    {
+      type |= QgsDelimitedTextScanRecord::ValueInt | QgsDelimitedTextScanRecord::ValueLongLong | QgsDelimitedTextScanRecord::ValueDouble;
+    }
+    else
+    {
+      value.toLongLong( &ok );
+      if ( ok )
+      {
+        type |= QgsDelimitedTextScanRecord::ValueLongLong | QgsDelimitedTextScanRecord::ValueDouble;
+      }
+      else
+      {
+        if ( ! mDecimalPoint.isEmpty() )
+        {
+          value.replace( mDecimalPoint, "." );
+        }
+        value.toDouble( &ok );
+        if ( ok ) type |= QgsDelimitedTextScanRecord::ValueDouble;
+      }
+    }
+    record.valueTypes[i] = type;
+  }
+}
+
 void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
 {
   QStringList messages;
@@ -401,7 +558,6 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   //
   // Also build subset and spatial indexes.
 
-  QStringList parts;
   long nEmptyRecords = 0;
   long nBadFormatRecords = 0;
   long nIncompatibleGeometry = 0;
@@ -416,112 +572,126 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
   QList<bool> couldBeDouble;
   bool foundFirstGeometry = false;
 
-  while ( true )
+  // Records are read in batches, which are checked in parallel.  The results
+  // are then used in the order of the file.
+
+  QVector<QgsDelimitedTextScanRecord> records( SCAN_BATCH_SIZE );
+  bool atEnd = false;
+
+  while ( ! atEnd )
   {
-    QgsDelimitedTextFile::Status status = mFile->nextRecord( parts );
-    if ( status == QgsDelimitedTextFile::RecordEOF ) break;
-    if ( status != QgsDelimitedTextFile::RecordOk )
-    {
-      nBadFormatRecords++;
-      recordInvalidLine( tr( "Invalid record format at line %1" ) );
-      continue;
-    }
-    // Skip over empty records
-    if ( recordIsEmpty( parts ) )
+    int nRecords = 0;
+    while ( nRecords < SCAN_BATCH_SIZE )
     {
-      nEmptyRecords++;
-      continue;
+      QgsDelimitedTextScanRecord &record = records[nRecords];
+      record.status = mFile->nextRecord( record.parts );
+      if ( record.status == QgsDelimitedTextFile::RecordEOF )
+      {
+        atEnd = true;
+        break;
+      }
+      record.recordId = mFile->recordId();
+      nRecords++;
     }
 
-    // Check geometries are valid
-    bool geomValid = true;
+    QtConcurrent::blockingMap( records.begin(), records.begin() + nRecords, QgsDelimitedTextRecordCheck( this, mWktHasPrefix ) );
 
-    if ( mGeomRep == GeomAsWkt )
+    for ( int r = 0; r < nRecords; r++ )
     {
-      if ( mWktFieldIndex >= parts.size() || parts[mWktFieldIndex].isEmpty() )
+      QgsDelimitedTextScanRecord &record = records[r];
+
+      if ( record.status != QgsDelimitedTextFile::RecordOk )
       {
-        nEmptyGeometry++;
-        mNumberFeatures++;
+        nBadFormatRecords++;
+        recordInvalidLine( tr( "Invalid record format at line %1" ), record.recordId );
+        continue;
       }
-      else
+      // Skip over empty records
+      if ( record.isEmpty )
       {
-        // Get the wkt - confirm it is valid, get the type, and
-        // if compatible with the rest of file, add to the extents
+        nEmptyRecords++;
+        continue;
+      }
 
-        QString sWkt = parts[mWktFieldIndex];
-        QgsGeometry *geom = nullptr;
-        if ( !mWktHasPrefix && sWkt.indexOf( WktPrefixRegexp ) >= 0 )
-          mWktHasPrefix = true;
-        geom = geomFromWkt( sWkt, mWktHasPrefix );
+      // Check geometries are valid
+      bool geomValid = true;
 
-        if ( geom )
+      if ( mGeomRep == GeomAsWkt )
+      {
+        if ( record.geometryStatus == QgsDelimitedTextScanRecord::GeometryEmpty )
         {
-          QGis::WkbType type = geom->wkbType();
-          if ( type != QGis::WKBNoGeometry )
+          nEmptyGeometry++;
+          mNumberFeatures++;
+        }
+        else
+        {
+          // Check the type of the wkt and if compatible with the rest
+          // of file, add to the extents
+
+          if ( record.wktHasPrefix )
+            mWktHasPrefix = true;
+          QgsGeometry *geom = record.geometry;
+          record.geometry = nullptr;
+
+          if ( geom )
           {
-            if ( mGeometryType == QGis::UnknownGeometry || geom->type() == mGeometryType )
+            QGis::WkbType type = geom->wkbType();
+            if ( type != QGis::WKBNoGeometry )
             {
-              mGeometryType = geom->type();
-              if ( !foundFirstGeometry )
+              if ( mGeometryType == QGis::UnknownGeometry || geom->type() == mGeometryType )
               {
-                mNumberFeatures++;
-                mWkbType = type;
-                mExtent = geom->boundingBox();
-                foundFirstGeometry = true;
+                mGeometryType = geom->type();
+                if ( !foundFirstGeometry )
+                {
+                  mNumberFeatures++;
+                  mWkbType = type;
+                  mExtent = geom->boundingBox();
+                  foundFirstGeometry = true;
+                }
+                else
+                {
+                  mNumberFeatures++;
+                  if ( geom->isMultipart() ) mWkbType = type;
+                  QgsRectangle bbox( geom->boundingBox() );
+                  mExtent.combineExtentWith( bbox );
+                }
+                if ( buildSpatialIndex )
+                {
+                  QgsFeature f;
+                  f.setFeatureId( record.recordId );
+                  f.setGeometry( geom );
+                  mSpatialIndex->insertFeature( f );
+                  // Feature now has ownership of geometry, so set to null
+                  // here to avoid deleting twice.
+                  geom = nullptr;
+                }
               }
               else
               {
-                mNumberFeatures++;
-                if ( geom->isMultipart() ) mWkbType = type;
-                QgsRectangle bbox( geom->boundingBox() );
-                mExtent.combineExtentWith( bbox );
+                nIncompatibleGeometry++;
+                geomValid = false;
               }
-              if ( buildSpatialIndex )
-              {
-                QgsFeature f;
-                f.setFeatureId( mFile->recordId() );
-                f.setGeometry( geom );
-                mSpatialIndex->insertFeature( f );
-                // Feature now has ownership of geometry, so set to null
-                // here to avoid deleting twice.
-                geom = nullptr;
-              }
-            }
-            else
-            {
-              nIncompatibleGeometry++;
-              geomValid = false;
             }
+            if ( geom ) delete geom;
+          }
+          else
+          {
+            geomValid = false;
+            nInvalidGeometry++;
+            recordInvalidLine( tr( "Invalid WKT at line %1" ), record.recordId );
           }
-          if ( geom ) delete geom;
-        }
-        else
-        {
-          geomValid = false;
-          nInvalidGeometry++;
-          recordInvalidLine( tr( "Invalid WKT at line %1" ) );
         }
       }
-    }
-    else if ( mGeomRep == GeomAsXy )
-    {
-      // Get the x and y values, first checking to make sure they
-      // aren't null.
-
-      QString sX = mXFieldIndex < parts.size() ? parts[mXFieldIndex] : QString();
-      QString sY = mYFieldIndex < parts.size() ? parts[mYFieldIndex] : QString();
-      if ( sX.isEmpty() && sY.isEmpty() )
-      {
-        nEmptyGeometry++;
-        mNumberFeatures++;
-      }
-      else
+      else if ( mGeomRep == GeomAsXy )
       {
-        QgsPoint pt;
-        bool ok = pointFromXY( sX, sY, pt, mDecimalPoint, mXyDms );
-
-        if ( ok )
+        if ( record.geometryStatus == QgsDelimitedTextScanRecord::GeometryEmpty )
         {
+          nEmptyGeometry++;
+          mNumberFeatures++;
+        }
+        else if ( record.geometryStatus == QgsDelimitedTextScanRecord::GeometryValid )
+        {
+          const QgsPoint &pt = record.point;
           if ( foundFirstGeometry )
           {
             mExtent.combineExtentWith( pt.x(), pt.y() );
@@ -538,7 +708,7 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
           if ( buildSpatialIndex && qIsFinite( pt.x() ) && qIsFinite( pt.y() ) )
           {
             QgsFeature f;
-            f.setFeatureId( mFile->recordId() );
+            f.setFeatureId( record.recordId );
             f.setGeometry( QgsGeometry::fromPoint( pt ) );
             mSpatialIndex->insertFeature( f );
           }
@@ -547,73 +717,54 @@ void QgsDelimitedTextProvider::scanFile( bool buildIndexes )
         {
           geomValid = false;
           nInvalidGeometry++;
-          recordInvalidLine( tr( "Invalid X or Y fields at line %1" ) );
+          recordInvalidLine( tr( "Invalid X or Y fields at line %1" ), record.recordId );
         }
       }
-    }
-    else
-    {
-      mWkbType = QGis::WKBNoGeometry;
-      mNumberFeatures++;
-    }
-
-    if ( ! geomValid ) continue;
-
-    if ( buildSubsetIndex ) mSubsetIndex.append( mFile->recordId() );
-
+      else
+      {
+        mWkbType = QGis::WKBNoGeometry;
+        mNumberFeatures++;
+      }
 
-    // If we are going to use this record, then assess the potential types of each colum
+      if ( ! geomValid ) continue;
 
-    for ( int i = 0; i < parts.size(); i++ )
-    {
+      if ( buildSubsetIndex ) mSubsetIndex.append( record.recordId );
 
-      QString &value = parts[i];
-      // Ignore empty fields - spreadsheet generated CSV files often
-      // have random empty fields at the end of a row
-      if ( value.isEmpty() )
-        continue;
 
-      // Expand the columns to include this non empty field if necessary
+      // If we are going to use this record, then combine the potential types of each colum
 
-      while ( couldBeInt.size() <= i )
+      for ( int i = 0; i < record.valueTypes.size(); i++ )
       {
-        isEmpty.append( true );
-        couldBeInt.append( false );
-        couldBeLongLong.append( false );
-        couldBeDouble.append( false );
-      }
+        char type = record.valueTypes.at( i );
+        if ( type == QgsDelimitedTextScanRecord::ValueEmpty )
+          continue;
 
-      // If this column has been empty so far then initiallize it
-      // for possible types
+        // Expand the columns to include this non empty field if necessary
 
-      if ( isEmpty[i] )
-      {
-        isEmpty[i] = false;
-        couldBeInt[i] = true;
-        couldBeLongLong[i] = true;
-        couldBeDouble[i] = true;
-      }
-
-      // Now test for still valid possible types for the field
-      // Types are possible until first record which cannot be parsed
-
-      if ( couldBeInt[i] )
-      {
-        value.toInt( &couldBeInt[i] );
-      }
+        while ( couldBeInt.size() <= i )
+        {
+          isEmpty.append( true );
+          couldBeInt.append( false );
+          couldBeLongLong.append( false );
+          couldBeDouble.append( false );
+        }
 
-      if ( couldBeLongLong[i] && ! couldBeInt[i] )
-      {
-        value.toLongLong( &couldBeLongLong[i] );
-      }
+        // If this column has been empty so far then initiallize it
+        // for possible types
 
-      if ( couldBeDouble[i] && ! couldBeLongLong[i] )
-      {
-        if ( ! mDecimalPoint.isEmpty() )
+        if ( isEmpty[i] )
         {
-          value.replace( mDecimalPoint, "." );
+          isEmpty[i] = false;
+          couldBeInt[i] = true;
+          couldBeLongLong[i] = true;
+          couldBeDouble[i] = true;
         }
-        value.toDouble( &couldBeDouble[i] );
+
+        // Types are possible until first record which cannot be parsed
+
+        couldBeInt[i] = couldBeInt[i] && ( type & QgsDelimitedTextScanRecord::ValueInt );
+        couldBeLongLong[i] = couldBeLongLong[i] && ( type & QgsDelimitedTextScanRecord::ValueLongLong );
+        couldBeDouble[i] = couldBeDouble[i] && ( type & QgsDelimitedTextScanRecord::ValueDouble );
       }
     }
   }
@@ -930,11 +1081,11 @@ bool QgsDelimitedTextProvider::recordIsEmpty( QStringList &record )
   return true;
 }
 
-void QgsDelimitedTextProvider::recordInvalidLine( const QString& message )
+void QgsDelimitedTextProvider::recordInvalidLine( const QString& message, long recordId )
 {
   if ( mInvalidLines.size() < mMaxInvalidLines )
   {
-    mInvalidLines.append( message.arg( mFile->recordId() ) );
+    mInvalidLines.append( message.arg( recordId ) );
   }
   else
   {
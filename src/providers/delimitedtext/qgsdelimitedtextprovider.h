@@ -32,6 +32,8 @@ class QFile;
 class QTextStream;
 
 class QgsDelimitedTextFeatureIterator;
+class QgsDelimitedTextRecordCheck;
+struct QgsDelimitedTextScanRecord;
 class QgsExpression;
 class QgsSpatialIndex;
 
@@ -220,9 +222,10 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
     void resetCachedSubset();
     void resetIndexes();
     void clearInvalidLines();
-    void recordInvalidLine( const QString& message );
+    void recordInvalidLine( const QString& message, long recordId );
     void reportErrors( const QStringList& messages = QStringList(), bool showDialog = false );
     static bool recordIsEmpty( QStringList &record );
+    void checkRecord( QgsDelimitedTextScanRecord &record, bool wktHasPrefix ) const;
     void setUriParameter( const QString& parameter, const QString& value );
 
 
@@ -299,6 +302,7 @@ class QgsDelimitedTextProvider : public QgsVectorDataProvider
 
     friend class QgsDelimitedTextFeatureIterator;
     friend class QgsDelimitedTextFeatureSource;
+    friend class QgsDelimitedTextRecordCheck;
 };
 
 #endif
@@ -20,17 +20,45 @@
 #include "qgsspatialindex.h"
 #include "qgsmessagelog.h"
 
+#include <cfloat>
+#include <cmath>
+#include <cstring>
 
 
 QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource<QgsMemoryFeatureSource>( source, ownSource, request )
     , mSelectRectGeom( nullptr )
+    , mSelectRow( 0 )
+    , mFetchGeometry( !( mRequest.flags() & QgsFeatureRequest::NoGeometry ) )
+    , mAllAttributes( !( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes ) )
     , mSubsetExpression( nullptr )
 {
   if ( !mSource->mSubsetString.isEmpty() )
   {
     mSubsetExpression = new QgsExpression( mSource->mSubsetString );
     mSubsetExpression->prepare( &mSource->mExpressionContext );
+    mAllAttributes = true;
+    if ( mSubsetExpression->needsGeometry() )
+      mFetchGeometry = true;
+  }
+
+  // only read the requested attributes, and the ones required for expression filter
+  if ( !mAllAttributes )
+  {
+    mAttributes = mRequest.subsetOfAttributes();
+    if ( mRequest.filterType() == QgsFeatureRequest::FilterExpression )
+    {
+      Q_FOREACH ( const QString& field, mRequest.filterExpression()->referencedColumns() )
+      {
+        int attrIdx = mSource->mFields.fieldNameIndex( field );
+        if ( attrIdx >= 0 && !mAttributes.contains( attrIdx ) )
+          mAttributes << attrIdx;
+      }
+    }
+  }
+  if ( mRequest.filterType() == QgsFeatureRequest::FilterExpression && mRequest.filterExpression()->needsGeometry() )
+  {
+    mFetchGeometry = true;
   }
 
   if ( !mRequest.filterRect().isNull() && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
@@ -49,8 +77,7 @@ QgsMemoryFeatureIterator::QgsMemoryFeatureIterator( QgsMemoryFeatureSource* sour
   else if ( mRequest.filterType() == QgsFeatureRequest::FilterFid )
   {
     mUsingFeatureIdList = true;
-    QgsFeatureMap::const_iterator it = mSource->mFeatures.constFind( mRequest.filterFid() );
-    if ( it != mSource->mFeatures.constEnd() )
+    if ( mSource->mFeatures.row( mRequest.filterFid() ) >= 0 )
       mFeatureIdList.append( mRequest.filterFid() );
   }
   else
@@ -85,102 +112,86 @@ bool QgsMemoryFeatureIterator::fetchFeature( QgsFeature& feature )
 
 bool QgsMemoryFeatureIterator::nextFeatureUsingList( QgsFeature& feature )
 {
-  bool hasFeature = false;
-
   // option 1: we have a list of features to traverse
   while ( mFeatureIdListIterator != mFeatureIdList.constEnd() )
   {
-    if ( !mRequest.filterRect().isNull() && mRequest.flags() & QgsFeatureRequest::ExactIntersect )
-    {
-      // do exact check in case we're doing intersection
-      if ( mSource->mFeatures.value( *mFeatureIdListIterator ).constGeometry() && mSource->mFeatures.value( *mFeatureIdListIterator ).constGeometry()->intersects( mSelectRectGeom ) )
-        hasFeature = true;
-    }
-    else
-      hasFeature = true;
+    int row = mSource->mFeatures.row( *mFeatureIdListIterator );
+    ++mFeatureIdListIterator;
 
-    if ( mSubsetExpression )
-    {
-      mSource->mExpressionContext.setFeature( mSource->mFeatures.value( *mFeatureIdListIterator ) );
-      if ( !mSubsetExpression->evaluate( &mSource->mExpressionContext ).toBool() )
-        hasFeature = false;
-    }
+    // do exact check in case we're doing intersection
+    if ( row >= 0 && readRow( row, feature, mSelectRectGeom != nullptr ) )
+      return true;
+  }
 
-    if ( hasFeature )
-      break;
+  close();
+  return false;
+}
 
-    ++mFeatureIdListIterator;
-  }
 
-  // copy feature
-  if ( hasFeature )
+bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
+{
+  // option 2: traversing the whole layer
+  bool filterRect = !mRequest.filterRect().isNull();
+  while ( mSelectRow < mSource->mFeatures.rowCount() )
   {
-    feature = mSource->mFeatures.value( *mFeatureIdListIterator );
-    ++mFeatureIdListIterator;
+    int row = mSelectRow++;
+    if ( !mSource->mFeatures.isDeleted( row ) && readRow( row, feature, filterRect ) )
+      return true;
   }
-  else
-    close();
-
-  if ( hasFeature )
-    feature.setFields( mSource->mFields ); // allow name-based attribute lookups
 
-  return hasFeature;
+  close();
+  return false;
 }
 
-
-bool QgsMemoryFeatureIterator::nextFeatureTraverseAll( QgsFeature& feature )
+bool QgsMemoryFeatureIterator::readRow( int row, QgsFeature& feature, bool filterRect )
 {
-  bool hasFeature = false;
+  const QgsMemoryFeatureStore& features = mSource->mFeatures;
 
-  // option 2: traversing the whole layer
-  while ( mSelectIterator != mSource->mFeatures.constEnd() )
+  QgsGeometry* geometry = nullptr;
+  if ( filterRect )
   {
-    if ( mRequest.filterRect().isNull() )
+    // the stored bounding box discards most features without reading their geometry
+    if ( !features.mayIntersect( row, mRequest.filterRect() ) )
+      return false;
+
+    geometry = features.geometry( row );
+    bool intersects = false;
+    if ( mSelectRectGeom )
     {
-      // selection rect empty => using all features
-      hasFeature = true;
+      // using exact test when checking for intersection
+      intersects = geometry && geometry->intersects( mSelectRectGeom );
     }
     else
     {
-      if ( mRequest.flags() & QgsFeatureRequest::ExactIntersect )
-      {
-        // using exact test when checking for intersection
-        if ( mSelectIterator->constGeometry() && mSelectIterator->constGeometry()->intersects( mSelectRectGeom ) )
-          hasFeature = true;
-      }
-      else
-      {
-        // check just bounding box against rect when not using intersection
-        if ( mSelectIterator->constGeometry() && mSelectIterator->constGeometry()->boundingBox().intersects( mRequest.filterRect() ) )
-          hasFeature = true;
-      }
+      // check just bounding box against rect when not using intersection
+      intersects = geometry && geometry->boundingBox().intersects( mRequest.filterRect() );
     }
 
-    if ( mSubsetExpression )
+    if ( !intersects )
     {
-      mSource->mExpressionContext.setFeature( *mSelectIterator );
-      if ( !mSubsetExpression->evaluate( &mSource->mExpressionContext ).toBool() )
-        hasFeature = false;
+      delete geometry;
+      return false;
     }
+  }
 
-    if ( hasFeature )
-      break;
-
-    ++mSelectIterator;
+  features.readFeature( row, feature, mFetchGeometry && !geometry, mAttributes, mAllAttributes );
+  if ( geometry )
+  {
+    if ( mFetchGeometry )
+      feature.setGeometry( geometry );
+    else
+      delete geometry;
   }
+  feature.setFields( mSource->mFields ); // allow name-based attribute lookups
 
-  // copy feature
-  if ( hasFeature )
+  if ( mSubsetExpression )
   {
-    feature = mSelectIterator.value();
-    ++mSelectIterator;
-    feature.setValid( true );
-    feature.setFields( mSource->mFields ); // allow name-based attribute lookups
+    mSource->mExpressionContext.setFeature( feature );
+    if ( !mSubsetExpression->evaluate( &mSource->mExpressionContext ).toBool() )
+      return false;
   }
-  else
-    close();
 
-  return hasFeature;
+  return true;
 }
 
 bool QgsMemoryFeatureIterator::rewind()
@@ -191,7 +202,7 @@ bool QgsMemoryFeatureIterator::rewind()
   if ( mUsingFeatureIdList )
     mFeatureIdListIterator = mFeatureIdList.constBegin();
   else
-    mSelectIterator = mSource->mFeatures.constBegin();
+    mSelectRow = 0;
 
   return true;
 }
@@ -232,3 +243,435 @@ QgsFeatureIterator QgsMemoryFeatureSource::getFeatures( const QgsFeatureRequest&
 {
   return QgsFeatureIterator( new QgsMemoryFeatureIterator( this, false, request ) );
 }
+
+// -------------------------
+
+///@cond PRIVATE
+
+//! Returns the values of the given rows, in order
+template<class T> static QVector<T> selectRows( const QVector<T>& values, const QVector<int>& rows )
+{
+  QVector<T> selected( rows.count() );
+  for ( int i = 0; i < rows.count(); ++i )
+    selected[i] = values.at( rows.at( i ) );
+  return selected;
+}
+
+//! Returns the largest float which is not larger than a double
+static float floatBelow( double value )
+{
+  float f = static_cast<float>( value );
+  if ( f > value )
+    f = std::nextafter( f, -FLT_MAX );
+  return f;
+}
+
+//! Returns the smallest float which is not smaller than a double
+static float floatAbove( double value )
+{
+  float f = static_cast<float>( value );
+  if ( f < value )
+    f = std::nextafter( f, FLT_MAX );
+  return f;
+}
+
+///@endcond
+
+QgsMemoryFeatureStore::QgsMemoryFeatureStore()
+    : mCount( 0 )
+    , mUnusedWkbSize( 0 )
+    , mWkbSize( 0 )
+{
+}
+
+int QgsMemoryFeatureStore::row( QgsFeatureId fid ) const
+{
+  if ( fid < 0 || fid >= mRows.size() )
+    return -1;
+  return mRows.at( fid );
+}
+
+void QgsMemoryFeatureStore::addAttribute( QVariant::Type type )
+{
+  Column column;
+  column.type = type;
+  int rows = rowCount();
+  switch ( type )
+  {
+    case QVariant::Int:
+      column.storage = StoreInt;
+      column.ints.fill( 0, rows );
+      break;
+    case QVariant::LongLong:
+      column.storage = StoreLongLong;
+      column.longLongs.fill( 0, rows );
+      break;
+    case QVariant::Double:
+      column.storage = StoreDouble;
+      column.doubles.fill( 0.0, rows );
+      break;
+    case QVariant::String:
+      column.storage = StoreString;
+      column.strings.resize( rows );
+      break;
+    default:
+      column.storage = StoreVariant;
+      column.variants.resize( rows );
+      break;
+  }
+  if ( column.storage != StoreVariant )
+    column.states.fill( ValueInvalid, rows );
+
+  mColumns << column;
+}
+
+void QgsMemoryFeatureStore::deleteAttribute( int idx )
+{
+  if ( idx >= 0 && idx < mColumns.count() )
+    mColumns.removeAt( idx );
+}
+
+void QgsMemoryFeatureStore::append( const QgsFeature& feature )
+{
+  QgsFeatureId fid = feature.id();
+  Q_ASSERT( fid >= 0 && ( mFids.isEmpty() || fid > mFids.last() ) );
+
+  int row = rowCount();
+  if ( fid >= mRows.size() )
+  {
+    int size = mRows.size();
+    mRows.resize( fid + 1 );
+    for ( int i = size; i < mRows.size(); ++i )
+      mRows[i] = -1;
+  }
+  mRows[fid] = row;
+  mFids << fid;
+
+  const QgsAttributes& attributes = feature.attributes();
+  for ( int idx = 0; idx < mColumns.count(); ++idx )
+    appendValue( mColumns[idx], idx < attributes.count() ? attributes.at( idx ) : QVariant() );
+
+  mGeometries << GeometryRef();
+  mBoxes << 0.0f << 0.0f << 0.0f << 0.0f;
+  setGeometry( row, feature.constGeometry() );
+
+  ++mCount;
+}
+
+void QgsMemoryFeatureStore::remove( int row )
+{
+  if ( row < 0 || row >= rowCount() || isDeleted( row ) )
+    return;
+
+  // release the values which are not stored inline
+  for ( int idx = 0; idx < mColumns.count(); ++idx )
+  {
+    Column& column = mColumns[idx];
+    if ( column.storage == StoreString )
+      column.strings[row] = QString();
+    else if ( column.storage == StoreVariant )
+      column.variants[row] = QVariant();
+    column.others.remove( row );
+  }
+  setGeometry( row, nullptr );
+
+  mRows[mFids.at( row )] = -1;
+  mFids[row] = DELETED_FID;
+  --mCount;
+
+  if ( rowCount() - mCount > mCount )
+    compact();
+}
+
+QVariant QgsMemoryFeatureStore::attribute( int row, int idx ) const
+{
+  if ( idx < 0 || idx >= mColumns.count() )
+    return QVariant();
+  return value( mColumns.at( idx ), row );
+}
+
+void QgsMemoryFeatureStore::setAttribute( int row, int idx, const QVariant& value )
+{
+  if ( idx < 0 || idx >= mColumns.count() )
+    return;
+  setValue( mColumns[idx], row, value );
+}
+
+QgsGeometry* QgsMemoryFeatureStore::geometry( int row ) const
+{
+  const GeometryRef& ref = mGeometries.at( row );
+  if ( ref.size < 0 )
+    return nullptr;
+
+  QgsGeometry* geometry = new QgsGeometry();
+  if ( ref.size > 0 )
+  {
+    unsigned char* wkb = new unsigned char[ref.size];
+    memcpy( wkb, mWkbBlocks.at( ref.block ).constData() + ref.offset, ref.size );
+    geometry->fromWkb( wkb, ref.size );
+  }
+  return geometry;
+}
+
+void QgsMemoryFeatureStore::setGeometry( int row, const QgsGeometry* geometry )
+{
+  GeometryRef ref;
+  if ( geometry )
+  {
+    const unsigned char* wkb = geometry->asWkb();
+    int size = geometry->wkbSize();
+    if ( wkb && size > 0 )
+      ref = writeWkb( wkb, size );
+    else
+      ref.size = 0;
+  }
+
+  if ( mGeometries.at( row ).size > 0 )
+    mUnusedWkbSize += mGeometries.at( row ).size;
+  mGeometries[row] = ref;
+  setBoundingBox( row, ref.size > 0 ? geometry : nullptr );
+
+  if ( mUnusedWkbSize > WKB_BLOCK_SIZE && mUnusedWkbSize > mWkbSize / 2 )
+    compactGeometries();
+}
+
+bool QgsMemoryFeatureStore::mayIntersect( int row, const QgsRectangle& rect ) const
+{
+  if ( mGeometries.at( row ).size < 0 )
+    return false;
+
+  const float* box = mBoxes.constData() + 4 * row;
+  return !( box[0] > rect.xMaximum() || box[2] < rect.xMinimum() ||
+            box[1] > rect.yMaximum() || box[3] < rect.yMinimum() );
+}
+
+void QgsMemoryFeatureStore::readFeature( int row, QgsFeature& feature, bool fetchGeometry, const QgsAttributeList& attributes, bool allAttributes ) const
+{
+  feature.setFeatureId( mFids.at( row ) );
+
+  QgsAttributes values( mColumns.count() );
+  if ( allAttributes )
+  {
+    for ( int idx = 0; idx < mColumns.count(); ++idx )
+      values[idx] = value( mColumns.at( idx ), row );
+  }
+  else
+  {
+    Q_FOREACH ( int idx, attributes )
+    {
+      if ( idx >= 0 && idx < mColumns.count() )
+        values[idx] = value( mColumns.at( idx ), row );
+    }
+  }
+  feature.setAttributes( values );
+
+  feature.setGeometry( fetchGeometry ? geometry( row ) : nullptr );
+  feature.setValid( true );
+}
+
+void QgsMemoryFeatureStore::appendValue( Column& column, const QVariant& value )
+{
+  int row = column.storage == StoreVariant ? column.variants.size() : column.states.size();
+  switch ( column.storage )
+  {
+    case StoreInt:
+      column.ints << 0;
+      break;
+    case StoreLongLong:
+      column.longLongs << 0;
+      break;
+    case StoreDouble:
+      column.doubles << 0.0;
+      break;
+    case StoreString:
+      column.strings << QString();
+      break;
+    case StoreVariant:
+      column.variants << value;
+      return;
+  }
+  column.states.append( static_cast<char>( ValueInvalid ) );
+  setValue( column, row, value );
+}
+
+void QgsMemoryFeatureStore::setValue( Column& column, int row, const QVariant& value )
+{
+  if ( column.storage == StoreVariant )
+  {
+    column.variants[row] = value;
+    return;
+  }
+
+  // values which can not be stored in the column keep their own type
+  column.others.remove( row );
+  ValueState state = ValueStored;
+  if ( !value.isValid() )
+    state = ValueInvalid;
+  else if ( value.type() != column.type )
+    state = ValueOther;
+  else if ( value.isNull() && column.storage != StoreString )
+    state = ValueNull;
+
+  if ( state == ValueOther )
+    column.others.insert( row, value );
+  column.states[row] = static_cast<char>( state );
+
+  bool stored = state == ValueStored;
+  switch ( column.storage )
+  {
+    case StoreInt:
+      column.ints[row] = stored ? value.toInt() : 0;
+      break;
+    case StoreLongLong:
+      column.longLongs[row] = stored ? value.toLongLong() : 0;
+      break;
+    case StoreDouble:
+      column.doubles[row] = stored ? value.toDouble() : 0.0;
+      break;
+    case StoreString:
+      // null strings are stored as they are
+      column.strings[row] = stored ? value.toString() : QString();
+      break;
+    case StoreVariant:
+      break;
+  }
+}
+
+QVariant QgsMemoryFeatureStore::value( const Column& column, int row ) const
+{
+  if ( column.storage == StoreVariant )
+    return column.variants.at( row );
+
+  switch ( column.states.at( row ) )
+  {
+    case ValueInvalid:
+      return QVariant();
+    case ValueNull:
+      return QVariant( column.type );
+    case ValueOther:
+      return column.others.value( row );
+    default:
+      break;
+  }
+
+  switch ( column.storage )
+  {
+    case StoreInt:
+      return QVariant( column.ints.at( row ) );
+    case StoreLongLong:
+      return QVariant( static_cast<qlonglong>( column.longLongs.at( row ) ) );
+    case StoreDouble:
+      return QVariant( column.doubles.at( row ) );
+    case StoreString:
+      return QVariant( column.strings.at( row ) );
+    case StoreVariant:
+      break;
+  }
+  return QVariant();
+}
+
+QgsMemoryFeatureStore::GeometryRef QgsMemoryFeatureStore::writeWkb( const unsigned char* wkb, int size )
+{
+  // a geometry larger than a block gets a block of its own
+  if ( mWkbBlocks.isEmpty() || ( !mWkbBlocks.last().isEmpty() && mWkbBlocks.last().size() + size > WKB_BLOCK_SIZE ) )
+    mWkbBlocks << QByteArray();
+
+  QByteArray& block = mWkbBlocks.last();
+  GeometryRef ref;
+  ref.block = mWkbBlocks.count() - 1;
+  ref.offset = block.size();
+  ref.size = size;
+  block.append( reinterpret_cast<const char*>( wkb ), size );
+  mWkbSize += size;
+  return ref;
+}
+
+void QgsMemoryFeatureStore::setBoundingBox( int row, const QgsGeometry* geometry )
+{
+  float* box = mBoxes.data() + 4 * row;
+  if ( geometry )
+  {
+    QgsRectangle rect = geometry->boundingBox();
+    box[0] = floatBelow( rect.xMinimum() );
+    box[1] = floatBelow( rect.yMinimum() );
+    box[2] = floatAbove( rect.xMaximum() );
+    box[3] = floatAbove( rect.yMaximum() );
+  }
+  else
+  {
+    // empty geometries are left to the exact test
+    box[0] = box[1] = box[2] = box[3] = 0.0f;
+  }
+}
+
+void QgsMemoryFeatureStore::compact()
+{
+  QVector<int> rows;
+  rows.reserve( mCount );
+  QVector<int> newRows( rowCount(), -1 );
+  for ( int row = 0; row < rowCount(); ++row )
+  {
+    if ( isDeleted( row ) )
+      continue;
+    newRows[row] = rows.count();
+    rows << row;
+  }
+
+  for ( int idx = 0; idx < mColumns.count(); ++idx )
+  {
+    Column& column = mColumns[idx];
+    switch ( column.storage )
+    {
+      case StoreInt:
+        column.ints = selectRows( column.ints, rows );
+        break;
+      case StoreLongLong:
+        column.longLongs = selectRows( column.longLongs, rows );
+        break;
+      case StoreDouble:
+        column.doubles = selectRows( column.doubles, rows );
+        break;
+      case StoreString:
+        column.strings = selectRows( column.strings, rows );
+        break;
+      case StoreVariant:
+        column.variants = selectRows( column.variants, rows );
+        continue;
+    }
+
+    QByteArray states( rows.count(), static_cast<char>( ValueInvalid ) );
+    for ( int i = 0; i < rows.count(); ++i )
+      states[i] = column.states.at( rows.at( i ) );
+    column.states = states;
+
+    QHash<int, QVariant> others;
+    for ( QHash<int, QVariant>::const_iterator it = column.others.constBegin(); it != column.others.constEnd(); ++it )
+      others.insert( newRows.at( it.key() ), it.value() );
+    column.others = others;
+  }
+
+  QVector<float> boxes( 4 * rows.count() );
+  for ( int i = 0; i < rows.count(); ++i )
+    memcpy( boxes.data() + 4 * i, mBoxes.constData() + 4 * rows.at( i ), 4 * sizeof( float ) );
+  mBoxes = boxes;
+
+  mGeometries = selectRows( mGeometries, rows );
+  mFids = selectRows( mFids, rows );
+  for ( int i = 0; i < mFids.count(); ++i )
+    mRows[mFids.at( i )] = i;
+}
+
+void QgsMemoryFeatureStore::compactGeometries()
+{
+  QList<QByteArray> blocks = mWkbBlocks;
+  mWkbBlocks.clear();
+  mWkbSize = 0;
+  mUnusedWkbSize = 0;
+
+  for ( int row = 0; row < mGeometries.count(); ++row )
+  {
+    GeometryRef& ref = mGeometries[row];
+    if ( ref.size > 0 )
+      ref = writeWkb( reinterpret_cast<const unsigned char*>( blocks.at( ref.block ).constData() ) + ref.offset, ref.size );
+  }
+}
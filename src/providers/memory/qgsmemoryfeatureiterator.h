@@ -18,12 +18,155 @@
 #include "qgsfeatureiterator.h"
 #include "qgsexpressioncontext.h"
 
-class QgsMemoryProvider;
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QVector>
 
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
+class QgsMemoryProvider;
 
 class QgsSpatialIndex;
 
+/**
+ * Columnar storage of the features of a memory layer.
+ *
+ * Features are stored in rows, in the order they were added, which is the order of their ids.
+ * Each attribute is stored in a column holding the values of its field type, any other value
+ * is kept aside, so that values are returned as they were set. Geometries are stored as WKB in
+ * a few large blocks, along with a bounding box of each geometry in single precision, rounded
+ * outwards, which is used to skip features outside of a rectangle without reading their geometry.
+ *
+ * Deleted features leave an empty row until more than half of the rows are empty. All the
+ * containers are implicitly shared, so copying the store is cheap.
+ */
+class QgsMemoryFeatureStore
+{
+  public:
+    QgsMemoryFeatureStore();
+
+    //! Returns the number of features
+    int count() const { return mCount; }
+    bool isEmpty() const { return mCount == 0; }
+
+    //! Returns the number of rows, including the rows of deleted features
+    int rowCount() const { return mFids.size(); }
+    //! Returns the row of a feature, or -1 if there is no feature with this id
+    int row( QgsFeatureId fid ) const;
+    //! Returns whether a row belongs to a deleted feature
+    bool isDeleted( int row ) const { return mFids.at( row ) == DELETED_FID; }
+
+    //! Adds a column of invalid values for a field of the given type
+    void addAttribute( QVariant::Type type );
+    void deleteAttribute( int idx );
+
+    //! Adds a feature, whose id must be larger than the ids of the features already stored
+    void append( const QgsFeature& feature );
+    void remove( int row );
+
+    QVariant attribute( int row, int idx ) const;
+    void setAttribute( int row, int idx, const QVariant& value );
+
+    //! Returns the geometry of a row, or nullptr if the feature has none. Ownership is transferred to the caller.
+    QgsGeometry* geometry( int row ) const;
+    void setGeometry( int row, const QgsGeometry* geometry );
+
+    //! Returns false if the geometry of a row can not intersect a rectangle, true if it may
+    bool mayIntersect( int row, const QgsRectangle& rect ) const;
+
+    /** Reads the feature of a row
+     * @param row row of the feature
+     * @param feature feature which is set
+     * @param fetchGeometry whether the geometry is read
+     * @param attributes indexes of the attributes read, the other attributes are invalid
+     * @param allAttributes whether all attributes are read rather than the listed ones
+     */
+    void readFeature( int row, QgsFeature& feature, bool fetchGeometry, const QgsAttributeList& attributes, bool allAttributes ) const;
+
+  private:
+
+    //! Id of the rows of deleted features
+    static const QgsFeatureId DELETED_FID = -1;
+    //! Size of the blocks WKB is stored in
+    static const int WKB_BLOCK_SIZE = 1024 * 1024;
+
+    enum StorageType
+    {
+      StoreInt,
+      StoreLongLong,
+      StoreDouble,
+      StoreString,
+      StoreVariant
+    };
+
+    //! State of a value of a column with typed storage
+    enum ValueState
+    {
+      ValueStored = 0,  //!< value is in the vector of the column type
+      ValueInvalid,     //!< invalid QVariant
+      ValueNull,        //!< null QVariant of the column type
+      ValueOther        //!< value of another type, kept in the hash of other values
+    };
+
+    struct Column
+    {
+      Column()
+          : type( QVariant::Invalid )
+          , storage( StoreVariant )
+      {}
+
+      QVariant::Type type;
+      StorageType storage;
+      QVector<int> ints;
+      QVector<qint64> longLongs;
+      QVector<double> doubles;
+      QVector<QString> strings;
+      QVector<QVariant> variants;
+      //! ValueState of each row, unused for variant storage
+      QByteArray states;
+      QHash<int, QVariant> others;
+    };
+
+    //! Location of the WKB of a geometry
+    struct GeometryRef
+    {
+      GeometryRef()
+          : block( 0 )
+          , offset( 0 )
+          , size( -1 )
+      {}
+
+      int block;
+      int offset;
+      //! size of the WKB, 0 for an empty geometry and -1 if there is no geometry
+      int size;
+    };
+
+    void appendValue( Column& column, const QVariant& value );
+    void setValue( Column& column, int row, const QVariant& value );
+    QVariant value( const Column& column, int row ) const;
+
+    GeometryRef writeWkb( const unsigned char* wkb, int size );
+    void setBoundingBox( int row, const QgsGeometry* geometry );
+
+    //! Removes the rows of deleted features
+    void compact();
+    //! Rewrites the WKB of the geometries without the space of replaced geometries
+    void compactGeometries();
+
+    int mCount;
+    QVector<QgsFeatureId> mFids;
+    //! row of each feature id, -1 for ids without a feature
+    QVector<int> mRows;
+    QList<Column> mColumns;
+    QVector<GeometryRef> mGeometries;
+    //! xmin, ymin, xmax, ymax of the geometry of each row
+    QVector<float> mBoxes;
+    QList<QByteArray> mWkbBlocks;
+    //! size of the WKB of geometries which were replaced or deleted
+    qint64 mUnusedWkbSize;
+    qint64 mWkbSize;
+};
+
 
 class QgsMemoryFeatureSource : public QgsAbstractFeatureSource
 {
@@ -35,7 +178,7 @@ class QgsMemoryFeatureSource : public QgsAbstractFeatureSource
 
   protected:
     QgsFields mFields;
-    QgsFeatureMap mFeatures;
+    QgsMemoryFeatureStore mFeatures;
     QgsSpatialIndex* mSpatialIndex;
     QString mSubsetString;
     QgsExpressionContext mExpressionContext;
@@ -65,8 +208,16 @@ class QgsMemoryFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Qgs
     bool nextFeatureUsingList( QgsFeature& feature );
     bool nextFeatureTraverseAll( QgsFeature& feature );
 
+    //! Reads the feature of a row if it matches the request, testing the rectangle if filterRect is true
+    bool readRow( int row, QgsFeature& feature, bool filterRect );
+
     QgsGeometry* mSelectRectGeom;
-    QgsFeatureMap::const_iterator mSelectIterator;
+    //! next row when traversing the whole layer
+    int mSelectRow;
+    bool mFetchGeometry;
+    //! attributes read from the store, unless all of them are read
+    QgsAttributeList mAttributes;
+    bool mAllAttributes;
     bool mUsingFeatureIdList;
     QList<QgsFeatureId> mFeatureIdList;
     QList<QgsFeatureId>::const_iterator mFeatureIdListIterator;
@@ -25,6 +25,7 @@
 
 #include <QUrl>
 #include <QRegExp>
+#include <QScopedPointer>
 
 
 static const QString TEXT_PROVIDER_KEY = "memory";
@@ -288,10 +289,14 @@ QgsRectangle QgsMemoryProvider::extent()
   if ( mExtent.isEmpty() && !mFeatures.isEmpty() )
   {
     mExtent.setMinimal();
-    Q_FOREACH ( const QgsFeature &feat, mFeatures )
+    for ( int row = 0; row < mFeatures.rowCount(); ++row )
     {
-      if ( feat.constGeometry() )
-        mExtent.unionRect( feat.constGeometry()->boundingBox() );
+      if ( mFeatures.isDeleted( row ) )
+        continue;
+
+      QScopedPointer<QgsGeometry> geometry( mFeatures.geometry( row ) );
+      if ( geometry )
+        mExtent.unionRect( geometry->boundingBox() );
     }
   }
 
@@ -347,7 +352,7 @@ bool QgsMemoryProvider::addFeatures( QgsFeatureList & flist )
     it->setFeatureId( mNextFeatureId );
     it->setValid( true );
 
-    mFeatures.insert( mNextFeatureId, *it );
+    mFeatures.append( *it );
 
     if ( it->constGeometry() )
     {
@@ -374,17 +379,21 @@ bool QgsMemoryProvider::deleteFeatures( const QgsFeatureIds & id )
 {
   for ( QgsFeatureIds::const_iterator it = id.begin(); it != id.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( *it );
+    int row = mFeatures.row( *it );
 
     // check whether such feature exists
-    if ( fit == mFeatures.end() )
+    if ( row < 0 )
       continue;
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+    {
+      QgsFeature feature;
+      mFeatures.readFeature( row, feature, true, QgsAttributeList(), false );
+      mSpatialIndex->deleteFeature( feature );
+    }
 
-    mFeatures.erase( fit );
+    mFeatures.remove( row );
   }
 
   updateExtents();
@@ -412,14 +421,7 @@ bool QgsMemoryProvider::addAttributes( const QList<QgsField> &attributes )
     }
     // add new field as a last one
     mFields.append( *it );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      QgsAttributes attr = f.attributes();
-      attr.append( QVariant() );
-      f.setAttributes( attr );
-    }
+    mFeatures.addAttribute( it->type() );
   }
   return true;
 }
@@ -458,14 +460,7 @@ bool QgsMemoryProvider::deleteAttributes( const QgsAttributeIds& attributes )
   {
     int idx = *it;
     mFields.remove( idx );
-
-    for ( QgsFeatureMap::iterator fit = mFeatures.begin(); fit != mFeatures.end(); ++fit )
-    {
-      QgsFeature& f = fit.value();
-      QgsAttributes attr = f.attributes();
-      attr.remove( idx );
-      f.setAttributes( attr );
-    }
+    mFeatures.deleteAttribute( idx );
   }
   return true;
 }
@@ -474,13 +469,13 @@ bool QgsMemoryProvider::changeAttributeValues( const QgsChangedAttributesMap &at
 {
   for ( QgsChangedAttributesMap::const_iterator it = attr_map.begin(); it != attr_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    int row = mFeatures.row( it.key() );
+    if ( row < 0 )
       continue;
 
     const QgsAttributeMap& attrs = it.value();
     for ( QgsAttributeMap::const_iterator it2 = attrs.constBegin(); it2 != attrs.constEnd(); ++it2 )
-      fit->setAttribute( it2.key(), it2.value() );
+      mFeatures.setAttribute( row, it2.key(), it2.value() );
   }
   return true;
 }
@@ -489,19 +484,27 @@ bool QgsMemoryProvider::changeGeometryValues( const QgsGeometryMap &geometry_map
 {
   for ( QgsGeometryMap::const_iterator it = geometry_map.begin(); it != geometry_map.end(); ++it )
   {
-    QgsFeatureMap::iterator fit = mFeatures.find( it.key() );
-    if ( fit == mFeatures.end() )
+    int row = mFeatures.row( it.key() );
+    if ( row < 0 )
       continue;
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->deleteFeature( *fit );
+    {
+      QgsFeature feature;
+      mFeatures.readFeature( row, feature, true, QgsAttributeList(), false );
+      mSpatialIndex->deleteFeature( feature );
+    }
 
-    fit->setGeometry( it.value() );
+    mFeatures.setGeometry( row, &it.value() );
 
     // update spatial index
     if ( mSpatialIndex )
-      mSpatialIndex->insertFeature( *fit );
+    {
+      QgsFeature feature;
+      mFeatures.readFeature( row, feature, true, QgsAttributeList(), false );
+      mSpatialIndex->insertFeature( feature );
+    }
   }
 
   updateExtents();
@@ -539,9 +542,14 @@ bool QgsMemoryProvider::createSpatialIndex()
     mSpatialIndex = new QgsSpatialIndex();
 
     // add existing features to index
-    for ( QgsFeatureMap::const_iterator it = mFeatures.constBegin(); it != mFeatures.constEnd(); ++it )
+    QgsFeature feature;
+    for ( int row = 0; row < mFeatures.rowCount(); ++row )
     {
-      mSpatialIndex->insertFeature( *it );
+      if ( mFeatures.isDeleted( row ) )
+        continue;
+
+      mFeatures.readFeature( row, feature, true, QgsAttributeList(), false );
+      mSpatialIndex->insertFeature( feature );
     }
   }
   return true;
@@ -15,9 +15,7 @@
 
 #include "qgsvectordataprovider.h"
 #include "qgscoordinatereferencesystem.h"
-
-
-typedef QMap<QgsFeatureId, QgsFeature> QgsFeatureMap;
+#include "qgsmemoryfeatureiterator.h"
 
 class QgsSpatialIndex;
 
@@ -170,7 +168,7 @@ class QgsMemoryProvider : public QgsVectorDataProvider
     mutable QgsRectangle mExtent;
 
     // features
-    QgsFeatureMap mFeatures;
+    QgsMemoryFeatureStore mFeatures;
     QgsFeatureId mNextFeatureId;
 
     // indexing
@@ -26,6 +26,10 @@
 
 #include <QTextCodec>
 #include <QFile>
+#include <QThread>
+#include <QtConcurrentRun>
+
+#include <limits>
 
 // using from provider:
 // - setRelevantFields(), mRelevantFieldsForNextFeature
@@ -34,6 +38,11 @@
 // - mAttributeFields
 // - mEncoding
 
+//! Number of feature ids selected by one attribute filter when fetching features by id
+static const int FID_BATCH_SIZE = 1000;
+
+//! Number of partitions a layer read in parallel is split into, per thread
+static const int PARTITIONS_PER_THREAD = 4;
 
 QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource<QgsOgrFeatureSource>( source, ownSource, request )
@@ -44,8 +53,14 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool
     , mOrigFidAdded( false )
     , mFetchGeometry( false )
     , mExpressionCompiled( false )
-    , mFilterFids( mRequest.filterFids() )
+    , mFilterFids( mRequest.filterFids().toList() )
     , mFilterFidsIt( mFilterFids.constBegin() )
+    , mFidBatchActive( false )
+    , mPartitionWorkerCount( 0 )
+    , mParallelReader( nullptr )
+    , mPartition( 0 )
+    , mPartitionStarted( false )
+    , mPartitionOwned( false )
 {
   mConn = QgsOgrConnPool::instance()->acquireConnection( mSource->mDataSource );
   if ( !mConn->ds )
@@ -152,6 +167,39 @@ QgsOgrFeatureIterator::QgsOgrFeatureIterator( QgsOgrFeatureSource* source, bool
     OGR_L_SetAttributeFilter( ogrLayer, nullptr );
   }
 
+  // many features requested by id are read in the order of their ids, batch by batch,
+  // with an attribute filter which drivers resolve with an index or a native query
+  if ( mRequest.filterType() == QgsFeatureRequest::FilterFids )
+  {
+    qSort( mFilterFids );
+
+    if ( mFilterFids.count() > 1 )
+    {
+      if ( mOrigFidAdded )
+      {
+        OGRFeatureDefnH fdef = OGR_L_GetLayerDefn( ogrLayer );
+        int lastField = OGR_FD_GetFieldCount( fdef ) - 1;
+        if ( lastField >= 0 )
+          mFidColumn = QgsOgrProviderUtils::quotedIdentifier( OGR_Fld_GetNameRef( OGR_FD_GetFieldDefn( fdef, lastField ) ), mSource->mDriverName );
+      }
+      else if ( mSource->mDriverName == "ESRI Shapefile" )
+      {
+        mFidColumn = "FID";
+      }
+      else if ( mSource->mDriverName == "GPKG" || mSource->mDriverName == "SQLite" )
+      {
+        QByteArray fidColumn = OGR_L_GetFIDColumn( ogrLayer );
+        if ( !fidColumn.isEmpty() )
+          mFidColumn = QgsOgrProviderUtils::quotedIdentifier( fidColumn, mSource->mDriverName );
+      }
+    }
+
+    // features fetched by id were never filtered by the rectangle in OGR
+    if ( !mFidColumn.isEmpty() )
+      OGR_L_SetSpatialFilter( ogrLayer, nullptr );
+  }
+
+  preparePartitions();
 
   //start with first feature
   rewind();
@@ -229,6 +277,23 @@ bool QgsOgrFeatureIterator::fetchFeature( QgsFeature& feature )
   }
   else if ( mRequest.filterType() == QgsFeatureRequest::FilterFids )
   {
+    while ( mFidBatchActive )
+    {
+      OGRFeatureH fet;
+      while (( fet = OGR_L_GetNextFeature( ogrLayer ) ) )
+      {
+        if ( !readFeature( fet, feature ) )
+          continue;
+
+        OGR_F_Destroy( fet );
+        feature.setValid( true );
+        return true;
+      }
+
+      mFidBatchActive = setNextFidBatch();
+    }
+
+    // features are read one by one if the ids can not be filtered
     while ( mFilterFidsIt != mFilterFids.constEnd() )
     {
       QgsFeatureId nextId = *mFilterFidsIt;
@@ -241,6 +306,9 @@ bool QgsOgrFeatureIterator::fetchFeature( QgsFeature& feature )
     return false;
   }
 
+  if ( !mPartitions.isEmpty() )
+    return fetchPartitionedFeature( feature );
+
   OGRFeatureH fet;
 
   while (( fet = OGR_L_GetNextFeature( ogrLayer ) ) )
@@ -272,11 +340,252 @@ bool QgsOgrFeatureIterator::rewind()
   OGR_L_ResetReading( ogrLayer );
 
   mFilterFidsIt = mFilterFids.constBegin();
+  mFidBatchActive = !mFidColumn.isEmpty() && setNextFidBatch();
+
+  if ( !mPartitions.isEmpty() )
+  {
+    // the workers are started by the first fetched feature
+    delete mParallelReader;
+    mParallelReader = nullptr;
+    mPartition = 0;
+    mPartitionStarted = false;
+    mPartitionOwned = false;
+  }
+
+  return true;
+}
+
+bool QgsOgrFeatureIterator::setNextFidBatch()
+{
+  if ( mFilterFidsIt == mFilterFids.constEnd() )
+    return false;
+
+  QList<QgsFeatureId>::const_iterator batchStart = mFilterFidsIt;
+  QByteArray filter = mFidColumn + " IN (";
+  for ( int i = 0; i < FID_BATCH_SIZE && mFilterFidsIt != mFilterFids.constEnd(); ++i, ++mFilterFidsIt )
+  {
+    if ( i > 0 )
+      filter += ',';
+    filter += QByteArray::number( FID_TO_NUMBER( *mFilterFidsIt ) );
+  }
+  filter += ')';
+
+  if ( OGR_L_SetAttributeFilter( ogrLayer, filter.constData() ) != OGRERR_NONE )
+  {
+    // read the remaining features one by one
+    QgsDebugMsg( QString( "Could not filter feature ids on %1" ).arg( QString::fromUtf8( mFidColumn ) ) );
+    OGR_L_SetAttributeFilter( ogrLayer, nullptr );
+    mFidColumn.clear();
+    mFilterFidsIt = batchStart;
+    return false;
+  }
 
+  OGR_L_ResetReading( ogrLayer );
   return true;
 }
 
 
+void QgsOgrFeatureIterator::preparePartitions()
+{
+  // only whole layers read in the order of their ids, with no filter evaluated by OGR
+  // besides the rectangle, are split
+  if ( mRequest.filterType() == QgsFeatureRequest::FilterFid || mRequest.filterType() == QgsFeatureRequest::FilterFids ||
+       mCompileStatus != NoCompilation || mSubsetStringSet || mRequest.limit() >= 0 )
+    return;
+
+  // shapefiles are split by index, which their spatial index can not be combined with
+  bool shapefile = mSource->mDriverName == "ESRI Shapefile";
+  if ( !( mSource->mDriverName == "GPKG" || ( shapefile && mRequest.filterRect().isNull() ) ) )
+    return;
+
+  QSettings settings;
+  if ( !settings.value( "/qgis/ogr_parallel_read", true ).toBool() )
+    return;
+
+  // the iterator uses a connection too, and one is left for iterators nested in the
+  // consumer of this one, which the workers may be waiting for
+  int workerCount = qMin( QThread::idealThreadCount(), CONN_POOL_MAX_CONCURRENT_CONNS - 1 ) - 1;
+  if ( workerCount < 1 )
+    return;
+
+  qint64 minFid = 0;
+  qint64 maxFid = -1;
+  if ( shapefile )
+  {
+    maxFid = OGR_L_GetFeatureCount( ogrLayer, TRUE ) - 1;
+  }
+  else
+  {
+    QByteArray fidColumn = OGR_L_GetFIDColumn( ogrLayer );
+    if ( fidColumn.isEmpty() )
+      return;
+    QByteArray quotedFidColumn = QgsOgrProviderUtils::quotedIdentifier( fidColumn, mSource->mDriverName );
+
+    QByteArray sql = "SELECT MIN(" + quotedFidColumn + "), MAX(" + quotedFidColumn + ") FROM " +
+                     QgsOgrProviderUtils::quotedIdentifier( OGR_L_GetName( ogrLayer ), mSource->mDriverName );
+    OGRLayerH result = OGR_DS_ExecuteSQL( mConn->ds, sql.constData(), nullptr, nullptr );
+    if ( !result )
+      return;
+
+    OGRFeatureH fet = OGR_L_GetNextFeature( result );
+    if ( fet )
+    {
+      if ( OGR_F_IsFieldSet( fet, 0 ) && OGR_F_IsFieldSet( fet, 1 ) )
+      {
+#if defined(GDAL_VERSION_NUM) && GDAL_VERSION_NUM >= 2000000
+        minFid = OGR_F_GetFieldAsInteger64( fet, 0 );
+        maxFid = OGR_F_GetFieldAsInteger64( fet, 1 );
+#else
+        minFid = OGR_F_GetFieldAsInteger( fet, 0 );
+        maxFid = OGR_F_GetFieldAsInteger( fet, 1 );
+#endif
+      }
+      OGR_F_Destroy( fet );
+    }
+    OGR_DS_ReleaseResultSet( mConn->ds, result );
+
+    mPartitionFidColumn = quotedFidColumn;
+  }
+
+  qint64 fidCount = maxFid - minFid + 1;
+  if ( fidCount < qMax( 2, settings.value( "/qgis/ogr_parallel_read_min_features", 100000 ).toInt() ) )
+  {
+    mPartitionFidColumn.clear();
+    return;
+  }
+
+  // a few partitions per thread, so that threads which start late still get a share of the work
+  int partitionCount = ( workerCount + 1 ) * PARTITIONS_PER_THREAD;
+  qint64 partitionSize = ( fidCount + partitionCount - 1 ) / partitionCount;
+  for ( qint64 begin = minFid; begin <= maxFid; begin += partitionSize )
+  {
+    mPartitions << qMakePair( static_cast<QgsFeatureId>( begin ), static_cast<QgsFeatureId>( begin + partitionSize ) );
+  }
+  // the last partition is open ended, in case the count of features was not exact
+  mPartitions.last().second = std::numeric_limits<QgsFeatureId>::max();
+
+  mPartitionWorkerCount = workerCount;
+}
+
+
+OGRLayerH QgsOgrFeatureIterator::openLayer( QgsOgrConn* conn ) const
+{
+  if ( !conn->ds )
+    return nullptr;
+
+  OGRLayerH layer;
+  if ( mSource->mLayerName.isNull() )
+  {
+    layer = OGR_DS_GetLayer( conn->ds, mSource->mLayerIndex );
+  }
+  else
+  {
+    layer = OGR_DS_GetLayerByName( conn->ds, TO8( mSource->mLayerName ) );
+  }
+  if ( !layer )
+    return nullptr;
+
+  QgsAttributeList attrs = ( mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes ) ? mRequest.subsetOfAttributes() : mSource->mFields.allAttributesList();
+  QgsOgrProviderUtils::setRelevantFields( layer, mSource->mFields.count(), mFetchGeometry, attrs, mSource->mFirstFieldIsFid );
+
+  if ( !mRequest.filterRect().isNull() )
+  {
+    const QgsRectangle& rect = mRequest.filterRect();
+    OGR_L_SetSpatialFilterRect( layer, rect.xMinimum(), rect.yMinimum(), rect.xMaximum(), rect.yMaximum() );
+  }
+  else
+  {
+    OGR_L_SetSpatialFilter( layer, nullptr );
+  }
+  OGR_L_SetAttributeFilter( layer, nullptr );
+
+  return layer;
+}
+
+
+void QgsOgrFeatureIterator::selectPartition( OGRLayerH layer, int partition ) const
+{
+  const QPair<QgsFeatureId, QgsFeatureId>& range = mPartitions.at( partition );
+
+  if ( mPartitionFidColumn.isEmpty() )
+  {
+    OGR_L_ResetReading( layer );
+    OGR_L_SetNextByIndex( layer, FID_TO_NUMBER( range.first ) );
+    return;
+  }
+
+  QByteArray filter = mPartitionFidColumn + " >= " + QByteArray::number( FID_TO_NUMBER( range.first ) );
+  if ( range.second != std::numeric_limits<QgsFeatureId>::max() )
+    filter += " AND " + mPartitionFidColumn + " < " + QByteArray::number( FID_TO_NUMBER( range.second ) );
+
+  // features outside of the partition are skipped when reading if the filter fails
+  if ( OGR_L_SetAttributeFilter( layer, filter.constData() ) != OGRERR_NONE )
+    QgsDebugMsg( QString( "Could not filter feature ids on %1" ).arg( QString::fromUtf8( mPartitionFidColumn ) ) );
+  OGR_L_ResetReading( layer );
+}
+
+
+bool QgsOgrFeatureIterator::readPartitionFeature( OGRLayerH layer, int partition, QgsFeature& feature ) const
+{
+  const QPair<QgsFeatureId, QgsFeatureId>& range = mPartitions.at( partition );
+
+  OGRFeatureH fet;
+  while (( fet = OGR_L_GetNextFeature( layer ) ) )
+  {
+    QgsFeatureId fid = OGR_F_GetFID( fet );
+    if ( fid < range.first || fid >= range.second )
+    {
+      OGR_F_Destroy( fet );
+      // shapefiles are read in the order of their ids
+      if ( mPartitionFidColumn.isEmpty() && fid >= range.second )
+        return false;
+      continue;
+    }
+
+    if ( !readFeature( fet, feature ) )
+      continue;
+
+    OGR_F_Destroy( fet );
+
+    if ( !mRequest.filterRect().isNull() && !feature.constGeometry() )
+      continue;
+
+    feature.setValid( true );
+    return true;
+  }
+
+  return false;
+}
+
+
+bool QgsOgrFeatureIterator::fetchPartitionedFeature( QgsFeature& feature )
+{
+  if ( !mParallelReader )
+    mParallelReader = new QgsOgrParallelReader( this, mPartitions.count(), mPartitionWorkerCount );
+
+  while ( mPartition < mPartitions.count() )
+  {
+    if ( !mPartitionStarted )
+    {
+      // partitions no worker has started yet are read on the connection of the iterator
+      mPartitionStarted = true;
+      mPartitionOwned = mParallelReader->claim( mPartition );
+      if ( mPartitionOwned )
+        selectPartition( ogrLayer, mPartition );
+    }
+
+    if ( mPartitionOwned ? readPartitionFeature( ogrLayer, mPartition, feature ) : mParallelReader->takeFeature( mPartition, feature ) )
+      return true;
+
+    ++mPartition;
+    mPartitionStarted = false;
+  }
+
+  close();
+  return false;
+}
+
+
 bool QgsOgrFeatureIterator::close()
 {
   if ( !mConn )
@@ -284,9 +593,15 @@ bool QgsOgrFeatureIterator::close()
 
   iteratorClosed();
 
+  if ( mParallelReader )
+    mParallelReader->cancel();
+
   // Will for example release SQLite3 statements
   if ( ogrLayer )
   {
+    // do not leave the filter of the ids on the layer of the pooled connection
+    if ( !mFidColumn.isEmpty() || !mPartitionFidColumn.isEmpty() )
+      OGR_L_SetAttributeFilter( ogrLayer, nullptr );
     OGR_L_ResetReading( ogrLayer );
   }
 
@@ -301,6 +616,10 @@ bool QgsOgrFeatureIterator::close()
   mConn = nullptr;
   ogrLayer = nullptr;
 
+  // waits for the workers, which do not need the connection of the iterator
+  delete mParallelReader;
+  mParallelReader = nullptr;
+
   mClosed = true;
   return true;
 }
@@ -424,3 +743,144 @@ QgsFeatureIterator QgsOgrFeatureSource::getFeatures( const QgsFeatureRequest& re
 {
   return QgsFeatureIterator( new QgsOgrFeatureIterator( this, false, request ) );
 }
+
+
+QgsOgrParallelReader::QgsOgrParallelReader( const QgsOgrFeatureIterator* iterator, int partitionCount, int workerCount )
+    : mIterator( iterator )
+    , mPartitions( partitionCount )
+    , mCancelled( false )
+{
+  for ( int i = 0; i < workerCount; ++i )
+  {
+    mWorkers << QtConcurrent::run( runWorker, this );
+  }
+}
+
+QgsOgrParallelReader::~QgsOgrParallelReader()
+{
+  cancel();
+  Q_FOREACH ( QFuture<void> worker, mWorkers )
+  {
+    worker.waitForFinished();
+  }
+}
+
+bool QgsOgrParallelReader::claim( int partition )
+{
+  QMutexLocker locker( &mMutex );
+  if ( mPartitions.at( partition ).claimed )
+    return false;
+
+  mPartitions[partition].claimed = true;
+  return true;
+}
+
+bool QgsOgrParallelReader::takeFeature( int partition, QgsFeature& feature )
+{
+  QMutexLocker locker( &mMutex );
+  Partition& p = mPartitions[partition];
+  while ( p.features.isEmpty() && !p.finished && !mCancelled )
+  {
+    mFeatureAdded.wait( &mMutex );
+  }
+
+  if ( p.features.isEmpty() )
+    return false;
+
+  feature = p.features.dequeue();
+  mFeatureTaken.wakeAll();
+  return true;
+}
+
+void QgsOgrParallelReader::cancel()
+{
+  QMutexLocker locker( &mMutex );
+  mCancelled = true;
+  mFeatureAdded.wakeAll();
+  mFeatureTaken.wakeAll();
+}
+
+void QgsOgrParallelReader::runWorker( QgsOgrParallelReader* reader )
+{
+  reader->work();
+}
+
+void QgsOgrParallelReader::work()
+{
+  // waiting for a connection could block the iterator, which may be waiting for this worker.
+  // The worker keeps its connection while its queue is full, so it leaves one connection
+  // available, for the iterators the consumer of the features may open on the same source
+  QgsOgrConn* conn = QgsOgrConnPool::instance()->tryAcquireConnection( mIterator->mSource->mDataSource, 1 );
+  if ( !conn )
+    return;
+
+  OGRLayerH layer = mIterator->openLayer( conn );
+  while ( layer )
+  {
+    int partition = claimNext();
+    if ( partition < 0 )
+      break;
+
+    mIterator->selectPartition( layer, partition );
+
+    QgsFeature feature;
+    bool cancelled = false;
+    while ( !cancelled && mIterator->readPartitionFeature( layer, partition, feature ) )
+    {
+      cancelled = !enqueue( partition, feature );
+    }
+
+    finish( partition );
+    if ( cancelled )
+      break;
+  }
+
+  if ( layer )
+  {
+    OGR_L_SetAttributeFilter( layer, nullptr );
+    OGR_L_ResetReading( layer );
+  }
+
+  QgsOgrConnPool::instance()->releaseConnection( conn );
+}
+
+int QgsOgrParallelReader::claimNext()
+{
+  QMutexLocker locker( &mMutex );
+  if ( mCancelled )
+    return -1;
+
+  for ( int i = 0; i < mPartitions.count(); ++i )
+  {
+    if ( !mPartitions.at( i ).claimed )
+    {
+      mPartitions[i].claimed = true;
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool QgsOgrParallelReader::enqueue( int partition, const QgsFeature& feature )
+{
+  QMutexLocker locker( &mMutex );
+  Partition& p = mPartitions[partition];
+  while ( p.features.count() >= MAX_QUEUED_FEATURES && !mCancelled )
+  {
+    mFeatureTaken.wait( &mMutex );
+  }
+
+  if ( mCancelled )
+    return false;
+
+  p.features.enqueue( feature );
+  mFeatureAdded.wakeAll();
+  return true;
+}
+
+void QgsOgrParallelReader::finish( int partition )
+{
+  QMutexLocker locker( &mMutex );
+  mPartitions[partition].finished = true;
+  mFeatureAdded.wakeAll();
+}
@@ -18,9 +18,16 @@
 #include "qgsfeatureiterator.h"
 #include "qgsogrconnpool.h"
 
+#include <QFuture>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QWaitCondition>
+
 #include <ogr_api.h>
 
 class QgsOgrFeatureIterator;
+class QgsOgrParallelReader;
 class QgsOgrProvider;
 
 class QgsOgrFeatureSource : public QgsAbstractFeatureSource
@@ -85,11 +92,111 @@ class QgsOgrFeatureIterator : public QgsAbstractFeatureIteratorFromSource<QgsOgr
 
   private:
     bool mExpressionCompiled;
-    QgsFeatureIds mFilterFids;
-    QgsFeatureIds::const_iterator mFilterFidsIt;
+    //! requested feature ids, in ascending order
+    QList<QgsFeatureId> mFilterFids;
+    QList<QgsFeatureId>::const_iterator mFilterFidsIt;
+    //! quoted column the feature ids are filtered on, empty if features are fetched one by one
+    QByteArray mFidColumn;
+    //! true while the features of a batch of ids are read
+    bool mFidBatchActive;
 
     bool fetchFeatureWithId( QgsFeatureId id, QgsFeature& feature ) const;
 
+    //! Sets an attribute filter selecting the next batch of requested ids, returns false if there is none
+    bool setNextFidBatch();
+
+    //! ranges of feature ids the layer is split into when it is read in parallel, empty if it is read sequentially
+    QList< QPair<QgsFeatureId, QgsFeatureId> > mPartitions;
+    //! quoted column the partitions are filtered on, empty if partitions are selected by index
+    QByteArray mPartitionFidColumn;
+    //! number of threads reading partitions besides the iterator
+    int mPartitionWorkerCount;
+    QgsOgrParallelReader* mParallelReader;
+    //! partition the iterator is returning features of
+    int mPartition;
+    bool mPartitionStarted;
+    //! true if the current partition is read by the iterator rather than by a worker
+    bool mPartitionOwned;
+
+    //! Splits the layer into partitions if it can be read in parallel
+    void preparePartitions();
+
+    //! Returns the layer of another connection to the data source, with the filters of the request
+    OGRLayerH openLayer( QgsOgrConn* conn ) const;
+
+    //! Sets up a layer for reading the features of a partition
+    void selectPartition( OGRLayerH layer, int partition ) const;
+
+    //! Reads the next feature of the partition selected on a layer
+    bool readPartitionFeature( OGRLayerH layer, int partition, QgsFeature& feature ) const;
+
+    //! Returns the next feature of the partitions, in order
+    bool fetchPartitionedFeature( QgsFeature& feature );
+
+    friend class QgsOgrParallelReader;
+
+};
+
+/** Reads the partitions of a layer on worker threads, each one using a connection of its own.
+ *
+ * Partitions are claimed in order, either by a worker or by the iterator, which reads the partitions
+ * no worker has claimed yet when it reaches them. Workers only take connections which are available
+ * right away and leave one available, so the iterator never waits for a worker which could not start
+ * and iterators nested in its consumer still get a connection. Features read by the
+ * workers are queued per partition until the iterator takes them, so they are returned in the same
+ * order as when reading the layer sequentially.
+ */
+class QgsOgrParallelReader
+{
+  public:
+    QgsOgrParallelReader( const QgsOgrFeatureIterator* iterator, int partitionCount, int workerCount );
+
+    //! Stops the workers and waits for them
+    ~QgsOgrParallelReader();
+
+    //! Claims a partition for the iterator, returns false if a worker has claimed it
+    bool claim( int partition );
+
+    //! Returns the next feature of a partition claimed by a worker, waiting for it if needed
+    bool takeFeature( int partition, QgsFeature& feature );
+
+    //! Makes the workers stop as soon as possible
+    void cancel();
+
+  private:
+    //! Maximum number of features of a partition waiting for the iterator
+    static const int MAX_QUEUED_FEATURES = 1000;
+
+    struct Partition
+    {
+      Partition()
+          : claimed( false )
+          , finished( false )
+      {}
+
+      bool claimed;
+      bool finished;
+      QQueue<QgsFeature> features;
+    };
+
+    static void runWorker( QgsOgrParallelReader* reader );
+    void work();
+
+    //! Claims the first partition nobody has claimed, returns -1 if there is none
+    int claimNext();
+    //! Queues a feature read by a worker, returns false if reading was cancelled
+    bool enqueue( int partition, const QgsFeature& feature );
+    void finish( int partition );
+
+    const QgsOgrFeatureIterator* mIterator;
+    QVector<Partition> mPartitions;
+    bool mCancelled;
+    QMutex mMutex;
+    QWaitCondition mFeatureAdded;
+    QWaitCondition mFeatureTaken;
+    QList< QFuture<void> > mWorkers;
+
+    Q_DISABLE_COPY( QgsOgrParallelReader )
 };
 
 #endif // QGSOGRFEATUREITERATOR_H
@@ -32,6 +32,7 @@
 #include <QThread>
 
 #include <climits>
+#include <cstring>
 
 // for htonl
 #ifdef Q_OS_WIN
@@ -1309,6 +1310,24 @@ qint64 QgsPostgresConn::getBinaryInt( QgsPostgresResult &queryResult, int row, i
   return oid;
 }
 
+double QgsPostgresConn::getBinaryDouble( QgsPostgresResult &queryResult, int row, int col )
+{
+  // float8 is sent with the byte order of int8
+  qint64 bits = getBinaryInt( queryResult, row, col );
+  double value;
+  memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
+float QgsPostgresConn::getBinaryFloat( QgsPostgresResult &queryResult, int row, int col )
+{
+  // float4 is sent with the byte order of int4
+  quint32 bits = static_cast< quint32 >( getBinaryInt( queryResult, row, col ) );
+  float value;
+  memcpy( &value, &bits, sizeof( value ) );
+  return value;
+}
+
 QString QgsPostgresConn::fieldExpression( const QgsField &fld, QString expr )
 {
   const QString &type = fld.typeName();
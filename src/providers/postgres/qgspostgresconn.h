@@ -306,6 +306,12 @@ class QgsPostgresConn : public QObject
 
     qint64 getBinaryInt( QgsPostgresResult &queryResult, int row, int col );
 
+    //! Returns a float8 value of a binary cursor
+    double getBinaryDouble( QgsPostgresResult &queryResult, int row, int col );
+
+    //! Returns a float4 value of a binary cursor
+    float getBinaryFloat( QgsPostgresResult &queryResult, int row, int col );
+
     QString fieldExpression( const QgsField &fld, QString expr = "%1" );
 
     QString connInfo() const { return mConnInfo; }
@@ -27,12 +27,17 @@
 
 
 const int QgsPostgresFeatureIterator::sFeatureQueueSize = 2000;
+const int QgsPostgresFeatureIterator::sInitialFeatureQueueSize = 200;
 
 
 QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource* source, bool ownSource, const QgsFeatureRequest& request )
     : QgsAbstractFeatureIteratorFromSource<QgsPostgresFeatureSource>( source, ownSource, request )
     , mConn( nullptr )
     , mFeatureQueueSize( sFeatureQueueSize )
+    , mMaxFeatureQueueSize( sFeatureQueueSize )
+    , mPendingFetchSize( 0 )
+    , mFetchPending( false )
+    , mPrefetch( false )
     , mFetched( 0 )
     , mFetchGeometry( false )
     , mExpressionCompiled( false )
@@ -65,6 +70,14 @@ QgsPostgresFeatureIterator::QgsPostgresFeatureIterator( QgsPostgresFeatureSource
     return;
   }
 
+  // start with a small batch and grow it, so that the first features are available quickly.
+  // The next batch is fetched while the current one is consumed, unless the connection is
+  // shared with a transaction, which must not have a query in flight between calls.
+  QSettings settings;
+  mMaxFeatureQueueSize = qMax( 1, settings.value( "/PostgreSQL/fetchBatchSize", sFeatureQueueSize ).toInt() );
+  mFeatureQueueSize = qMin( sInitialFeatureQueueSize, mMaxFeatureQueueSize );
+  mPrefetch = !mIsTransactionConnection && settings.value( "/PostgreSQL/prefetch", true ).toBool();
+
   mCursorName = mConn->uniqueCursorName();
   QString whereClause;
 
@@ -235,40 +248,47 @@ bool QgsPostgresFeatureIterator::fetchFeature( QgsFeature& feature )
 
   if ( mFeatureQueue.empty() && !mLastFetch )
   {
-    QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( mCursorName );
-    QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 4 );
-
     lock();
-    if ( mConn->PQsendQuery( fetch ) == 0 ) // fetch features asynchronously
-    {
-      QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName, mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
-    }
+    if ( !mFetchPending )
+      sendFetch();
 
     QgsPostgresResult queryResult;
-    for ( ;; )
+    while ( mFetchPending )
     {
-      queryResult = mConn->PQgetResult();
-      if ( !queryResult.result() )
+      PGresult* result = mConn->PQgetResult();
+      if ( !result )
+      {
+        mFetchPending = false;
         break;
+      }
 
-      if ( queryResult.PQresultStatus() != PGRES_TUPLES_OK )
+      if ( ::PQresultStatus( result ) != PGRES_TUPLES_OK )
       {
         QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName, mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
-        break;
+        ::PQclear( result );
+        continue;
       }
 
-      int rows = queryResult.PQntuples();
-      if ( rows == 0 )
-        continue;
+      queryResult = result;
+    }
 
-      mLastFetch = rows < mFeatureQueueSize;
+    int rows = queryResult.result() ? queryResult.PQntuples() : 0;
+    mLastFetch = rows < mPendingFetchSize;
 
-      for ( int row = 0; row < rows; row++ )
-      {
-        mFeatureQueue.enqueue( QgsFeature() );
-        getFeature( queryResult, row, mFeatureQueue.back() );
-      } // for each row in queue
+    if ( !mLastFetch )
+    {
+      mFeatureQueueSize = qMin( 2 * mFeatureQueueSize, mMaxFeatureQueueSize );
+
+      // let the server send the next batch while this one is decoded and consumed
+      if ( mPrefetch )
+        sendFetch();
     }
+
+    for ( int row = 0; row < rows; row++ )
+    {
+      mFeatureQueue.enqueue( QgsFeature() );
+      getFeature( queryResult, row, mFeatureQueue.back() );
+    } // for each row in queue
     unlock();
   }
 
@@ -332,6 +352,31 @@ bool QgsPostgresFeatureIterator::prepareOrderBy( const QList<QgsFeatureRequest::
   return mOrderByCompiled;
 }
 
+void QgsPostgresFeatureIterator::sendFetch()
+{
+  QString fetch = QString( "FETCH FORWARD %1 FROM %2" ).arg( mFeatureQueueSize ).arg( mCursorName );
+  QgsDebugMsgLevel( QString( "fetching %1 features." ).arg( mFeatureQueueSize ), 4 );
+
+  mPendingFetchSize = mFeatureQueueSize;
+  mFetchPending = mConn->PQsendQuery( fetch ) != 0; // fetch features asynchronously
+  if ( !mFetchPending )
+  {
+    QgsMessageLog::logMessage( QObject::tr( "Fetching from cursor %1 failed\nDatabase error: %2" ).arg( mCursorName, mConn->PQerrorMessage() ), QObject::tr( "PostGIS" ) );
+  }
+}
+
+void QgsPostgresFeatureIterator::discardPendingFetch()
+{
+  while ( mFetchPending )
+  {
+    PGresult* result = mConn->PQgetResult();
+    if ( !result )
+      mFetchPending = false;
+    else
+      ::PQclear( result );
+  }
+}
+
 void QgsPostgresFeatureIterator::lock()
 {
   if ( mIsTransactionConnection )
@@ -352,9 +397,11 @@ bool QgsPostgresFeatureIterator::rewind()
   // move cursor to first record
 
   lock();
+  discardPendingFetch();
   mConn->PQexecNR( QString( "move absolute 0 in %1" ).arg( mCursorName ) );
   unlock();
   mFeatureQueue.clear();
+  mFeatureQueueSize = qMin( sInitialFeatureQueueSize, mMaxFeatureQueueSize );
   mFetched = 0;
   mLastFetch = false;
 
@@ -367,6 +414,7 @@ bool QgsPostgresFeatureIterator::close()
     return false;
 
   lock();
+  discardPendingFetch();
   mConn->closeCursor( mCursorName );
   unlock();
 
@@ -607,13 +655,27 @@ bool QgsPostgresFeatureIterator::declareCursor( const QString& whereClause, long
       return false;
   }
 
+  // numeric attributes are read in binary format, which saves formatting and parsing them as text
+  mBinaryAttributeTypes.fill( QString(), mSource->mFields.count() );
+  bool binaryAttributes = QSettings().value( "/PostgreSQL/binaryAttributes", true ).toBool();
+
   bool subsetOfAttributes = mRequest.flags() & QgsFeatureRequest::SubsetOfAttributes;
   Q_FOREACH ( int idx, subsetOfAttributes ? mRequest.subsetOfAttributes() : mSource->mFields.allAttributesList() )
   {
     if ( mSource->mPrimaryKeyAttrs.contains( idx ) )
       continue;
 
-    query += delim + mConn->fieldExpression( mSource->mFields.at( idx ) );
+    const QgsField& fld = mSource->mFields.at( idx );
+    QString binaryType = binaryAttributes ? binaryAttributeType( fld ) : QString();
+    if ( !binaryType.isEmpty() )
+    {
+      mBinaryAttributeTypes[idx] = binaryType;
+      query += delim + QString( "%1::%2" ).arg( QgsPostgresConn::quotedIdentifier( fld.name() ), binaryType );
+    }
+    else
+    {
+      query += delim + mConn->fieldExpression( fld );
+    }
   }
 
   query += " FROM " + mSource->mQuery;
@@ -789,12 +851,53 @@ void QgsPostgresFeatureIterator::getFeatureAttribute( int idx, QgsPostgresResult
   if ( mSource->mPrimaryKeyAttrs.contains( idx ) )
     return;
 
-  QVariant v = QgsPostgresProvider::convertValue( mSource->mFields.at( idx ).type(), queryResult.PQgetvalue( row, col ) );
+  const QgsField& fld = mSource->mFields.at( idx );
+  const QString& binaryType = mBinaryAttributeTypes.at( idx );
+
+  QVariant v;
+  if ( binaryType.isEmpty() )
+  {
+    v = QgsPostgresProvider::convertValue( fld.type(), queryResult.PQgetvalue( row, col ) );
+  }
+  else if ( queryResult.PQgetisnull( row, col ) )
+  {
+    v = QVariant( fld.type() );
+  }
+  else if ( binaryType == "float8" )
+  {
+    v = QVariant( mConn->getBinaryDouble( queryResult, row, col ) );
+  }
+  else if ( binaryType == "float4" )
+  {
+    v = QVariant( static_cast< double >( mConn->getBinaryFloat( queryResult, row, col ) ) );
+  }
+  else if ( fld.type() == QVariant::LongLong )
+  {
+    v = QVariant( mConn->getBinaryInt( queryResult, row, col ) );
+  }
+  else
+  {
+    v = QVariant( static_cast< int >( mConn->getBinaryInt( queryResult, row, col ) ) );
+  }
   feature.setAttribute( idx, v );
 
   col++;
 }
 
+QString QgsPostgresFeatureIterator::binaryAttributeType( const QgsField& field )
+{
+  const QString& type = field.typeName();
+  if (( type == "int2" || type == "int4" ) && field.type() == QVariant::Int )
+    return "int4";
+  else if ( type == "int8" && field.type() == QVariant::LongLong )
+    return "int8";
+  else if ( type == "float4" && field.type() == QVariant::Double )
+    return "float4";
+  else if ( type == "float8" && field.type() == QVariant::Double )
+    return "float8";
+  return QString();
+}
+
 
 //  ------------------
 
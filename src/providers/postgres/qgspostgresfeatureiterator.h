@@ -99,6 +99,15 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
     void getFeatureAttribute( int idx, QgsPostgresResult& queryResult, int row, int& col, QgsFeature& feature );
     bool declareCursor( const QString& whereClause, long limit = -1, bool closeOnFail = true , const QString& orderBy = QString() );
 
+    //! send the FETCH for the next batch of features, without waiting for the result
+    void sendFetch();
+
+    //! wait for the result of a FETCH which has been sent and discard it
+    void discardPendingFetch();
+
+    //! returns the type attributes are cast to in order to read them in binary format, or an empty string to read them as text
+    static QString binaryAttributeType( const QgsField& field );
+
     QString mCursorName;
 
     /**
@@ -107,9 +116,24 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
      */
     QQueue<QgsFeature> mFeatureQueue;
 
-    //! Maximal size of the feature queue
+    //! Number of features fetched by the next FETCH. Grows up to mMaxFeatureQueueSize, so that the first features arrive quickly
     int mFeatureQueueSize;
 
+    //! Maximal size of the feature queue
+    int mMaxFeatureQueueSize;
+
+    //! Number of features requested by the FETCH which has been sent
+    int mPendingFetchSize;
+
+    //! Set to true, if a FETCH has been sent and its result has not been read yet
+    bool mFetchPending;
+
+    //! Set to true, if the next batch is fetched while the current batch is consumed
+    bool mPrefetch;
+
+    //! Binary types of the fetched attributes (see binaryAttributeType()), empty for attributes fetched as text
+    QVector<QString> mBinaryAttributeTypes;
+
     //! Number of retrieved features
     int mFetched;
 
@@ -119,6 +143,7 @@ class QgsPostgresFeatureIterator : public QgsAbstractFeatureIteratorFromSource<Q
     bool mIsTransactionConnection;
 
     static const int sFeatureQueueSize;
+    static const int sInitialFeatureQueueSize;
 
   private:
     //! returns whether the iterator supports simplify geometries on provider side
@@ -27,10 +27,12 @@
 #include "qgscrscache.h"
 
 #include <QDir>
+#include <QFutureWatcher>
 #include <QProgressDialog>
 #include <QTimer>
 #include <QSettings>
 #include <QStyle>
+#include <QtConcurrentRun>
 
 QgsWFSFeatureHitsAsyncRequest::QgsWFSFeatureHitsAsyncRequest( QgsWFSDataSourceURI& uri )
     : QgsWFSRequest( uri.uri() )
@@ -78,6 +80,41 @@ QString QgsWFSFeatureHitsAsyncRequest::errorMessageWithReason( const QString& re
 
 // -------------------------
 
+QgsWFSFeaturePageRequest::QgsWFSFeaturePageRequest( QgsWFSDataSourceURI& uri, int page )
+    : QgsWFSRequest( uri.uri() )
+    , mPage( page )
+    , mFinished( false )
+    , mLaunchCount( 0 )
+{
+  connect( this, SIGNAL( downloadFinished() ), this, SLOT( pageReplyFinished() ) );
+}
+
+QgsWFSFeaturePageRequest::~QgsWFSFeaturePageRequest()
+{
+}
+
+void QgsWFSFeaturePageRequest::launch( const QUrl& url )
+{
+  mFinished = false;
+  ++mLaunchCount;
+  sendGET( url,
+           false, /* synchronous */
+           true, /* forceRefresh */
+           false /* cache */ );
+}
+
+void QgsWFSFeaturePageRequest::pageReplyFinished()
+{
+  mFinished = true;
+}
+
+QString QgsWFSFeaturePageRequest::errorMessageWithReason( const QString& reason )
+{
+  return tr( "Download of features failed: %1" ).arg( reason );
+}
+
+// -------------------------
+
 QgsWFSFeatureDownloader::QgsWFSFeatureDownloader( QgsWFSSharedData* shared )
     : QgsWFSRequest( shared->mURI.uri() )
     , mShared( shared )
@@ -431,6 +468,8 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
   bool truncatedResponse = false;
   QSettings s;
   const int maxRetry = s.value( "/qgis/defaultTileMaxRetry", "3" ).toInt();
+  const int maxParallelRequests = s.value( "/qgis/wfs_parallel_requests", 4 ).toInt();
+  int numberMatchedFirstPage = -1;
   int retryIter = 0;
   int lastValidTotalDownloadedFeatureCount = 0;
   int pagingIter = 1;
@@ -646,15 +685,7 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
             // as serializeFeatures() can modify the featureList to remove features
             // that have already been cached, so as to avoid to notify them several
             // times to subscribers
-            if ( serializeFeatures )
-              mShared->serializeFeatures( featureList );
-
-            if ( !featureList.isEmpty() )
-            {
-              emit featureReceived( featureList );
-              emit featureReceived( featureList.size() );
-            }
-
+            notifyFeatures( featureList, serializeFeatures );
             featureList.clear();
           }
 
@@ -664,6 +695,8 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
 
       if ( finished )
       {
+        if ( pagingIter == 1 )
+          numberMatchedFirstPage = parser->numberMatched();
         if ( parser->isTruncatedResponse() && !mSupportsPaging )
         {
           // e.g: http://services.cuzk.cz/wfs/inspire-cp-wfs.asp?SERVICE=WFS&REQUEST=GetFeature&VERSION=2.0.0&TYPENAMES=cp:CadastralParcel
@@ -709,6 +742,27 @@ void QgsWFSFeatureDownloader::run( bool serializeFeatures, int maxFeatures )
       {
         mShared->mMaxFeatures = 0;
       }
+      continue;
+    }
+
+    // Once two pages have confirmed that the server supports paging, and the
+    // total number of features is known, fetch the remaining pages concurrently
+    int numberMatched = mNumberMatched >= 0 ? mNumberMatched : numberMatchedFirstPage;
+    if ( numberMatched < 0 && mShared->isFeatureCountExact() && mShared->mRect.isNull() )
+      numberMatched = mShared->getFeatureCount( false );
+    if ( pagingIter > 2 && maxParallelRequests > 1 && maxFeatures == 0 && mShared->mMaxFeatures > 0 &&
+         numberMatched > mTotalDownloadedFeatureCount + mShared->mMaxFeatures )
+    {
+      bool lastPageFull = false;
+      success = downloadPagesInParallel( mTotalDownloadedFeatureCount, mShared->mMaxFeatures, numberMatched,
+                                         maxParallelRequests, maxRetry, serializeFeatures, lastPageFull );
+      if ( mStop )
+        interrupted = true;
+      if ( !success || !lastPageFull )
+        break;
+
+      // the server has more features than announced, go on page by page
+      lastValidTotalDownloadedFeatureCount = mTotalDownloadedFeatureCount;
     }
   }
 
@@ -746,6 +800,212 @@ QString QgsWFSFeatureDownloader::errorMessageWithReason( const QString& reason )
   return tr( "Download of features failed: %1" ).arg( reason );
 }
 
+void QgsWFSFeatureDownloader::notifyFeatures( QVector<QgsWFSFeatureGmlIdPair>& featureList, bool serializeFeatures )
+{
+  // We call it directly to avoid asynchronous signal notification, and
+  // as serializeFeatures() can modify the featureList to remove features
+  // that have already been cached, so as to avoid to notify them several
+  // times to subscribers
+  if ( serializeFeatures )
+    mShared->serializeFeatures( featureList );
+
+  if ( !featureList.isEmpty() )
+  {
+    emit featureReceived( featureList );
+    emit featureReceived( featureList.size() );
+  }
+}
+
+///@cond PRIVATE
+
+/** Features of a page parsed in a worker thread */
+struct QgsWFSParsedFeaturePage
+{
+  QgsWFSParsedFeaturePage()
+      : missingGmlId( false )
+  {}
+
+  QVector<QgsWFSFeatureGmlIdPair> features;
+  QString errorMessage;
+  //! whether a fake gml:id had to be computed for a feature
+  bool missingGmlId;
+};
+
+static QgsWFSParsedFeaturePage parseFeaturePage( QgsGmlStreamingParser* parser, const QByteArray& data, bool swapAxis )
+{
+  QgsWFSParsedFeaturePage page;
+  QString gmlProcessErrorMsg;
+  if ( !parser->processData( data, true, gmlProcessErrorMsg ) )
+  {
+    page.errorMessage = QgsWFSFeatureDownloader::tr( "Error when parsing GetFeature response" ) + " : " + gmlProcessErrorMsg;
+  }
+  else if ( parser->isException() )
+  {
+    page.errorMessage = QgsWFSFeatureDownloader::tr( "Server generated an exception in GetFeature response" ) + ": " + parser->exceptionText();
+  }
+  else
+  {
+    QVector<QgsGmlStreamingParser::QgsGmlFeaturePtrGmlIdPair> featurePtrList =
+      parser->getAndStealReadyFeatures();
+    page.features.reserve( featurePtrList.size() );
+    for ( int i = 0; i < featurePtrList.size(); i++ )
+    {
+      QgsGmlStreamingParser::QgsGmlFeaturePtrGmlIdPair& featPair = featurePtrList[i];
+      QgsFeature& f = *( featPair.first );
+      QString gmlId( featPair.second );
+      if ( gmlId.isEmpty() )
+      {
+        gmlId = QgsWFSUtils::getMD5( f );
+        page.missingGmlId = true;
+      }
+      if ( swapAxis && f.geometry() )
+      {
+        f.geometry()->transform( QTransform( 0, 1, 1, 0, 0, 0 ) );
+      }
+      page.features.push_back( QgsWFSFeatureGmlIdPair( f, gmlId ) );
+      delete featPair.first;
+    }
+  }
+  delete parser;
+  return page;
+}
+
+///@endcond
+
+bool QgsWFSFeatureDownloader::downloadPagesInParallel( int startIndex, int pageSize, int numberMatched,
+    int maxRequests, int maxRetry, bool serializeFeatures,
+    bool& lastPageFull )
+{
+  const int pageCount = ( numberMatched - startIndex + pageSize - 1 ) / pageSize;
+  QgsDebugMsg( QString( "Downloading %1 pages with up to %2 concurrent requests" ).arg( pageCount ).arg( maxRequests ) );
+
+  QEventLoop loop;
+  connect( this, SIGNAL( doStop() ), &loop, SLOT( quit() ) );
+
+  QMap<int, QgsWFSFeaturePageRequest*> requests;
+  QMap<int, QFutureWatcher<QgsWFSParsedFeaturePage>*> parsing;
+  QMap<int, QgsWFSParsedFeaturePage> parsed;
+  int nextPageToLaunch = 0;
+  int nextPageToNotify = 0;
+  int lastPageFeatureCount = 0;
+  bool success = true;
+
+  while ( success && !mStop && nextPageToNotify < pageCount )
+  {
+    bool progress = false;
+
+    // Keep maxRequests requests running, without getting too far ahead of
+    // the page which is waited for, to bound the memory used
+    while ( requests.size() < maxRequests && nextPageToLaunch < pageCount &&
+            nextPageToLaunch - nextPageToNotify < 2 * maxRequests )
+    {
+      QgsWFSFeaturePageRequest* request = new QgsWFSFeaturePageRequest( mShared->mURI, nextPageToLaunch );
+      connect( request, SIGNAL( downloadFinished() ), &loop, SLOT( quit() ) );
+      request->launch( buildURL( startIndex + nextPageToLaunch * pageSize, pageSize, false ) );
+      requests.insert( nextPageToLaunch, request );
+      ++nextPageToLaunch;
+      progress = true;
+    }
+
+    // Hand over the received responses to the worker threads
+    Q_FOREACH ( QgsWFSFeaturePageRequest* request, requests )
+    {
+      if ( !request->isFinished() )
+        continue;
+
+      progress = true;
+      if ( request->errorCode() != NoError )
+      {
+        if ( request->launchCount() <= maxRetry )
+        {
+          QUrl url( buildURL( startIndex + request->page() * pageSize, pageSize, false ) );
+          QgsMessageLog::logMessage( tr( "Retrying request %1: %2/%3" ).arg( url.toString() ).arg( request->launchCount() ).arg( maxRetry ), tr( "WFS" ) );
+          request->launch( url );
+          continue;
+        }
+        mErrorMessage = request->errorMessage();
+        success = false;
+        break;
+      }
+
+      QFutureWatcher<QgsWFSParsedFeaturePage>* watcher = new QFutureWatcher<QgsWFSParsedFeaturePage>();
+      connect( watcher, SIGNAL( finished() ), &loop, SLOT( quit() ) );
+      watcher->setFuture( QtConcurrent::run( parseFeaturePage, mShared->createParser(), request->response(),
+                                             mShared->mGetFeatureEPSGDotHonoursEPSGOrder ) );
+      parsing.insert( request->page(), watcher );
+      requests.remove( request->page() );
+      request->deleteLater();
+    }
+
+    // Collect the parsed pages
+    Q_FOREACH ( QFutureWatcher<QgsWFSParsedFeaturePage>* watcher, parsing )
+    {
+      if ( !success || !watcher->isFinished() )
+        continue;
+
+      progress = true;
+      int page = parsing.key( watcher );
+      QgsWFSParsedFeaturePage result = watcher->result();
+      parsing.remove( page );
+      delete watcher;
+
+      if ( !result.errorMessage.isEmpty() )
+      {
+        mErrorMessage = result.errorMessage;
+        QgsMessageLog::logMessage( mErrorMessage, tr( "WFS" ) );
+        success = false;
+        break;
+      }
+      parsed.insert( page, result );
+    }
+
+    // Notify the features in page order
+    while ( success && !mStop && parsed.contains( nextPageToNotify ) )
+    {
+      progress = true;
+      QgsWFSParsedFeaturePage result = parsed.take( nextPageToNotify );
+      if ( result.missingGmlId && !mShared->mHasWarnedAboutMissingFeatureId )
+      {
+        QgsDebugMsg( "Server returns features without fid/gml:id. Computing a fake one using feature attributes" );
+        mShared->mHasWarnedAboutMissingFeatureId = true;
+      }
+
+      lastPageFeatureCount = result.features.size();
+      mTotalDownloadedFeatureCount += lastPageFeatureCount;
+      for ( int i = 0; i < result.features.size(); i += 1000 )
+      {
+        QVector<QgsWFSFeatureGmlIdPair> featureList = result.features.mid( i, 1000 );
+        notifyFeatures( featureList, serializeFeatures );
+      }
+      if ( !mStop )
+      {
+        emit updateProgress( mTotalDownloadedFeatureCount );
+      }
+      ++nextPageToNotify;
+    }
+
+    if ( !progress && !mStop )
+    {
+      loop.exec( QEventLoop::ExcludeUserInputEvents );
+    }
+  }
+
+  Q_FOREACH ( QgsWFSFeaturePageRequest* request, requests )
+  {
+    request->abort();
+    request->deleteLater();
+  }
+  Q_FOREACH ( QFutureWatcher<QgsWFSParsedFeaturePage>* watcher, parsing )
+  {
+    // parsing can not be cancelled, the parser deletes itself when done
+    watcher->waitForFinished();
+    delete watcher;
+  }
+
+  lastPageFull = lastPageFeatureCount == pageSize;
+  return success && !mStop;
+}
+
 QgsWFSThreadedFeatureDownloader::QgsWFSThreadedFeatureDownloader( QgsWFSSharedData* shared )
     : mShared( shared )
     , mDownloader( nullptr )
@@ -62,6 +62,39 @@ class QgsWFSFeatureHitsAsyncRequest: public QgsWFSRequest
 };
 
 
+/** Utility class to issue the GetFeature request of one page, when several
+    pages are downloaded concurrently by QgsWFSFeatureDownloader */
+class QgsWFSFeaturePageRequest: public QgsWFSRequest
+{
+    Q_OBJECT
+  public:
+    QgsWFSFeaturePageRequest( QgsWFSDataSourceURI& uri, int page );
+    ~QgsWFSFeaturePageRequest();
+
+    void launch( const QUrl& url );
+
+    /** Return index of the page, starting with the first page downloaded concurrently */
+    int page() const { return mPage; }
+
+    /** Return whether the response (or an error) has been received */
+    bool isFinished() const { return mFinished; }
+
+    /** Return the number of times the request was launched */
+    int launchCount() const { return mLaunchCount; }
+
+  private slots:
+    void pageReplyFinished();
+
+  protected:
+    virtual QString errorMessageWithReason( const QString& reason ) override;
+
+  private:
+    int mPage;
+    bool mFinished;
+    int mLaunchCount;
+};
+
+
 /** Utility class for QgsWFSFeatureDownloader */
 class QgsWFSProgressDialog: public QProgressDialog
 {
@@ -135,6 +168,18 @@ class QgsWFSFeatureDownloader: public QgsWFSRequest
   private:
     QUrl buildURL( int startIndex, int maxFeatures, bool forHits );
     void pushError( const QString& errorMsg );
+
+    /** Serializes features if requested, and notifies them to subscribers */
+    void notifyFeatures( QVector<QgsWFSFeatureGmlIdPair>& featureList, bool serializeFeatures );
+
+    /** Downloads the pages from startIndex up to numberMatched with several concurrent
+        requests, parses them in worker threads and notifies their features in page order.
+        @param lastPageFull set to whether the last page had pageSize features, in which
+        case more features may follow
+        @return false in case of error or interruption */
+    bool downloadPagesInParallel( int startIndex, int pageSize, int numberMatched,
+                                  int maxRequests, int maxRetry, bool serializeFeatures,
+                                  bool& lastPageFull );
     QString sanitizeFilter( QString filter );
 
     /** Mutable data shared between provider, feature sources and downloader. */